@@ -0,0 +1,44 @@
+-- lua heap allocator benchmark, run it with each $LUAIO_LUA_ALLOCATOR
+-- (see run_bench_alloc.sh) and compare the numbers.
+local ROUNDS = tonumber(__ARGV__[4]) or 200000
+
+-- the VM may refuse the allocator asked for, do not time the default one under its name
+local wanted = os.getenv('LUAIO_LUA_ALLOCATOR')
+if wanted and wanted ~= '' and wanted ~= system.allocator then
+  print(string.format('%-10s skipped, the lua VM runs with the %s allocator', wanted, system.allocator))
+  return
+end
+
+local function bench(name, fn)
+  collectgarbage()
+  local start = system.hrtime()
+  fn()
+  local cost = (system.hrtime() - start) / 1000000
+  print(string.format('%-10s %-8s %10.2f ms %10.2f KB', 
+                      system.allocator, name, cost, collectgarbage('count')))
+end
+
+bench('table', function()
+  local list = {}
+  for i = 1, ROUNDS do
+    local t = { i, i + 1, name = 'item', value = i }
+    t.extra = { i }
+    list[i % 1024 + 1] = t
+  end
+end)
+
+bench('string', function()
+  local list = {}
+  for i = 1, ROUNDS do
+    list[i % 1024 + 1] = 'key:' .. i .. ':' .. string.rep('x', i % 256)
+  end
+end)
+
+bench('grow', function()
+  for i = 1, ROUNDS / 100 do
+    local t = {}
+    for j = 1, 512 do
+      t[j] = j
+    end
+  end
+end)
@@ -0,0 +1,58 @@
+-- http parser throughput benchmark, run it with each $LUAIO_HTTP_SIMD
+-- (see run_bench_http_parser.sh) and compare the numbers, the digest must
+-- be the same for every level.
+local fs = require('fs')
+local http_native = require('http_native')
+local ReadBuffer = require('read_buffer')
+
+local ROUNDS = tonumber(__ARGV__[4]) or 200
+
+local request = table.concat({
+  'GET /static/javascripts/application/components/navigation-bar.min.js?version=20151016&locale=zh-CN&theme=dark HTTP/1.1\r\n',
+  'Host: www.coord.cn\r\n',
+  'Connection: keep-alive\r\n',
+  'Cache-Control: max-age=0\r\n',
+  'Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/webp,*/*;q=0.8\r\n',
+  'Upgrade-Insecure-Requests: 1\r\n',
+  'User-Agent: Mozilla/5.0 (Macintosh; Intel Mac OS X 10_11_0) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/46.0.2490.71 Safari/537.36\r\n',
+  'Referer: http://www.coord.cn/articles/2015/10/luaio-http-parser-simd-scanning.html\r\n',
+  'Accept-Encoding: gzip, deflate, sdch\r\n',
+  'Accept-Language: zh-CN,zh;q=0.8,en;q=0.6\r\n',
+  'Cookie: session=6f1ed002ab5595859014ebf0951522d9; theme=dark; locale=zh-CN\r\n',
+  'If-None-Match: "5620a1b3-1c8f"\r\n',
+  'If-Modified-Since: Fri, 16 Oct 2015 07:28:19 GMT\r\n',
+  'X-Requested-With: XMLHttpRequest\r\n',
+  'X-Forwarded-For: 192.168.1.100, 10.0.0.1\r\n',
+  '\r\n'
+})
+
+local COUNT = 4096
+local file = './bench_http_parser.txt'
+fs.writeFile(file, string.rep(request, COUNT))
+
+local fd = fs.open(file, 'r')
+local buffer = ReadBuffer.new(#request * COUNT)
+local parser = http_native.new_parser()
+local digest = 0
+local cost = 0
+
+for i = 1, ROUNDS do
+  fs.read(fd, buffer, 0)
+  local start = system.hrtime()
+  for j = 1, COUNT do
+    local req, err = parser:parse_request(buffer)
+    if j == COUNT then
+      digest = (digest + #req:path() + #req:query() + req:nheader()
+                + #req:header(http_native.HEADER_USER_AGENT)) % 1000000007
+    end
+  end
+  cost = cost + system.hrtime() - start
+end
+
+fs.close(fd)
+fs.unlink(file)
+
+local total = ROUNDS * COUNT
+print(string.format('%-8s %10.1f ns/request %10.1f MB/s digest: %d',
+                    http_native.simd, cost / total,
+                    #request * total / (cost / 1000000000) / 1048576, digest))
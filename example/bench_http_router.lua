@@ -0,0 +1,45 @@
+-- router benchmark: the C radix tree against a linear list of lua patterns,
+-- the cost of the radix tree follows the path length, not the number of routes.
+local http_native = require('http_native')
+
+local ROUTES = tonumber(__ARGV__[4]) or 2000
+local LOOKUPS = 200000
+
+local router = http_native.new_router()
+local patterns = {}
+for i = 1, ROUTES do
+  local pattern = '/api/v' .. (i % 5) .. '/resource' .. i .. '/:id/items'
+  router:add(http_native.GET, pattern, i)
+  patterns[i] = '^' .. pattern:gsub(':id', '([^/]+)') .. '$'
+end
+
+local paths = {}
+for i = 1, 64 do
+  local n = (i * 7919) % ROUTES + 1
+  paths[i] = '/api/v' .. (n % 5) .. '/resource' .. n .. '/abc' .. i .. '/items'
+end
+
+local function linear(path)
+  for i = 1, #patterns do
+    local id = path:match(patterns[i])
+    if id then return i, id end
+  end
+end
+
+local function bench(name, lookups, match)
+  local digest = 0
+  local start = system.hrtime()
+  for i = 1, lookups do
+    local id = match(paths[i % #paths + 1])
+    digest = (digest + id) % 1000000007
+  end
+  local cost = system.hrtime() - start
+  print(string.format('%-8s %6d routes %10.1f ns/match digest: %d', name, ROUTES, cost / lookups, digest))
+end
+
+bench('radix', LOOKUPS, function(path)
+  return router:match(http_native.GET, path)
+end)
+
+-- the linear matcher is O(routes), fewer lookups keep it short
+bench('linear', LOOKUPS / 100, linear)
@@ -10,6 +10,8 @@ local function onconnect(socket)
   socket.id = num
   print('[' .. socket.id .. '] connected')
   room:add(socket)
+  -- a client which does not read its messages drops them instead of piling them up
+  socket:setWriteWatermarks(64 * 1024, 16 * 1024, true)
 
   socket:on('close', function()
     print('[' .. socket.id .. '] closed')
@@ -26,7 +28,7 @@ local function onconnect(socket)
     
     local msg = '[' .. socket.id .. '] say: ' .. data
     room:forEach(function(sock)
-      err = sock:write(msg)
+      sock:writeAsync(msg)
     end)
   end
 end
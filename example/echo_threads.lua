@@ -0,0 +1,9 @@
+local system = require('system')
+local thread = require('thread')
+
+-- one loop thread per cpu, echo_server.lua listens with reuseport,
+-- so the kernel spreads the connections over the threads
+for i = 1, #system.cpuinfo() do
+  local id = thread.spawn('./echo_server.lua')
+  print(id)
+end
@@ -0,0 +1,3 @@
+for allocator in default system pmemory; do
+  LUAIO_LUA_ALLOCATOR=$allocator ./LuaIO ./bench_alloc.lua
+done
@@ -0,0 +1,3 @@
+for simd in none sse4.2 avx2; do
+  LUAIO_HTTP_SIMD=$simd ./LuaIO ./bench_http_parser.lua
+done
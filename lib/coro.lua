@@ -20,7 +20,7 @@ function coro.create(fn)
   local co
   if idle_num > 0 then
     idle_num = idle_num - 1
-    local co = table_remove(idle_coro)
+    co = table_remove(idle_coro)
   end
 
   if co == nil then
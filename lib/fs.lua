@@ -100,7 +100,7 @@ end
 
 -- @example: local ret = fs.write(fd, data[, offset])
 -- @param: fd {integer}
--- @param: data {string|buffer|table[array(string|buffer)]}
+-- @param: data {string|buffer|slice|table[array(string|buffer|slice)]}
 -- @param: offset {integer|defualt: -1}
 -- @return: ret {integer} if ret < 0 ret is errno else ret is write bytes
 function fs.write(fd, data, offset)
@@ -204,7 +204,7 @@ end
 -- @param: length {integer}
 -- @return: err {integer}
 function fs.sendfile(outfd, infd, offset, length)
-  return fs_native.senfile(outfd, infd, offset, length)
+  return fs_native.sendfile(outfd, infd, offset, length)
 end
 
 -- @example: local stat, err = fs.stat(path)
@@ -1,64 +1,962 @@
- local STATUS_CODES = {
-  100 = 'Continue',
-  101 = 'Switching Protocols',
-  102 = 'Processing',                 -- RFC 2518, obsoleted by RFC 4918
-  200 = 'OK',
-  201 = 'Created',
-  202 = 'Accepted',
-  203 = 'Non-Authoritative Information',
-  204 = 'No Content',
-  205 = 'Reset Content',
-  206 = 'Partial Content',
-  207 = 'Multi-Status',               -- RFC 4918
-  208 = 'Already Reported',
-  226 = 'IM Used',
-  300 = 'Multiple Choices',
-  301 = 'Moved Permanently',
-  302 = 'Found',
-  303 = 'See Other',
-  304 = 'Not Modified',
-  305 = 'Use Proxy',
-  307 = 'Temporary Redirect',
-  308 = 'Permanent Redirect',         -- RFC 7238
-  400 = 'Bad Request',
-  401 = 'Unauthorized',
-  402 = 'Payment Required',
-  403 = 'Forbidden',
-  404 = 'Not Found',
-  405 = 'Method Not Allowed',
-  406 = 'Not Acceptable',
-  407 = 'Proxy Authentication Required',
-  408 = 'Request Timeout',
-  409 = 'Conflict',
-  410 = 'Gone',
-  411 = 'Length Required',
-  412 = 'Precondition Failed',
-  413 = 'Payload Too Large',
-  414 = 'URI Too Long',
-  415 = 'Unsupported Media Type',
-  416 = 'Range Not Satisfiable',
-  417 = 'Expectation Failed',
-  418 = 'I\'m a teapot',              -- RFC 2324
-  421 = 'Misdirected Request',
-  422 = 'Unprocessable Entity',       -- RFC 4918
-  423 = 'Locked',                     -- RFC 4918
-  424 = 'Failed Dependency',          -- RFC 4918
-  425 = 'Unordered Collection',       -- RFC 4918
-  426 = 'Upgrade Required',           -- RFC 2817
-  428 = 'Precondition Required',      -- RFC 6585
-  429 = 'Too Many Requests',          -- RFC 6585
-  431 = 'Request Header Fields Too Large', -- RFC 6585
-  451 = 'Unavailable For Legal Reasons',
-  500 = 'Internal Server Error',
-  501 = 'Not Implemented',
-  502 = 'Bad Gateway',
-  503 = 'Service Unavailable',
-  504 = 'Gateway Timeout',
-  505 = 'HTTP Version Not Supported',
-  506 = 'Variant Also Negotiates',    -- RFC 2295
-  507 = 'Insufficient Storage',       -- RFC 4918
-  508 = 'Loop Detected',
-  509 = 'Bandwidth Limit Exceeded',
-  510 = 'Not Extended',               -- RFC 2774
-  511 = 'Network Authentication Required' -- RFC 6585
-};
+local http_native = require('http_native')
+local tcp = require('tcp')
+local Object = require('object')
+local ERRNO = require('errno')
+
+local OK = http_native.OK
+local AGAIN = http_native.AGAIN
+local DONE = http_native.DONE
+local HEAD = http_native.HEAD
+local HEADER_CONTENT_LENGTH = http_native.HEADER_CONTENT_LENGTH
+local HEADER_TRANSFER_ENCODING = http_native.HEADER_TRANSFER_ENCODING
+local write_head = http_native.write_head
+local write_chunk = http_native.write_chunk
+
+local STATUS_CODES = {
+  [100] = 'Continue',
+  [101] = 'Switching Protocols',
+  [102] = 'Processing',                 -- RFC 2518, obsoleted by RFC 4918
+  [200] = 'OK',
+  [201] = 'Created',
+  [202] = 'Accepted',
+  [203] = 'Non-Authoritative Information',
+  [204] = 'No Content',
+  [205] = 'Reset Content',
+  [206] = 'Partial Content',
+  [207] = 'Multi-Status',               -- RFC 4918
+  [208] = 'Already Reported',
+  [226] = 'IM Used',
+  [300] = 'Multiple Choices',
+  [301] = 'Moved Permanently',
+  [302] = 'Found',
+  [303] = 'See Other',
+  [304] = 'Not Modified',
+  [305] = 'Use Proxy',
+  [307] = 'Temporary Redirect',
+  [308] = 'Permanent Redirect',         -- RFC 7238
+  [400] = 'Bad Request',
+  [401] = 'Unauthorized',
+  [402] = 'Payment Required',
+  [403] = 'Forbidden',
+  [404] = 'Not Found',
+  [405] = 'Method Not Allowed',
+  [406] = 'Not Acceptable',
+  [407] = 'Proxy Authentication Required',
+  [408] = 'Request Timeout',
+  [409] = 'Conflict',
+  [410] = 'Gone',
+  [411] = 'Length Required',
+  [412] = 'Precondition Failed',
+  [413] = 'Payload Too Large',
+  [414] = 'URI Too Long',
+  [415] = 'Unsupported Media Type',
+  [416] = 'Range Not Satisfiable',
+  [417] = 'Expectation Failed',
+  [418] = 'I\'m a teapot',              -- RFC 2324
+  [421] = 'Misdirected Request',
+  [422] = 'Unprocessable Entity',       -- RFC 4918
+  [423] = 'Locked',                     -- RFC 4918
+  [424] = 'Failed Dependency',          -- RFC 4918
+  [425] = 'Unordered Collection',       -- RFC 4918
+  [426] = 'Upgrade Required',           -- RFC 2817
+  [428] = 'Precondition Required',      -- RFC 6585
+  [429] = 'Too Many Requests',          -- RFC 6585
+  [431] = 'Request Header Fields Too Large', -- RFC 6585
+  [451] = 'Unavailable For Legal Reasons',
+  [500] = 'Internal Server Error',
+  [501] = 'Not Implemented',
+  [502] = 'Bad Gateway',
+  [503] = 'Service Unavailable',
+  [504] = 'Gateway Timeout',
+  [505] = 'HTTP Version Not Supported',
+  [506] = 'Variant Also Negotiates',    -- RFC 2295
+  [507] = 'Insufficient Storage',       -- RFC 4918
+  [508] = 'Loop Detected',
+  [509] = 'Bandwidth Limit Exceeded',
+  [510] = 'Not Extended',               -- RFC 2774
+  [511] = 'Network Authentication Required' -- RFC 6585
+}
+
+-- strings longer than this are queued as they are, shorter chunks are framed into one string
+local CHUNK_COPY_SIZE = 4096
+
+local CLOSE_HEADERS = { Connection = 'close' }
+local KEEP_ALIVE_HEADERS = { Connection = 'keep-alive' }
+
+-- responses queued on a connection go out with one socket:write(), the queue
+-- is flushed when no complete request is left in the read buffer, before the
+-- connection waits for more data, or when it exceeds the limits.
+local Connection = Object:extend()
+
+-- @example: local err = Connection.init(self, socket, options)
+-- @param: socket {Socket}
+-- @param: options {table} pipelineQueue and pipelineBytes of http.createServer
+function Connection:init(socket, options)
+  self.socket = socket
+  self.parser = http_native.new_parser()
+  self.queue = {}
+  self.queued = 0
+  self.queued_bytes = 0
+  self.max_queued = options.pipelineQueue
+  self.max_queued_bytes = options.pipelineBytes
+  self.flushes = 0
+  return 0
+end
+
+-- @example: instance:push(data)
+-- @param: data {string} buffers and slices are copied by the caller
+-- @param: bytes {integer} length of data
+function Connection:push(data, bytes)
+  local queued = self.queued + 1
+  self.queue[queued] = data
+  self.queued = queued
+  self.queued_bytes = self.queued_bytes + bytes
+
+  if queued >= self.max_queued or self.queued_bytes >= self.max_queued_bytes then
+    return self:flush()
+  end
+
+  return 0
+end
+
+-- @example: local err = instance:flush()
+-- @return: err {integer}
+function Connection:flush()
+  local queued = self.queued
+  if queued == 0 then return 0 end
+
+  local queue = self.queue
+  local data = queued == 1 and queue[1] or queue
+  local _, err = self.socket:write(data)
+  self.flushes = self.flushes + 1
+
+  for i = 1, queued do
+    queue[i] = nil
+  end
+  self.queued = 0
+  self.queued_bytes = 0
+
+  return err
+end
+
+-- @example: local err = instance:read()
+-- @return: err {integer} bytes read or error
+function Connection:read()
+  local err = self:flush()
+  if err < 0 then return err end
+
+  local socket = self.socket
+  local ret = socket:_read()
+  if ret > 0 then
+    socket.read_bytes = socket.read_bytes + ret
+  end
+
+  return ret
+end
+
+local Response = Object:extend()
+
+-- @example: local err = Response.init(self, connection, request)
+-- @param: connection {Connection}
+-- @param: request {userdata(request)}
+function Response:init(connection, request)
+  self.connection = connection
+  self.request = request
+  self.keep_alive = request:keep_alive()
+  self.headers_sent = false
+  self.chunked = false
+  self.finished = false
+  self.head = request:method() == HEAD
+
+  -- the framing of the request body
+  self.body_length = 0
+  self.body_chunked = false
+  local transfer_encoding = request:header(HEADER_TRANSFER_ENCODING)
+  if transfer_encoding then
+    if transfer_encoding:lower() ~= 'chunked' then return 501 end
+    self.body_chunked = true
+  else
+    local content_length = request:header(HEADER_CONTENT_LENGTH)
+    if content_length then
+      local length = tonumber(content_length)
+      if not length or length < 0 or length % 1 ~= 0 then return 400 end
+      self.body_length = length
+    end
+  end
+
+  return 0
+end
+
+local function has_length(headers)
+  return headers['Content-Length'] or headers['content-length']
+         or headers['Transfer-Encoding'] or headers['transfer-encoding']
+end
+
+local function merge_headers(headers, extra)
+  local merged = {}
+  if headers then
+    for k, v in pairs(headers) do merged[k] = v end
+  end
+  for k, v in pairs(extra) do merged[k] = v end
+  return merged
+end
+
+-- @example: local err = response:writeHead(status, headers[, body])
+-- @param: status {integer}
+-- @param: headers {nil|table}
+-- @param: body {nil|integer|string|buffer|slice|table} the body or its length,
+--    nil streams the body chunked through response:write(data)
+-- @return: err {integer}
+function Response:writeHead(status, headers, body)
+  if self.headers_sent then error('headers have been sent') end
+  self.headers_sent = true
+
+  local request = self.request
+  local _, minor = request:version()
+  if not self.keep_alive then
+    headers = merge_headers(headers, CLOSE_HEADERS)
+  elseif minor == 0 then
+    headers = merge_headers(headers, KEEP_ALIVE_HEADERS)
+  end
+
+  if body == nil and status >= 200 and status ~= 204 and status ~= 304
+     and not (headers and has_length(headers)) then
+    if minor == 0 then
+      -- no chunked encoding in HTTP/1.0, the body ends with the connection
+      self.keep_alive = false
+      headers = merge_headers(headers, CLOSE_HEADERS)
+    else
+      self.chunked = true
+      headers = merge_headers(headers, { ['Transfer-Encoding'] = 'chunked' })
+    end
+  end
+
+  local head = write_head(nil, status, headers, body)
+  return self.connection:push(head, #head)
+end
+
+-- @example: local err = response:write(data)
+-- @param: data {string|buffer|slice}
+-- @return: err {integer}
+function Response:write(data)
+  if self.finished then error('response has been finished') end
+  if not self.headers_sent then
+    local err = self:writeHead(200)
+    if err < 0 then return err end
+  end
+
+  if self.head then return 0 end
+
+  local connection = self.connection
+  if not self.chunked then
+    -- the queue is flushed later, a buffer may be reused by then and a slice
+    -- goes stale when the read buffer is compacted, so they are queued as copies
+    if type(data) ~= 'string' then data = data:tostring() end
+    return connection:push(data, #data)
+  end
+
+  if type(data) == 'string' then
+    local len = #data
+    if len == 0 then return 0 end
+
+    if len > CHUNK_COPY_SIZE then
+      local err = connection:push(string.format('%x\r\n', len), 0)
+      if err < 0 then return err end
+      err = connection:push(data, len)
+      if err < 0 then return err end
+      return connection:push('\r\n', 2)
+    end
+  end
+
+  local chunk = write_chunk(nil, data)
+  return connection:push(chunk, #chunk)
+end
+
+-- @example: local err = response:finish([data])
+-- @param: data {nil|string|buffer|slice}
+-- @return: err {integer}
+function Response:finish(data)
+  if self.finished then return 0 end
+
+  local err = 0
+  if not self.headers_sent then
+    err = self:writeHead(200, nil, data or 0)
+    if err < 0 then return err end
+  end
+
+  if data ~= nil then
+    err = self:write(data)
+    if err < 0 then return err end
+  end
+
+  self.finished = true
+  if self.chunked and not self.head then
+    return self.connection:push('0\r\n\r\n', 5)
+  end
+
+  return 0
+end
+
+-- @example: local err = response:send(status, headers, body)
+-- @param: status {integer}
+-- @param: headers {nil|table}
+-- @param: body {nil|string|buffer|slice}
+-- @return: err {integer}
+function Response:send(status, headers, body)
+  local err = self:writeHead(status, headers, body or 0)
+  if err < 0 then return err end
+  return self:finish(body)
+end
+
+-- @example: local err = response:sendfile(fd, offset, length)
+-- @overview: the queued responses and the head are flushed, then the file
+--    range goes from the kernel to the socket, the response is finished
+-- @param: fd {integer}
+-- @param: offset {integer}
+-- @param: length {integer}
+-- @return: err {integer}
+function Response:sendfile(fd, offset, length)
+  if self.finished then error('response has been finished') end
+  if not self.headers_sent then
+    local err = self:writeHead(200, nil, length)
+    if err < 0 then return err end
+  end
+
+  if self.chunked then error('response:sendfile() needs a Content-Length response') end
+  self.finished = true
+  if self.head or length == 0 then return 0 end
+
+  local connection = self.connection
+  local err = connection:flush()
+  if err < 0 then
+    self.keep_alive = false
+    return err
+  end
+
+  local bytes
+  bytes, err = connection.socket:sendfile(fd, offset, length)
+  if err == 0 and bytes < length then
+    -- the file has been truncated, the length sent in the head is wrong
+    err = ERRNO.UV_EOF
+  end
+
+  if err < 0 then self.keep_alive = false end
+  return err
+end
+
+-- @example: local body, err = response:readBody()
+-- @overview: read the whole body of the request this response answers
+-- @return: body {string}
+-- @return: err {integer} 0, a socket error or an http status(400)
+function Response:readBody()
+  local connection = self.connection
+  local buffer = connection.socket.read_buffer
+  local parts = {}
+  local data, err
+
+  if self.body_chunked then
+    local parser = connection.parser
+    while true do
+      data, err = parser:parse_chunked(buffer)
+      if data and #data > 0 then parts[#parts + 1] = data end
+      if err == OK then break end
+      if err ~= AGAIN then
+        self.keep_alive = false
+        return nil, err
+      end
+
+      err = connection:read()
+      if err < 0 then return nil, err end
+    end
+
+    self.body_chunked = false
+    return table.concat(parts), 0
+  end
+
+  local remaining = self.body_length
+  local capacity = buffer:capacity()
+  while remaining > 0 do
+    data, err = buffer:read(remaining < capacity and remaining or capacity)
+    if err > 0 then
+      parts[#parts + 1] = data
+      remaining = remaining - err
+    else
+      err = connection:read()
+      if err < 0 then
+        self.body_length = remaining
+        return nil, err
+      end
+    end
+  end
+
+  self.body_length = 0
+  return table.concat(parts), 0
+end
+
+-- @example: local err = response:_skipBody()
+-- @overview: drop the body the handler has not read, the next request follows it
+function Response:_skipBody()
+  if self.body_chunked then
+    local _, err = self:readBody()
+    return err
+  end
+
+  local connection = self.connection
+  local buffer = connection.socket.read_buffer
+  local remaining = self.body_length
+  while remaining > 0 do
+    remaining = remaining - buffer:discard(remaining)
+    if remaining > 0 then
+      local err = connection:read()
+      if err < 0 then return err end
+    end
+  end
+
+  self.body_length = 0
+  return 0
+end
+
+local function reject(connection, status)
+  local head = write_head(nil, status, CLOSE_HEADERS, 0)
+  connection:push(head, #head)
+  connection:flush()
+end
+
+-- @example: serve(socket, onrequest, options)
+-- @overview: requests pipelined in one read are parsed from the buffer one
+--    after another, their responses are queued and flushed together.
+local function serve(socket, onrequest, options)
+  local connection = Connection:new(socket, options)
+  local parser = connection.parser
+  local buffer = socket.read_buffer
+  local request, response, err
+
+  while true do
+    request, err = parser:parse_request(buffer)
+
+    if err == OK then
+      response, err = Response:new(connection, request)
+      if not response then
+        reject(connection, err)
+        return
+      end
+
+      onrequest(request, response)
+      err = response:finish()
+      if err < 0 then return end
+
+      err = response:_skipBody()
+      if err ~= 0 then
+        if err > 0 then reject(connection, err) end
+        return
+      end
+
+      if not response.keep_alive then
+        connection:flush()
+        return
+      end
+    elseif err == AGAIN then
+      err = connection:read()
+      if err < 0 then return end
+    else
+      reject(connection, err)
+      return
+    end
+  end
+end
+
+-- client connections are pooled per host:port, an idle connection is parked
+-- in C where EOF, stray bytes and the idle timeout close it, a parked one is
+-- checked again when it is taken out of the pool.
+local Agent = Object:extend()
+
+-- @example: local err = Agent.init(self, options)
+-- @param: options {table}
+--    local options = {
+--      maxIdle = {integer|default: 16} idle connections kept per host:port
+--      idleTimeout = {integer|default: 60000} milliseconds an idle connection is kept
+--      timeout = {integer|default: 0} connect, read and write timeout milliseconds
+--      bufferSize = {integer|default: 16384} read buffer size of a connection
+--    }
+function Agent:init(options)
+  options = options or {}
+  self.max_idle = options.maxIdle or 16
+  self.idle_timeout = options.idleTimeout or 60000
+  self.timeout = options.timeout or 0
+  self.buffer_size = options.bufferSize or 16384
+  self.idle = {}
+  self.created = 0
+  self.reused = 0
+  self.stale = 0
+  return 0
+end
+
+-- @example: local socket, reused, err = instance:_acquire(host, port)
+function Agent:_acquire(host, port)
+  local key = host .. ':' .. port
+  local idle = self.idle[key]
+  if idle then
+    while #idle > 0 do
+      local socket = table.remove(idle)
+      if socket:unpark() == 0 then
+        self.reused = self.reused + 1
+        return socket, true, 0
+      end
+
+      self.stale = self.stale + 1
+      socket:close()
+    end
+  end
+
+  local socket, err = tcp.connect(port, host, {
+    timeout = self.timeout,
+    buffer_size = self.buffer_size
+  })
+  if not socket then return nil, false, err end
+
+  socket.pool_key = key
+  socket.http_parser = http_native.new_parser()
+  self.created = self.created + 1
+  return socket, false, 0
+end
+
+-- @example: instance:_release(socket, reuse)
+function Agent:_release(socket, reuse)
+  if socket.closed then return end
+
+  -- bytes after the response mean the connection is out of step
+  if reuse and socket.read_buffer:capacity() > 0 and socket.read_buffer:discard(-1) > 0 then
+    reuse = false
+  end
+
+  if not reuse or self.max_idle == 0 then
+    socket:close()
+    return
+  end
+
+  local key = socket.pool_key
+  local idle = self.idle[key]
+  if not idle then
+    idle = {}
+    self.idle[key] = idle
+  end
+
+  -- the oldest connection makes room, the newest is taken out first
+  if #idle >= self.max_idle then
+    table.remove(idle, 1):close()
+  end
+
+  if socket:park(self.idle_timeout) ~= 0 then
+    socket:close()
+    return
+  end
+
+  idle[#idle + 1] = socket
+end
+
+-- @example: local count = instance:idleCount([host, port])
+-- @return: count {integer} idle connections of host:port, or of all hosts
+function Agent:idleCount(host, port)
+  if host then
+    local idle = self.idle[host .. ':' .. port]
+    return idle and #idle or 0
+  end
+
+  local count = 0
+  for _, idle in pairs(self.idle) do
+    count = count + #idle
+  end
+  return count
+end
+
+-- @example: instance:close()
+-- @overview: close all the idle connections
+function Agent:close()
+  for key, idle in pairs(self.idle) do
+    for i = 1, #idle do
+      idle[i]:close()
+    end
+    self.idle[key] = nil
+  end
+end
+
+local ClientResponse = Object:extend()
+
+-- @example: local err = ClientResponse.init(self, agent, socket)
+function ClientResponse:init(agent, socket)
+  self.agent = agent
+  self.socket = socket
+  self.status = 0
+  self.major = 1
+  self.minor = 1
+  self.reason = nil
+  self.headers = {}
+  self.cookies = {}
+  self.keep_alive = false
+  self.chunked = false
+  self.remaining = -1
+  self.finished = false
+  self.received = 0
+  return 0
+end
+
+-- @example: local err = instance:_fill()
+-- @return: err {integer} bytes read or error
+function ClientResponse:_fill()
+  local socket = self.socket
+  local ret = socket:_read()
+  if ret > 0 then
+    socket.read_bytes = socket.read_bytes + ret
+    self.received = self.received + ret
+  end
+  return ret
+end
+
+-- @example: local err = instance:_readHead(head_only)
+-- @param: head_only {boolean} the request was HEAD, no body follows
+-- @return: err {integer}
+function ClientResponse:_readHead(head_only)
+  local socket = self.socket
+  local parser = socket.http_parser
+  local buffer = socket.read_buffer
+  local status, major, minor, reason, err
+
+  if buffer:capacity() == 0 then
+    err = self:_fill()
+    if err < 0 then return err end
+  end
+
+  while true do
+    parser:reset()
+    while true do
+      status, major, minor, reason, err = parser:parse_status_line(buffer)
+      if err == OK then break end
+      if err ~= AGAIN then return ERRNO.UV_EPROTO end
+      err = self:_fill()
+      if err < 0 then return err end
+    end
+
+    local headers = {}
+    local cookies = {}
+    while true do
+      err = parser:parse_headers(buffer, headers, cookies)
+      if err == OK then break end
+      if err == AGAIN then
+        err = self:_fill()
+        if err < 0 then return err end
+      elseif err ~= DONE then
+        return ERRNO.UV_EPROTO
+      end
+    end
+
+    -- 1xx interim responses are followed by the final one
+    if status >= 200 or status == 101 then
+      self.status = status
+      self.major = major
+      self.minor = minor
+      self.reason = reason
+      self.headers = headers
+      self.cookies = cookies
+      break
+    end
+  end
+
+  local headers = self.headers
+  local connection = headers['connection']
+  connection = connection and connection:lower()
+  if self.minor == 0 then
+    self.keep_alive = connection == 'keep-alive'
+  else
+    self.keep_alive = connection ~= 'close'
+  end
+
+  local status = self.status
+  if head_only or status == 204 or status == 304 then
+    self.remaining = 0
+  else
+    local transfer_encoding = headers['transfer-encoding']
+    local content_length = headers['content-length']
+    if transfer_encoding and transfer_encoding:lower():find('chunked', 1, true) then
+      self.chunked = true
+      parser:reset()
+    elseif content_length then
+      local length = tonumber(content_length)
+      if not length or length < 0 or length % 1 ~= 0 then return ERRNO.UV_EPROTO end
+      self.remaining = length
+    else
+      -- the body ends with the connection
+      self.keep_alive = false
+    end
+  end
+
+  if self.remaining == 0 then
+    self:_finish(true)
+  end
+
+  return 0
+end
+
+-- @example: instance:_finish(reuse)
+function ClientResponse:_finish(reuse)
+  if self.finished then return end
+  self.finished = true
+  self.agent:_release(self.socket, reuse and self.keep_alive)
+end
+
+-- @example: local data, err = response:read()
+-- @overview: stream the body, the bytes in the read buffer are returned as
+--    they arrive, the connection goes back to the pool after the last byte
+-- @return: data {string|nil} nil when the body has ended or on error
+-- @return: err {integer}
+function ClientResponse:read()
+  if self.finished then return nil, 0 end
+
+  local socket = self.socket
+  local buffer = socket.read_buffer
+  local data, err
+
+  if self.chunked then
+    local parser = socket.http_parser
+    while true do
+      data, err = parser:parse_chunked(buffer)
+      if err == OK then
+        self:_finish(true)
+        if #data > 0 then return data, 0 end
+        return nil, 0
+      end
+
+      if err ~= AGAIN then
+        self:_finish(false)
+        return nil, ERRNO.UV_EPROTO
+      end
+
+      if #data > 0 then return data, 0 end
+
+      err = self:_fill()
+      if err < 0 then
+        self:_finish(false)
+        return nil, err
+      end
+    end
+  end
+
+  local remaining = self.remaining
+  while true do
+    data, err = buffer:read(-1)
+    if err > 0 then
+      if remaining < 0 then return data, 0 end
+
+      if err >= remaining then
+        if err > remaining then
+          data = data:sub(1, remaining)
+          self.keep_alive = false
+        end
+        self.remaining = 0
+        self:_finish(true)
+        return data, 0
+      end
+
+      self.remaining = remaining - err
+      return data, 0
+    end
+
+    err = self:_fill()
+    if err < 0 then
+      if remaining < 0 and err == ERRNO.UV_EOF then
+        self:_finish(false)
+        return nil, 0
+      end
+
+      self:_finish(false)
+      return nil, err
+    end
+  end
+end
+
+-- @example: local body, err = response:readBody()
+-- @return: body {string}
+-- @return: err {integer}
+function ClientResponse:readBody()
+  local parts = {}
+  while true do
+    local data, err = self:read()
+    if err < 0 then return nil, err end
+    if not data then break end
+    parts[#parts + 1] = data
+  end
+  return table.concat(parts), 0
+end
+
+-- @example: response:close()
+-- @overview: give up the rest of the body, the connection is closed instead of pooled
+function ClientResponse:close()
+  self:_finish(false)
+end
+
+-- a token method, a path and a host without whitespace or control characters
+-- and headers without CR LF, like http_native.write_head
+local function check_request(method, path, host, headers)
+  if not method:find('^[%w!#$%%&\'*+%-.^_`|~]+$') then
+    error('http.request(options) error: invalid method')
+  end
+
+  if path:find('[%z\1-\32\127]') or host:find('[%z\1-\32\127]') then
+    error('http.request(options) error: path and host must not contain whitespace or control characters')
+  end
+
+  if not headers then return end
+
+  for name, value in pairs(headers) do
+    if type(name) ~= 'string' or name == '' or name:find('[%z\1-\32:\127]') then
+      error('http.request(options) error: invalid header name')
+    end
+
+    local values = type(value) == 'table' and value or { value }
+    for i = 1, #values do
+      local v = values[i]
+      if (type(v) ~= 'string' and type(v) ~= 'number') or tostring(v):find('[\r\n]') then
+        error('http.request(options) error: ' .. name .. ' must be string, number or array of them without CR LF')
+      end
+    end
+  end
+end
+
+local function format_request(method, path, host, port, headers, body)
+  check_request(method, path, host, headers)
+
+  local head = { method, ' ', path, ' HTTP/1.1\r\n' }
+  local n = #head
+  local has_host, has_length = false, false
+
+  if headers then
+    for name, value in pairs(headers) do
+      local lower = name:lower()
+      if lower == 'host' then has_host = true end
+      if lower == 'content-length' or lower == 'transfer-encoding' then has_length = true end
+
+      if type(value) == 'table' then
+        for i = 1, #value do
+          head[n + 1] = name
+          head[n + 2] = ': '
+          head[n + 3] = value[i]
+          head[n + 4] = '\r\n'
+          n = n + 4
+        end
+      else
+        head[n + 1] = name
+        head[n + 2] = ': '
+        head[n + 3] = value
+        head[n + 4] = '\r\n'
+        n = n + 4
+      end
+    end
+  end
+
+  if not has_host then
+    head[n + 1] = 'Host: '
+    head[n + 2] = port == 80 and host or host .. ':' .. port
+    head[n + 3] = '\r\n'
+    n = n + 3
+  end
+
+  if body and not has_length then
+    head[n + 1] = 'Content-Length: '
+    head[n + 2] = #body
+    head[n + 3] = '\r\n'
+    n = n + 3
+  end
+
+  head[n + 1] = '\r\n'
+  return table.concat(head)
+end
+
+-- rfc7231 4.2.2, sent again on a new connection when a pooled one fails
+local IDEMPOTENT_METHODS = {
+  GET = true,
+  HEAD = true,
+  PUT = true,
+  DELETE = true,
+  OPTIONS = true,
+  TRACE = true
+}
+
+local global_agent = Agent:new()
+
+local http = {}
+
+http.STATUS_CODES = STATUS_CODES
+
+-- @example: local server, err = http.createServer(port, onrequest, options)
+-- @param: port {integer}
+-- @param: onrequest {function}
+--    function onrequest(request, response)
+--    end
+-- @param: options {table} tcp.createServer options and
+--    local options = {
+--      pipelineQueue = {integer|default: 64} queued pieces flushed at once
+--      pipelineBytes = {integer|default: 65536} queued bytes flushed at once
+--    }
+-- @return: server {Server}
+-- @return: err {integer}
+http.createServer = function(port, onrequest, options)
+  options = options or {}
+  local limits = {
+    pipelineQueue = options.pipelineQueue or 64,
+    pipelineBytes = options.pipelineBytes or 65536
+  }
+
+  return tcp.createServer(port, function(socket)
+    serve(socket, onrequest, limits)
+  end, options)
+end
+
+http.Agent = Agent
+http.globalAgent = global_agent
+
+-- @example: local response, err = http.request(options)
+-- @param: options {table}
+--    local options = {
+--      host = {string|default: '127.0.0.1'}
+--      port = {integer|default: 80}
+--      method = {string|default: 'GET'}
+--      path = {string|default: '/'}
+--      headers = {table} name = value, value is string, number or array of them
+--        without CR LF
+--      body = {string}
+--      agent = {Agent|default: http.globalAgent} the connection pool
+--    }
+-- @return: response {ClientResponse} status, headers, cookies, read(), readBody(), close()
+-- @return: err {integer} a pooled connection closed before the response is
+--    replaced by a new one only for idempotent methods
+http.request = function(options)
+  local host = options.host or '127.0.0.1'
+  local port = options.port or 80
+  local method = options.method or 'GET'
+  local agent = options.agent or global_agent
+  local body = options.body
+  local head = format_request(method, options.path or '/', host, port, options.headers, body)
+  local data = body and { head, body } or head
+
+  while true do
+    local socket, reused, err = agent:_acquire(host, port)
+    if not socket then return nil, err end
+
+    local response = ClientResponse:new(agent, socket)
+    local bytes
+    bytes, err = socket:write(data)
+    if err >= 0 then
+      err = response:_readHead(method == 'HEAD')
+      if err == 0 then return response, 0 end
+    end
+
+    response:_finish(false)
+
+    -- a pooled connection the server closed before it answered, try a new one,
+    -- unless the server may have acted on a request which is not idempotent
+    if not reused or response.received > 0 or not IDEMPOTENT_METHODS[method] then
+      return nil, err
+    end
+  end
+end
+
+return http
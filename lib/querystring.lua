@@ -25,32 +25,10 @@ limitations under the License.
   tags = {"luvit", "url", "codec"}
 ]]
 
-local find = string.find
-local gsub = string.gsub
-local char = string.char
-local byte = string.byte
-local format = string.format
-local match = string.match
-local gmatch = string.gmatch
+local querystring_native = require('querystring_native')
 
-local function urldecode(str)
-  str = gsub(str, '+', ' ')
-  str = gsub(str, '%%(%x%x)', function(h)
-    return char(tonumber(h, 16))
-  end)
-  str = gsub(str, '\r\n', '\n')
-  return str
-end
-
-local function urlencode(str)
-  if str then
-    str = gsub(str, '\n', '\r\n')
-    str = gsub(str, '([^%w])', function(c)
-      return format('%%%02X', byte(c))
-    end)
-  end
-  return str
-end
+local urldecode = querystring_native.urldecode
+local urlencode = querystring_native.urlencode
 
 local function stringifyPrimitive(v)
   return tostring(v)
@@ -76,32 +54,10 @@ local function stringify(params, sep, eq)
   return ''
 end
 
--- parse querystring into table. urldecode tokens
-local function parse(str, sep, eq)
-  if not sep then sep = '&' end
-  if not eq then eq = '=' end
-  local vars = {}
-  for pair in gmatch(tostring(str), '[^' .. sep .. ']+') do
-    if not find(pair, eq) then
-      vars[urldecode(pair)] = ''
-    else
-      local key, value = match(pair, '([^' .. eq .. ']*)' .. eq .. '(.*)')
-      if key then
-        key = urldecode(key)
-        value = urldecode(value)
-        local type = type(vars[key])
-        if type=='nil' then
-          vars[key] = value
-        elseif type=='table' then
-          table.insert(vars[key], value)
-        else
-          vars[key] = {vars[key],value}
-        end
-      end
-    end
-  end
-  return vars
-end
+-- parse querystring into table in C, a key or a value is one string,
+-- a repeated key has the array of its values.
+-- str is a string or a slice, sep and eq are one character, max limits the pairs read.
+local parse = querystring_native.parse
 
 return {
   urldecode = urldecode,
@@ -4,12 +4,13 @@ local ERRNO = require('errno')
 
 local Readable = Emitter:extend()
 
--- @example: local err = Readable.init(self, size)
+-- @example: local err = Readable.init(self, size[, max_size])
 -- @param: self {table} child instance
 -- @param: size {integer}
+-- @param: max_size {integer|nil} the buffer grows up to max_size and is released while empty
 -- @return: err {integer}
-function Readable:init(size)
-  local read_buffer = ReadBuffer.new(size)
+function Readable:init(size, max_size)
+  local read_buffer = ReadBuffer.new(size, max_size)
   if not read_buffer then return ERRNO.UV_ENOMEM end
 
   self.read_buffer = read_buffer
@@ -106,7 +107,7 @@ function Readable:readline()
   
   local val, err = self.read_buffer:readline()
   if err >= 0 then return val, err end
-  if err == ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY then
+  if err ~= ERRNO.LUAIO_EAGAIN then
     return val, err
   end
 
@@ -117,7 +118,7 @@ function Readable:readline()
 
     val, err = self.read_buffer:readline()
     if err >= 0 then return val, err end
-    if err == ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY then
+    if err ~= ERRNO.LUAIO_EAGAIN then
       return val, err
     end
   end
@@ -0,0 +1,458 @@
+local fs = require('fs')
+local date = require('date')
+local system = require('system')
+local http_native = require('http_native')
+local Object = require('object')
+
+local GET = http_native.GET
+local HEAD = http_native.HEAD
+local HEADER_ACCEPT_ENCODING = http_native.HEADER_ACCEPT_ENCODING
+local HEADER_IF_MODIFIED_SINCE = http_native.HEADER_IF_MODIFIED_SINCE
+local HEADER_IF_NONE_MATCH = http_native.HEADER_IF_NONE_MATCH
+local HEADER_IF_RANGE = http_native.HEADER_IF_RANGE
+local HEADER_RANGE = http_native.HEADER_RANGE
+
+local MIME_TYPES = {
+  html = 'text/html; charset=utf-8',
+  htm = 'text/html; charset=utf-8',
+  css = 'text/css; charset=utf-8',
+  js = 'application/javascript; charset=utf-8',
+  json = 'application/json; charset=utf-8',
+  txt = 'text/plain; charset=utf-8',
+  xml = 'application/xml; charset=utf-8',
+  svg = 'image/svg+xml',
+  png = 'image/png',
+  jpg = 'image/jpeg',
+  jpeg = 'image/jpeg',
+  gif = 'image/gif',
+  webp = 'image/webp',
+  ico = 'image/x-icon',
+  woff = 'font/woff',
+  woff2 = 'font/woff2',
+  ttf = 'font/ttf',
+  pdf = 'application/pdf',
+  zip = 'application/zip',
+  gz = 'application/gzip',
+  mp4 = 'video/mp4',
+  mp3 = 'audio/mpeg',
+  wasm = 'application/wasm'
+}
+
+local DEFAULT_TYPE = 'application/octet-stream'
+
+local function now()
+  return system.hrtime() / 1000000
+end
+
+-- open fds and stat results by path, the least recently used is closed first,
+-- an entry older than ttl milliseconds is checked again with stat before use.
+-- a missing file is cached too, so a flood of 404s costs no syscall.
+local Cache = Object:extend()
+
+-- @example: local err = Cache.init(self, max_files, ttl)
+-- @param: max_files {integer}
+-- @param: ttl {integer} milliseconds
+function Cache:init(max_files, ttl)
+  self.max_files = max_files
+  self.ttl = ttl
+  self.entries = {}
+  self.count = 0
+  self.hits = 0
+  self.misses = 0
+  self.evictions = 0
+
+  -- the most recently used entry is next to the sentinel
+  local list = {}
+  list.prev = list
+  list.next = list
+  self.list = list
+  return 0
+end
+
+local function unlink(entry)
+  entry.prev.next = entry.next
+  entry.next.prev = entry.prev
+end
+
+local function link_front(list, entry)
+  entry.prev = list
+  entry.next = list.next
+  list.next.prev = entry
+  list.next = entry
+end
+
+-- the fd of an entry in use by a response is closed by the last user
+local function close_entry(entry)
+  entry.evicted = true
+  if entry.fd and entry.users == 0 then
+    local fd = entry.fd
+    entry.fd = nil
+    fs.close(fd)
+  end
+end
+
+-- @example: instance:_remove(entry)
+function Cache:_remove(entry)
+  if self.entries[entry.path] == entry then
+    self.entries[entry.path] = nil
+    self.count = self.count - 1
+    unlink(entry)
+  end
+  close_entry(entry)
+end
+
+-- @example: instance:_insert(entry)
+function Cache:_insert(entry)
+  self.entries[entry.path] = entry
+  self.count = self.count + 1
+  link_front(self.list, entry)
+
+  local list = self.list
+  while self.count > self.max_files do
+    self.evictions = self.evictions + 1
+    self:_remove(list.prev)
+  end
+end
+
+local function same_file(entry, stat)
+  if stat and stat.type == fs.FILE then
+    return entry.fd ~= nil and stat.ino == entry.ino and stat.size == entry.size and stat.mtime == entry.mtime
+  end
+
+  if stat and stat.type == fs.DIR then return entry.dir end
+  return entry.fd == nil and not entry.dir
+end
+
+-- @example: local entry = instance:get(path)
+-- @return: entry {table}
+--    local entry = {
+--      fd = {integer|nil} nil if the path is not a regular file
+--      dir = {boolean} the path is a directory
+--      size = {integer}
+--      mtime = {integer}
+--      etag = {string}
+--      last_modified = {string}
+--    }
+function Cache:get(path)
+  local entry = self.entries[path]
+  local time = now()
+
+  if entry then
+    if time - entry.checked < self.ttl then
+      self.hits = self.hits + 1
+      unlink(entry)
+      link_front(self.list, entry)
+      return entry
+    end
+
+    local stat = fs.stat(path)
+    -- the entry may have been replaced while stat yielded
+    if self.entries[path] == entry then
+      if same_file(entry, stat) then
+        self.hits = self.hits + 1
+        entry.checked = time
+        unlink(entry)
+        link_front(self.list, entry)
+        return entry
+      end
+
+      self:_remove(entry)
+    end
+  end
+
+  self.misses = self.misses + 1
+  entry = { path = path, checked = time, users = 0, dir = false }
+
+  local fd = fs.open(path, 'r')
+  if fd >= 0 then
+    local stat = fs.fstat(fd)
+    if stat and stat.type == fs.FILE then
+      entry.fd = fd
+      entry.ino = stat.ino
+      entry.size = stat.size
+      entry.mtime = stat.mtime
+      entry.etag = string.format('"%x-%x"', stat.mtime, stat.size)
+      entry.last_modified = date.getUTCString(stat.mtime)
+    else
+      entry.dir = stat ~= nil and stat.type == fs.DIR
+      fs.close(fd)
+    end
+  end
+
+  -- another coroutine has opened the same path meanwhile
+  local other = self.entries[path]
+  if other then
+    if entry.fd then fs.close(entry.fd) end
+    return other
+  end
+
+  self:_insert(entry)
+  return entry
+end
+
+-- @example: instance:acquire(entry)
+function Cache:acquire(entry)
+  entry.users = entry.users + 1
+end
+
+-- @example: instance:release(entry)
+function Cache:release(entry)
+  entry.users = entry.users - 1
+  if entry.evicted then close_entry(entry) end
+end
+
+-- @example: instance:close()
+function Cache:close()
+  local list = self.list
+  while list.next ~= list do
+    self:_remove(list.next)
+  end
+end
+
+local function decode_path(path)
+  if path:find('%', 1, true) then
+    path = path:gsub('%%(%x%x)', function(hex)
+      return string.char(tonumber(hex, 16))
+    end)
+  end
+  return path
+end
+
+local function safe_path(path)
+  if path:sub(1, 1) ~= '/' or path:find('\0', 1, true) then return false end
+  for segment in path:gmatch('[^/\\]+') do
+    if segment == '..' then return false end
+  end
+  return true
+end
+
+local function etag_matches(header, etag)
+  if header == '*' then return true end
+  for tag in header:gmatch('[^,%s]+') do
+    if tag == etag or tag == 'W/' .. etag then return true end
+  end
+  return false
+end
+
+-- @return: first, last {integer} the range, nil to send the whole file, false if unsatisfiable
+local function parse_range(range, size)
+  local first, last = range:match('^bytes=(%d*)-(%d*)$')
+  if not first or (first == '' and last == '') then return nil end
+  if size == 0 then return false end
+
+  if first == '' then
+    local n = tonumber(last)
+    if n == 0 then return false end
+    if n > size then n = size end
+    return size - n, size - 1
+  end
+
+  first = tonumber(first)
+  if last == '' then
+    last = size - 1
+  else
+    last = tonumber(last)
+    if last < first then return nil end
+    if last >= size then last = size - 1 end
+  end
+
+  if first >= size then return false end
+  return first, last
+end
+
+local Static = Object:extend()
+
+-- @example: local err = Static.init(self, root, options)
+-- @param: root {string} directory of the files
+-- @param: options {table}
+--    local options = {
+--      index = {string|default: 'index.html'} file served for a path ending with '/'
+--      maxFiles = {integer|default: 1024} open files kept in the cache
+--      ttl = {integer|default: 1000} milliseconds before a cached file is checked again
+--      maxAge = {integer|nil} seconds of Cache-Control: max-age
+--      gzip = {boolean|default: false} serve path.gz instead of path to clients accepting gzip
+--    }
+function Static:init(root, options)
+  options = options or {}
+  self.root = root:gsub('/+$', '')
+  self.index = options.index or 'index.html'
+  self.gzip = options.gzip or false
+  self.cache_control = options.maxAge and 'public, max-age=' .. options.maxAge or nil
+  self.cache = Cache:new(options.maxFiles or 1024, options.ttl or 1000)
+  return 0
+end
+
+local function add_validators(headers, entry)
+  headers['ETag'] = entry.etag
+  headers['Last-Modified'] = entry.last_modified
+end
+
+-- @example: local not_modified = instance:_notModified(request, entry)
+function Static:_notModified(request, entry)
+  local if_none_match = request:header(HEADER_IF_NONE_MATCH)
+  if if_none_match then
+    return etag_matches(if_none_match, entry.etag)
+  end
+
+  local if_modified_since = request:header(HEADER_IF_MODIFIED_SINCE)
+  if if_modified_since then
+    local time = date.parseUTCString(if_modified_since)
+    return time ~= nil and time >= entry.mtime
+  end
+
+  return false
+end
+
+-- @example: local entry = instance:_gzipEntry(request, path, entry)
+-- @return: entry {table|nil} the fresh path.gz entry if the client takes gzip
+function Static:_gzipEntry(request, path, entry)
+  local accept_encoding = request:header(HEADER_ACCEPT_ENCODING)
+  if not accept_encoding or not accept_encoding:find('gzip', 1, true) then return nil end
+
+  local gz = self.cache:get(path .. '.gz')
+  if gz.fd and gz.mtime >= entry.mtime then return gz end
+  return nil
+end
+
+-- @example: local status = instance:serve(request, response)
+-- @overview: answer a GET or HEAD request with the file under root
+-- @return: status {integer} the status sent
+function Static:serve(request, response)
+  local method = request:method()
+  if method ~= GET and method ~= HEAD then
+    response:send(405, { Allow = 'GET, HEAD' }, 'Method Not Allowed')
+    return 405
+  end
+
+  local url_path = decode_path(request:path())
+  if not safe_path(url_path) then
+    response:send(403, nil, 'Forbidden')
+    return 403
+  end
+
+  if url_path:sub(-1) == '/' then
+    url_path = url_path .. self.index
+  end
+
+  local cache = self.cache
+  local path = self.root .. url_path
+  local entry = cache:get(path)
+  -- _gzipEntry and the response yield, an eviction meanwhile must not close entry.fd
+  cache:acquire(entry)
+  local status = self:_send(request, response, url_path, path, entry)
+  cache:release(entry)
+  return status
+end
+
+-- @example: local status = instance:_send(request, response, url_path, path, entry)
+-- @param: entry {table} acquired by the caller
+-- @return: status {integer} the status sent
+function Static:_send(request, response, url_path, path, entry)
+  local cache = self.cache
+  if not entry.fd then
+    if entry.dir then
+      local location = request:path() .. '/'
+      response:send(301, { Location = location }, location)
+      return 301
+    end
+
+    response:send(404, nil, 'Not Found')
+    return 404
+  end
+
+  local headers = {
+    ['Content-Type'] = MIME_TYPES[url_path:match('%.(%w+)$') or ''] or DEFAULT_TYPE,
+    ['Accept-Ranges'] = 'bytes',
+    ['Cache-Control'] = self.cache_control
+  }
+
+  if self:_notModified(request, entry) then
+    add_validators(headers, entry)
+    response:writeHead(304, headers)
+    response:finish()
+    return 304
+  end
+
+  local size = entry.size
+  local status = 200
+  local first, last = 0, size - 1
+
+  local range = request:header(HEADER_RANGE)
+  if range then
+    local if_range = request:header(HEADER_IF_RANGE)
+    if if_range and if_range ~= entry.etag and if_range ~= entry.last_modified then
+      range = nil
+    end
+  end
+
+  if range then
+    local range_first, range_last = parse_range(range, size)
+    if range_first == false then
+      add_validators(headers, entry)
+      headers['Content-Range'] = 'bytes */' .. size
+      response:send(416, headers, 'Range Not Satisfiable')
+      return 416
+    end
+
+    if range_first then
+      status = 206
+      first, last = range_first, range_last
+      headers['Content-Range'] = 'bytes ' .. first .. '-' .. last .. '/' .. size
+    end
+  end
+
+  -- a precompressed sibling is only sent whole
+  local gz
+  if self.gzip then
+    headers['Vary'] = 'Accept-Encoding'
+    if status == 200 then
+      gz = self:_gzipEntry(request, path, entry)
+      if gz then
+        cache:acquire(gz)
+        headers['Content-Encoding'] = 'gzip'
+        entry = gz
+        first, last = 0, gz.size - 1
+      end
+    end
+  end
+
+  add_validators(headers, entry)
+  local length = last - first + 1
+  local err = response:writeHead(status, headers, length)
+  if err >= 0 then
+    response:sendfile(entry.fd, first, length)
+  end
+
+  if gz then cache:release(gz) end
+  return status
+end
+
+-- @example: local stats = instance:stats()
+-- @return: stats {table} files, hits, misses, evictions of the cache
+function Static:stats()
+  local cache = self.cache
+  return {
+    files = cache.count,
+    hits = cache.hits,
+    misses = cache.misses,
+    evictions = cache.evictions
+  }
+end
+
+-- @example: instance:close()
+-- @overview: close the cached files
+function Static:close()
+  self.cache:close()
+end
+
+local static = {}
+
+-- @example: local handler = static.new(root[, options])
+-- @param: root {string}
+-- @param: options {table} @Static:init
+-- @return: handler {Static} handler:serve(request, response) in the onrequest of http.createServer
+static.new = function(root, options)
+  return Static:new(root, options)
+end
+
+return static
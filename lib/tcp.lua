@@ -9,13 +9,14 @@ local ERRNO = require('errno')
 
 local Socket = Readable:extend()
 
--- @example: local err = Socket.init(self, size)
+-- @example: local err = Socket.init(self, size[, max_size])
 -- @param: self {table} child instance
 -- @param: size {integer}
+-- @param: max_size {integer|nil} @Readable:init
 -- @return: err {integer}
-function Socket:init(size)
+function Socket:init(size, max_size)
   local buffer_size = size or 16384
-  local err = Readable.init(self, buffer_size)
+  local err = Readable.init(self, buffer_size, max_size)
   if err < 0 then return err end
 
   self.errno = 0
@@ -99,8 +100,40 @@ function Socket:_read()
   return err
 end
 
+-- @example: local bytes, err = instance:readChain(chain)
+-- @overview: append the next data to a buffer_chain, the unread bytes of the
+--    read buffer go first, a message of any size is gathered without moving
+--    the bytes already received
+-- @param: chain {buffer_chain}
+-- @return: bytes {integer} appended to chain
+-- @return: err {integer}
+function Socket:readChain(chain)
+  if self.closing then error('closing, unavaliable') end 
+
+  if not self.handle then
+    error('not connected, please call socket:connect(port, host) first')
+  end
+
+  local read_buffer = self.read_buffer
+  if read_buffer:capacity() > 0 then
+    local bytes = chain:append(read_buffer)
+    if bytes > 0 then
+      read_buffer:discard(-1)
+      return bytes, 0
+    end
+  end
+
+  local ret = self.handle:read(chain)
+  if ret < 0 then
+    self.errno = ret
+    return 0, ret
+  end
+
+  return ret, 0
+end
+
 -- @example: local err = instance:write(data)
--- @param: data {string|buffer|table[array(string|buffer)]}
+-- @param: data {string|buffer|chain|table[array(string|buffer)]}
 -- @param: bytes {integer} written bytes
 -- @return: err {integer}
 function Socket:write(data)
@@ -123,7 +156,7 @@ function Socket:write(data)
 end
 
 -- @example: local err = instance:writeAsync(data)
--- @param: data {string|buffer|table[array(string|buffer)]}
+-- @param: data {string|buffer|chain|table[array(string|buffer)]}
 -- @param: bytes {integer} written bytes
 -- @return: err {integer}
 function Socket:writeAsync(data)
@@ -145,34 +178,181 @@ function Socket:writeAsync(data)
   return bytes, err
 end
 
+-- @example: local err = instance:cork([enable])
+-- @overview: corked writeAsync only queues data, the queues of all corked
+--    sockets are written with one writev each when the loop iteration ends.
+--    write, sendfile, pipe, shutdown and close flush the queue first
+-- @param: enable {boolean|default: true} false flushes and turns it off
+-- @return: err {integer}
+function Socket:cork(enable)
+  if self.closed then error('closed, unavaliable') end
+  if self.closing then error('closing, unavaliable') end
+
+  if not self.handle then
+    error('not connected, please call socket:connect(port, host) first')
+  end
+
+  local err = self.handle:cork(enable ~= false)
+  self.errno = err
+  return err
+end
+
+-- @example: local err = instance:flush()
+-- @overview: write the corked queue now
+-- @return: err {integer} the error of this or an earlier flush
+function Socket:flush()
+  if self.closed then error('closed, unavaliable') end
+
+  local err = self.handle:flush()
+  self.errno = err
+  return err
+end
+
+-- @example: local err = instance:setWriteWatermarks(high[, low, nowait])
+-- @overview: writeAsync yields while more than high bytes are queued until
+--    the queue drains to low, the socket timeout applies to it. stalled
+--    writers go on in the order they stalled
+-- @param: high {integer} 0 means no limit
+-- @param: low {integer|default: high / 2}
+-- @param: nowait {boolean} writeAsync returns ERRNO.UV_EAGAIN without queuing
+--    instead of yielding, until the queue drains to low, the data can be
+--    dropped or sent later
+-- @return: err {integer}
+function Socket:setWriteWatermarks(high, low, nowait)
+  if self.closed then error('closed, unavaliable') end
+  if self.closing then error('closing, unavaliable') end
+
+  if not self.handle then
+    error('not connected, please call socket:connect(port, host) first')
+  end
+
+  return self.handle:set_write_watermarks(high, low, nowait)
+end
+
+-- @example: local stats = instance:writeStats()
+-- @return: stats {table} queued, queued_peak, stalls, stall_time(milliseconds), eagains, high, low
+function Socket:writeStats()
+  if self.closed then error('closed, unavaliable') end
+  return self.handle:write_stats()
+end
+
+-- @example: local bytes, err = instance:pipe(other[, options])
+-- @param: other {Socket}
+-- @param: options {table}
+--    options = {
+--      limit = {integer|default: 0} stop after limit bytes, 0 means no limit
+--      timeout = {integer|default: 0} idle timeout milliseconds
+--    }
+-- @return: bytes {integer} bytes moved to other
+-- @return: err {integer} ERRNO.UV_EOF if the socket ended, 0 if the limit reached
+function Socket:pipe(other, options)
+  if self.closed or other.closed then error('closed, unavaliable') end
+  if self.closing or other.closing then error('closing, unavaliable') end
+
+  if not self.handle or not other.handle then
+    error('not connected, please call socket:connect(port, host) first')
+  end
+
+  options = options or {}
+  local limit = options.limit or 0
+  local bytes = 0
+  local err
+
+  -- data already read into the buffer goes first
+  local data
+  local read_buffer = self.read_buffer
+  if read_buffer:capacity() > 0 then
+    data = read_buffer:read_slice(limit > 0 and limit or -1)
+    if not data and limit > 0 then
+      data = read_buffer:read_slice(-1)
+    end
+  end
+
+  if data then
+    bytes, err = other.handle:write(data)
+    if err < 0 then
+      self.errno = err
+      return bytes, err
+    end
+
+    if limit > 0 then
+      limit = limit - bytes
+      if limit == 0 then return bytes, 0 end
+    end
+  end
+
+  local piped
+  piped, err = self.handle:pipe(other.handle, limit, options.timeout or 0)
+  other.write_bytes = other.write_bytes + bytes + piped
+  self.errno = err
+
+  return bytes + piped, err
+end
+
+-- @example: local err = instance:park(idle_timeout)
+-- @overview: leave an idle connection to the loop, EOF, unexpected data or
+--    idle_timeout milliseconds without use close it in C
+-- @param: idle_timeout {integer} 0 means no idle timeout
+-- @return: err {integer}
+function Socket:park(idle_timeout)
+  if self.closed then error('closed, unavaliable') end
+  if self.closing then error('closing, unavaliable') end
+
+  if not self.handle then
+    error('not connected, please call socket:connect(port, host) first')
+  end
+
+  return self.handle:park(idle_timeout or 0)
+end
+
+-- @example: local err = instance:unpark()
+-- @return: err {integer} 0 if the connection is still usable, otherwise why it
+--    has been closed(ERRNO.UV_EOF, ERRNO.UV_ETIMEDOUT, ERRNO.UV_EPROTO ...),
+--    the socket still has to be closed by socket:close()
+function Socket:unpark()
+  if self.closed then error('closed, unavaliable') end
+
+  local err = self.handle:unpark()
+  self.errno = err
+  return err
+end
+
 -- @example: bytes = instance:bytesWritten()
 -- @return: bytes {integer}
 function Socket:bytesWritten()
   return self.write_bytes
 end
 
--- @example: local err = instance:sendfile(fd, offset, length)
+-- @example: local bytes, err = instance:sendfile(fd, offset, length)
+-- @overview: the kernel copies the file range to the socket, the call yields
+--    only while the socket buffer is full, the socket timeout applies to it
 -- @param: fd {integer}
 -- @param: offset {integer}
 -- @param: length {integer}
+-- @return: bytes {integer} less than length if the file is shorter
 -- @return: err {integer}
 function Socket:sendfile(fd, offset, length)
   if self.closed then error('closed, unavaliable') end
   if self.closing then error('closing, unavaliable') end
 
-  if not self.fd then
+  if not self.handle then
     error('not connected, please call socket:connect(port, host) first')
   end
 
-  local err = fs_natives.sendfile(self.fd, fd, offset, length)
+  local bytes, err = self.handle:sendfile(fd, offset, length)
+  if bytes > 0 then
+    self.write_bytes = self.write_bytes + bytes
+  end
+
   self.errno = err
 
-  return err
+  return bytes, err
 end
 
--- @example: instance:setTimeout(ms)
+-- @example: instance:setTimeout(ms[, precise])
 -- @param: ms {integer}
-function Socket:setTimeout(ms)
+-- @param: precise {boolean} exact timer instead of the coarse timer wheel
+function Socket:setTimeout(ms, precise)
   if self.closed then error('closed, unavaliable') end
   if self.closing then error('closing, unavaliable') end
 
@@ -180,7 +360,7 @@ function Socket:setTimeout(ms)
     error('not connected, please call socket:connect(port, host) first')
   end
 
-  self.handle:set_timeout(ms)
+  self.handle:set_timeout(ms, precise)
 end
 
 -- @example: local err = instance:setNodelay(enable)
@@ -293,7 +473,12 @@ local server_options = {
   backlog = 511,
   reuseport = false,
   bufferSize = 16384,
-  maxConnections = 65535
+  maxBufferSize = nil,
+  maxConnections = 65535,
+  acceptBatch = 64,
+  cork = false,
+  highWatermark = 0,
+  lowWatermark = nil
 }
 
 local server_meta = {
@@ -315,7 +500,12 @@ local server_meta = {
 --      backlog = {integer}
 --      reuseport = {boolean}
 --      bufferSize = {integer}
---      maxConnections = {integer}
+--      maxBufferSize = {integer} read buffers start with bufferSize, grow up to maxBufferSize and are released while idle
+--      maxConnections = {integer} accepting pauses while the server has maxConnections
+--      acceptBatch = {integer} connections accepted per loop iteration
+--      cork = {boolean} socket:cork() every connection
+--      highWatermark = {integer} socket:setWriteWatermarks(highWatermark, lowWatermark) every connection
+--      lowWatermark = {integer}
 --    }
 function Server:init(port, onconnect, options)
   if not options then
@@ -331,7 +521,11 @@ function Server:init(port, onconnect, options)
   self.keepalive = options.keepalive
   self.keepidle = options.keepidle
   self.buffer_size = options.bufferSize
+  self.max_buffer_size = options.maxBufferSize
   self.max_connections = options.maxConnections
+  self.cork = options.cork
+  self.high_watermark = options.highWatermark
+  self.low_watermark = options.lowWatermark
 
   local handle = nil
   local handle_ = nil
@@ -365,12 +559,14 @@ function Server:init(port, onconnect, options)
   end
 
   -- one client connection one coroutine
+  -- max connections are enforced in C by pausing accept
   function _onconnect(client_handle)
-    if self.closed or self.quit or ((self.connections + 1) > self.max_connections) then
+    if self.closed or self.quit then
+      client_handle:close()
       return
     end
 
-    local socket, err = Socket:new(self.bufferSize)
+    local socket, err = Socket:new(self.buffer_size, self.max_buffer_size)
     if not socket then
       client_handle:close()
       return 
@@ -383,6 +579,10 @@ function Server:init(port, onconnect, options)
     socket:setTimeout(self.timeout)
     socket:setNodelay(self.nodelay)
     socket:setKeepalive(self.keepalive, self.keepidle)
+    if self.cork then socket:cork() end
+    if self.high_watermark > 0 then
+      socket:setWriteWatermarks(self.high_watermark, self.low_watermark)
+    end
 
     self.connections = self.connections + 1
 
@@ -390,7 +590,7 @@ function Server:init(port, onconnect, options)
     socket:close()
   end
 
-  err = handle:listen(_onconnect, options.backlog)
+  err = handle:listen(_onconnect, options.backlog, options.maxConnections, options.acceptBatch)
   if err < 0 then
     handle:close()
     return err
@@ -409,6 +609,24 @@ function Server:address()
   return self.handle:local_address()
 end
 
+-- @example: local stats = instance:acceptStats()
+-- @return: stats {table}
+--    local stats = {
+--      accepted = {integer} connections accepted
+--      errors = {integer} failed accepts
+--      pauses = {integer} times accepting paused at maxConnections
+--      deferrals = {integer} times a full batch deferred accepting to the next loop iteration
+--      rate = {integer} accepts per second in the last second
+--      connections = {integer}
+--      max_connections = {integer}
+--      accept_batch = {integer}
+--      paused = {boolean}
+--    }
+function Server:acceptStats()
+  if self.closed then error('closed, unavaliable') end
+  return self.handle:accept_stats()
+end
+
 -- @example: instance:_decrease_connections()
 function Server:_decrease_connections()
   self.connections = self.connections - 1
@@ -446,12 +664,13 @@ end
 --    options = {
 --      timeout = {integer}
 --      buffer_size = {integer}
+--      max_buffer_size = {integer}
 --    }
 -- @return: socket {table}
 -- @return: err {integer}
 tcp.connect = function(port, host, options)
   options = options or {}
-  local socket, err = Socket:new(options.buffer_size)
+  local socket, err = Socket:new(options.buffer_size, options.max_buffer_size)
   if err < 0 then return nil, err end
 
   err = socket:connect(port, host, options.timeout)
@@ -0,0 +1,35 @@
+local thread_native = require('thread_native')
+local process_native = require('process_native')
+
+local execpath = process_native.execpath()
+
+local thread = {}
+
+-- @brief: the id of the current loop thread, 0 for the main thread
+-- @example: local id = thread.id
+-- @return: id {integer}
+thread.id = thread_native.id()
+
+-- @brief: start a loop thread which runs file in its own lua state,
+--         the thread has its own event loop, timers, dns channel and memory pools,
+--         nothing is shared with the other threads(use tcp reuseport to share a port).
+--         the process exits when the main thread and all loop threads have ended.
+-- @example: local id = thread.spawn(file[, package])
+-- @param: file {string}
+-- @param: package {string} the package file of the thread, default: package.lua
+-- @return: id {integer}
+--    if id < 0 => error
+--    if id > 0 => thread id
+function thread.spawn(file, package)
+  if type(file) ~= 'string' then
+    error('thread.spawn(file[, package]) error: file must be string')
+  end
+
+  if package and type(package) ~= 'string' then
+    error('thread.spawn(file[, package]) error: package must be string')
+  end
+
+  return thread_native.spawn(execpath, file, package)
+end
+
+return thread
@@ -0,0 +1,117 @@
+local udp_native = require('udp_native')
+local Object = require('object')
+local ERRNO = require('errno')
+
+local Socket = Object:extend()
+
+-- @example: local err = Socket.init(self[, options])
+-- @param: options {table}
+--    options = {
+--      batch = {integer|default: 1} datagrams received per wakeup, a socket
+--        with batch > 1 also queues its sends until the loop iteration ends
+--      datagramSize = {integer|default: 2048} longer datagrams are truncated
+--      timeout = {integer} recv timeout milliseconds
+--    }
+-- @return: err {integer}
+function Socket:init(options)
+  options = options or {}
+
+  local handle = udp_native.new(options.batch, options.datagramSize)
+  if not handle then return ERRNO.UV_ENOMEM end
+
+  if options.timeout then
+    handle:set_timeout(options.timeout)
+  end
+
+  self.handle = handle
+  self.closed = false
+  return 0
+end
+
+-- @example: local err = instance:bind(port[, host, reuseaddr])
+-- @param: port {integer} 0 lets the system pick one
+-- @param: host {string|default: '0.0.0.0'} IP address
+-- @param: reuseaddr {boolean}
+-- @return: err {integer}
+function Socket:bind(port, host, reuseaddr)
+  if self.closed then error('closed, unavaliable') end
+  return self.handle:bind(port, host or '0.0.0.0', reuseaddr)
+end
+
+-- @example: local data, bytes, host, port = instance:recv()
+-- @overview: the oldest unread datagram, yields until one comes
+-- @return: data {string|nil}
+-- @return: bytes {integer} the error if data is nil, ERRNO.UV_ETIMEDOUT
+--    after the timeout, ERRNO.UV_ECANCELED if the socket is closed meanwhile
+-- @return: host {string}
+-- @return: port {integer}
+function Socket:recv()
+  if self.closed then error('closed, unavaliable') end
+  return self.handle:recv()
+end
+
+-- @example: local bytes, err = instance:send(data, port, host)
+-- @param: data {string|buffer|slice|chain|table(string|buffer|slice)} one datagram
+-- @param: port {integer}
+-- @param: host {string} IP address
+-- @return: bytes {integer}
+-- @return: err {integer} the error of an earlier batch is returned first
+function Socket:send(data, port, host)
+  if self.closed then error('closed, unavaliable') end
+  return self.handle:send(data, port, host)
+end
+
+-- @example: local err = instance:flush()
+-- @overview: send the queued datagrams now instead of at the end of the loop iteration
+-- @return: err {integer}
+function Socket:flush()
+  if self.closed then error('closed, unavaliable') end
+  return self.handle:flush()
+end
+
+-- @example: instance:setTimeout(ms[, precise])
+-- @param: ms {integer} 0 means no timeout
+-- @param: precise {boolean} exact timer instead of the coarse timer wheel
+function Socket:setTimeout(ms, precise)
+  if self.closed then error('closed, unavaliable') end
+  self.handle:set_timeout(ms, precise)
+end
+
+-- @example: local addr = instance:localAddress()
+-- @return: addr {table} @tcp Socket:localAddress
+function Socket:localAddress()
+  if self.closed then return nil end
+
+  local addr, err = self.handle:local_address()
+  if err < 0 then return nil end
+  return addr
+end
+
+-- @example: local stats = instance:stats()
+-- @return: stats {table} received, recv_calls, truncated, unread, sent,
+--    send_calls, send_errors, queued, batch. recv_calls and send_calls count
+--    the system calls
+function Socket:stats()
+  if self.closed then error('closed, unavaliable') end
+  return self.handle:stats()
+end
+
+function Socket:close()
+  if self.closed then return end
+
+  -- keep self.handle, the close callback still uses its memory
+  self.closed = true
+  self.handle:close()
+end
+
+local udp = {}
+
+-- @example: local socket, err = udp.createSocket([options])
+-- @param: options {table} @Socket:init
+-- @return: socket {table}
+-- @return: err {integer}
+udp.createSocket = function(options)
+  return Socket:new(options)
+end
+
+return udp
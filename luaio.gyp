@@ -37,6 +37,9 @@
       },
       'sources': [
         'src/luaio_buffer.c',
+        'src/luaio_buffer_chain.c',
+        'src/luaio_buffer_slice.c',
+        'src/luaio_coroutine.c',
         'src/luaio_date.c',
         'src/luaio_dns.c',
         'src/luaio_errno.c',
@@ -44,9 +47,13 @@
         'src/luaio_hash.c',
         'src/luaio_http.c',
         'src/luaio_http_parser.c',
+        'src/luaio_http_request.c',
+        'src/luaio_http_router.c',
+        'src/luaio_http_scan.c',
         'src/luaio_init.c',
         'src/luaio_pmemory.c',
         'src/luaio_process.c',
+        'src/luaio_querystring.c',
         'src/luaio_read_buffer.c',
         'src/luaio_setaffinity.c',
         'src/luaio_signal.c',
@@ -54,9 +61,12 @@
         'src/luaio_string.c',
         'src/luaio_system.c',
         'src/luaio_tcp.c',
+        'src/luaio_thread.c',
         'src/luaio_timer.c',
+        'src/luaio_udp.c',
         'src/luaio_util.c',
         'src/luaio_write_buffer.c',
+        'src/luaio_zlib.c',
       ],
      'rules': [
        {
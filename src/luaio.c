@@ -8,6 +8,12 @@
 #include "luaio.h"
 #include "luaio_init.h"
 #include "luaio_pmemory.h"
+#include "luaio_timer.h"
+#include "luaio_coroutine.h"
+
+#ifdef LUA_LJDIR
+#include "luajit.h"
+#endif
 
 /*fprintf(stderr, "malloc(size: %" PRId64 ") failed.\n", size);*/
 
@@ -51,15 +57,81 @@ static char *bootstrap =
   "coroutine.resume(__LUAIO_BASE_COROUTINE__)\n"
 ;
 
-#if LUA_VERSION_NUM == 503
+/* LuaJIT 2.0 on 64 bit targets only works with its own allocator,
+ * lua_newstate() always returns NULL there.
+ */
+#if defined(LUAJIT_VERSION_NUM) && LUAJIT_VERSION_NUM < 20100 \
+    && (defined(__x86_64__) || defined(_M_X64))
+# define LUAIO_LUA_CUSTOM_ALLOC 0
+#else
+# define LUAIO_LUA_CUSTOM_ALLOC 1
+#endif
+
+#if LUAIO_LUA_CUSTOM_ALLOC
 
-static void *luaio_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+/* osize is the used size of ptr, so only that much is copied */
+static void *luaio_pmemory_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
+  (void)ud;  /* not used */
+  if (nsize == 0) {
+    luaio_pfree(ptr);
+    return NULL;
+  }
+
+  return luaio_prealloc_used(ptr, ptr ? osize : 0, nsize);
+}
+
+static void *luaio_system_alloc (void *ud, void *ptr, size_t osize, size_t nsize) {
   (void)ud; (void)osize;  /* not used */
-  return luaio_prealloc(ptr, nsize);
+  if (nsize == 0) {
+    luaio_free(ptr);
+    return NULL;
+  }
+
+  return luaio_realloc(ptr, nsize);
 }
 
 #endif
 
+/* @overview: create the main lua state with the allocator named by
+ *            $LUAIO_LUA_ALLOCATOR(pmemory|system|default), falls back to
+ *            the VM default allocator if the VM does not accept another one.
+ */
+static lua_State *luaio_newstate() {
+  const char *allocator = getenv("LUAIO_LUA_ALLOCATOR");
+  int asked = allocator != NULL && *allocator != '\0';
+  if (!asked) {
+    allocator = LUAIO_LUA_ALLOCATOR;
+  }
+
+#if LUAIO_LUA_CUSTOM_ALLOC
+  if (strcmp(allocator, "pmemory") == 0) {
+    luaio_set_lua_allocator("pmemory");
+    return lua_newstate(luaio_pmemory_alloc, NULL);
+  }
+
+  if (strcmp(allocator, "system") == 0) {
+    luaio_set_lua_allocator("system");
+    return lua_newstate(luaio_system_alloc, NULL);
+  }
+#endif
+
+  /* pmemory and system only get here if the VM does not accept them, that
+   * is told when $LUAIO_LUA_ALLOCATOR asked for one, not for the built-in choice.
+   */
+  int known = strcmp(allocator, "pmemory") == 0 || strcmp(allocator, "system") == 0;
+  if (strcmp(allocator, "default") != 0 && (asked || !known)) {
+    fprintf(stderr,
+            LUAIO_COLOR_ERROR
+            "lua allocator[%s] %s, use default\n"
+            LUAIO_COLOR_RESET,
+            allocator,
+            known ? "is not accepted by this lua VM" : "is unknown");
+  }
+
+  luaio_set_lua_allocator("default");
+  return luaL_newstate();
+}
+
 static int luaio_panic (lua_State *L) {
   lua_writestringerror(LUAIO_COLOR_ERROR
                        "PANIC: unprotected error in call to Lua API\n%s\n"
@@ -68,16 +140,18 @@ static int luaio_panic (lua_State *L) {
   return 0;  /* return to Lua to abort */
 }
 
-int main(int argc, char *argv[]) {
-  argv = uv_setup_args(argc, argv);
+static void luaio_onwalk(uv_handle_t *handle, void *arg) {
+  if (!uv_is_closing(handle)) uv_close(handle, NULL);
+}
 
+/* @overview: run a lua state on loop until the loop has nothing to do,
+ *            every loop thread(and the main thread) runs here.
+ *            argv[1] is the file to run, argv[2] the package file.
+ */
+int luaio_run(uv_loop_t *loop, int thread_id, int argc, char *argv[]) {
   luaio_pmemory_init();
 
-#if LUA_VERSION_NUM < 502
-  lua_State *L = luaL_newstate();
-#else
-  lua_State *L = lua_newstate(luaio_alloc, NULL);
-#endif
+  lua_State *L = luaio_newstate();
   if (L == NULL) {
     fprintf(stderr,
             LUAIO_COLOR_ERROR
@@ -89,7 +163,7 @@ int main(int argc, char *argv[]) {
   lua_atpanic(L, &luaio_panic);
   luaL_openlibs(L);
 
-  if (luaio_init(L, argc, argv)) {
+  if (luaio_init(L, loop, thread_id, argc, argv)) {
     fprintf(stderr,
             LUAIO_COLOR_ERROR
             "luaio_init(L) failed\n"
@@ -97,6 +171,7 @@ int main(int argc, char *argv[]) {
     return 1;
   }
 
+  int ret = 0;
   if (luaL_dostring(L, bootstrap)) {
     fprintf(stderr,
             LUAIO_COLOR_ERROR
@@ -104,12 +179,35 @@ int main(int argc, char *argv[]) {
             LUAIO_COLOR_RESET, 
             lua_tostring(L, -1));
     lua_pop(L, 1);
-    lua_close(L);
-    return -1;
+    ret = -1;
+  } else {
+    uv_run(loop, UV_RUN_DEFAULT);
   }
 
-  uv_run(uv_default_loop(), UV_RUN_DEFAULT);
+  /*handles still referenced by lua objects are closed before the state*/
+  luaio_dns_destroy();
+  luaio_timer_destroy();
+  uv_walk(loop, luaio_onwalk, NULL);
+  uv_run(loop, UV_RUN_DEFAULT);
+
+  luaio_coroutine_destroy();
   lua_close(L);
+  luaio_pmemory_destroy();
+  return ret;
+}
+
+int main(int argc, char *argv[]) {
+  argv = uv_setup_args(argc, argv);
+
+  if (luaio_global_init()) {
+    fprintf(stderr,
+            LUAIO_COLOR_ERROR
+            "luaio_global_init() failed\n"
+            LUAIO_COLOR_RESET);
+    return 1;
+  }
 
-  return 0;
+  int ret = luaio_run(uv_default_loop(), 0, argc, argv);
+  luaio_thread_join_all();
+  return ret;
 }
@@ -35,6 +35,7 @@
 #include "luaio_string.h"
 #include "luaio_hash.h"
 #include "luaio_buffer.h"
+#include "luaio_buffer_chain.h"
 
 #if defined(LUAIO_WINDOWS)
 
@@ -71,6 +72,8 @@
 #define LUAIO_ENOTFILE                      -9529
 #define LUAIO_EBAD_UTF8_CHAR                -9530
 #define LUAIO_EINCOMPLETE_UTF8_CHAR         -9531
+#define LUAIO_EZLIB_DATA                    -9532
+#define LUAIO_EZLIB_STREAM                  -9533
 
 #define LUAIO_ERRNO_MAP(XX)                                             \
   XX(EAGAIN, "try again")                                               \
@@ -78,6 +81,8 @@
   XX(ENOTFILE, "not a file")                                            \
   XX(EBAD_UTF8_CHAR, "bad utf8 char")                                   \
   XX(EINCOMPLETE_UTF8_CHAR, "incomplete utf8 char")                     \
+  XX(EZLIB_DATA, "invalid or incomplete compressed data")               \
+  XX(EZLIB_STREAM, "inconsistent zlib stream state")                    \
 
 #define luaio_set_bit(value, shift)         (value |= (1 << shift))
 #define luaio_clear_bit(value, shift)       (value &= ~(1 << shift))
@@ -86,6 +91,13 @@
 #define LUAIO_TYPE_SOCKET                   1
 #define LUAIO_TYPE_READ_BUFFER              4
 #define LUAIO_TYPE_WRITE_BUFFER             6 
+#define LUAIO_TYPE_BUFFER_SLICE             8
+#define LUAIO_TYPE_HTTP_REQUEST             10
+#define LUAIO_TYPE_HTTP_ROUTER              16
+#define LUAIO_TYPE_ZLIB_STREAM              18
+/*bit 2 is kept clear, a chain is not a flat buffer*/
+#define LUAIO_TYPE_BUFFER_CHAIN             24
+#define LUAIO_TYPE_UDP_SOCKET               26
 
 #define luaio_is_buffer(type) luaio_check_bit(type, 2)
 
@@ -112,12 +124,15 @@
 /*luaio_util.c*/
 int luaio_cannot_change(lua_State *L);
 
-static inline void luaio_resume(lua_State *L, int nargs) {
+/*LUA_OK if the coroutine has returned, LUA_YIELD if it is suspended*/
+static inline int luaio_resume(lua_State *L, int nargs) {
   int ret = lua_resume(L, NULL, nargs);
   if (ret > LUA_YIELD) {
     const char *error_string = lua_tostring(L, -1);
     luaL_error(L, "luaio_resume() error: \n%s\n", error_string ? error_string : "unknow");
   }
+
+  return ret;
 }
 
 static inline void luaio_pcall(lua_State *L, int nargs) {
@@ -13,6 +13,48 @@
     return luaL_argerror(L, 1, "buffer:"#name" error: buffer must be [userdata](buffer)\n"); \
   }
 
+int luaio_buffer_grow(luaio_buffer_t *buffer, size_t size) {
+  size_t max_size = buffer->max_size;
+  if (size > max_size) return LUAIO_EXCEED_BUFFER_CAPACITY;
+
+  size_t capacity = buffer->capacity << 1;
+  if (capacity < size) capacity = size;
+  if (capacity > max_size) capacity = max_size;
+
+  char *start = luaio_palloc(capacity);
+  if (start == NULL) return UV_ENOMEM;
+
+  char *old = buffer->start;
+  size_t rest_size = 0;
+  if (old != NULL) {
+    rest_size = buffer->write_pos - buffer->read_pos;
+    luaio_memcpy(start, buffer->read_pos, rest_size);
+    luaio_pfree(old);
+  }
+
+  capacity = luaio_pmemory_get_capacity(start);
+  buffer->capacity = capacity;
+  buffer->generation++;
+  buffer->start = start;
+  buffer->read_pos = start;
+  buffer->write_pos = start + rest_size;
+  buffer->end = start + capacity;
+  return 0;
+}
+
+void luaio_buffer_release(luaio_buffer_t *buffer) {
+  char *start = buffer->start;
+  if (buffer->max_size == 0 || start == NULL || buffer->read_pos != buffer->write_pos) return;
+
+  luaio_pfree(start);
+  buffer->capacity = 0;
+  buffer->generation++;
+  buffer->start = NULL;
+  buffer->read_pos = NULL;
+  buffer->write_pos = NULL;
+  buffer->end = NULL;
+}
+
 /* local capacity = buffer:capacity() */
 int luaio_buffer_capacity(lua_State *L) {
   luaio_buffer_check_buffer(L, capacity());
@@ -25,6 +67,13 @@ int luaio_buffer_capacity(lua_State *L) {
  */
 int luaio_buffer_discard(lua_State *L) {
   luaio_buffer_check_buffer(L, discard([n]));
+
+  /*a released adaptive buffer is empty*/
+  if (buffer->capacity == 0 && buffer->max_size != 0) {
+    lua_pushinteger(L, 0);
+    return 1;
+  }
+
   luaio_buffer_check_memory(L, diacard([n]));
   lua_Integer n = luaL_checkinteger(L, 2);
 
@@ -50,6 +99,20 @@ int luaio_buffer_discard(lua_State *L) {
   return 1;
 }
 
+/* local str = buffer:tostring()  copy of the unread bytes, they are not consumed */
+int luaio_buffer_tostring(lua_State *L) {
+  luaio_buffer_check_buffer(L, tostring());
+
+  char *read_pos = buffer->read_pos;
+  if (read_pos == NULL) {
+    lua_pushliteral(L, "");
+    return 1;
+  }
+
+  lua_pushlstring(L, read_pos, buffer->write_pos - read_pos);
+  return 1;
+}
+
 int luaio_buffer_gc(lua_State *L) {
   luaio_buffer_check_buffer(L, __gc());
 
@@ -13,19 +13,55 @@ typedef struct {
   size_t    type;
   size_t    size;
   size_t    capacity;
+  size_t    max_size;    /*0: fixed, else grown up to max_size and released while empty*/
+  size_t    generation;  /*bumped when the bytes under slices are moved or overwritten*/
   char      *start;
   char      *read_pos;
   char      *write_pos;
   char      *end;
 } luaio_buffer_t;
 
+/* zero-copy view of a read buffer range, valid until the buffer is
+ * compacted or refilled from its start, the buffer is kept alive by a ref.
+ */
+typedef struct {
+  size_t          type;
+  size_t          generation;
+  luaio_buffer_t  *buffer;
+  char            *base;
+  size_t          len;
+  int             buffer_ref;
+} luaio_buffer_slice_t;
+
+#define luaio_buffer_slice_is_stale(slice) \
+  ((slice)->generation != (slice)->buffer->generation)
+
+/*new data will overwrite consumed bytes, slices of them are stale*/
+#define luaio_buffer_before_fill(buffer) \
+  if ((buffer)->write_pos == (buffer)->start) { \
+    (buffer)->generation++; \
+  }
+
 #define luaio_buffer_check_memory(L, name) \
   if (buffer->capacity == 0) { \
     return luaL_error(L, "buffer:"#name" error: no memory available\n"); \
   }
 
+/* move the unread bytes into a chunk of at least size bytes(twice the
+ * capacity if bigger, at most max_size), the old chunk goes back to pmemory.
+ * @return: 0, LUAIO_EXCEED_BUFFER_CAPACITY or UV_ENOMEM
+ */
+int luaio_buffer_grow(luaio_buffer_t *buffer, size_t size);
+
+/*give the memory of an empty adaptive buffer back, the next fill allocates size bytes again*/
+void luaio_buffer_release(luaio_buffer_t *buffer);
+
 int luaio_buffer_capacity(lua_State *L);
 int luaio_buffer_discard(lua_State *L);
+int luaio_buffer_tostring(lua_State *L);
 int luaio_buffer_gc(lua_State *L);
 
+int luaio_buffer_slice_new(lua_State *L, int index, char *base, size_t len);
+void luaio_buffer_slice_init(lua_State *L);
+
 #endif /* LUAIO_BUFFER_H */
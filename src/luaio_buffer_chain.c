@@ -0,0 +1,362 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: a buffer made of pmemory segments, reads append segments, the
+ *            unread bytes never move, socket:write(chain) sends the segments
+ *            as an iovec.
+ */
+
+#include "luaio.h"
+#include "luaio_init.h"
+#include "luaio_stack_buffer.h"
+
+static char luaio_buffer_chain_metatable_key;
+
+#define luaio_buffer_check_chain(L, name) \
+  luaio_buffer_chain_t *chain = lua_touserdata(L, 1); \
+  if (chain == NULL || chain->type != LUAIO_TYPE_BUFFER_CHAIN) { \
+    return luaL_argerror(L, 1, "chain:"#name" error: chain must be [userdata](buffer_chain)\n"); \
+  }
+
+static luaio_buffer_segment_t *luaio_buffer_segment_new(size_t size) {
+  luaio_buffer_segment_t *segment = luaio_palloc(size);
+  if (segment == NULL) return NULL;
+
+  char *start = (char*)(segment + 1);
+  segment->next = NULL;
+  segment->read_pos = start;
+  segment->write_pos = start;
+  segment->end = (char*)segment + luaio_pmemory_get_capacity(segment);
+  return segment;
+}
+
+/*the head has been read, its memory goes back to pmemory*/
+static void luaio_buffer_chain_shift(luaio_buffer_chain_t *chain) {
+  luaio_buffer_segment_t *head = chain->head;
+  chain->head = head->next;
+  if (chain->head == NULL) chain->tail = NULL;
+  chain->nsegment--;
+  luaio_pfree(head);
+}
+
+char *luaio_buffer_chain_reserve(luaio_buffer_chain_t *chain, size_t *len) {
+  luaio_buffer_segment_t *tail = chain->tail;
+  if (tail == NULL || tail->write_pos == tail->end) {
+    luaio_buffer_segment_t *segment = luaio_buffer_segment_new(chain->segment_size);
+    if (segment == NULL) return NULL;
+
+    if (tail == NULL) {
+      chain->head = segment;
+    } else {
+      tail->next = segment;
+    }
+
+    chain->tail = segment;
+    chain->nsegment++;
+    tail = segment;
+  }
+
+  *len = tail->end - tail->write_pos;
+  return tail->write_pos;
+}
+
+void luaio_buffer_chain_commit(luaio_buffer_chain_t *chain, size_t n) {
+  chain->tail->write_pos += n;
+  chain->size += n;
+}
+
+int luaio_buffer_chain_append(luaio_buffer_chain_t *chain, const char *data, size_t len) {
+  while (len > 0) {
+    size_t free_size;
+    char *write_pos = luaio_buffer_chain_reserve(chain, &free_size);
+    if (write_pos == NULL) return UV_ENOMEM;
+
+    size_t n = len < free_size ? len : free_size;
+    luaio_memcpy(write_pos, data, n);
+    luaio_buffer_chain_commit(chain, n);
+    data += n;
+    len -= n;
+  }
+
+  return 0;
+}
+
+void luaio_buffer_chain_discard(luaio_buffer_chain_t *chain, size_t n) {
+  if (n > chain->size) n = chain->size;
+  chain->size -= n;
+  chain->scanned = chain->scanned > n ? chain->scanned - n : 0;
+
+  while (n > 0) {
+    luaio_buffer_segment_t *head = chain->head;
+    size_t len = head->write_pos - head->read_pos;
+    if (n < len) {
+      head->read_pos += n;
+      return;
+    }
+
+    n -= len;
+    luaio_buffer_chain_shift(chain);
+  }
+
+  /*an empty segment left by a read which brought nothing*/
+  luaio_buffer_segment_t *head = chain->head;
+  if (head != NULL && head->read_pos == head->write_pos) {
+    luaio_buffer_chain_shift(chain);
+  }
+}
+
+/*push the first n bytes as one string, they are copied once if they span segments*/
+static int luaio_buffer_chain_push(lua_State *L, luaio_buffer_chain_t *chain, size_t n) {
+  luaio_buffer_segment_t *head = chain->head;
+  if (n == 0 || (size_t)(head->write_pos - head->read_pos) >= n) {
+    lua_pushlstring(L, n == 0 ? "" : head->read_pos, n);
+    return 0;
+  }
+
+  luaio_stack_buffer_t stack_buf;
+  char *buf = luaio_stack_buffer_init(&stack_buf, n);
+  if (buf == NULL) return UV_ENOMEM;
+
+  size_t k = 0;
+  luaio_buffer_chain_foreach(chain, segment) {
+    size_t len = segment->write_pos - segment->read_pos;
+    if (len > n - k) len = n - k;
+    luaio_memcpy(buf + k, segment->read_pos, len);
+    k += len;
+    if (k == n) break;
+  }
+
+  lua_pushlstring(L, buf, n);
+  luaio_stack_buffer_free(&stack_buf);
+  return 0;
+}
+
+/* local chain = buffer_chain.new([segment_size])
+ * @param: segment_size {integer|default: 16384} bytes of a segment, header included
+ */
+static int luaio_buffer_chain_new(lua_State *L) {
+  lua_Integer segment_size = luaL_optinteger(L, 1, LUAIO_BUFFER_CHAIN_SEGMENT_SIZE);
+  if (segment_size <= (lua_Integer)sizeof(luaio_buffer_segment_t)) {
+    return luaL_argerror(L, 1, "buffer_chain.new([segment_size]) error: segment_size is too small\n");
+  }
+
+  luaio_buffer_chain_t *chain = lua_newuserdata(L, sizeof(luaio_buffer_chain_t));
+  if (chain == NULL) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  chain->type = LUAIO_TYPE_BUFFER_CHAIN;
+  chain->segment_size = segment_size;
+  chain->size = 0;
+  chain->scanned = 0;
+  chain->nsegment = 0;
+  chain->head = NULL;
+  chain->tail = NULL;
+
+  lua_pushlightuserdata(L, &luaio_buffer_chain_metatable_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+/* local bytes, err = chain:append(data)
+ * @param: data {string|buffer|slice} the unread bytes of a buffer are copied, not consumed
+ */
+static int luaio_buffer_chain_append_data(lua_State *L) {
+  luaio_buffer_check_chain(L, append(data));
+
+  size_t len;
+  const char *data;
+  int type = lua_type(L, 2);
+  if (type == LUA_TSTRING) {
+    data = lua_tolstring(L, 2, &len);
+  } else if (type == LUA_TUSERDATA) {
+    luaio_buffer_t *buffer = lua_touserdata(L, 2);
+    if (buffer->type == LUAIO_TYPE_BUFFER_SLICE) {
+      luaio_buffer_slice_t *slice = (luaio_buffer_slice_t*)buffer;
+      if (luaio_buffer_slice_is_stale(slice)) {
+        return luaL_argerror(L, 2, "chain:append(data) error: data is slice, but the buffer has been refilled\n");
+      }
+
+      data = slice->base;
+      len = slice->len;
+    } else if (luaio_is_buffer(buffer->type)) {
+      /*a buffer without memory is empty*/
+      data = buffer->read_pos;
+      len = buffer->write_pos - buffer->read_pos;
+    } else {
+      return luaL_argerror(L, 2, "chain:append(data) error: data is userdata, but not buffer\n");
+    }
+  } else {
+    return luaL_argerror(L, 2, "chain:append(data) error: data must be [string|buffer|slice]\n");
+  }
+
+  int err = luaio_buffer_chain_append(chain, data, len);
+  lua_pushinteger(L, len);
+  lua_pushinteger(L, err);
+  return 2;
+}
+
+/* local data, err = chain:read([n])
+ * @param: n {integer} read the rest if n is nil or < 0
+ * @return: data {string|nil} nil and LUAIO_EAGAIN while fewer than n bytes are in the chain
+ */
+static int luaio_buffer_chain_read(lua_State *L) {
+  luaio_buffer_check_chain(L, read([n]));
+
+  lua_Integer n = luaL_optinteger(L, 2, -1);
+  size_t size = chain->size;
+  if (n < 0) {
+    if (size == 0) {
+      lua_pushnil(L);
+      lua_pushinteger(L, LUAIO_EAGAIN);
+      return 2;
+    }
+
+    n = size;
+  }
+
+  if ((size_t)n > size) {
+    lua_pushnil(L);
+    lua_pushinteger(L, LUAIO_EAGAIN);
+    return 2;
+  }
+
+  if (luaio_buffer_chain_push(L, chain, n) < 0) {
+    return luaL_error(L, "chain:read([n]) error: no memory\n");
+  }
+
+  luaio_buffer_chain_discard(chain, n);
+  lua_pushinteger(L, n);
+  return 2;
+}
+
+/* local line, err = chain:readline()
+ * @return: line {string|nil} without '\n' or '\r\n', nil and LUAIO_EAGAIN until a '\n' is in the chain
+ *
+ * the line may span segments, the bytes searched already are not searched again.
+ */
+static int luaio_buffer_chain_readline(lua_State *L) {
+  luaio_buffer_check_chain(L, readline());
+
+  size_t offset = 0;
+  size_t skip = chain->scanned;
+  char *find = NULL;
+  char last = 0;
+  luaio_buffer_chain_foreach(chain, segment) {
+    char *read_pos = segment->read_pos;
+    size_t len = segment->write_pos - read_pos;
+    if (skip >= len) {
+      skip -= len;
+    } else {
+      find = luaio_memchr(read_pos + skip, '\n', len - skip);
+      if (find != NULL) {
+        offset += find - read_pos;
+        if (find > read_pos) last = *(find - 1);
+        break;
+      }
+
+      skip = 0;
+    }
+
+    offset += len;
+    if (len > 0) last = *(segment->write_pos - 1);
+  }
+
+  if (find == NULL) {
+    chain->scanned = chain->size;
+    lua_pushnil(L);
+    lua_pushinteger(L, LUAIO_EAGAIN);
+    return 2;
+  }
+
+  size_t size = offset;
+  if (size > 0 && last == '\r') --size;
+
+  if (luaio_buffer_chain_push(L, chain, size) < 0) {
+    return luaL_error(L, "chain:readline() error: no memory\n");
+  }
+
+  luaio_buffer_chain_discard(chain, offset + 1);
+  lua_pushinteger(L, size);
+  return 2;
+}
+
+/* local bytes = chain:discard([n])
+ * @param: n {integer} discard all if n is nil or < 0
+ */
+static int luaio_buffer_chain_discard_data(lua_State *L) {
+  luaio_buffer_check_chain(L, discard([n]));
+
+  lua_Integer n = luaL_optinteger(L, 2, -1);
+  size_t size = chain->size;
+  if (n < 0 || (size_t)n > size) n = size;
+
+  luaio_buffer_chain_discard(chain, n);
+  lua_pushinteger(L, n);
+  return 1;
+}
+
+/* local size = chain:size() */
+static int luaio_buffer_chain_size(lua_State *L) {
+  luaio_buffer_check_chain(L, size());
+  lua_pushinteger(L, chain->size);
+  return 1;
+}
+
+/* local segments = chain:segments() */
+static int luaio_buffer_chain_segments(lua_State *L) {
+  luaio_buffer_check_chain(L, segments());
+  lua_pushinteger(L, chain->nsegment);
+  return 1;
+}
+
+static int luaio_buffer_chain_gc(lua_State *L) {
+  luaio_buffer_check_chain(L, __gc());
+
+  while (chain->head != NULL) {
+    luaio_buffer_chain_shift(chain);
+  }
+
+  chain->size = 0;
+  chain->scanned = 0;
+  return 0;
+}
+
+int luaopen_buffer_chain(lua_State *L) {
+  luaL_Reg buffer_chain_mtlib[] = {
+    { "append", luaio_buffer_chain_append_data },
+    { "read", luaio_buffer_chain_read },
+    { "readline", luaio_buffer_chain_readline },
+    { "discard", luaio_buffer_chain_discard_data },
+    { "size", luaio_buffer_chain_size },
+    { "segments", luaio_buffer_chain_segments },
+    { "__gc", luaio_buffer_chain_gc },
+    { NULL, NULL }
+  };
+
+  lua_pushlightuserdata(L, &luaio_buffer_chain_metatable_key);
+  luaL_newlib(L, buffer_chain_mtlib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_rawset(L, LUA_REGISTRYINDEX);
+
+  luaL_Reg lib[] = {
+    { "new", luaio_buffer_chain_new },
+    { "__newindex", luaio_cannot_change },
+    { NULL, NULL }
+  };
+
+  lua_createtable(L, 0, 0);
+
+  luaL_newlib(L, lib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushliteral(L, "metatable is protected.");
+  lua_setfield(L, -2, "__metatable");
+
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
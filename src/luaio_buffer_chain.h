@@ -0,0 +1,50 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: a buffer made of pmemory segments, new data is appended in a
+ *            new segment instead of moving the unread bytes, a segment is
+ *            freed as soon as it has been read.
+ */
+
+#ifndef LUAIO_BUFFER_CHAIN_H
+#define LUAIO_BUFFER_CHAIN_H
+
+#include "luaio_init.h"
+
+/*the bytes follow the header in the same pmemory chunk*/
+typedef struct luaio_buffer_segment_s luaio_buffer_segment_t;
+struct luaio_buffer_segment_s {
+  luaio_buffer_segment_t  *next;
+  char                    *read_pos;
+  char                    *write_pos;
+  char                    *end;
+};
+
+typedef struct {
+  size_t                  type;
+  size_t                  segment_size;
+  size_t                  size;       /*unread bytes*/
+  size_t                  scanned;    /*leading bytes known to hold no '\n'*/
+  size_t                  nsegment;
+  luaio_buffer_segment_t  *head;
+  luaio_buffer_segment_t  *tail;
+} luaio_buffer_chain_t;
+
+#define luaio_buffer_chain_foreach(chain, segment) \
+  for (luaio_buffer_segment_t *segment = (chain)->head; segment != NULL; segment = segment->next)
+
+/* free space at the tail, a new segment is appended when the tail is full.
+ * @return: NULL if no memory
+ */
+char *luaio_buffer_chain_reserve(luaio_buffer_chain_t *chain, size_t *len);
+
+/*n bytes have been written into the space given by luaio_buffer_chain_reserve()*/
+void luaio_buffer_chain_commit(luaio_buffer_chain_t *chain, size_t n);
+
+/* @return: 0 or UV_ENOMEM, the bytes copied before the failure stay in the chain */
+int luaio_buffer_chain_append(luaio_buffer_chain_t *chain, const char *data, size_t len);
+
+/*drop the first n bytes, all if n is bigger*/
+void luaio_buffer_chain_discard(luaio_buffer_chain_t *chain, size_t n);
+
+#endif /* LUAIO_BUFFER_CHAIN_H */
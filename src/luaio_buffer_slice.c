@@ -0,0 +1,231 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: zero-copy slices of read buffers
+ */
+
+#include "luaio.h"
+#include "luaio_buffer.h"
+
+static char luaio_buffer_slice_metatable_key;
+
+#define luaio_buffer_check_slice(L, name) \
+  luaio_buffer_slice_t *slice = lua_touserdata(L, 1); \
+  if (slice == NULL || slice->type != LUAIO_TYPE_BUFFER_SLICE) { \
+    return luaL_argerror(L, 1, "slice:"#name" error: slice must be [userdata](slice)\n"); \
+  } \
+  \
+  if (luaio_buffer_slice_is_stale(slice)) { \
+    return luaL_error(L, "slice:"#name" error: slice is stale, the buffer has been refilled\n"); \
+  }
+
+/*string or slice at index*/
+static const char *luaio_buffer_slice_check_data(lua_State *L, int index, size_t *len) {
+  if (lua_type(L, index) == LUA_TSTRING) {
+    return lua_tolstring(L, index, len);
+  }
+
+  luaio_buffer_slice_t *slice = lua_touserdata(L, index);
+  if (slice == NULL || slice->type != LUAIO_TYPE_BUFFER_SLICE) {
+    luaL_argerror(L, index, "data must be [string|slice]\n");
+    return NULL;
+  }
+
+  if (luaio_buffer_slice_is_stale(slice)) {
+    luaL_argerror(L, index, "slice is stale, the buffer has been refilled\n");
+    return NULL;
+  }
+
+  *len = slice->len;
+  return slice->base;
+}
+
+static char *luaio_buffer_slice_memmem(char *s, size_t n, const char *p, size_t m) {
+  if (m == 0) return s;
+  if (m > n) return NULL;
+
+  char *last = s + n - m;
+  char first = p[0];
+  while (s <= last) {
+    s = luaio_memchr(s, first, last - s + 1);
+    if (s == NULL) return NULL;
+    if (luaio_memcmp(s, p, m) == 0) return s;
+    s++;
+  }
+
+  return NULL;
+}
+
+/* @overview: push a slice of the buffer at index, base and len must be
+ *            inside the readable range of the buffer.
+ */
+int luaio_buffer_slice_new(lua_State *L, int index, char *base, size_t len) {
+  luaio_buffer_t *buffer = lua_touserdata(L, index);
+
+  lua_pushvalue(L, index);
+  int buffer_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  luaio_buffer_slice_t *slice = lua_newuserdata(L, sizeof(luaio_buffer_slice_t));
+  slice->type = LUAIO_TYPE_BUFFER_SLICE;
+  slice->generation = buffer->generation;
+  slice->buffer = buffer;
+  slice->base = base;
+  slice->len = len;
+  slice->buffer_ref = buffer_ref;
+
+  lua_pushlightuserdata(L, &luaio_buffer_slice_metatable_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+/* local len = slice:len() */
+static int luaio_buffer_slice_len(lua_State *L) {
+  luaio_buffer_check_slice(L, len());
+  lua_pushinteger(L, slice->len);
+  return 1;
+}
+
+/* local str = slice:tostring() */
+static int luaio_buffer_slice_tostring(lua_State *L) {
+  luaio_buffer_check_slice(L, tostring());
+  lua_pushlstring(L, slice->base, slice->len);
+  return 1;
+}
+
+/* local byte = slice:byte(i) */
+static int luaio_buffer_slice_byte(lua_State *L) {
+  luaio_buffer_check_slice(L, byte(i));
+
+  lua_Integer i = luaL_checkinteger(L, 2);
+  if (i < 0) i += slice->len + 1;
+  if (i < 1 || i > (lua_Integer)slice->len) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_pushinteger(L, (unsigned char)slice->base[i - 1]);
+  return 1;
+}
+
+/* local sub = slice:sub(i[, j]) same indices as string.sub */
+static int luaio_buffer_slice_sub(lua_State *L) {
+  luaio_buffer_check_slice(L, sub(i[, j]));
+
+  lua_Integer len = slice->len;
+  lua_Integer i = luaL_checkinteger(L, 2);
+  lua_Integer j = luaL_optinteger(L, 3, -1);
+  if (i < 0) i += len + 1;
+  if (j < 0) j += len + 1;
+  if (i < 1) i = 1;
+  if (j > len) j = len;
+
+  /*slices are not buffers, make the new one from the buffer*/
+  lua_rawgeti(L, LUA_REGISTRYINDEX, slice->buffer_ref);
+  int index = lua_gettop(L);
+  if (i > j) {
+    luaio_buffer_slice_new(L, index, slice->base, 0);
+  } else {
+    luaio_buffer_slice_new(L, index, slice->base + i - 1, j - i + 1);
+  }
+
+  lua_remove(L, index);
+  return 1;
+}
+
+/* local first, last = slice:find(str[, init]) plain search */
+static int luaio_buffer_slice_find(lua_State *L) {
+  luaio_buffer_check_slice(L, find(str[, init]));
+
+  size_t n;
+  const char *p = luaio_buffer_slice_check_data(L, 2, &n);
+  lua_Integer len = slice->len;
+  lua_Integer init = luaL_optinteger(L, 3, 1);
+  if (init < 0) init += len + 1;
+  if (init < 1) init = 1;
+  if (init > len + 1) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  char *s = slice->base + init - 1;
+  char *find = luaio_buffer_slice_memmem(s, len - init + 1, p, n);
+  if (find == NULL) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_Integer first = find - slice->base + 1;
+  lua_pushinteger(L, first);
+  lua_pushinteger(L, first + n - 1);
+  return 2;
+}
+
+/* local ok = slice:equals(str|slice) */
+static int luaio_buffer_slice_equals(lua_State *L) {
+  luaio_buffer_check_slice(L, equals(data));
+
+  size_t n;
+  const char *p = luaio_buffer_slice_check_data(L, 2, &n);
+  lua_pushboolean(L, n == slice->len && luaio_memcmp(slice->base, p, n) == 0);
+  return 1;
+}
+
+/* local hash = slice:hash() */
+static int luaio_buffer_slice_hash(lua_State *L) {
+  luaio_buffer_check_slice(L, hash());
+  lua_pushinteger(L, (lua_Integer)luaio_hash(slice->base, slice->len));
+  return 1;
+}
+
+/* slice1 == slice2 */
+static int luaio_buffer_slice_eq(lua_State *L) {
+  luaio_buffer_slice_t *s1 = lua_touserdata(L, 1);
+  luaio_buffer_slice_t *s2 = lua_touserdata(L, 2);
+  if (s1 == NULL || s2 == NULL
+      || s1->type != LUAIO_TYPE_BUFFER_SLICE
+      || s2->type != LUAIO_TYPE_BUFFER_SLICE
+      || luaio_buffer_slice_is_stale(s1)
+      || luaio_buffer_slice_is_stale(s2)) {
+    lua_pushboolean(L, 0);
+    return 1;
+  }
+
+  lua_pushboolean(L, s1->len == s2->len && luaio_memcmp(s1->base, s2->base, s1->len) == 0);
+  return 1;
+}
+
+static int luaio_buffer_slice_gc(lua_State *L) {
+  luaio_buffer_slice_t *slice = lua_touserdata(L, 1);
+  if (slice == NULL || slice->type != LUAIO_TYPE_BUFFER_SLICE) return 0;
+
+  if (slice->buffer_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, slice->buffer_ref);
+    slice->buffer_ref = LUA_NOREF;
+  }
+
+  return 0;
+}
+
+void luaio_buffer_slice_init(lua_State *L) {
+  luaL_Reg slice_mtlib[] = {
+    { "len", luaio_buffer_slice_len },
+    { "tostring", luaio_buffer_slice_tostring },
+    { "byte", luaio_buffer_slice_byte },
+    { "sub", luaio_buffer_slice_sub },
+    { "find", luaio_buffer_slice_find },
+    { "equals", luaio_buffer_slice_equals },
+    { "hash", luaio_buffer_slice_hash },
+    { "__len", luaio_buffer_slice_len },
+    { "__eq", luaio_buffer_slice_eq },
+    { "__tostring", luaio_buffer_slice_tostring },
+    { "__gc", luaio_buffer_slice_gc },
+    { NULL, NULL }
+  };
+
+  lua_pushlightuserdata(L, &luaio_buffer_slice_metatable_key);
+  luaL_newlib(L, slice_mtlib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_rawset(L, LUA_REGISTRYINDEX);
+}
@@ -25,18 +25,56 @@
     bytes += len; \
     count = 1; \
     bufs = &buf; \
+  } else if (type == LUA_TUSERDATA && \
+             ((luaio_buffer_t*)lua_touserdata(L, index))->type == LUAIO_TYPE_BUFFER_CHAIN) { \
+    /*one iovec entry per segment*/ \
+    luaio_buffer_chain_t *chain = lua_touserdata(L, index); \
+    count = chain->nsegment; \
+    if (count == 0) { \
+      buf.base = NULL; \
+      buf.len = 0; \
+      count = 1; \
+      bufs = &buf; \
+    } else { \
+      bufs = luaio_stack_buffer_init(&stack_buf, sizeof(uv_buf_t) * count); \
+      if (bufs == NULL) { \
+        lua_pushinteger(L, 0); \
+        lua_pushinteger(L, UV_ENOMEM); \
+        return 2; \
+      } \
+      \
+      tmp = bufs; \
+      size_t i = 0; \
+      luaio_buffer_chain_foreach(chain, segment) { \
+        bufs[i].base = segment->read_pos; \
+        bufs[i].len = segment->write_pos - segment->read_pos; \
+        i++; \
+      } \
+      bytes = chain->size; \
+    } \
   } else if (type == LUA_TUSERDATA) { \
     luaio_buffer_t *buffer = lua_touserdata(L, index); \
-    if (!luaio_is_buffer(buffer->type)) { \
-      return luaL_argerror(L, index, #name" error: data is userdata, but not buffer\n"); \
-    } \
-    \
-    if (buffer->capacity == 0) { \
-      return luaL_argerror(L, index, #name" error: data is buffer, but no memory available\n"); \
+    if (buffer->type == LUAIO_TYPE_BUFFER_SLICE) { \
+      luaio_buffer_slice_t *slice = (luaio_buffer_slice_t*)buffer; \
+      if (luaio_buffer_slice_is_stale(slice)) { \
+        return luaL_argerror(L, index, #name" error: data is slice, but the buffer has been refilled\n"); \
+      } \
+      \
+      read_pos = slice->base; \
+      len = slice->len; \
+    } else { \
+      if (!luaio_is_buffer(buffer->type)) { \
+        return luaL_argerror(L, index, #name" error: data is userdata, but not buffer\n"); \
+      } \
+      \
+      if (buffer->capacity == 0) { \
+        return luaL_argerror(L, index, #name" error: data is buffer, but no memory available\n"); \
+      } \
+      \
+      read_pos = buffer->read_pos; \
+      len = buffer->write_pos - read_pos; \
     } \
     \
-    read_pos = buffer->read_pos; \
-    len = buffer->write_pos - read_pos; \
     buf.base = read_pos; \
     buf.len = len; \
     bytes += len; \
@@ -63,27 +101,38 @@
         bytes += len; \
       } else if (ttype == LUA_TUSERDATA) { \
         luaio_buffer_t *buffer = lua_touserdata(L, -1); \
-        if (!luaio_is_buffer(buffer->type)) { \
-          return luaL_error(L, #name" error: data[%d] is userdata, but not buffer\n", pos); \
+        if (buffer->type == LUAIO_TYPE_BUFFER_SLICE) { \
+          luaio_buffer_slice_t *slice = (luaio_buffer_slice_t*)buffer; \
+          if (luaio_buffer_slice_is_stale(slice)) { \
+            return luaL_error(L, #name" error: data[%d] is slice, but the buffer has been refilled\n", pos); \
+          } \
+          \
+          read_pos = slice->base; \
+          len = slice->len; \
+        } else { \
+          if (!luaio_is_buffer(buffer->type)) { \
+            return luaL_error(L, #name" error: data[%d] is userdata, but not buffer\n", pos); \
+          } \
+          \
+          if (buffer->capacity == 0) { \
+            return luaL_error(L, #name" error: data[%d] is Buffer, but no memory available\n", pos); \
+          } \
+          \
+          read_pos = buffer->read_pos; \
+          len = buffer->write_pos - read_pos; \
         } \
         \
-        if (buffer->capacity == 0) { \
-          return luaL_error(L, #name" error: data[%d] is Buffer, but no memory available\n", pos); \
-        } \
-        \
-        read_pos = buffer->read_pos; \
-        len = buffer->write_pos - read_pos; \
-        buf.base = read_pos; \
-        buf.len = len; \
+        bufs[i].base = read_pos; \
+        bufs[i].len = len; \
         bytes += len; \
       } else { \
-        return luaL_error(L, #name" error: data[%d] must be string or buffer\n", pos); \
+        return luaL_error(L, #name" error: data[%d] must be string, buffer or slice\n", pos); \
       } \
       \
       lua_pop(L, 1); \
     } \
   } else { \
-    return luaL_argerror(L, index, #name" error: data must be [string|buffer|table(string|buffer)]\n"); \
+    return luaL_argerror(L, index, #name" error: data must be [string|buffer|slice|chain|table(string|buffer|slice)]\n"); \
   }
 
 #endif /* LUAIO_COMMON_H */
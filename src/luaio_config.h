@@ -218,8 +218,51 @@ static inline void *luaio_memalign(size_t align, size_t size) {
 #define luaio_memchr                memchr
 #define luaio_memzero(p, size)      memset(p, 0, size)
 
+#if defined(_MSC_VER)
+#define LUAIO_THREAD_LOCAL          __declspec(thread)
+#else
+#define LUAIO_THREAD_LOCAL          __thread
+#endif
+
 #define LUAIO_OPENSSL_NO_ENGINE     0
 #define LUAIO_USE_PMEMORY           1
 #define LUAIO_MAX_FREE_TIMERS       1024
+/*finished connection coroutines cached for reuse*/
+#define LUAIO_MAX_FREE_COROUTINES   1024
+/*milliseconds per tick of the timer wheel, wheel timeouts are rounded up to it*/
+#define LUAIO_TIMER_WHEEL_TICK      10
+/*connections accepted by a server per loop iteration before serving others*/
+#define LUAIO_TCP_ACCEPT_BATCH      64
+#define LUAIO_TCP_MAX_CONNECTIONS   65535
+/*bytes moved per read by socket:pipe(other)*/
+#define LUAIO_TCP_PIPE_SIZE         65536
+#if LUAIO_LINUX && !LUAIO_ANDROID
+/*socket:pipe(other) moves bytes with splice(2) through a kernel pipe*/
+#define LUAIO_HAVE_SPLICE           1
+/*socket:sendfile(fd, offset, length) calls sendfile(2) on the loop thread*/
+#define LUAIO_HAVE_SENDFILE         1
+/*batched udp sockets drain a wakeup with recvmmsg(2) and send their queue with sendmmsg(2)*/
+#define LUAIO_HAVE_MMSG             1
+#endif
+/*corked socket:write_async(data): strings up to COPY_SIZE are copied into a
+ *chunk of at least CHUNK_SIZE, larger ones are referenced
+ */
+#define LUAIO_TCP_CORK_COPY_SIZE    1024
+#define LUAIO_TCP_CORK_CHUNK_SIZE   4096
+#define LUAIO_TCP_CORK_PIECES       16
+/*bytes sent by socket:sendfile(fd, offset, length) per loop iteration*/
+#define LUAIO_TCP_SENDFILE_CHUNK    (1024 * 1024)
+/*bytes of a buffer_chain segment, header included, unless told otherwise*/
+#define LUAIO_BUFFER_CHAIN_SEGMENT_SIZE   16384
+/*udp_native: bytes of a receive slot unless told otherwise, datagrams per
+ *recvmmsg/sendmmsg at most, first chunk of the queued datagrams
+ */
+#define LUAIO_UDP_DATAGRAM_SIZE     2048
+#define LUAIO_UDP_MAX_BATCH         64
+#define LUAIO_UDP_CHUNK_SIZE        4096
+/*allocator of the lua heap: pmemory, system or default(the VM's own),
+ *overridden by $LUAIO_LUA_ALLOCATOR
+ */
+#define LUAIO_LUA_ALLOCATOR         "pmemory"
 
 #endif /* LUAIO_CONFIG_H */
@@ -0,0 +1,93 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: pool of finished lua threads, reused by new connections
+ */
+
+#include "luaio_coroutine.h"
+
+static LUAIO_THREAD_LOCAL luaio_coroutine_pool_t luaio_coroutine_pool;
+static LUAIO_THREAD_LOCAL lua_State *luaio_coroutine_main;
+
+void luaio_coroutine_init(lua_State *L, size_t max_free_coroutines) {
+  luaio_coroutine_main = L;
+  luaio_memzero(&luaio_coroutine_pool, sizeof(luaio_coroutine_pool_t));
+  luaio_coroutine_set_max_free_coroutines(max_free_coroutines);
+}
+
+/*the refs die with the lua state*/
+void luaio_coroutine_destroy() {
+  luaio_free(luaio_coroutine_pool.free_list);
+  luaio_memzero(&luaio_coroutine_pool, sizeof(luaio_coroutine_pool_t));
+}
+
+/* @overview: resize the pool, cached coroutines beyond the new size are
+ *            given back to the GC.
+ * @return: 0 or UV_ENOMEM
+ */
+int luaio_coroutine_set_max_free_coroutines(size_t max_free_coroutines) {
+  luaio_coroutine_pool_t *pool = &luaio_coroutine_pool;
+
+  while (pool->free_coroutines > max_free_coroutines) {
+    luaio_coroutine_t *coroutine = &pool->free_list[--pool->free_coroutines];
+    luaL_unref(luaio_coroutine_main, LUA_REGISTRYINDEX, coroutine->ref);
+    pool->releases++;
+  }
+
+  if (max_free_coroutines == 0) {
+    luaio_free(pool->free_list);
+    pool->free_list = NULL;
+    pool->max_free_coroutines = 0;
+    return 0;
+  }
+
+  luaio_coroutine_t *free_list = luaio_realloc(pool->free_list, 
+                                               max_free_coroutines * sizeof(luaio_coroutine_t));
+  if (free_list == NULL) return UV_ENOMEM;
+
+  pool->free_list = free_list;
+  pool->max_free_coroutines = max_free_coroutines;
+  return 0;
+}
+
+const luaio_coroutine_pool_t *luaio_coroutine_get_pool() {
+  return &luaio_coroutine_pool;
+}
+
+/* @overview: take a coroutine from the pool or create a new one,
+ *            the coroutine is kept by ref until luaio_coroutine_free().
+ */
+lua_State *luaio_coroutine_alloc(int *ref) {
+  luaio_coroutine_pool_t *pool = &luaio_coroutine_pool;
+
+  if (pool->free_coroutines > 0) {
+    luaio_coroutine_t *coroutine = &pool->free_list[--pool->free_coroutines];
+    pool->hits++;
+    *ref = coroutine->ref;
+    return coroutine->co;
+  }
+
+  lua_State *L = luaio_coroutine_main;
+  lua_State *co = lua_newthread(L);
+  *ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  pool->misses++;
+  return co;
+}
+
+/* @overview: give back a coroutine, a finished one(returned from its function)
+ *            is reset and cached with its ref, the others are left to the GC.
+ */
+void luaio_coroutine_free(lua_State *co, int ref, int finished) {
+  luaio_coroutine_pool_t *pool = &luaio_coroutine_pool;
+
+  if (finished && pool->free_coroutines < pool->max_free_coroutines) {
+    lua_settop(co, 0);
+    luaio_coroutine_t *coroutine = &pool->free_list[pool->free_coroutines++];
+    coroutine->co = co;
+    coroutine->ref = ref;
+    return;
+  }
+
+  luaL_unref(luaio_coroutine_main, LUA_REGISTRYINDEX, ref);
+  pool->releases++;
+}
@@ -0,0 +1,34 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: pool of finished lua threads, reused by new connections
+ */
+
+#ifndef LUAIO_COROUTINE_H
+#define LUAIO_COROUTINE_H
+
+#include "luaio.h"
+
+typedef struct {
+  lua_State *co;
+  int       ref;
+} luaio_coroutine_t;
+
+typedef struct {
+  luaio_coroutine_t *free_list;
+  size_t            max_free_coroutines;
+  size_t            free_coroutines;
+  uint64_t          hits;      /* coroutines reused from the pool */
+  uint64_t          misses;    /* coroutines created by lua_newthread() */
+  uint64_t          releases;  /* coroutines dropped, pool full or not finished */
+} luaio_coroutine_pool_t;
+
+void luaio_coroutine_init(lua_State *L, size_t max_free_coroutines);
+void luaio_coroutine_destroy();
+int luaio_coroutine_set_max_free_coroutines(size_t max_free_coroutines);
+const luaio_coroutine_pool_t *luaio_coroutine_get_pool();
+
+lua_State *luaio_coroutine_alloc(int *ref);
+void luaio_coroutine_free(lua_State *co, int ref, int finished);
+
+#endif /* LUAIO_COROUTINE_H */
@@ -8,7 +8,6 @@
 #include "luaio.h"
 #include "luaio_init.h"
 
-#define LUAIO_DATE_UTC_SIZE       sizeof("Tue, 10 Nov 2002 23:50:13 GMT") - 1
 #define LUAIO_DATE_LOCAL_SIZE     sizeof("2002-11-10 23:50:13") - 1
 #define IS_NUM(c)                 ((c) >= '0' && (c) <= '9')
 
@@ -68,6 +67,71 @@ void luaio_date_init() {
 #endif
 }
 
+/*Tue, 10 Nov 2002 23:50:13 GMT*/
+static void luaio_date_format_utc(char *buf, struct tm *stm) {
+  int year = stm->tm_year + 1900;
+  int wday = stm->tm_wday;
+  int mday = stm->tm_mday;
+  int mon = stm->tm_mon;
+  int hour = stm->tm_hour;
+  int min = stm->tm_min;
+  int sec = stm->tm_sec;
+  const char *week_day = week[wday];
+  const char *month = months[mon];
+
+  buf[0] = week_day[0];
+  buf[1] = week_day[1];
+  buf[2] = week_day[2];
+  buf[3] = ',';
+  buf[4] = ' ';
+  buf[5] = (mday / 10) + '0';
+  buf[6] = (mday % 10) + '0';
+  buf[7] = ' ';
+  buf[8] = month[0];
+  buf[9] = month[1];
+  buf[10] = month[2];
+  buf[11] = ' ';
+  buf[12] = (year / 1000) +  '0';
+  year %= 1000;
+  buf[13] = (year / 100) + '0';
+  year %= 100;
+  buf[14] = (year / 10) + '0';
+  buf[15] = (year % 10) + '0';
+  buf[16] = ' ';
+  buf[17] = (hour / 10) + '0';
+  buf[18] = (hour % 10) + '0';
+  buf[19] = ':';
+  buf[20] = (min / 10) + '0';
+  buf[21] = (min % 10) + '0';
+  buf[22] = ':';
+  buf[23] = (sec / 10) + '0';
+  buf[24] = (sec % 10) + '0';
+  buf[25] = ' ';
+  buf[26] = 'G';
+  buf[27] = 'M';
+  buf[28] = 'T';
+}
+
+/*Date header of the responses, formatted once per second*/
+static LUAIO_THREAD_LOCAL char luaio_date_http[LUAIO_DATE_UTC_SIZE];
+/* the wall clock second luaio_date_http shows, the cached loop time is not
+ * used since it can lag one loop iteration behind the second boundary.
+ */
+static LUAIO_THREAD_LOCAL time_t luaio_date_http_second = -1;
+
+const char *luaio_date_get_http_date() {
+  time_t t = time(NULL);
+  if (t != luaio_date_http_second) {
+    struct tm tmr;
+    if (gmtime_r(&t, &tmr) != NULL) {
+      luaio_date_format_utc(luaio_date_http, &tmr);
+      luaio_date_http_second = t;
+    }
+  }
+
+  return luaio_date_http;
+}
+
 /*Tue, 10 Nov 2002 23:50:13 GMT*/
 static time_t luaio_date_parse_utc(const char *str, size_t len) {
   uint64_t time;
@@ -469,47 +533,7 @@ static int luaio_date_get_utc_string(lua_State *L) {
     lua_pushnil(L);
   } else {
     char buf[LUAIO_DATE_UTC_SIZE];
-    int year = stm->tm_year + 1900;
-    int wday = stm->tm_wday;
-    int mday = stm->tm_mday;
-    int mon = stm->tm_mon;
-    int hour = stm->tm_hour;
-    int min = stm->tm_min;
-    int sec = stm->tm_sec;
-    const char *week_day = week[wday];
-    const char *month = months[mon];
-
-    buf[0] = week_day[0];
-    buf[1] = week_day[1];
-    buf[2] = week_day[2];
-    buf[3] = ',';
-    buf[4] = ' ';
-    buf[5] = (mday / 10) + '0';
-    buf[6] = (mday % 10) + '0';
-    buf[7] = ' ';
-    buf[8] = month[0];
-    buf[9] = month[1];
-    buf[10] = month[2];
-    buf[11] = ' ';
-    buf[12] = (year / 1000) +  '0';
-    year %= 1000;
-    buf[13] = (year / 100) + '0';
-    year %= 100;
-    buf[14] = (year / 10) + '0';
-    buf[15] = (year % 10) + '0';
-    buf[16] = ' ';
-    buf[17] = (hour / 10) + '0';
-    buf[18] = (hour % 10) + '0';
-    buf[19] = ':';
-    buf[20] = (min / 10) + '0';
-    buf[21] = (min % 10) + '0';
-    buf[22] = ':';
-    buf[23] = (sec / 10) + '0';
-    buf[24] = (sec % 10) + '0';
-    buf[25] = ' ';
-    buf[26] = 'G';
-    buf[27] = 'M';
-    buf[28] = 'T';
+    luaio_date_format_utc(buf, stm);
 
     lua_pushlstring(L, buf, LUAIO_DATE_UTC_SIZE);
   }
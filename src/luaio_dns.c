@@ -6,9 +6,10 @@
 #include "luaio.h"
 #include "luaio_init.h"
 
-static ares_channel luaio_ares_channel;
-static uv_timer_t luaio_ares_timer;
-static luaio_hash_t* luaio_ares_tasks;
+static LUAIO_THREAD_LOCAL ares_channel luaio_ares_channel;
+static LUAIO_THREAD_LOCAL uv_timer_t luaio_ares_timer;
+static LUAIO_THREAD_LOCAL luaio_hash_t* luaio_ares_tasks;
+static LUAIO_THREAD_LOCAL int luaio_ares_destroyed;
 
 typedef struct {
   UV_HANDLE_FIELDS
@@ -43,6 +44,12 @@ static void luaio_ares_poll_close_callback(uv_handle_t *watcher) {
   luaio_hash_int_remove(luaio_ares_tasks, task->sock);
 
   if (!luaio_ares_tasks->items) {
+    if (luaio_ares_destroyed) {
+      luaio_hash_destroy(luaio_ares_tasks);
+      luaio_ares_tasks = NULL;
+      return;
+    }
+
     uv_timer_stop(&luaio_ares_timer);
   }
 }
@@ -84,7 +91,7 @@ static void luaio_ares_sockstate_callback(void *data,
         uv_timer_start(&luaio_ares_timer, luaio_ares_timeout, 1000, 1000);
       }
 
-      task = luaio_ares_task_create(uv_default_loop(), sock);
+      task = luaio_ares_task_create(luaio_get_loop(), sock);
       if (!task) {
         /* This should never happen unless we're out of memory or something */
         /* is seriously wrong. The socket won't be polled, but the the query */
@@ -106,14 +113,21 @@ static void luaio_ares_sockstate_callback(void *data,
   }
 }
 
-void luaio_dns_init(lua_State *L) {
-  uv_loop_t *loop = uv_default_loop();
+/*once per process, before any loop is started*/
+int luaio_dns_global_init() {
   int ret = ares_library_init(ARES_LIB_INIT_ALL);
   if (ret != ARES_SUCCESS) {
-    luaL_error(L, "ares_library_init() error: %s\n", ares_strerror(ret));
-    return;
+    fprintf(stderr, "ares_library_init() error: %s\n", ares_strerror(ret));
+    return -1;
   }
 
+  return 0;
+}
+
+void luaio_dns_init(lua_State *L) {
+  uv_loop_t *loop = luaio_get_loop();
+  int ret;
+
   struct ares_options options;
   luaio_memzero(&options, sizeof(options));
   options.flags = ARES_FLAG_NOCHECKRESP;
@@ -130,6 +144,21 @@ void luaio_dns_init(lua_State *L) {
 
   uv_timer_init(loop, &luaio_ares_timer);
   luaio_ares_tasks = luaio_hash_create_int_pointer(LUAIO_2K_SHIFT, 0);
+  luaio_ares_destroyed = 0;
+}
+
+/* @overview: the loop has stopped, ares_destroy() cancels the pending queries
+ *            and closes their sockets, the tasks are freed by their close callbacks.
+ */
+void luaio_dns_destroy() {
+  luaio_ares_destroyed = 1;
+  ares_destroy(luaio_ares_channel);
+  uv_close((uv_handle_t*)&luaio_ares_timer, NULL);
+
+  if (!luaio_ares_tasks->items) {
+    luaio_hash_destroy(luaio_ares_tasks);
+    luaio_ares_tasks = NULL;
+  }
 }
 
 static void luaio_dns_host2addrs(lua_State *L, struct hostent *host) {
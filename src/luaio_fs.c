@@ -85,7 +85,7 @@ static int luaio_fs_parse_access_mode(lua_State *L, const char *amode, int n) {
   req->current_thread = L;
 
 #define FS_CALL1(name, req, ...) \
-  int ret = uv_fs_##name(uv_default_loop(), &req->req, __VA_ARGS__, luaio_fs_callback); \
+  int ret = uv_fs_##name(luaio_get_loop(), &req->req, __VA_ARGS__, luaio_fs_callback); \
   if (ret < 0) { \
     luaio_pfree(req); \
     lua_pushinteger(L, ret); \
@@ -94,7 +94,7 @@ static int luaio_fs_parse_access_mode(lua_State *L, const char *amode, int n) {
   return lua_yield(L, 0);
 
 #define FS_CALL2(name, req, ...) \
-  int ret = uv_fs_##name(uv_default_loop(), &req->req, __VA_ARGS__, luaio_fs_callback); \
+  int ret = uv_fs_##name(luaio_get_loop(), &req->req, __VA_ARGS__, luaio_fs_callback); \
   if (ret < 0) { \
     luaio_pfree(req); \
     lua_pushnil(L); \
@@ -342,6 +342,7 @@ static int luaio_fs_read(lua_State *L) {
     buffer->end = start + capacity;
   }
 
+  luaio_buffer_before_fill(buffer);
   uv_buf_t buf;
   char *write_pos = buffer->write_pos;
   buf.base = write_pos;
@@ -363,7 +364,7 @@ static int luaio_fs_write(lua_State *L) {
 
   CREATE_REQ1();
   req->bytes = bytes;
-  int err = uv_fs_write(uv_default_loop(), 
+  int err = uv_fs_write(luaio_get_loop(), 
                         &req->req,
                         fd,
                         bufs,
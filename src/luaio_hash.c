@@ -6,6 +6,7 @@
 
 #include "uv.h"
 #include "luaio_hash.h"
+#include "luaio_init.h"
 
 /*double slots size and rehash*/
 static void luaio_hash_rehash(luaio_hash_t *hash) {
@@ -111,7 +112,7 @@ void luaio_hash_str_set(luaio_hash_t *hash, char *key, size_t n, void *pointer)
           luaio_pfree(item->pointer);
           item->pointer = pointer;
           if (hash->max_age) {
-            item->expires = uv_now(uv_default_loop()) + hash->max_age;
+            item->expires = uv_now(luaio_get_loop()) + hash->max_age;
           } else {
             item->expires = 0;
           }
@@ -125,7 +126,7 @@ void luaio_hash_str_set(luaio_hash_t *hash, char *key, size_t n, void *pointer)
   item->pointer = pointer;
   item->hash = hash_key;
   if (hash->max_age) {
-    item->expires = uv_now(uv_default_loop()) + hash->max_age;
+    item->expires = uv_now(luaio_get_loop()) + hash->max_age;
   } else {
     item->expires = 0;
   }
@@ -149,7 +150,7 @@ void *luaio_hash_str_get(luaio_hash_t *hash, const char *key, size_t n) {
       if (item->key_length == n) {
         cmp = hash->str_cmp(item->key, key, n);
         if (!cmp) {
-          if (item->expires && (item->expires < uv_now(uv_default_loop()))) {
+          if (item->expires && (item->expires < uv_now(luaio_get_loop()))) {
             return NULL;
           }
           return item->pointer;
@@ -204,7 +205,7 @@ void luaio_hash_int_set(luaio_hash_t *hash, size_t key, void *pointer) {
         luaio_pfree(item->pointer);
         item->pointer = pointer;
         if (hash->max_age) {
-          item->expires = uv_now(uv_default_loop()) + hash->max_age;
+          item->expires = uv_now(luaio_get_loop()) + hash->max_age;
         } else {
           item->expires = 0;
         }
@@ -217,7 +218,7 @@ void luaio_hash_int_set(luaio_hash_t *hash, size_t key, void *pointer) {
   item->pointer = pointer;
   item->hash = key;
   if (hash->max_age) {
-    item->expires = uv_now(uv_default_loop()) + hash->max_age;
+    item->expires = uv_now(luaio_get_loop()) + hash->max_age;
   } else {
     item->expires = 0;
   }
@@ -235,7 +236,7 @@ void *luaio_hash_int_get(luaio_hash_t *hash, size_t key) {
     luaio_hlist_for_each(pos, slot) {
       item = luaio_list_entry(pos, luaio_hash_item_t, node);
       if (item->hash == key) {
-        if (item->expires && (item->expires < uv_now(uv_default_loop()))) {
+        if (item->expires && (item->expires < uv_now(luaio_get_loop()))) {
           return NULL;
         }
         return item->pointer;
@@ -7,6 +7,10 @@
 #include "luaio.h"
 #include "luaio_init.h"
 #include "luaio_http_parser.h"
+#include "luaio_http_request.h"
+#include "luaio_http_router.h"
+#include "luaio_http_scan.h"
+#include "luaio_stack_buffer.h"
 
 #define luaio_http_check_http_parser(L, name) \
   http_parser_t *parser = lua_touserdata(L, 1); \
@@ -106,6 +110,7 @@ static int luaio_http_parser_parse_status_line(lua_State *L) {
     dist = read_pos - start;
 
     luaio_memmove(start, read_pos, rest_size);
+    buffer->generation++;
     buffer->read_pos = start;
     buffer->write_pos = start + rest_size;
     parser->last_pos = last_pos - dist;
@@ -149,30 +154,7 @@ static int luaio_http_parser_parse_request_line(lua_State *L) {
 
   if (ret == HTTP_OK) {
     http_url_t *url = &parser->url;
-    char *server = url->server.base;
-    size_t length = url->server.len;
-    if (server && length > 0) {
-      ret = http_parse_host(url, server, length, parser->found_at);
-      if (ret) goto BAD_REQUEST;
-    }
-
-    /* host must be present if there is a schema */
-    /* parsing http:///toto will fail */
-    if (url->schema.base != NULL && url->host.base == NULL) goto BAD_REQUEST;
-  
-    /* CONNECT requests can only contain "hostname:port" */
-    if (parser->method == HTTP_CONNECT) {
-      if (url->host.base != NULL && url->port.base != NULL) {
-        if (url->userinfo.base != NULL
-            || url->path.base != NULL 
-            || url->query.base != NULL 
-            || url->fragment.base != NULL) {
-          goto BAD_REQUEST;
-        }
-      } else {
-        goto BAD_REQUEST;
-      }
-    }
+    if (http_check_request_url(parser) != HTTP_OK) goto BAD_REQUEST;
 
     lua_pushinteger(L, parser->method);
     lua_pushinteger(L, parser->http_major);
@@ -243,6 +225,7 @@ static int luaio_http_parser_parse_request_line(lua_State *L) {
     dist = read_pos - start;
  
     luaio_memmove(start, read_pos, rest_size);
+    buffer->generation++;
     buffer->read_pos = start;
     buffer->write_pos = start + rest_size;
     parser->last_pos = last_pos - dist;
@@ -276,7 +259,6 @@ static int luaio_http_parser_parse_request_line(lua_State *L) {
   return 5;
 
 BAD_REQUEST:
-    fprintf(stderr, "test: %d\n", HTTP_BAD_REQUEST);
   lua_pushnil(L);
   lua_pushnil(L);
   lua_pushnil(L);
@@ -300,35 +282,35 @@ static int luaio_http_parser_parse_headers(lua_State *L) {
   luaio_http_check_buffer(L, parse_headers(buffer));
 
   http_buf_t headers[HTTP_MAX_HEADERS_PER_READ * 2];
+  uint8_t ids[HTTP_MAX_HEADERS_PER_READ];
   size_t nheader = 0;
 
   char *start, *last_pos;
   char *read_pos = buffer->read_pos;
   char *write_pos = buffer->write_pos;
-  int ret = http_parse_headers(parser, read_pos, write_pos, headers, &nheader);
+  int ret = http_parse_headers(parser, read_pos, write_pos, headers, ids, &nheader);
   last_pos = parser->last_pos;
 
   assert(nheader <= HTTP_MAX_HEADERS_PER_READ);
   if (nheader > 0) {
     size_t ncookie = lua_rawlen(L, 4);
   
-    char *field, *value;
-    size_t field_len, value_len, field_index, value_index;
+    char *value;
+    size_t value_len, field_index, value_index;
+    uint8_t id;
     for (size_t i = 0; i < nheader; i++) {
       field_index = i << 1;
       value_index = field_index + 1;
-      field = headers[field_index].base;
-      field_len = headers[field_index].len;
       value = headers[value_index].base;
       value_len = headers[value_index].len;
+      id = ids[i];
   
       if (value != NULL) {
-        if ((field_len == 6 && luaio_streq(field, "cookie", 6))
-            || (field_len == 10 && luaio_streq(field, "set-cookie", 10))) {
+        if (id == HTTP_HEADER_COOKIE || id == HTTP_HEADER_SET_COOKIE) {
           lua_pushlstring(L, value, value_len);
-          lua_rawseti(L, 4, ncookie++);
+          lua_rawseti(L, 4, ++ncookie);
         } else {
-          lua_pushlstring(L, field, field_len);
+          luaio_http_push_field(L, &headers[field_index], id);
           lua_pushlstring(L, value, value_len);
           lua_rawset(L, 3);
         }
@@ -371,6 +353,7 @@ static int luaio_http_parser_parse_headers(lua_State *L) {
         read_pos = parser->field.base;
         int rest_size = write_pos - read_pos;
         luaio_memmove(start, read_pos, rest_size);
+        buffer->generation++;
         buffer->read_pos = start;
         write_pos = start + rest_size;
         buffer->write_pos = write_pos;
@@ -391,6 +374,44 @@ static int luaio_http_parser_parse_headers(lua_State *L) {
   return 1;
 }
 
+/* @example: local data, error = http_parser:parse_chunked(read_buffer)
+ * @param: read_buffer {userdate(ReadBuffer)}
+ * @return: data {string} the payload of all the chunks in the buffer, '' if none
+ * @return: error {integer} http.OK(the body has ended), http.AGAIN(read more data and call again) or an error status
+ *
+ * call it after http_parser:parse_headers() has returned http.OK, the
+ * chunks are decoded in place, the bytes parsed are consumed from the buffer.
+ */
+static int luaio_http_parser_parse_chunked(lua_State *L) {
+  luaio_http_check_http_parser(L, parse_chunked(buffer));
+  luaio_http_check_buffer(L, parse_chunked(buffer));
+
+  size_t len = 0;
+  char *read_pos = buffer->read_pos;
+  char *write_pos = buffer->write_pos;
+  int ret = http_parse_chunked(parser, read_pos, write_pos, &len);
+  char *last_pos = parser->last_pos;
+  parser->last_pos = NULL;
+
+  lua_pushlstring(L, read_pos, len);
+  lua_pushinteger(L, ret);
+
+  if (ret != HTTP_OK && ret != HTTP_AGAIN) return 2;
+
+  /*the payload has been moved over the chunk headers*/
+  if (len > 0) buffer->generation++;
+
+  if (last_pos == write_pos) {
+    char *start = buffer->start;
+    buffer->read_pos = start;
+    buffer->write_pos = start;
+  } else {
+    buffer->read_pos = last_pos;
+  }
+
+  return 2;
+}
+
 static int luaio_http_parser_reset(lua_State *L) {
   luaio_http_check_http_parser(L, reset());
   http_parser_init(parser);
@@ -440,6 +461,399 @@ static int luaio_http_parse_url(lua_State *L) {
   return 1;
 }
 
+typedef struct {
+  const char  *base;
+  size_t      len;
+} luaio_http_line_t;
+
+#define luaio_http_status_line(code, reason) \
+  [code] = { "HTTP/1.1 "#code" "reason"\r\n", sizeof("HTTP/1.1 "#code" "reason"\r\n") - 1 },
+
+static const luaio_http_line_t luaio_http_status_lines[HTTP_MAX_STATUS + 1] = {
+  HTTP_STATUS_MAP(luaio_http_status_line)
+};
+
+#undef luaio_http_status_line
+
+/*"HTTP/1.1 xxx \r\n", the reason phrase of an unlisted status is empty(rfc7230 3.1.2)*/
+#define LUAIO_HTTP_STATUS_LINE_SIZE   (sizeof("HTTP/1.1 xxx \r\n") - 1)
+#define LUAIO_HTTP_DATE_SIZE          (sizeof("Date: \r\n") - 1 + LUAIO_DATE_UTC_SIZE)
+#define LUAIO_HTTP_LENGTH_SIZE        (sizeof("Content-Length: \r\n") - 1)
+#define LUAIO_HTTP_MAX_CHUNK_SIZE     (sizeof("ffffffffffffffff\r\n\r\n") - 1)
+
+#define luaio_http_append(p, str, len) \
+  luaio_memcpy(p, str, len); \
+  p += len;
+
+#define luaio_http_append_literal(p, str) \
+  luaio_memcpy(p, str, sizeof(str) - 1); \
+  p += sizeof(str) - 1;
+
+static size_t luaio_http_format_dec(char *p, uint64_t n) {
+  char buf[20];
+  size_t i = sizeof(buf);
+
+  do {
+    buf[--i] = (char)('0' + n % 10);
+    n /= 10;
+  } while (n);
+
+  size_t len = sizeof(buf) - i;
+  luaio_memcpy(p, buf + i, len);
+  return len;
+}
+
+static size_t luaio_http_format_hex(char *p, uint64_t n) {
+  static const char hex[] = "0123456789abcdef";
+  char buf[16];
+  size_t i = sizeof(buf);
+
+  do {
+    buf[--i] = hex[n & 0xf];
+    n >>= 4;
+  } while (n);
+
+  size_t len = sizeof(buf) - i;
+  luaio_memcpy(p, buf + i, len);
+  return len;
+}
+
+/*length of a string, buffer or slice, -1 for other values*/
+static int64_t luaio_http_data_length(lua_State *L, int index) {
+  int type = lua_type(L, index);
+  if (type == LUA_TSTRING) {
+    return (int64_t)lua_rawlen(L, index);
+  }
+
+  if (type != LUA_TUSERDATA) return -1;
+
+  luaio_buffer_t *buffer = lua_touserdata(L, index);
+  if (buffer->type == LUAIO_TYPE_BUFFER_SLICE) {
+    luaio_buffer_slice_t *slice = (luaio_buffer_slice_t*)buffer;
+    return luaio_buffer_slice_is_stale(slice) ? -1 : (int64_t)slice->len;
+  }
+
+  if (!luaio_is_buffer(buffer->type)) return -1;
+
+  return (int64_t)(buffer->write_pos - buffer->read_pos);
+}
+
+/*length of a body as socket:write(data) takes it, -1 for other values*/
+static int64_t luaio_http_body_length(lua_State *L, int index) {
+  if (lua_type(L, index) != LUA_TTABLE) {
+    return luaio_http_data_length(L, index);
+  }
+
+  int64_t bytes = 0;
+  size_t count = lua_rawlen(L, index);
+  for (size_t i = 1; i <= count; ++i) {
+    lua_rawgeti(L, index, i);
+    int64_t len = luaio_http_data_length(L, -1);
+    lua_pop(L, 1);
+    if (len < 0) return -1;
+    bytes += len;
+  }
+
+  return bytes;
+}
+
+/*room for len more bytes at buffer->write_pos, the unsent bytes are moved to the start if needed*/
+static char *luaio_http_buffer_reserve(luaio_buffer_t *buffer, size_t len) {
+  char *write_pos = buffer->write_pos;
+  if (write_pos + len <= buffer->end) return write_pos;
+
+  char *read_pos = buffer->read_pos;
+  size_t rest_size = write_pos - read_pos;
+  if (rest_size + len > buffer->capacity) return NULL;
+
+  char *start = buffer->start;
+  luaio_memmove(start, read_pos, rest_size);
+  buffer->read_pos = start;
+  buffer->write_pos = start + rest_size;
+  buffer->generation++;
+  return buffer->write_pos;
+}
+
+#define luaio_http_check_write_buffer(L, name) \
+  luaio_buffer_t *buffer = NULL; \
+  if (!lua_isnil(L, 1)) { \
+    buffer = lua_touserdata(L, 1); \
+    if (buffer == NULL || buffer->type != LUAIO_TYPE_WRITE_BUFFER) { \
+      return luaL_argerror(L, 1, "http_native."#name" error: buffer must be [nil|WriteBuffer]\n"); \
+    } \
+    \
+    if (buffer->capacity == 0) { \
+      return luaL_argerror(L, 1, "http_native."#name" error: buffer has no memory available\n"); \
+    } \
+  }
+
+/* reserve len bytes for the output, in the WriteBuffer if there is one, in the
+ * stack buffer otherwise.
+ */
+#define luaio_http_output_start(L, len) \
+  luaio_stack_buffer_t stack_buf; \
+  char *start; \
+  if (buffer != NULL) { \
+    start = luaio_http_buffer_reserve(buffer, len); \
+    if (start == NULL) { \
+      lua_pushinteger(L, LUAIO_EXCEED_BUFFER_CAPACITY); \
+      return 1; \
+    } \
+  } else { \
+    start = luaio_stack_buffer_init(&stack_buf, len); \
+    if (start == NULL) { \
+      return luaL_error(L, "http_native: no memory available\n"); \
+    } \
+  } \
+  char *p = start;
+
+/*bytes written into the WriteBuffer, or the string written*/
+#define luaio_http_output_end(L) \
+  if (buffer != NULL) { \
+    buffer->write_pos = p; \
+    lua_pushinteger(L, p - start); \
+  } else { \
+    lua_pushlstring(L, start, p - start); \
+    luaio_stack_buffer_free(&stack_buf); \
+  } \
+  return 1;
+
+#define luaio_http_is_header(name, len, str) \
+  ((len) == sizeof(str) - 1 && strncasecmp(name, str, sizeof(str) - 1) == 0)
+
+#define luaio_http_has_crlf(str, len) \
+  (memchr(str, '\r', len) != NULL || memchr(str, '\n', len) != NULL)
+
+/*a header name has no ':', no whitespace and no control characters*/
+static int luaio_http_is_header_name(const char *name, size_t len) {
+  if (len == 0) return 0;
+
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = name[i];
+    if (c <= ' ' || c == ':' || c == 0x7f) return 0;
+  }
+
+  return 1;
+}
+
+/*bytes of "name: value\r\n" for a string or number value, -1 for other values*/
+static int64_t luaio_http_header_length(lua_State *L, size_t name_len, int index) {
+  int type = lua_type(L, index);
+  if (type != LUA_TSTRING && type != LUA_TNUMBER) return -1;
+
+  size_t len;
+  const char *value = lua_tolstring(L, index, &len);
+  if (luaio_http_has_crlf(value, len)) return -1;
+
+  return name_len + len + 4;
+}
+
+static char *luaio_http_write_header(lua_State *L, char *p, const char *name, size_t name_len, int index) {
+  size_t len;
+  const char *value = lua_tolstring(L, index, &len);
+  luaio_http_append(p, name, name_len);
+  luaio_http_append_literal(p, ": ");
+  luaio_http_append(p, value, len);
+  luaio_http_append_literal(p, "\r\n");
+  return p;
+}
+
+/* @example: local bytes = http_native.write_head(buffer, status, headers, body)
+ *           local head = http_native.write_head(nil, status, headers, body)
+ * @param buffer {nil|WriteBuffer}
+ * @param status {integer} 100 - 599
+ * @param headers {nil|table} name = value, value is string, number or array of them
+ * @param body {nil|integer|string|buffer|slice|table} the Content-Length,
+ *    nil for a body without length(Transfer-Encoding: chunked, 204, 304 ...)
+ * @return bytes {integer} bytes written, LUAIO_EXCEED_BUFFER_CAPACITY if the
+ *    WriteBuffer has no room for the head
+ *         head {string} if buffer is nil
+ * Date is added unless headers has one, Content-Length unless headers has it
+ * or Transfer-Encoding.
+ */
+static int luaio_http_write_head(lua_State *L) {
+  luaio_http_check_write_buffer(L, write_head(buffer, status, headers, body));
+
+  lua_Integer status = luaL_checkinteger(L, 2);
+  if (status < HTTP_MIN_STATUS || status > HTTP_MAX_STATUS) {
+    return luaL_argerror(L, 2, "http_native.write_head(buffer, status, headers, body) error: status must be in [100, 599]\n");
+  }
+
+  int has_headers = 0;
+  int type = lua_type(L, 3);
+  if (type == LUA_TTABLE) {
+    has_headers = 1;
+  } else if (type != LUA_TNIL && type != LUA_TNONE) {
+    return luaL_argerror(L, 3, "http_native.write_head(buffer, status, headers, body) error: headers must be [nil|table]\n");
+  }
+
+  int64_t content_length = -1;
+  type = lua_type(L, 4);
+  if (type == LUA_TNUMBER) {
+    lua_Integer n = lua_tointeger(L, 4);
+    if (n < 0) {
+      return luaL_argerror(L, 4, "http_native.write_head(buffer, status, headers, body) error: body length must be >= 0\n");
+    }
+    content_length = n;
+  } else if (type != LUA_TNIL && type != LUA_TNONE) {
+    content_length = luaio_http_body_length(L, 4);
+    if (content_length < 0) {
+      return luaL_argerror(L, 4, "http_native.write_head(buffer, status, headers, body) error: body must be [nil|integer|string|buffer|slice|table(string|buffer|slice)]\n");
+    }
+  }
+
+  const luaio_http_line_t *line = &luaio_http_status_lines[status];
+  size_t len = line->len ? line->len : LUAIO_HTTP_STATUS_LINE_SIZE;
+  int has_date = 0;
+  int has_length = 0;
+
+  /*pass 1: check the headers and count the bytes*/
+  if (has_headers) {
+    lua_pushnil(L);
+    while (lua_next(L, 3)) {
+      if (lua_type(L, -2) != LUA_TSTRING) {
+        return luaL_error(L, "http_native.write_head(buffer, status, headers, body) error: header name must be string\n");
+      }
+
+      size_t name_len;
+      const char *name = lua_tolstring(L, -2, &name_len);
+      if (!luaio_http_is_header_name(name, name_len)) {
+        return luaL_error(L, "http_native.write_head(buffer, status, headers, body) error: invalid header name\n");
+      }
+
+      if (luaio_http_is_header(name, name_len, "date")) {
+        has_date = 1;
+      } else if (luaio_http_is_header(name, name_len, "content-length") ||
+                 luaio_http_is_header(name, name_len, "transfer-encoding")) {
+        has_length = 1;
+      }
+
+      int64_t bytes = 0;
+      if (lua_type(L, -1) == LUA_TTABLE) {
+        size_t count = lua_rawlen(L, -1);
+        for (size_t i = 1; i <= count; ++i) {
+          lua_rawgeti(L, -1, i);
+          bytes = luaio_http_header_length(L, name_len, -1);
+          lua_pop(L, 1);
+          if (bytes < 0) break;
+          len += bytes;
+        }
+      } else {
+        bytes = luaio_http_header_length(L, name_len, -1);
+        len += bytes;
+      }
+
+      if (bytes < 0) {
+        return luaL_error(L, "http_native.write_head(buffer, status, headers, body) error: %s must be string, number or array of them without CR LF\n", name);
+      }
+
+      lua_pop(L, 1);
+    }
+  }
+
+  if (!has_date) len += LUAIO_HTTP_DATE_SIZE;
+  if (!has_length && content_length >= 0) len += LUAIO_HTTP_LENGTH_SIZE + 20;
+  len += 2;
+
+  luaio_http_output_start(L, len);
+
+  /*pass 2: write the head*/
+  if (line->len) {
+    luaio_http_append(p, line->base, line->len);
+  } else {
+    luaio_http_append_literal(p, "HTTP/1.1 ");
+    p += luaio_http_format_dec(p, status);
+    luaio_http_append_literal(p, " \r\n");
+  }
+
+  if (has_headers) {
+    lua_pushnil(L);
+    while (lua_next(L, 3)) {
+      size_t name_len;
+      const char *name = lua_tolstring(L, -2, &name_len);
+
+      if (lua_type(L, -1) == LUA_TTABLE) {
+        size_t count = lua_rawlen(L, -1);
+        for (size_t i = 1; i <= count; ++i) {
+          lua_rawgeti(L, -1, i);
+          p = luaio_http_write_header(L, p, name, name_len, -1);
+          lua_pop(L, 1);
+        }
+      } else {
+        p = luaio_http_write_header(L, p, name, name_len, -1);
+      }
+
+      lua_pop(L, 1);
+    }
+  }
+
+  if (!has_date) {
+    luaio_http_append_literal(p, "Date: ");
+    luaio_http_append(p, luaio_date_get_http_date(), LUAIO_DATE_UTC_SIZE);
+    luaio_http_append_literal(p, "\r\n");
+  }
+
+  if (!has_length && content_length >= 0) {
+    luaio_http_append_literal(p, "Content-Length: ");
+    p += luaio_http_format_dec(p, content_length);
+    luaio_http_append_literal(p, "\r\n");
+  }
+
+  luaio_http_append_literal(p, "\r\n");
+
+  luaio_http_output_end(L);
+}
+
+/* @example: local bytes = http_native.write_chunk(buffer, data)
+ *           local chunk = http_native.write_chunk(nil, data)
+ * @param buffer {nil|WriteBuffer}
+ * @param data {nil|string|buffer|slice} nil or empty for the last chunk
+ * @return bytes {integer} bytes written, LUAIO_EXCEED_BUFFER_CAPACITY if the
+ *    WriteBuffer has no room for the chunk
+ *         chunk {string} if buffer is nil
+ */
+static int luaio_http_write_chunk(lua_State *L) {
+  luaio_http_check_write_buffer(L, write_chunk(buffer, data));
+
+  int64_t data_len = 0;
+  if (!lua_isnoneornil(L, 2)) {
+    data_len = luaio_http_data_length(L, 2);
+    if (data_len < 0) {
+      return luaL_argerror(L, 2, "http_native.write_chunk(buffer, data) error: data must be [nil|string|buffer|slice]\n");
+    }
+  }
+
+  const char *data = NULL;
+  if (data_len > 0) {
+    if (lua_type(L, 2) == LUA_TSTRING) {
+      data = lua_tostring(L, 2);
+    } else {
+      luaio_buffer_t *data_buffer = lua_touserdata(L, 2);
+      if (data_buffer->type == LUAIO_TYPE_BUFFER_SLICE) {
+        data = ((luaio_buffer_slice_t*)data_buffer)->base;
+      } else {
+        data = data_buffer->read_pos;
+      }
+    }
+  }
+
+  /*the data may be the unsent bytes of the WriteBuffer itself*/
+  if (buffer != NULL && data != NULL && data >= buffer->start && data < buffer->end) {
+    return luaL_argerror(L, 2, "http_native.write_chunk(buffer, data) error: data must not be in the buffer\n");
+  }
+
+  luaio_http_output_start(L, LUAIO_HTTP_MAX_CHUNK_SIZE + data_len);
+
+  p += luaio_http_format_hex(p, data_len);
+  luaio_http_append_literal(p, "\r\n");
+  if (data_len > 0) {
+    luaio_http_append(p, data, (size_t)data_len);
+  }
+  luaio_http_append_literal(p, "\r\n");
+
+  luaio_http_output_end(L);
+}
+
 static void luaio_http_setup_constants(lua_State *L) {
 #define XX(num, name, _) \
   lua_pushinteger(L, num); \
@@ -448,6 +862,13 @@ static void luaio_http_setup_constants(lua_State *L) {
   HTTP_METHOD_MAP(XX)
 #undef XX
 
+#define XX(num, name, _) \
+  lua_pushinteger(L, num); \
+  lua_setfield(L, -2, "HEADER_"#name);
+
+  HTTP_HEADER_MAP(XX)
+#undef XX
+
   lua_pushinteger(L, HTTP_OK);
   lua_setfield(L, -2, "OK");
 
@@ -459,27 +880,50 @@ static void luaio_http_setup_constants(lua_State *L) {
 
   lua_pushinteger(L, HTTP_ERROR);
   lua_setfield(L, -2, "ERROR");
+
+  lua_pushstring(L, http_scan_level_name(http_scan_level()));
+  lua_setfield(L, -2, "simd");
 }
 
 int luaopen_http(lua_State *L) {
+#ifdef DEBUG
+  http_header_slots_check();
+#endif
+
+  /*names of the known headers, shared by the functions which push header fields*/
+  luaio_http_push_header_names(L);
+  int names = lua_gettop(L);
+
   /*http_Parser metatable*/
   luaL_Reg http_parser_mtlib[] = {
     { "parse_status_line", luaio_http_parser_parse_status_line },
     { "parse_request_line", luaio_http_parser_parse_request_line },
-    { "parse_headers", luaio_http_parser_parse_headers },
+    { "parse_request", luaio_http_parser_parse_request },
+    { "parse_chunked", luaio_http_parser_parse_chunked },
     { "reset", luaio_http_parser_reset },
     { NULL, NULL }
   };
 
   lua_pushlightuserdata(L, &luaio_http_parser_metatable_key);
   luaL_newlib(L, http_parser_mtlib);
+  lua_pushvalue(L, names);
+  lua_pushcclosure(L, luaio_http_parser_parse_headers, 1);
+  lua_setfield(L, -2, "parse_headers");
   lua_pushvalue(L, -1);
   lua_setfield(L, -2, "__index");
   lua_rawset(L, LUA_REGISTRYINDEX);
 
+  luaio_http_request_init(L, names);
+  lua_pop(L, 1);
+
+  luaio_http_router_init(L);
+
   luaL_Reg lib[] = {
     { "new_parser", luaio_http_new_parser },
+    { "new_router", luaio_http_new_router },
     { "parse_url", luaio_http_parse_url },
+    { "write_head", luaio_http_write_head },
+    { "write_chunk", luaio_http_write_chunk },
     { "__newindex", luaio_cannot_change },
     { NULL, NULL }
   };
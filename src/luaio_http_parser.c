@@ -7,6 +7,7 @@
  */
 
 #include "luaio_http_parser.h"
+#include "luaio_http_scan.h"
 #include <assert.h>
 #include <stddef.h>
 #include <ctype.h>
@@ -214,6 +215,19 @@ enum state {
   s_headers_almost_done
 };
 
+enum http_chunked_state {
+  s_chunk_start = 0,
+  s_chunk_size,
+  s_chunk_extension,
+  s_chunk_size_almost_done,
+  s_chunk_data,
+  s_chunk_data_almost_done,
+  s_chunk_data_done,
+  s_chunk_trailer_start,
+  s_chunk_trailer,
+  s_chunk_almost_done
+};
+
 enum http_host_state {
   s_http_userinfo_start,
   s_http_userinfo,
@@ -269,6 +283,17 @@ enum http_host_state {
 # define STRICT_CHECK(cond, error)
 #endif
 
+/*skip the run a SIMD scanner passes, the byte it stops at goes through the switch*/
+#define SCAN(scan, max, error)                                         \
+  do {                                                                 \
+    size_t skip = scan(p + 1, last);                                   \
+    p += skip;                                                         \
+    parser->nread += skip;                                             \
+    if (UNLIKELY(parser->nread > (max))) {                             \
+      RETURN(error);                                                   \
+    }                                                                  \
+  } while (0)
+
 
 void http_parser_init(http_parser_t *parser) {
   memset(parser, 0, sizeof(http_parser_t));
@@ -756,7 +781,12 @@ int http_parse_request_line(http_parser_t *parser, char *data, char *last) {
 
       case s_req_path:
       {
-        if (IS_URL_CHAR(ch)) break;
+        if (IS_URL_CHAR(ch)) {
+          if (http_scan_path != NULL) {
+            SCAN(http_scan_path, HTTP_MAX_REQUEST_LINE_SIZE, HTTP_REQUEST_URI_TOO_LARGE);
+          }
+          break;
+        }
 
         switch (ch) {
           case '?':
@@ -825,6 +855,9 @@ int http_parse_request_line(http_parser_t *parser, char *data, char *last) {
       case s_req_query_string:
       {
         if (IS_URL_CHAR(ch) || ch == '?') {
+          if (http_scan_query != NULL) {
+            SCAN(http_scan_query, HTTP_MAX_REQUEST_LINE_SIZE, HTTP_REQUEST_URI_TOO_LARGE);
+          }
           break;
         }
 
@@ -1042,10 +1075,123 @@ int http_parse_request_line(http_parser_t *parser, char *data, char *last) {
   return HTTP_AGAIN;
 }
 
+/*length, first, second and last but one bytes, no two known names share them*/
+#define HTTP_HEADER_KEY(name, len)                                     \
+  ((uint32_t)(len) << 24                                               \
+   | (uint32_t)(unsigned char)(name)[0] << 16                          \
+   | (uint32_t)(unsigned char)(name)[1] << 8                           \
+   | (uint32_t)(unsigned char)(name)[(len) - 2])
+#define HTTP_HEADER_SEED_SLOT(key, seed)                               \
+  ((((uint32_t)(key) ^ (uint32_t)(seed)) * 0x9E3779B1U) >> 24)
+#define HTTP_HEADER_SLOT(key) HTTP_HEADER_SEED_SLOT(key, HTTP_HEADER_HASH_SEED)
+
+typedef struct {
+  const char  *name;
+  size_t      len;
+} http_header_name_t;
+
+static const http_header_name_t http_header_names[HTTP_HEADER_MAX] = {
+  { NULL, 0 },
+#define XX(num, name, string) { string, sizeof(string) - 1 },
+  HTTP_HEADER_MAP(XX)
+#undef XX
+};
+
+/* HTTP_HEADER_SLOT(HTTP_HEADER_KEY(name)) => enum http_header,
+ * no two known names share a slot with HTTP_HEADER_HASH_SEED.
+ * made by http_header_slots_check(), see below.
+ */
+static const uint8_t http_header_slots[256] = {
+   0, 44,  0, 72, 71,  0,  0,  0,  0,  0, 68,  0,  0,  0,  9,  0,
+   0,  0,  0, 52, 35, 27, 15, 40, 58,  0,  0, 12,  0,  0,  0, 49,
+   0,  0,  0,  0, 28, 66,  0,  0,  0, 75,  0,  0, 61, 62,  0, 26,
+   0,  0, 48,  0,  0,  0,  0,  0, 69,  0,  0,  0, 43,  0, 18,  0,
+   0,  0, 24,  0,  0,  0,  0, 70, 17, 57,  0, 63,  0, 36,  0, 51,
+   0,  0,  0,  0,  0, 21,  0,  0,  0, 31, 32,  0,  0,  0, 33,  0,
+   0,  0,  0, 59, 23,  0,  0,  0,  0,  0, 10,  0,  6,  0,  3,  0,
+   0, 46,  0,  0,  0, 22,  0, 19,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0,  0, 53,  0,  0,  0,  0, 37,  2,  0, 25, 42,  0,  0,
+  14, 16,  0,  0, 74,  0,  0,  0,  0,  8, 64, 38,  0,  0,  0,  0,
+   0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 34,  0, 39,
+   0,  0,  0, 55,  0,  0,  0,  0,  0,  7, 13,  0, 45,  0, 54,  0,
+   1, 60,  0,  0,  0, 20,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+   0,  0,  0, 50,  0, 11,  0, 41,  0,  5, 73,  0,  0,  0,  0,  0,
+   0, 29,  0,  0, 30,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 65,
+   0,  0,  0,  0, 47,  0,  0,  0,  0, 67, 56,  0,  0,  0,  4,  0,
+};
+
+#ifdef DEBUG
+/*the slots of the known names with seed, -1 if two of them share one*/
+static int http_header_slots_build(uint32_t seed, uint8_t *slots) {
+  memset(slots, 0, 256);
+  for (int id = HTTP_HEADER_UNKNOWN + 1; id < HTTP_HEADER_MAX; id++) {
+    const http_header_name_t *header = &http_header_names[id];
+    uint32_t slot = HTTP_HEADER_SEED_SLOT(HTTP_HEADER_KEY(header->name, header->len), seed);
+    if (slots[slot] != HTTP_HEADER_UNKNOWN) return -1;
+    slots[slot] = id;
+  }
+
+  return 0;
+}
+
+/* @overview: a debug build checks http_header_slots against HTTP_HEADER_MAP at
+ *            startup. when a header has been added or renamed, it searches a
+ *            seed without collisions, prints it with the table to paste here
+ *            and aborts.
+ */
+void http_header_slots_check(void) {
+  uint8_t slots[256];
+  if (http_header_slots_build(HTTP_HEADER_HASH_SEED, slots) == 0 &&
+      memcmp(slots, http_header_slots, sizeof(slots)) == 0) {
+    return;
+  }
+
+  uint32_t seed;
+  for (seed = 1; seed < (1U << 26); seed++) {
+    if (http_header_slots_build(seed, slots) == 0) break;
+  }
+
+  if (seed == (1U << 26)) {
+    fprintf(stderr, "http_header_slots: no seed found, two names share HTTP_HEADER_KEY\n");
+    abort();
+  }
+
+  fprintf(stderr, "http_header_slots: out of date, use\n#define HTTP_HEADER_HASH_SEED %u\n", seed);
+  for (int i = 0; i < 256; i++) {
+    fprintf(stderr, "%s%2d,%s", i % 16 == 0 ? "  " : " ", slots[i], i % 16 == 15 ? "\n" : "");
+  }
+  abort();
+}
+#endif
+
+/* @overview: enum http_header of a lower case header name, HTTP_HEADER_UNKNOWN if
+ *            it is not a known header.
+ */
+int http_header_lookup(const char *name, size_t len) {
+  if (len < 2) return HTTP_HEADER_UNKNOWN;
+
+  int id = http_header_slots[HTTP_HEADER_SLOT(HTTP_HEADER_KEY(name, len))];
+  if (id == HTTP_HEADER_UNKNOWN) return id;
+
+  const http_header_name_t *header = &http_header_names[id];
+  if (header->len != len || memcmp(header->name, name, len) != 0) return HTTP_HEADER_UNKNOWN;
+
+  return id;
+}
+
+/* @overview: lower case name of a known header, NULL if id is unknown */
+const char *http_header_name(int id, size_t *len) {
+  if (id <= HTTP_HEADER_UNKNOWN || id >= HTTP_HEADER_MAX) return NULL;
+
+  *len = http_header_names[id].len;
+  return http_header_names[id].name;
+}
+
 int http_parse_headers(http_parser_t *parser, 
                        char *data, 
                        char *last,
                        http_buf_t* headers,
+                       uint8_t *ids,
                        size_t *n) {
   char ch, c;
   char *p, *find, *base;
@@ -1095,6 +1241,7 @@ int http_parse_headers(http_parser_t *parser,
       {
         if (ch == ':') {
           parser->field.len = p - parser->field.base;
+          parser->field_id = http_header_lookup(parser->field.base, parser->field.len);
           ++parser->index;
           UPDATE_STATE(s_header_space_before_value);
           break;
@@ -1106,6 +1253,9 @@ int http_parse_headers(http_parser_t *parser,
         }
 
         *p = c;
+        if (http_scan_field != NULL) {
+          SCAN(http_scan_field, HTTP_MAX_HEADER_SIZE, HTTP_BAD_REQUEST);
+        }
         break;
       }
 
@@ -1123,6 +1273,7 @@ int http_parse_headers(http_parser_t *parser,
           value_index = field_index + 1;
           headers[field_index].base = parser->field.base;
           headers[field_index].len = parser->field.len;
+          if (ids != NULL) ids[nheader] = parser->field_id;
           headers[value_index].base = NULL;
           headers[value_index].len = 0;
           parser->index = 0;
@@ -1167,6 +1318,7 @@ int http_parse_headers(http_parser_t *parser,
           value_index = field_index + 1;
           headers[field_index].base = parser->field.base;
           headers[field_index].len = parser->field.len;
+          if (ids != NULL) ids[nheader] = parser->field_id;
           headers[value_index].base = base;
           headers[value_index].len = find - base + 1;
           parser->index = 0;
@@ -1197,6 +1349,7 @@ int http_parse_headers(http_parser_t *parser,
         value_index = field_index + 1;
         headers[field_index].base = parser->field.base;
         headers[field_index].len = parser->field.len;
+        if (ids != NULL) ids[nheader] = parser->field_id;
         headers[value_index].base = NULL;
         headers[value_index].len = 0;
         parser->index = 0;
@@ -1235,6 +1388,207 @@ int http_parse_headers(http_parser_t *parser,
   return HTTP_AGAIN;
 }
 
+/* @overview: decode a chunked body in place, the payload is moved to the
+ *            front of [data, last) so the chunks come out as one range.
+ *            chunk extensions and trailers are checked and skipped.
+ * @param: len {size_t*} payload bytes written at data
+ * @return: HTTP_OK(the last chunk and the trailers have been parsed),
+ *          HTTP_AGAIN or HTTP_BAD_REQUEST, parser->last_pos is the end of
+ *          the bytes parsed.
+ */
+int http_parse_chunked(http_parser_t *parser, char *data, char *last, size_t *len) {
+  char ch;
+  char *p, *find;
+  char *out = data;
+  uint64_t size = parser->chunk_size;
+  size_t n;
+  enum http_chunked_state p_state = (enum http_chunked_state) parser->state;
+
+  assert(data <= last);
+
+  for (p = data; p < last; p++) {
+    ch = *p;
+    parser->nread++;
+    if (UNLIKELY(parser->nread > HTTP_MAX_HEADER_SIZE)) {
+      *len = out - data;
+      RETURN(HTTP_BAD_REQUEST);
+    }
+
+    switch (CURRENT_STATE()) {
+      case s_chunk_start:
+      {
+        if (UNLIKELY(!IS_HEX(ch))) {
+          *len = out - data;
+          RETURN(HTTP_BAD_REQUEST);
+        }
+
+        size = unhex[(unsigned char)ch];
+        p_state = s_chunk_size;
+        break;
+      }
+
+      case s_chunk_size:
+      {
+        if (IS_HEX(ch)) {
+          if (UNLIKELY(size > (UINT64_MAX >> 4))) {
+            *len = out - data;
+            RETURN(HTTP_BAD_REQUEST);
+          }
+
+          size = (size << 4) + unhex[(unsigned char)ch];
+          break;
+        }
+
+        if (ch == CR) {
+          p_state = s_chunk_size_almost_done;
+          break;
+        }
+
+        if (ch == LF) goto chunk_size_done;
+
+        if (ch == ';' || ch == ' ' || ch == '\t') {
+          p_state = s_chunk_extension;
+          break;
+        }
+
+        *len = out - data;
+        RETURN(HTTP_BAD_REQUEST);
+      }
+
+      case s_chunk_extension:
+      {
+        find = memchr(p, LF, last - p);
+        if (find == NULL) {
+          parser->nread += last - p - 1;
+          p = last - 1;
+          break;
+        }
+
+        parser->nread += find - p;
+        p = find;
+        goto chunk_size_done;
+      }
+
+      case s_chunk_size_almost_done:
+      {
+        if (UNLIKELY(ch != LF)) {
+          *len = out - data;
+          RETURN(HTTP_BAD_REQUEST);
+        }
+
+chunk_size_done:
+        parser->nread = 0;
+        if (size == 0) {
+          p_state = s_chunk_trailer_start;
+        } else {
+          p_state = s_chunk_data;
+        }
+        break;
+      }
+
+      case s_chunk_data:
+      {
+        n = last - p;
+        if (size < n) n = (size_t)size;
+
+        if (out != p) memmove(out, p, n);
+        out += n;
+        p += n - 1;
+        size -= n;
+        parser->nread = 0;
+        if (size == 0) p_state = s_chunk_data_almost_done;
+        break;
+      }
+
+      case s_chunk_data_almost_done:
+      {
+        if (ch == CR) {
+          p_state = s_chunk_data_done;
+          break;
+        }
+
+        if (ch == LF) {
+          p_state = s_chunk_start;
+          break;
+        }
+
+        *len = out - data;
+        RETURN(HTTP_BAD_REQUEST);
+      }
+
+      case s_chunk_data_done:
+      {
+        if (UNLIKELY(ch != LF)) {
+          *len = out - data;
+          RETURN(HTTP_BAD_REQUEST);
+        }
+
+        p_state = s_chunk_start;
+        break;
+      }
+
+      case s_chunk_trailer_start:
+      {
+        if (ch == CR) {
+          p_state = s_chunk_almost_done;
+          break;
+        }
+
+        if (ch == LF) goto chunked_done;
+
+        if (UNLIKELY(!TOKEN(ch))) {
+          *len = out - data;
+          RETURN(HTTP_BAD_REQUEST);
+        }
+
+        p_state = s_chunk_trailer;
+        break;
+      }
+
+      case s_chunk_trailer:
+      {
+        find = memchr(p, LF, last - p);
+        if (find == NULL) {
+          parser->nread += last - p - 1;
+          p = last - 1;
+          break;
+        }
+
+        parser->nread += find - p;
+        p = find;
+        p_state = s_chunk_trailer_start;
+        break;
+      }
+
+      case s_chunk_almost_done:
+      {
+        if (UNLIKELY(ch != LF)) {
+          *len = out - data;
+          RETURN(HTTP_BAD_REQUEST);
+        }
+
+chunked_done:
+        parser->nread = 0;
+        parser->chunk_size = 0;
+        *len = out - data;
+        p_state = s_chunk_start;
+        RETURN(HTTP_OK);
+      }
+
+      default:
+        assert(0 && "unhandled state");
+        *len = out - data;
+        RETURN(HTTP_BAD_REQUEST);
+    }
+  }
+
+  *len = out - data;
+  parser->chunk_size = size;
+  parser->state = CURRENT_STATE();
+  parser->last_pos = p;
+  return HTTP_AGAIN;
+}
+
 int http_parse_host(http_url_t *url, char *data, size_t len, uint8_t found_at) {
   char ch;
   char *p;
@@ -1659,3 +2013,36 @@ int http_parse_url(http_url_t *url, char *data, size_t len, int is_connect) {
 
   return HTTP_OK;
 }
+
+/* @overview: split the server part of the request url parsed by
+ *            http_parse_request_line() and check it against the method.
+ * @return: HTTP_OK or HTTP_BAD_REQUEST
+ */
+int http_check_request_url(http_parser_t *parser) {
+  http_url_t *url = &parser->url;
+  char *server = url->server.base;
+  size_t length = url->server.len;
+  if (server && length > 0) {
+    if (http_parse_host(url, server, length, parser->found_at)) return HTTP_BAD_REQUEST;
+  }
+
+  /* host must be present if there is a schema */
+  /* parsing http:///toto will fail */
+  if (url->schema.base != NULL && url->host.base == NULL) return HTTP_BAD_REQUEST;
+
+  /* CONNECT requests can only contain "hostname:port" */
+  if (parser->method == HTTP_CONNECT) {
+    if (url->host.base != NULL && url->port.base != NULL) {
+      if (url->userinfo.base != NULL
+          || url->path.base != NULL 
+          || url->query.base != NULL 
+          || url->fragment.base != NULL) {
+        return HTTP_BAD_REQUEST;
+      }
+    } else {
+      return HTTP_BAD_REQUEST;
+    }
+  }
+
+  return HTTP_OK;
+}
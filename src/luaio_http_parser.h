@@ -89,6 +89,168 @@ enum http_method {
 };
 
 
+/* Known headers, the names are lower case as http_parse_headers() leaves them.
+ * http_parse_headers() maps every field name to enum http_header when it
+ * reaches the ':', through a perfect hash of the length and the first, second
+ * and last but one bytes of the name(HTTP_HEADER_KEY) seeded with
+ * HTTP_HEADER_HASH_SEED. a new header needs a new seed and http_header_slots,
+ * a debug build prints both at startup(http_header_slots_check()).
+ */
+#define HTTP_HEADER_MAP(XX)                                   \
+  XX(1, ACCEPT, "accept")                                     \
+  XX(2, ACCEPT_CHARSET, "accept-charset")                     \
+  XX(3, ACCEPT_ENCODING, "accept-encoding")                   \
+  XX(4, ACCEPT_LANGUAGE, "accept-language")                   \
+  XX(5, ACCEPT_RANGES, "accept-ranges")                       \
+  XX(6, ACCESS_CONTROL_ALLOW_CREDENTIALS, "access-control-allow-credentials")\
+  XX(7, ACCESS_CONTROL_ALLOW_HEADERS, "access-control-allow-headers")\
+  XX(8, ACCESS_CONTROL_ALLOW_METHODS, "access-control-allow-methods")\
+  XX(9, ACCESS_CONTROL_ALLOW_ORIGIN, "access-control-allow-origin")\
+  XX(10, ACCESS_CONTROL_EXPOSE_HEADERS, "access-control-expose-headers")\
+  XX(11, ACCESS_CONTROL_MAX_AGE, "access-control-max-age")    \
+  XX(12, ACCESS_CONTROL_REQUEST_HEADERS, "access-control-request-headers")\
+  XX(13, ACCESS_CONTROL_REQUEST_METHOD, "access-control-request-method")\
+  XX(14, AGE, "age")                                          \
+  XX(15, ALLOW, "allow")                                      \
+  XX(16, AUTHORIZATION, "authorization")                      \
+  XX(17, CACHE_CONTROL, "cache-control")                      \
+  XX(18, CONNECTION, "connection")                            \
+  XX(19, CONTENT_DISPOSITION, "content-disposition")          \
+  XX(20, CONTENT_ENCODING, "content-encoding")                \
+  XX(21, CONTENT_LANGUAGE, "content-language")                \
+  XX(22, CONTENT_LENGTH, "content-length")                    \
+  XX(23, CONTENT_LOCATION, "content-location")                \
+  XX(24, CONTENT_RANGE, "content-range")                      \
+  XX(25, CONTENT_TYPE, "content-type")                        \
+  XX(26, COOKIE, "cookie")                                    \
+  XX(27, DATE, "date")                                        \
+  XX(28, DNT, "dnt")                                          \
+  XX(29, ETAG, "etag")                                        \
+  XX(30, EXPECT, "expect")                                    \
+  XX(31, EXPIRES, "expires")                                  \
+  XX(32, FORWARDED, "forwarded")                              \
+  XX(33, FROM, "from")                                        \
+  XX(34, HOST, "host")                                        \
+  XX(35, IF_MATCH, "if-match")                                \
+  XX(36, IF_MODIFIED_SINCE, "if-modified-since")              \
+  XX(37, IF_NONE_MATCH, "if-none-match")                      \
+  XX(38, IF_RANGE, "if-range")                                \
+  XX(39, IF_UNMODIFIED_SINCE, "if-unmodified-since")          \
+  XX(40, KEEP_ALIVE, "keep-alive")                            \
+  XX(41, LAST_MODIFIED, "last-modified")                      \
+  XX(42, LINK, "link")                                        \
+  XX(43, LOCATION, "location")                                \
+  XX(44, MAX_FORWARDS, "max-forwards")                        \
+  XX(45, ORIGIN, "origin")                                    \
+  XX(46, PRAGMA, "pragma")                                    \
+  XX(47, PROXY_AUTHENTICATE, "proxy-authenticate")            \
+  XX(48, PROXY_AUTHORIZATION, "proxy-authorization")          \
+  XX(49, PROXY_CONNECTION, "proxy-connection")                \
+  XX(50, RANGE, "range")                                      \
+  XX(51, REFERER, "referer")                                  \
+  XX(52, RETRY_AFTER, "retry-after")                          \
+  XX(53, SEC_WEBSOCKET_ACCEPT, "sec-websocket-accept")        \
+  XX(54, SEC_WEBSOCKET_EXTENSIONS, "sec-websocket-extensions")\
+  XX(55, SEC_WEBSOCKET_KEY, "sec-websocket-key")              \
+  XX(56, SEC_WEBSOCKET_PROTOCOL, "sec-websocket-protocol")    \
+  XX(57, SEC_WEBSOCKET_VERSION, "sec-websocket-version")      \
+  XX(58, SERVER, "server")                                    \
+  XX(59, SET_COOKIE, "set-cookie")                            \
+  XX(60, STRICT_TRANSPORT_SECURITY, "strict-transport-security")\
+  XX(61, TE, "te")                                            \
+  XX(62, TRAILER, "trailer")                                  \
+  XX(63, TRANSFER_ENCODING, "transfer-encoding")              \
+  XX(64, UPGRADE, "upgrade")                                  \
+  XX(65, UPGRADE_INSECURE_REQUESTS, "upgrade-insecure-requests")\
+  XX(66, USER_AGENT, "user-agent")                            \
+  XX(67, VARY, "vary")                                        \
+  XX(68, VIA, "via")                                          \
+  XX(69, WARNING, "warning")                                  \
+  XX(70, WWW_AUTHENTICATE, "www-authenticate")                \
+  XX(71, X_FORWARDED_FOR, "x-forwarded-for")                  \
+  XX(72, X_FORWARDED_HOST, "x-forwarded-host")                \
+  XX(73, X_FORWARDED_PROTO, "x-forwarded-proto")              \
+  XX(74, X_REAL_IP, "x-real-ip")                              \
+  XX(75, X_REQUESTED_WITH, "x-requested-with")                \
+
+enum http_header {
+  HTTP_HEADER_UNKNOWN = 0,
+#define XX(num, name, string) HTTP_HEADER_##name = num,
+  HTTP_HEADER_MAP(XX)
+#undef XX
+  HTTP_HEADER_MAX
+};
+
+/* Response status codes, the status lines of http_native.write_head() are
+ * precomputed from them.
+ */
+#define HTTP_STATUS_MAP(XX)                                   \
+  XX(100, "Continue")                                         \
+  XX(101, "Switching Protocols")                              \
+  XX(102, "Processing")                                       \
+  XX(200, "OK")                                               \
+  XX(201, "Created")                                          \
+  XX(202, "Accepted")                                         \
+  XX(203, "Non-Authoritative Information")                    \
+  XX(204, "No Content")                                       \
+  XX(205, "Reset Content")                                    \
+  XX(206, "Partial Content")                                  \
+  XX(207, "Multi-Status")                                     \
+  XX(208, "Already Reported")                                 \
+  XX(226, "IM Used")                                          \
+  XX(300, "Multiple Choices")                                 \
+  XX(301, "Moved Permanently")                                \
+  XX(302, "Found")                                            \
+  XX(303, "See Other")                                        \
+  XX(304, "Not Modified")                                     \
+  XX(305, "Use Proxy")                                        \
+  XX(307, "Temporary Redirect")                               \
+  XX(308, "Permanent Redirect")                               \
+  XX(400, "Bad Request")                                      \
+  XX(401, "Unauthorized")                                     \
+  XX(402, "Payment Required")                                 \
+  XX(403, "Forbidden")                                        \
+  XX(404, "Not Found")                                        \
+  XX(405, "Method Not Allowed")                               \
+  XX(406, "Not Acceptable")                                   \
+  XX(407, "Proxy Authentication Required")                    \
+  XX(408, "Request Timeout")                                  \
+  XX(409, "Conflict")                                         \
+  XX(410, "Gone")                                             \
+  XX(411, "Length Required")                                  \
+  XX(412, "Precondition Failed")                              \
+  XX(413, "Payload Too Large")                                \
+  XX(414, "URI Too Long")                                     \
+  XX(415, "Unsupported Media Type")                           \
+  XX(416, "Range Not Satisfiable")                            \
+  XX(417, "Expectation Failed")                               \
+  XX(418, "I'm a teapot")                                     \
+  XX(421, "Misdirected Request")                              \
+  XX(422, "Unprocessable Entity")                             \
+  XX(423, "Locked")                                           \
+  XX(424, "Failed Dependency")                                \
+  XX(425, "Unordered Collection")                             \
+  XX(426, "Upgrade Required")                                 \
+  XX(428, "Precondition Required")                            \
+  XX(429, "Too Many Requests")                                \
+  XX(431, "Request Header Fields Too Large")                  \
+  XX(451, "Unavailable For Legal Reasons")                    \
+  XX(500, "Internal Server Error")                            \
+  XX(501, "Not Implemented")                                  \
+  XX(502, "Bad Gateway")                                      \
+  XX(503, "Service Unavailable")                              \
+  XX(504, "Gateway Timeout")                                  \
+  XX(505, "HTTP Version Not Supported")                       \
+  XX(506, "Variant Also Negotiates")                          \
+  XX(507, "Insufficient Storage")                             \
+  XX(508, "Loop Detected")                                    \
+  XX(509, "Bandwidth Limit Exceeded")                         \
+  XX(510, "Not Extended")                                     \
+  XX(511, "Network Authentication Required")                  \
+
+#define HTTP_MIN_STATUS                 100
+#define HTTP_MAX_STATUS                 599
+
 /*parse completed*/
 #define HTTP_OK                         0
 /*parsed HTTP_MAX_HEADERS_PER_READ headers*/
@@ -124,6 +286,7 @@ typedef struct {
 #define HTTP_MAX_HEADER_SIZE          (64 * 1024)
 #define HTTP_MAX_HEADERS              256
 #define HTTP_MAX_HEADERS_PER_READ     64
+#define HTTP_HEADER_HASH_SEED         442446
 
 typedef struct {
   http_url_t  url;
@@ -131,11 +294,14 @@ typedef struct {
   http_buf_t  value;
   http_buf_t  status;
   char        *last_pos;
+  /*bytes left in the current chunk*/
+  uint64_t    chunk_size;
   uint32_t    nread;
   uint16_t    http_major;
   uint16_t    http_minor;
   uint16_t    status_code;
   uint16_t    nheader;
+  uint8_t     field_id;
   uint8_t     method;
   uint8_t     state;
   uint8_t     index;
@@ -144,6 +310,10 @@ typedef struct {
 
 void http_parser_init(http_parser_t *parser);
 
+#ifdef DEBUG
+void http_header_slots_check(void);
+#endif
+
 int http_parse_status_line(http_parser_t *parser, char *data, char *last);
 
 int http_parse_request_line(http_parser_t *parser, char *data, char *last);
@@ -152,8 +322,15 @@ int http_parse_headers(http_parser_t *parser,
                        char *data, 
                        char *last, 
                        http_buf_t* headers, 
+                       uint8_t *ids,
                        size_t *nheader);
 
+int http_header_lookup(const char *name, size_t len);
+
+const char *http_header_name(int id, size_t *len);
+
+int http_parse_chunked(http_parser_t *parser, char *data, char *last, size_t *len);
+
 int http_parse_host(http_url_t *url, 
                     char *data, 
                     size_t len, 
@@ -161,6 +338,8 @@ int http_parse_host(http_url_t *url,
 
 int http_parse_url(http_url_t *url, char *data, size_t len, int is_connect);
 
+int http_check_request_url(http_parser_t *parser);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,497 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: http request parsed by one call, headers are materialized lazily
+ */
+
+#include "luaio.h"
+#include "luaio_init.h"
+#include "luaio_http_request.h"
+#include "luaio_querystring.h"
+
+/*headers of one request, plus the room of a last batch*/
+#define LUAIO_HTTP_REQUEST_MAX_HEADERS  (HTTP_MAX_HEADERS + HTTP_MAX_HEADERS_PER_READ)
+/*longest header name looked up by request:header(name)*/
+#define LUAIO_HTTP_MAX_FIELD_SIZE       256
+
+static char luaio_http_request_metatable_key;
+
+#define luaio_http_check_request(L, name) \
+  luaio_http_request_t *request = lua_touserdata(L, 1); \
+  if (request == NULL || request->type != LUAIO_TYPE_HTTP_REQUEST) { \
+    return luaL_argerror(L, 1, "request:"#name" error: request must be [userdata](request)\n"); \
+  }
+
+#define luaio_http_request_rebase(buf, from, to) \
+  if ((buf).base != NULL) (buf).base = (to) + ((buf).base - (from));
+
+/* parse the request line and all the headers in [data, last),
+ * on HTTP_OK parser->last_pos is the end of the request head.
+ */
+static int luaio_http_request_parse(http_parser_t *parser,
+                                    char *data,
+                                    char *last,
+                                    http_buf_t *headers,
+                                    uint8_t *ids,
+                                    size_t *nheader) {
+  http_parser_init(parser);
+
+  int ret = http_parse_request_line(parser, data, last);
+  if (ret != HTTP_OK) return ret;
+
+  ret = http_check_request_url(parser);
+  if (ret != HTTP_OK) return ret;
+
+  size_t total = 0;
+  char *p = parser->last_pos;
+  parser->last_pos = NULL;
+  for (;;) {
+    size_t n = 0;
+    ret = http_parse_headers(parser, p, last, headers + (total << 1), ids + total, &n);
+    total += n;
+    if (ret != HTTP_DONE) break;
+
+    p = parser->last_pos;
+    parser->last_pos = NULL;
+  }
+
+  *nheader = total;
+  return ret;
+}
+
+/* @example: local request, error = http_parser:parse_request(read_buffer)
+ * @param: read_buffer {userdate(ReadBuffer)}
+ * @return: request {userdata(request)|nil}
+ * @return: error {integer} http.OK, http.AGAIN(read more data and call again) or an error status
+ *
+ * the request line and all the headers are parsed in one call, the request
+ * head is consumed from the buffer and copied into the request.
+ * a partially received head is parsed again when more data arrives,
+ * an adaptive buffer filled by it grows before the head is refused.
+ */
+int luaio_http_parser_parse_request(lua_State *L) {
+  http_parser_t *parser = lua_touserdata(L, 1);
+  if (parser == NULL) {
+    return luaL_argerror(L, 1, "http_parser:parse_request(buffer) error: http_parser must be userdata\n");
+  }
+
+  luaio_buffer_t *buffer = lua_touserdata(L, 2);
+  if (buffer == NULL || buffer->type != LUAIO_TYPE_READ_BUFFER) {
+    return luaL_argerror(L, 2, "http_parser:parse_request(buffer) error: buffer must be ReadBuffer\n");
+  }
+
+  /*the memory is allocated by the first read*/
+  if (buffer->capacity == 0) {
+    lua_pushnil(L);
+    lua_pushinteger(L, HTTP_AGAIN);
+    return 2;
+  }
+
+  http_buf_t headers[LUAIO_HTTP_REQUEST_MAX_HEADERS * 2];
+  uint8_t ids[LUAIO_HTTP_REQUEST_MAX_HEADERS];
+  size_t nheader = 0;
+
+  char *read_pos = buffer->read_pos;
+  char *write_pos = buffer->write_pos;
+  int ret = luaio_http_request_parse(parser, read_pos, write_pos, headers, ids, &nheader);
+
+  if (ret == HTTP_AGAIN) {
+    if (write_pos == buffer->end) {
+      char *start = buffer->start;
+
+      /*the head does not fit in the buffer*/
+      if (read_pos == start) {
+        if (luaio_buffer_grow(buffer, buffer->capacity + 1) == 0) {
+          lua_pushnil(L);
+          lua_pushinteger(L, HTTP_AGAIN);
+          return 2;
+        }
+
+        lua_pushnil(L);
+        lua_pushinteger(L, parser->url.path.base == NULL ? HTTP_REQUEST_URI_TOO_LARGE : HTTP_BAD_REQUEST);
+        return 2;
+      }
+
+      size_t rest_size = write_pos - read_pos;
+      luaio_memmove(start, read_pos, rest_size);
+      buffer->read_pos = start;
+      buffer->write_pos = start + rest_size;
+      buffer->generation++;
+    }
+
+    lua_pushnil(L);
+    lua_pushinteger(L, HTTP_AGAIN);
+    return 2;
+  }
+
+  if (ret != HTTP_OK) {
+    lua_pushnil(L);
+    lua_pushinteger(L, ret);
+    return 2;
+  }
+
+  char *last_pos = parser->last_pos;
+  size_t head_len = last_pos - read_pos;
+  size_t headers_size = nheader * 2 * sizeof(http_buf_t);
+  luaio_http_request_t *request = lua_newuserdata(L, sizeof(luaio_http_request_t) + headers_size + nheader + head_len);
+
+  request->type = LUAIO_TYPE_HTTP_REQUEST;
+  request->headers = (http_buf_t*)(request + 1);
+  request->ids = (uint8_t*)request->headers + headers_size;
+  request->head = (char*)request->ids + nheader;
+  request->head_len = head_len;
+  request->nheader = nheader;
+  request->headers_ref = LUA_NOREF;
+  request->cookies_ref = LUA_NOREF;
+  request->http_major = parser->http_major;
+  request->http_minor = parser->http_minor;
+  request->method = parser->method;
+
+  char *head = request->head;
+  luaio_memcpy(head, read_pos, head_len);
+
+  http_url_t *url = &request->url;
+  *url = parser->url;
+  luaio_http_request_rebase(url->schema, read_pos, head);
+  luaio_http_request_rebase(url->userinfo, read_pos, head);
+  luaio_http_request_rebase(url->host, read_pos, head);
+  luaio_http_request_rebase(url->port, read_pos, head);
+  luaio_http_request_rebase(url->path, read_pos, head);
+  luaio_http_request_rebase(url->query, read_pos, head);
+  luaio_http_request_rebase(url->fragment, read_pos, head);
+  luaio_http_request_rebase(url->server, read_pos, head);
+
+  for (size_t i = 0; i < nheader * 2; i++) {
+    request->headers[i] = headers[i];
+    luaio_http_request_rebase(request->headers[i], read_pos, head);
+  }
+
+  luaio_memzero(request->known, sizeof(request->known));
+  for (size_t i = 0; i < nheader; i++) {
+    uint8_t id = ids[i];
+    request->ids[i] = id;
+    if (id != HTTP_HEADER_UNKNOWN && request->known[id] == 0) {
+      request->known[id] = i + 1;
+    }
+  }
+
+  if (last_pos == write_pos) {
+    buffer->read_pos = buffer->start;
+    buffer->write_pos = buffer->start;
+  } else {
+    buffer->read_pos = last_pos;
+  }
+  parser->last_pos = NULL;
+
+  lua_pushlightuserdata(L, &luaio_http_request_metatable_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+
+  lua_pushinteger(L, HTTP_OK);
+  return 2;
+}
+
+static void luaio_http_request_push_buf(lua_State *L, http_buf_t *buf) {
+  if (buf->base != NULL) {
+    lua_pushlstring(L, buf->base, buf->len);
+  } else {
+    lua_pushnil(L);
+  }
+}
+
+/* local method = request:method() */
+static int luaio_http_request_method(lua_State *L) {
+  luaio_http_check_request(L, method());
+  lua_pushinteger(L, request->method);
+  return 1;
+}
+
+/* local major, minor = request:version() */
+static int luaio_http_request_version(lua_State *L) {
+  luaio_http_check_request(L, version());
+  lua_pushinteger(L, request->http_major);
+  lua_pushinteger(L, request->http_minor);
+  return 2;
+}
+
+/* local path = request:path() */
+static int luaio_http_request_path(lua_State *L) {
+  luaio_http_check_request(L, path());
+  luaio_http_request_push_buf(L, &request->url.path);
+  return 1;
+}
+
+/* local query = request:query() */
+static int luaio_http_request_query(lua_State *L) {
+  luaio_http_check_request(L, query());
+  luaio_http_request_push_buf(L, &request->url.query);
+  return 1;
+}
+
+/* local args = request:query_args([max]) parsed from the query of the request head
+ * max {integer|default: LUAIO_QUERYSTRING_MAX_ARGS} pairs read at most, 0 means all
+ */
+static int luaio_http_request_query_args(lua_State *L) {
+  luaio_http_check_request(L, query_args(max));
+  lua_Integer max = luaL_optinteger(L, 2, LUAIO_QUERYSTRING_MAX_ARGS);
+  if (max < 0) max = 0;
+
+  http_buf_t *query = &request->url.query;
+  if (luaio_querystring_push_args(L, query->base, query->len, '&', '=', (size_t)max) < 0) {
+    return luaL_error(L, "request:query_args(max) error: no memory\n");
+  }
+
+  return 1;
+}
+
+/* local url = request:url() same fields as http_parser:parse_request_line() */
+static int luaio_http_request_url(lua_State *L) {
+  luaio_http_check_request(L, url());
+
+  http_url_t *url = &request->url;
+  lua_createtable(L, 0, 7);
+  if (url->schema.base != NULL) {
+    luaio_setlstring("schema", url->schema.base, url->schema.len)
+  }
+
+  if (url->userinfo.base != NULL) {
+    luaio_setlstring("auth", url->userinfo.base, url->userinfo.len)
+  }
+
+  if (url->host.base != NULL) {
+    luaio_setlstring("host", url->host.base, url->host.len)
+  }
+
+  if (url->port.base != NULL) {
+    luaio_setlstring("port", url->port.base, url->port.len)
+  }
+
+  if (url->path.base != NULL) {
+    luaio_setlstring("path", url->path.base, url->path.len)
+  }
+
+  if (url->query.base != NULL) {
+    luaio_setlstring("query", url->query.base, url->query.len)
+  }
+
+  if (url->fragment.base != NULL) {
+    luaio_setlstring("hash", url->fragment.base, url->fragment.len)
+  }
+
+  return 1;
+}
+
+/*value of the first header named field(lower case), NULL if not found*/
+static http_buf_t *luaio_http_request_find(luaio_http_request_t *request, const char *field, size_t n) {
+  int id = http_header_lookup(field, n);
+  if (id != HTTP_HEADER_UNKNOWN) {
+    size_t index = request->known[id];
+    return index ? &request->headers[((index - 1) << 1) + 1] : NULL;
+  }
+
+  http_buf_t *headers = request->headers;
+  for (size_t i = 0; i < request->nheader; i++) {
+    http_buf_t *name = &headers[i << 1];
+    if (name->len == n && luaio_memcmp(name->base, field, n) == 0) {
+      return &headers[(i << 1) + 1];
+    }
+  }
+
+  return NULL;
+}
+
+/* local value = request:header(name|id) nil if not found
+ * name is case insensitive, id is one of http_native.HEADER_*
+ */
+static int luaio_http_request_header(lua_State *L) {
+  luaio_http_check_request(L, header(name));
+
+  http_buf_t *value;
+  if (lua_type(L, 2) == LUA_TNUMBER) {
+    lua_Integer id = lua_tointeger(L, 2);
+    if (id <= HTTP_HEADER_UNKNOWN || id >= HTTP_HEADER_MAX || request->known[id] == 0) {
+      lua_pushnil(L);
+      return 1;
+    }
+
+    value = &request->headers[((request->known[id] - 1) << 1) + 1];
+  } else {
+    size_t n;
+    const char *name = luaL_checklstring(L, 2, &n);
+    if (n > LUAIO_HTTP_MAX_FIELD_SIZE) {
+      lua_pushnil(L);
+      return 1;
+    }
+
+    char field[LUAIO_HTTP_MAX_FIELD_SIZE];
+    for (size_t i = 0; i < n; i++) {
+      char c = name[i];
+      field[i] = (c >= 'A' && c <= 'Z') ? luaio_lower(c) : c;
+    }
+
+    value = luaio_http_request_find(request, field, n);
+  }
+
+  if (value == NULL) {
+    lua_pushnil(L);
+  } else if (value->base == NULL) {
+    lua_pushliteral(L, "");
+  } else {
+    lua_pushlstring(L, value->base, value->len);
+  }
+
+  return 1;
+}
+
+static void luaio_http_request_materialize(lua_State *L, luaio_http_request_t *request) {
+  lua_createtable(L, 0, request->nheader);
+  lua_createtable(L, 2, 0);
+  size_t ncookie = 0;
+
+  http_buf_t *headers = request->headers;
+  for (size_t i = 0; i < request->nheader; i++) {
+    http_buf_t *field = &headers[i << 1];
+    http_buf_t *value = field + 1;
+    uint8_t id = request->ids[i];
+
+    if (id == HTTP_HEADER_COOKIE || id == HTTP_HEADER_SET_COOKIE) {
+      if (value->base != NULL) {
+        lua_pushlstring(L, value->base, value->len);
+        lua_rawseti(L, -2, ++ncookie);
+      }
+      continue;
+    }
+
+    luaio_http_push_field(L, field, id);
+    if (value->base != NULL) {
+      lua_pushlstring(L, value->base, value->len);
+    } else {
+      lua_pushliteral(L, "");
+    }
+    lua_rawset(L, -4);
+  }
+
+  request->cookies_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  request->headers_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+}
+
+/* local headers = request:headers() field(lower case) => value, built on first use */
+static int luaio_http_request_headers(lua_State *L) {
+  luaio_http_check_request(L, headers());
+
+  if (request->headers_ref == LUA_NOREF) {
+    luaio_http_request_materialize(L, request);
+  }
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, request->headers_ref);
+  return 1;
+}
+
+/* local cookies = request:cookies() values of cookie and set-cookie headers */
+static int luaio_http_request_cookies(lua_State *L) {
+  luaio_http_check_request(L, cookies());
+
+  if (request->cookies_ref == LUA_NOREF) {
+    luaio_http_request_materialize(L, request);
+  }
+
+  lua_rawgeti(L, LUA_REGISTRYINDEX, request->cookies_ref);
+  return 1;
+}
+
+/* local n = request:nheader() */
+static int luaio_http_request_nheader(lua_State *L) {
+  luaio_http_check_request(L, nheader());
+  lua_pushinteger(L, request->nheader);
+  return 1;
+}
+
+/* local keep_alive = request:keep_alive()
+ * HTTP/1.1 unless "connection: close", HTTP/1.0 only with "connection: keep-alive"
+ */
+static int luaio_http_request_keep_alive(lua_State *L) {
+  luaio_http_check_request(L, keep_alive());
+
+  int keep_alive = request->http_major > 1 || (request->http_major == 1 && request->http_minor >= 1);
+  http_buf_t *value = NULL;
+  size_t index = request->known[HTTP_HEADER_CONNECTION];
+  if (index) value = &request->headers[((index - 1) << 1) + 1];
+  if (value != NULL && value->base != NULL) {
+    if (value->len == 5 && luaio_strncasecmp(value->base, "close", 5) == 0) {
+      keep_alive = 0;
+    } else if (value->len == 10 && luaio_strncasecmp(value->base, "keep-alive", 10) == 0) {
+      keep_alive = 1;
+    }
+  }
+
+  lua_pushboolean(L, keep_alive);
+  return 1;
+}
+
+/* local head = request:head() the request head, field names are lower case */
+static int luaio_http_request_head(lua_State *L) {
+  luaio_http_check_request(L, head());
+  lua_pushlstring(L, request->head, request->head_len);
+  return 1;
+}
+
+static int luaio_http_request_gc(lua_State *L) {
+  luaio_http_request_t *request = lua_touserdata(L, 1);
+  if (request == NULL || request->type != LUAIO_TYPE_HTTP_REQUEST) return 0;
+
+  if (request->headers_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, request->headers_ref);
+    request->headers_ref = LUA_NOREF;
+  }
+
+  if (request->cookies_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, request->cookies_ref);
+    request->cookies_ref = LUA_NOREF;
+  }
+
+  return 0;
+}
+
+/* push the table id => name of the known headers */
+void luaio_http_push_header_names(lua_State *L) {
+  lua_createtable(L, HTTP_HEADER_MAX - 1, 0);
+  for (int id = HTTP_HEADER_UNKNOWN + 1; id < HTTP_HEADER_MAX; id++) {
+    size_t len;
+    const char *name = http_header_name(id, &len);
+    lua_pushlstring(L, name, len);
+    lua_rawseti(L, -2, id);
+  }
+}
+
+/* names is the stack index of the table made by luaio_http_push_header_names() */
+void luaio_http_request_init(lua_State *L, int names) {
+  luaL_Reg request_mtlib[] = {
+    { "method", luaio_http_request_method },
+    { "version", luaio_http_request_version },
+    { "path", luaio_http_request_path },
+    { "query", luaio_http_request_query },
+    { "query_args", luaio_http_request_query_args },
+    { "url", luaio_http_request_url },
+    { "header", luaio_http_request_header },
+    { "nheader", luaio_http_request_nheader },
+    { "keep_alive", luaio_http_request_keep_alive },
+    { "head", luaio_http_request_head },
+    { "__gc", luaio_http_request_gc },
+    { NULL, NULL }
+  };
+
+  lua_pushlightuserdata(L, &luaio_http_request_metatable_key);
+  luaL_newlib(L, request_mtlib);
+
+  lua_pushvalue(L, names);
+  lua_pushcclosure(L, luaio_http_request_headers, 1);
+  lua_setfield(L, -2, "headers");
+
+  lua_pushvalue(L, names);
+  lua_pushcclosure(L, luaio_http_request_cookies, 1);
+  lua_setfield(L, -2, "cookies");
+
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_rawset(L, LUA_REGISTRYINDEX);
+}
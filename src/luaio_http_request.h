@@ -0,0 +1,53 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: http request parsed by one call, headers are materialized lazily
+ */
+
+#ifndef LUAIO_HTTP_REQUEST_H
+#define LUAIO_HTTP_REQUEST_H
+
+#include "luaio.h"
+#include "luaio_http_parser.h"
+
+/* the request owns a copy of the request head, url and headers point into it.
+ *
+ *  request                headers                    ids                  head
+ *  |                      |                          |                    |
+ *  +----------------------+--------------------------+--------------------+--------------+
+ *  | luaio_http_request_t | http_buf_t[nheader * 2]  | uint8_t[nheader]   | request head |
+ *  +----------------------+--------------------------+--------------------+--------------+
+ */
+typedef struct {
+  size_t      type;
+  http_url_t  url;
+  http_buf_t  *headers;  /*field, value pairs, fields are lower case*/
+  uint8_t     *ids;      /*enum http_header of every field*/
+  char        *head;
+  size_t      head_len;
+  size_t      nheader;
+  /*index + 1 of the first header of every known header, 0 if absent*/
+  uint16_t    known[HTTP_HEADER_MAX];
+  int         headers_ref;
+  int         cookies_ref;
+  uint16_t    http_major;
+  uint16_t    http_minor;
+  uint8_t     method;
+} luaio_http_request_t;
+
+/* push the field name of a parsed header, the names of the known headers
+ * are taken from the table at upvalue 1 instead of being hashed again.
+ */
+static inline void luaio_http_push_field(lua_State *L, http_buf_t *field, uint8_t id) {
+  if (id != HTTP_HEADER_UNKNOWN) {
+    lua_rawgeti(L, lua_upvalueindex(1), id);
+  } else {
+    lua_pushlstring(L, field->base, field->len);
+  }
+}
+
+int luaio_http_parser_parse_request(lua_State *L);
+void luaio_http_push_header_names(lua_State *L);
+void luaio_http_request_init(lua_State *L, int names);
+
+#endif /* LUAIO_HTTP_REQUEST_H */
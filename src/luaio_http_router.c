@@ -0,0 +1,517 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview:
+ */
+
+#include "luaio.h"
+#include "luaio_init.h"
+#include "luaio_http_router.h"
+#include "luaio_http_request.h"
+
+static char luaio_http_router_metatable_key;
+
+#define luaio_http_check_router(L, name) \
+  luaio_http_router_t *router = lua_touserdata(L, 1); \
+  if (router == NULL || router->type != LUAIO_TYPE_HTTP_ROUTER) { \
+    return luaL_argerror(L, 1, "router:"#name" error: router must be [userdata](router)\n"); \
+  }
+
+/*':' and '*' are special at the start of a segment only*/
+#define luaio_http_route_is_special(p) \
+  ((*(p) == ':' || *(p) == '*') && *((p) - 1) == '/')
+
+static luaio_http_route_node_t *luaio_http_route_node_new(const char *label, size_t len) {
+  luaio_http_route_node_t *node = luaio_malloc(sizeof(luaio_http_route_node_t));
+  if (node == NULL) return NULL;
+
+  luaio_memzero(node, sizeof(luaio_http_route_node_t));
+  if (len > 0) {
+    node->label = luaio_malloc(len);
+    if (node->label == NULL) {
+      luaio_free(node);
+      return NULL;
+    }
+
+    luaio_memcpy(node->label, label, len);
+    node->label_len = len;
+  }
+
+  return node;
+}
+
+static void luaio_http_route_node_free(luaio_http_route_node_t *node) {
+  if (node == NULL) return;
+
+  for (size_t i = 0; i < node->nchildren; i++) {
+    luaio_http_route_node_free(node->children[i]);
+  }
+
+  luaio_http_route_node_free(node->param);
+  luaio_free(node->children);
+  luaio_free(node->indices);
+  luaio_free(node->label);
+  luaio_free(node->name);
+  luaio_free(node->wildcard);
+  luaio_free(node);
+}
+
+static int luaio_http_route_add_child(luaio_http_route_node_t *node, luaio_http_route_node_t *child) {
+  size_t n = node->nchildren + 1;
+  luaio_http_route_node_t **children = luaio_realloc(node->children, n * sizeof(luaio_http_route_node_t*));
+  if (children == NULL) return UV_ENOMEM;
+  node->children = children;
+
+  char *indices = luaio_realloc(node->indices, n);
+  if (indices == NULL) return UV_ENOMEM;
+  node->indices = indices;
+
+  children[n - 1] = child;
+  indices[n - 1] = child->label[0];
+  node->nchildren = n;
+  return 0;
+}
+
+static char *luaio_http_route_strdup(const char *str, size_t len) {
+  char *dup = luaio_malloc(len);
+  if (dup != NULL) luaio_memcpy(dup, str, len);
+  return dup;
+}
+
+/* add the pattern [p, last) under node, which has matched the bytes before p.
+ * @return: 0, UV_EEXIST if the pattern conflicts with a route, UV_ENOMEM
+ */
+static int luaio_http_route_insert(luaio_http_route_node_t *node, const char *p, const char *last, int id) {
+  while (p < last) {
+    if (*p == ':' && *(p - 1) == '/') {
+      const char *name = ++p;
+      while (p < last && *p != '/') p++;
+      size_t name_len = p - name;
+
+      luaio_http_route_node_t *param = node->param;
+      if (param != NULL) {
+        if (param->name_len != name_len || memcmp(param->name, name, name_len) != 0) {
+          return UV_EEXIST;
+        }
+      } else {
+        param = luaio_http_route_node_new(NULL, 0);
+        if (param == NULL) return UV_ENOMEM;
+
+        param->name = luaio_http_route_strdup(name, name_len);
+        if (param->name == NULL) {
+          luaio_free(param);
+          return UV_ENOMEM;
+        }
+
+        param->name_len = name_len;
+        node->param = param;
+      }
+
+      node = param;
+      continue;
+    }
+
+    if (*p == '*' && *(p - 1) == '/') {
+      if (node->wildcard_id != 0) return UV_EEXIST;
+
+      size_t name_len = last - p - 1;
+      node->wildcard = luaio_http_route_strdup(p + 1, name_len);
+      if (node->wildcard == NULL) return UV_ENOMEM;
+
+      node->wildcard_len = name_len;
+      node->wildcard_id = id;
+      return 0;
+    }
+
+    /*static bytes up to the next ':' or '*' segment*/
+    const char *s = p + 1;
+    while (s < last && !luaio_http_route_is_special(s)) s++;
+    size_t len = s - p;
+
+    luaio_http_route_node_t *child = NULL;
+    size_t i;
+    for (i = 0; i < node->nchildren; i++) {
+      if (node->indices[i] == *p) {
+        child = node->children[i];
+        break;
+      }
+    }
+
+    if (child == NULL) {
+      child = luaio_http_route_node_new(p, len);
+      if (child == NULL) return UV_ENOMEM;
+
+      int err = luaio_http_route_add_child(node, child);
+      if (err) {
+        luaio_http_route_node_free(child);
+        return err;
+      }
+
+      node = child;
+      p = s;
+      continue;
+    }
+
+    size_t k = 0;
+    size_t max = len < child->label_len ? len : child->label_len;
+    while (k < max && child->label[k] == p[k]) k++;
+
+    /*split the edge at the first byte which differs*/
+    if (k < child->label_len) {
+      luaio_http_route_node_t *split = luaio_http_route_node_new(child->label, k);
+      if (split == NULL) return UV_ENOMEM;
+
+      size_t rest = child->label_len - k;
+      luaio_memmove(child->label, child->label + k, rest);
+      child->label_len = rest;
+
+      int err = luaio_http_route_add_child(split, child);
+      if (err) {
+        luaio_memmove(child->label + k, child->label, rest);
+        luaio_memcpy(child->label, split->label, k);
+        child->label_len = k + rest;
+        split->nchildren = 0;
+        luaio_http_route_node_free(split);
+        return err;
+      }
+
+      node->children[i] = split;
+      child = split;
+    }
+
+    node = child;
+    p += k;
+  }
+
+  if (node->id != 0) return UV_EEXIST;
+  node->id = id;
+  return 0;
+}
+
+/* the branches which have failed during one lookup. whether node matches
+ * [p, last) does not depend on what was captured before it, so a failed
+ * (node, p) is not walked again and a lookup takes at most one walk per node
+ * and path byte, instead of every mix of static and :name siblings.
+ */
+typedef struct {
+  luaio_http_route_node_t *node;
+  const char              *p;
+} luaio_http_route_failed_t;
+
+typedef struct {
+  luaio_http_route_failed_t *slots;
+  size_t                    mask;
+  size_t                    count;
+  luaio_http_route_failed_t stack[LUAIO_HTTP_ROUTER_FAILED];
+} luaio_http_route_memo_t;
+
+#define luaio_http_route_memo_hash(node, p) \
+  ((((uintptr_t)(node) >> 4) ^ ((uintptr_t)(p) * 31)) * 2654435761u)
+
+static void luaio_http_route_memo_init(luaio_http_route_memo_t *memo) {
+  memo->slots = memo->stack;
+  memo->mask = LUAIO_HTTP_ROUTER_FAILED - 1;
+  memo->count = 0;
+}
+
+static void luaio_http_route_memo_free(luaio_http_route_memo_t *memo) {
+  if (memo->slots != memo->stack) luaio_free(memo->slots);
+}
+
+static int luaio_http_route_memo_has(luaio_http_route_memo_t *memo,
+                                     luaio_http_route_node_t *node,
+                                     const char *p) {
+  if (memo->count == 0) return 0;
+
+  size_t i = luaio_http_route_memo_hash(node, p) & memo->mask;
+  while (memo->slots[i].node != NULL) {
+    if (memo->slots[i].node == node && memo->slots[i].p == p) return 1;
+    i = (i + 1) & memo->mask;
+  }
+
+  return 0;
+}
+
+static void luaio_http_route_memo_put(luaio_http_route_memo_t *memo,
+                                      luaio_http_route_node_t *node,
+                                      const char *p) {
+  /*the stack slots are cleared on the first failure, most lookups have none*/
+  if (memo->count == 0 && memo->slots == memo->stack) {
+    luaio_memzero(memo->stack, sizeof(memo->stack));
+  }
+
+  /*keep the table half empty, without memory the failure is just not kept*/
+  if ((memo->count + 1) * 2 > memo->mask + 1) {
+    size_t size = (memo->mask + 1) * 2;
+    luaio_http_route_failed_t *slots = luaio_malloc(size * sizeof(luaio_http_route_failed_t));
+    if (slots == NULL) return;
+
+    luaio_memzero(slots, size * sizeof(luaio_http_route_failed_t));
+    for (size_t j = 0; j <= memo->mask; j++) {
+      luaio_http_route_failed_t *failed = &memo->slots[j];
+      if (failed->node == NULL) continue;
+
+      size_t k = luaio_http_route_memo_hash(failed->node, failed->p) & (size - 1);
+      while (slots[k].node != NULL) k = (k + 1) & (size - 1);
+      slots[k] = *failed;
+    }
+
+    luaio_http_route_memo_free(memo);
+    memo->slots = slots;
+    memo->mask = size - 1;
+  }
+
+  size_t i = luaio_http_route_memo_hash(node, p) & memo->mask;
+  while (memo->slots[i].node != NULL) i = (i + 1) & memo->mask;
+  memo->slots[i].node = node;
+  memo->slots[i].p = p;
+  memo->count++;
+}
+
+/* match [p, last) under node, which has matched the bytes before p. static
+ * edges are tried before :name and :name before *name, a failed branch is
+ * backtracked and kept in memo.
+ * @return: the route id, 0 if none
+ */
+static int luaio_http_route_match(luaio_http_route_node_t *node,
+                                  const char *p,
+                                  const char *last,
+                                  luaio_http_route_param_t *params,
+                                  size_t *nparam,
+                                  luaio_http_route_memo_t *memo) {
+  if (p == last) {
+    if (node->id != 0) return node->id;
+    if (node->wildcard_id == 0) return 0;
+  } else {
+    if (luaio_http_route_memo_has(memo, node, p)) return 0;
+
+    const char *indices = node->indices;
+    for (size_t i = 0; i < node->nchildren; i++) {
+      if (indices[i] != *p) continue;
+
+      luaio_http_route_node_t *child = node->children[i];
+      size_t len = child->label_len;
+      if ((size_t)(last - p) >= len && memcmp(p, child->label, len) == 0) {
+        int id = luaio_http_route_match(child, p + len, last, params, nparam, memo);
+        if (id != 0) return id;
+      }
+      break;
+    }
+
+    luaio_http_route_node_t *param = node->param;
+    if (param != NULL && *p != '/') {
+      const char *end = p + 1;
+      while (end < last && *end != '/') end++;
+
+      luaio_http_route_param_t *captured = &params[*nparam];
+      captured->name = param->name;
+      captured->name_len = param->name_len;
+      captured->value = p;
+      captured->value_len = end - p;
+      (*nparam)++;
+
+      int id = luaio_http_route_match(param, end, last, params, nparam, memo);
+      if (id != 0) return id;
+      (*nparam)--;
+    }
+
+    if (node->wildcard_id == 0) {
+      luaio_http_route_memo_put(memo, node, p);
+      return 0;
+    }
+  }
+
+  /*the tail, it may be empty*/
+  luaio_http_route_param_t *captured = &params[*nparam];
+  captured->name = node->wildcard;
+  captured->name_len = node->wildcard_len;
+  captured->value = p;
+  captured->value_len = last - p;
+  (*nparam)++;
+  return node->wildcard_id;
+}
+
+/* @example: local router = http_native.new_router() */
+int luaio_http_new_router(lua_State *L) {
+  luaio_http_router_t *router = lua_newuserdata(L, sizeof(luaio_http_router_t));
+  if (router == NULL) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  luaio_memzero(router, sizeof(luaio_http_router_t));
+  router->type = LUAIO_TYPE_HTTP_ROUTER;
+
+  lua_pushlightuserdata(L, &luaio_http_router_metatable_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+/* @example: local err = router:add(method, pattern, id)
+ * @param: method {integer} http_native.GET ..., http_native.UNKNOWN for any method
+ * @param: pattern {string} /users/:id, a "*path" segment takes the rest of the path and must be the last
+ * @param: id {integer} > 0, returned by router:match()
+ * @return: err {integer} 0, UV_EEXIST if the pattern conflicts with a route
+ */
+static int luaio_http_router_add(lua_State *L) {
+  luaio_http_check_router(L, add(method, pattern, id));
+
+  lua_Integer method = luaL_checkinteger(L, 2);
+  if (method < HTTP_UNKNOWN || method >= LUAIO_HTTP_ROUTER_METHODS) {
+    return luaL_argerror(L, 2, "router:add(method, pattern, id) error: unknown method\n");
+  }
+
+  size_t len;
+  const char *pattern = luaL_checklstring(L, 3, &len);
+  if (len == 0 || pattern[0] != '/') {
+    return luaL_argerror(L, 3, "router:add(method, pattern, id) error: pattern must start with '/'\n");
+  }
+
+  lua_Integer id = luaL_checkinteger(L, 4);
+  if (id <= 0 || id > INT_MAX) {
+    return luaL_argerror(L, 4, "router:add(method, pattern, id) error: id must be in [1, INT_MAX]\n");
+  }
+
+  const char *last = pattern + len;
+  size_t nparam = 0;
+  for (const char *p = pattern + 1; p < last; p++) {
+    if (!luaio_http_route_is_special(p)) continue;
+
+    const char *name = p + 1;
+    const char *end = name;
+    while (end < last && *end != '/') end++;
+    if (end == name || (*p == '*' && end != last)) {
+      return luaL_argerror(L, 3, "router:add(method, pattern, id) error: :name or *name needs a name, *name must be the last segment\n");
+    }
+
+    nparam++;
+  }
+
+  if (nparam > LUAIO_HTTP_ROUTER_MAX_PARAMS) {
+    return luaL_argerror(L, 3, "router:add(method, pattern, id) error: too many :name segments\n");
+  }
+
+  luaio_http_route_node_t *root = router->roots[method];
+  if (root == NULL) {
+    root = luaio_http_route_node_new(NULL, 0);
+    if (root == NULL) {
+      lua_pushinteger(L, UV_ENOMEM);
+      return 1;
+    }
+    router->roots[method] = root;
+  }
+
+  lua_pushinteger(L, luaio_http_route_insert(root, pattern, last, (int)id));
+  return 1;
+}
+
+static int luaio_http_router_lookup(luaio_http_router_t *router,
+                                    int method,
+                                    const char *path,
+                                    size_t len,
+                                    luaio_http_route_param_t *params,
+                                    size_t *nparam) {
+  const char *last = path + len;
+  luaio_http_route_node_t *root;
+  luaio_http_route_memo_t memo;
+  int id = 0;
+
+  if (len == 0 || path[0] != '/') return 0;
+
+  /*the trees share no node, one memo serves every root*/
+  luaio_http_route_memo_init(&memo);
+  root = router->roots[method];
+  if (root != NULL) {
+    id = luaio_http_route_match(root, path, last, params, nparam, &memo);
+  }
+
+  /*HEAD is answered by the GET routes without the body*/
+  if (id == 0 && method == HTTP_HEAD && router->roots[HTTP_GET] != NULL) {
+    id = luaio_http_route_match(router->roots[HTTP_GET], path, last, params, nparam, &memo);
+  }
+
+  root = router->roots[HTTP_UNKNOWN];
+  if (id == 0 && root != NULL && method != HTTP_UNKNOWN) {
+    id = luaio_http_route_match(root, path, last, params, nparam, &memo);
+  }
+
+  luaio_http_route_memo_free(&memo);
+  return id;
+}
+
+/* @example: local id, params = router:match(request)
+ *           local id, params = router:match(method, path)
+ * @param: request {userdata(request)} the path is matched where the parser left it
+ * @return: id {integer|nil} nil if no route matches
+ * @return: params {table|nil} name => value of the :name and *name segments,
+ *    nil if the route has none, the values are not url decoded
+ */
+static int luaio_http_router_match(lua_State *L) {
+  luaio_http_check_router(L, match(request));
+
+  int method;
+  const char *path;
+  size_t len;
+
+  luaio_http_request_t *request = lua_touserdata(L, 2);
+  if (request != NULL && request->type == LUAIO_TYPE_HTTP_REQUEST) {
+    method = request->method;
+    path = request->url.path.base;
+    len = request->url.path.len;
+  } else {
+    lua_Integer m = luaL_checkinteger(L, 2);
+    if (m < HTTP_UNKNOWN || m >= LUAIO_HTTP_ROUTER_METHODS) {
+      return luaL_argerror(L, 2, "router:match(method, path) error: unknown method\n");
+    }
+
+    method = (int)m;
+    path = luaL_checklstring(L, 3, &len);
+  }
+
+  luaio_http_route_param_t params[LUAIO_HTTP_ROUTER_MAX_PARAMS];
+  size_t nparam = 0;
+  int id = path == NULL ? 0 : luaio_http_router_lookup(router, method, path, len, params, &nparam);
+  if (id == 0) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_pushinteger(L, id);
+  if (nparam == 0) return 1;
+
+  lua_createtable(L, 0, nparam);
+  for (size_t i = 0; i < nparam; i++) {
+    lua_pushlstring(L, params[i].name, params[i].name_len);
+    lua_pushlstring(L, params[i].value, params[i].value_len);
+    lua_rawset(L, -3);
+  }
+
+  return 2;
+}
+
+static int luaio_http_router_gc(lua_State *L) {
+  luaio_http_check_router(L, __gc());
+
+  for (int i = 0; i < LUAIO_HTTP_ROUTER_METHODS; i++) {
+    luaio_http_route_node_free(router->roots[i]);
+    router->roots[i] = NULL;
+  }
+
+  return 0;
+}
+
+void luaio_http_router_init(lua_State *L) {
+  luaL_Reg router_mtlib[] = {
+    { "add", luaio_http_router_add },
+    { "match", luaio_http_router_match },
+    { "__gc", luaio_http_router_gc },
+    { NULL, NULL }
+  };
+
+  lua_pushlightuserdata(L, &luaio_http_router_metatable_key);
+  luaL_newlib(L, router_mtlib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_rawset(L, LUA_REGISTRYINDEX);
+}
@@ -0,0 +1,55 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: compressed radix tree router, one tree per method.
+ *            patterns are made of static bytes, ":name" segments and a "*name" tail,
+ *            static edges are tried before ":name" and ":name" before "*name",
+ *            a failed branch is backtracked and is not walked again.
+ * @reference: https://github.com/julienschmidt/httprouter
+ */
+
+#ifndef LUAIO_HTTP_ROUTER_H
+#define LUAIO_HTTP_ROUTER_H
+
+#include "luaio.h"
+#include "luaio_http_parser.h"
+
+#define LUAIO_HTTP_ROUTER_MAX_PARAMS  16
+/*failed branches a lookup keeps on its stack, more are kept on the heap*/
+#define LUAIO_HTTP_ROUTER_FAILED      64
+/*methods are enum http_method, HTTP_UNKNOWN holds the routes of any method*/
+#define LUAIO_HTTP_ROUTER_METHODS     (HTTP_MKCALENDAR + 1)
+
+typedef struct luaio_http_route_node_s luaio_http_route_node_t;
+
+struct luaio_http_route_node_s {
+  char                    *label;       /*static bytes of the edge into this node*/
+  size_t                  label_len;
+  char                    *indices;     /*first bytes of the static children*/
+  luaio_http_route_node_t **children;
+  size_t                  nchildren;
+  luaio_http_route_node_t *param;       /*":name" child*/
+  char                    *name;        /*name of a ":name" node*/
+  size_t                  name_len;
+  char                    *wildcard;    /*name of the "*name" tail*/
+  size_t                  wildcard_len;
+  int                     wildcard_id;
+  int                     id;           /*route ending here, 0 if none*/
+};
+
+typedef struct {
+  const char  *name;
+  size_t      name_len;
+  const char  *value;
+  size_t      value_len;
+} luaio_http_route_param_t;
+
+typedef struct {
+  size_t                  type;
+  luaio_http_route_node_t *roots[LUAIO_HTTP_ROUTER_METHODS];
+} luaio_http_router_t;
+
+int luaio_http_new_router(lua_State *L);
+void luaio_http_router_init(lua_State *L);
+
+#endif /* LUAIO_HTTP_ROUTER_H */
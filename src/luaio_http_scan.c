@@ -0,0 +1,206 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: SIMD scanners for the http parser, picked at runtime by cpuid
+ * @reference: https://github.com/h2o/picohttpparser
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "luaio_http_scan.h"
+#include "luaio_http_parser.h"
+
+http_scan_fn http_scan_path = NULL;
+http_scan_fn http_scan_query = NULL;
+http_scan_fn http_scan_field = NULL;
+
+/* the scanners are process wide, they are picked once by luaio_global_init()
+ * before any loop thread starts and only read afterwards, -1 until then.
+ */
+static int http_scan_current = -1;
+
+/*only the strict parser is scanned, the loose one takes more url characters*/
+#if HTTP_PARSER_STRICT && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HTTP_SCAN_X86 1
+#endif
+
+#ifdef HTTP_SCAN_X86
+#include <immintrin.h>
+
+#define HTTP_SCAN_SSE42_TARGET  __attribute__((target("sse4.2")))
+#define HTTP_SCAN_AVX2_TARGET   __attribute__((target("avx2")))
+
+/*ranges of the bytes which end a path(_mm_cmpestri pairs)*/
+static const char http_scan_path_ranges[16] = {
+  '\x00', ' ', '#', '#', '?', '?', '\x7f', '\xff'
+};
+
+/*ranges of the bytes which end a query*/
+static const char http_scan_query_ranges[16] = {
+  '\x00', ' ', '#', '#', '\x7f', '\xff'
+};
+
+/*ranges of the bytes passed in a header name*/
+static const char http_scan_field_ranges[16] = {
+  'a', 'z', 'A', 'Z', '0', '9', '-', '-', '_', '_'
+};
+
+HTTP_SCAN_SSE42_TARGET
+static size_t http_scan_ranges_sse42(char *p, char *last, const char *ranges, int len) {
+  char *start = p;
+  __m128i r = _mm_loadu_si128((const __m128i*)ranges);
+
+  while (last - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    int i = _mm_cmpestri(r, len, v, 16,
+                         _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_LEAST_SIGNIFICANT);
+    if (i != 16) return p + i - start;
+    p += 16;
+  }
+
+  return p - start;
+}
+
+HTTP_SCAN_SSE42_TARGET
+static size_t http_scan_path_sse42(char *p, char *last) {
+  return http_scan_ranges_sse42(p, last, http_scan_path_ranges, 8);
+}
+
+HTTP_SCAN_SSE42_TARGET
+static size_t http_scan_query_sse42(char *p, char *last) {
+  return http_scan_ranges_sse42(p, last, http_scan_query_ranges, 6);
+}
+
+HTTP_SCAN_SSE42_TARGET
+static size_t http_scan_field_sse42(char *p, char *last) {
+  char *start = p;
+  __m128i r = _mm_loadu_si128((const __m128i*)http_scan_field_ranges);
+  __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m128i upper_A = _mm_set1_epi8('A' - 1);
+  __m128i upper_Z = _mm_set1_epi8('Z' + 1);
+  __m128i lower = _mm_set1_epi8(0x20);
+
+  while (last - p >= 16) {
+    __m128i v = _mm_loadu_si128((const __m128i*)p);
+    int i = _mm_cmpestri(r, 10, v, 16,
+                         _SIDD_UBYTE_OPS | _SIDD_CMP_RANGES | _SIDD_NEGATIVE_POLARITY | _SIDD_LEAST_SIGNIFICANT);
+
+    /*lower case the passed bytes only*/
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, upper_A), _mm_cmpgt_epi8(upper_Z, v));
+    upper = _mm_and_si128(upper, _mm_cmpgt_epi8(_mm_set1_epi8((char)i), index));
+    _mm_storeu_si128((__m128i*)p, _mm_or_si128(v, _mm_and_si128(upper, lower)));
+
+    if (i != 16) return p + i - start;
+    p += 16;
+  }
+
+  return p - start;
+}
+
+HTTP_SCAN_AVX2_TARGET
+static size_t http_scan_url_avx2(char *p, char *last, int query) {
+  char *start = p;
+  __m256i space = _mm256_set1_epi8(' ' + 1);
+  __m256i del = _mm256_set1_epi8('\x7f');
+  __m256i hash = _mm256_set1_epi8('#');
+  __m256i question = _mm256_set1_epi8(query ? '#' : '?');
+
+  while (last - p >= 32) {
+    __m256i v = _mm256_loadu_si256((const __m256i*)p);
+    /*signed: bytes >= 0x80 are negative, so they are below ' ' + 1 too*/
+    __m256i stop = _mm256_cmpgt_epi8(space, v);
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, del));
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, hash));
+    stop = _mm256_or_si256(stop, _mm256_cmpeq_epi8(v, question));
+
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(stop);
+    if (mask != 0) return p + __builtin_ctz(mask) - start;
+    p += 32;
+  }
+
+  return p - start;
+}
+
+HTTP_SCAN_AVX2_TARGET
+static size_t http_scan_path_avx2(char *p, char *last) {
+  size_t n = http_scan_url_avx2(p, last, 0);
+  if (last - p - n < 32) n += http_scan_path_sse42(p + n, last);
+  return n;
+}
+
+HTTP_SCAN_AVX2_TARGET
+static size_t http_scan_query_avx2(char *p, char *last) {
+  size_t n = http_scan_url_avx2(p, last, 1);
+  if (last - p - n < 32) n += http_scan_query_sse42(p + n, last);
+  return n;
+}
+
+#endif /* HTTP_SCAN_X86 */
+
+int http_scan_init() {
+  if (http_scan_current >= 0) return http_scan_current;
+
+  int level = HTTP_SCAN_NONE;
+
+#ifdef HTTP_SCAN_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("sse4.2")) level = HTTP_SCAN_SSE42;
+  if (level == HTTP_SCAN_SSE42 && __builtin_cpu_supports("avx2")) level = HTTP_SCAN_AVX2;
+#endif
+
+  const char *env = getenv("LUAIO_HTTP_SIMD");
+  if (env != NULL) {
+    int max = HTTP_SCAN_AVX2;
+    if (strcmp(env, "none") == 0) {
+      max = HTTP_SCAN_NONE;
+    } else if (strcmp(env, "sse4.2") == 0) {
+      max = HTTP_SCAN_SSE42;
+    }
+
+    if (level > max) level = max;
+  }
+
+  switch (level) {
+#ifdef HTTP_SCAN_X86
+    case HTTP_SCAN_AVX2:
+      http_scan_path = http_scan_path_avx2;
+      http_scan_query = http_scan_query_avx2;
+      /*header names are short, a 32 bytes block costs more than it skips*/
+      http_scan_field = http_scan_field_sse42;
+      break;
+
+    case HTTP_SCAN_SSE42:
+      http_scan_path = http_scan_path_sse42;
+      http_scan_query = http_scan_query_sse42;
+      http_scan_field = http_scan_field_sse42;
+      break;
+#endif
+
+    default:
+      http_scan_path = NULL;
+      http_scan_query = NULL;
+      http_scan_field = NULL;
+      break;
+  }
+
+  http_scan_current = level;
+  return level;
+}
+
+int http_scan_level() {
+  return http_scan_current < 0 ? HTTP_SCAN_NONE : http_scan_current;
+}
+
+const char *http_scan_level_name(int level) {
+  switch (level) {
+    case HTTP_SCAN_AVX2:
+      return "avx2";
+
+    case HTTP_SCAN_SSE42:
+      return "sse4.2";
+
+    default:
+      return "none";
+  }
+}
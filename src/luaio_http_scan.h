@@ -0,0 +1,48 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: SIMD scanners for the long runs of the http parser, the url
+ *            is skipped 16(SSE4.2) or 32(AVX2) bytes at a time and the header
+ *            names 16 bytes at a time, the parser falls back to its state
+ *            machine for every byte a scanner stops at.
+ */
+
+#ifndef LUAIO_HTTP_SCAN_H
+#define LUAIO_HTTP_SCAN_H
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stddef.h>
+
+#define HTTP_SCAN_NONE    0
+#define HTTP_SCAN_SSE42   1
+#define HTTP_SCAN_AVX2    2
+
+/* @overview: bytes at the start of [p, last) that the scanner has passed,
+ *            NULL when no SIMD is used.
+ */
+typedef size_t (*http_scan_fn)(char *p, char *last);
+
+/*path characters, stops at '?', '#', SP, CTLs and bytes >= 0x7f*/
+extern http_scan_fn http_scan_path;
+/*query characters, same as path but '?' is passed*/
+extern http_scan_fn http_scan_query;
+/*[a-zA-Z0-9-_], the bytes passed are lower cased in place*/
+extern http_scan_fn http_scan_field;
+
+/* @overview: pick the scanners supported by the cpu, $LUAIO_HTTP_SIMD(none|sse4.2|avx2)
+ *            caps the level. it is called once per process before the loops
+ *            start, later calls return the level picked then.
+ * @return: the level picked
+ */
+int http_scan_init();
+
+int http_scan_level();
+
+const char *http_scan_level_name(int level);
+
+#ifdef __cplusplus
+}
+#endif
+#endif /* LUAIO_HTTP_SCAN_H */
@@ -7,9 +7,15 @@
 #include "luaio.h"
 #include "luaio_init.h"
 #include "luaio_timer.h"
+#include "luaio_coroutine.h"
+#include "luaio_http_scan.h"
 
-static uint64_t luaio_start_time;
-static lua_State *luaio_main_thread;
+/*every loop thread runs its own lua state on its own loop*/
+static LUAIO_THREAD_LOCAL uv_loop_t *luaio_loop;
+static LUAIO_THREAD_LOCAL int luaio_thread_id;
+static LUAIO_THREAD_LOCAL uint64_t luaio_start_time;
+static LUAIO_THREAD_LOCAL lua_State *luaio_main_thread;
+static LUAIO_THREAD_LOCAL const char *luaio_lua_allocator = "default";
 
 static void luaio_sleep_timeout(uv_timer_t *handle) {
   lua_State *L = handle->data;
@@ -44,14 +50,24 @@ static void luaio_platform_init() {
   assert(ret == 0);
 }
 
-int luaio_init(lua_State *L, int argc, char* argv[]) {
-  /*config.h*/
+/*once per process, before any loop is started*/
+int luaio_global_init() {
   luaio_platform_init();
-  luaio_timer_init(LUAIO_MAX_FREE_TIMERS);
   luaio_date_init(); 
+  http_scan_init();
+  return luaio_dns_global_init();
+}
+
+int luaio_init(lua_State *L, uv_loop_t *loop, int thread_id, int argc, char* argv[]) {
+  luaio_loop = loop;
+  luaio_thread_id = thread_id;
+
+  /*config.h*/
+  luaio_timer_init(LUAIO_MAX_FREE_TIMERS);
+  luaio_coroutine_init(L, LUAIO_MAX_FREE_COROUTINES);
   luaio_dns_init(L);
 
-  luaio_start_time = uv_now(uv_default_loop());
+  luaio_start_time = uv_now(loop);
   luaio_main_thread = L;
 
   /*preload*/
@@ -91,6 +107,10 @@ int luaio_init(lua_State *L, int argc, char* argv[]) {
   lua_pushcfunction(L, luaopen_write_buffer);
   lua_setfield(L, -2, "write_buffer");
   
+  /*buffer_chain*/
+  lua_pushcfunction(L, luaopen_buffer_chain);
+  lua_setfield(L, -2, "buffer_chain");
+  
   /*dns*/
   lua_pushcfunction(L, luaopen_dns);
   lua_setfield(L, -2, "dns");
@@ -99,6 +119,10 @@ int luaio_init(lua_State *L, int argc, char* argv[]) {
   lua_pushcfunction(L, luaopen_tcp);
   lua_setfield(L, -2, "tcp_native");
   
+  /*udp_native*/
+  lua_pushcfunction(L, luaopen_udp);
+  lua_setfield(L, -2, "udp_native");
+  
   /*http_native*/
   lua_pushcfunction(L, luaopen_http);
   lua_setfield(L, -2, "http_native");
@@ -107,6 +131,18 @@ int luaio_init(lua_State *L, int argc, char* argv[]) {
   lua_pushcfunction(L, luaopen_fs);
   lua_setfield(L, -2, "fs_native");
   
+  /*zlib*/
+  lua_pushcfunction(L, luaopen_zlib);
+  lua_setfield(L, -2, "zlib");
+
+  /*querystring_native*/
+  lua_pushcfunction(L, luaopen_querystring);
+  lua_setfield(L, -2, "querystring_native");
+
+  /*thread_native*/
+  lua_pushcfunction(L, luaopen_thread);
+  lua_setfield(L, -2, "thread_native");
+  
   lua_pop(L, 1);
 
   /*__ARGV__*/
@@ -124,6 +160,16 @@ int luaio_init(lua_State *L, int argc, char* argv[]) {
   return 0;
 }
 
+/*the loop of the current thread*/
+uv_loop_t *luaio_get_loop() {
+  return luaio_loop;
+}
+
+/*0 for the main thread, spawned loop threads count from 1*/
+int luaio_get_thread_id() {
+  return luaio_thread_id;
+}
+
 lua_State *luaio_get_main_thread() {
   return luaio_main_thread;
 }
@@ -131,3 +177,11 @@ lua_State *luaio_get_main_thread() {
 uint64_t luaio_get_start_time() {
   return luaio_start_time;
 }
+
+void luaio_set_lua_allocator(const char *name) {
+  luaio_lua_allocator = name;
+}
+
+const char *luaio_get_lua_allocator() {
+  return luaio_lua_allocator;
+}
@@ -9,10 +9,16 @@
 
 #include "luaio.h"
 
-int luaio_init(lua_State *L, int argc, char *argv[]);
+int luaio_global_init();
+int luaio_init(lua_State *L, uv_loop_t *loop, int thread_id, int argc, char *argv[]);
+int luaio_run(uv_loop_t *loop, int thread_id, int argc, char *argv[]);
 
+uv_loop_t *luaio_get_loop();
+int luaio_get_thread_id();
 lua_State *luaio_get_main_thread();
 uint64_t luaio_get_start_time();
+void luaio_set_lua_allocator(const char *name);
+const char *luaio_get_lua_allocator();
 
 int luaopen_errno(lua_State *L);
 int luaopen_system(lua_State *L);
@@ -20,17 +26,29 @@ int luaopen_signal(lua_State *L);
 int luaopen_process(lua_State *L);
 
 int luaopen_strlib(lua_State *L);
+#define LUAIO_DATE_UTC_SIZE       sizeof("Tue, 10 Nov 2002 23:50:13 GMT") - 1
 void luaio_date_init(); 
+/*LUAIO_DATE_UTC_SIZE bytes of the current time, refreshed once per second from the loop time*/
+const char *luaio_date_get_http_date();
 int luaopen_date(lua_State *L);
 
 int luaopen_read_buffer(lua_State *L);
 int luaopen_write_buffer(lua_State *L);
+int luaopen_buffer_chain(lua_State *L);
 
 int luaio_parse_socket_address(lua_State *L, struct sockaddr_storage *addr);
+int luaio_dns_global_init();
 void luaio_dns_init(lua_State *L);
+void luaio_dns_destroy();
 int luaopen_dns(lua_State *L);
 int luaopen_tcp(lua_State *L);
+int luaopen_udp(lua_State *L);
 int luaopen_http(lua_State *L);
 int luaopen_fs(lua_State *L);
+int luaopen_zlib(lua_State *L);
+int luaopen_querystring(lua_State *L);
+
+int luaopen_thread(lua_State *L);
+void luaio_thread_join_all();
 
 #endif /* LUAIO_INIT_H */
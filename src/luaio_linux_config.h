@@ -37,4 +37,10 @@
 /*buffer*/
 #include <endian.h>
 
+/*splice*/
+#include <fcntl.h>
+
+/*socket:sendfile(fd, offset, length)*/
+#include <sys/sendfile.h>
+
 #endif /* LUAIO_LINUX_CONFIG_H */
@@ -6,17 +6,59 @@
 
 #include "luaio_pmemory.h"
 
+#ifdef LUAIO_POSIX
+#include <sys/mman.h>
+#endif
+
+/* small chunks(<= 4KB) are carved out of 64KB slabs, the slab is aligned to
+ * its size, so the owner slab of a chunk is found by masking the address.
+ * free chunks are tracked by a bitmap(1 = free) in the slab header.
+ *
+ *  slab                 base
+ *  |                    |
+ *  +--------------------+--------+--------+-----+--------+
+ *  | luaio_pmemory_slab_t | chunk0 | chunk1 | ... | chunkN |
+ *  +--------------------+--------+--------+-----+--------+
+ */
+#define LUAIO_PMEMORY_SLAB_SIZE           (64 * 1024)
+#define LUAIO_PMEMORY_SLAB_MASK           ((uintptr_t)(LUAIO_PMEMORY_SLAB_SIZE - 1))
+#define LUAIO_PMEMORY_SLAB_MAP_WORDS      16
+#define LUAIO_PMEMORY_SLAB_SLOTS          32
+/*empty slabs kept per size class before giving them back to the system*/
+#define LUAIO_PMEMORY_SLAB_MAX_EMPTY      1
+
 typedef struct {
   luaio_list_t  free_list;
+  /*slabs which have free chunks*/
+  luaio_list_t  slabs;
   uint32_t      max_free_chunks;
   uint32_t      free_chunks;
   uint32_t      capacity;
-  uint32_t      luaio;
+  uint32_t      used_chunks;
+  uint32_t      stride;
+  uint32_t      slab_chunks;
+  uint32_t      nslabs;
+  uint32_t      empty_slabs;
+  uint64_t      hits;
+  uint64_t      misses;
+  uint64_t      releases;
 } luaio_pmemory_pool_t;
 
-#define LUAIO_PMEMORY_MAX_SLOT  64
+typedef struct {
+  luaio_list_t          list;
+  luaio_pmemory_pool_t  *pool;
+  char                  *base;
+  uint32_t              used;
+  uint32_t              hint;
+  uint64_t              map[LUAIO_PMEMORY_SLAB_MAP_WORDS];
+} luaio_pmemory_slab_t;
+
+#define LUAIO_PMEMORY_SLAB_HEADER_SIZE \
+  luaio_align(sizeof(luaio_pmemory_slab_t), LUAIO_PMEMORY_SMALL_CHUNK_ALIGNMENT)
 
-static luaio_pmemory_pool_t luaio_pmemory_pool[LUAIO_PMEMORY_MAX_SLOT];
+/*one set of pools per loop thread, chunks must be freed by the thread which allocated them*/
+static LUAIO_THREAD_LOCAL luaio_pmemory_pool_t luaio_pmemory_pool[LUAIO_PMEMORY_MAX_SLOT];
+static LUAIO_THREAD_LOCAL luaio_pmemory_huge_stats_t luaio_pmemory_huge;
 
 static const uint32_t max_free_chunks[LUAIO_PMEMORY_MAX_SLOT] = {
   16384, 16384, 16384, 16384, 16384, 16384, 16384, 16384,
@@ -89,15 +131,242 @@ void luaio_pmemory_init() {
   for (size_t i = 0; i < LUAIO_PMEMORY_MAX_SLOT; i++) {
     pool = &luaio_pmemory_pool[i];
     luaio_list_init(&pool->free_list);
+    luaio_list_init(&pool->slabs);
     pool->max_free_chunks = max_free_chunks[i];
     pool->free_chunks = 0;
     pool->capacity = capacity_table[i];
-    pool->luaio = 0;
+    pool->used_chunks = 0;
+    pool->stride = capacity_table[i] + sizeof(luaio_pmemory_chunk_t);
+    pool->nslabs = 0;
+    pool->empty_slabs = 0;
+    pool->hits = 0;
+    pool->misses = 0;
+    pool->releases = 0;
+
+    if (i < LUAIO_PMEMORY_SLAB_SLOTS) {
+      pool->slab_chunks = (LUAIO_PMEMORY_SLAB_SIZE - LUAIO_PMEMORY_SLAB_HEADER_SIZE) / pool->stride;
+      assert(pool->slab_chunks <= LUAIO_PMEMORY_SLAB_MAP_WORDS * 64);
+    } else {
+      pool->slab_chunks = 0;
+    }
+  }
+
+  luaio_memzero(&luaio_pmemory_huge, sizeof(luaio_pmemory_huge_stats_t));
+}
+
+/*return -1 if size is not served by the pools*/
+static int luaio_pmemory_get_index(size_t size) {
+  size_t aligned_size;
+  if (size == 0) return -1;
+
+  if (size <= LUAIO_PMEMORY_MAX_SMALL_CHUNK_SIZE) {
+    aligned_size = luaio_align(size, LUAIO_PMEMORY_SMALL_CHUNK_ALIGNMENT);
+    return indexes_small[(aligned_size >> LUAIO_PMEMORY_SMALL_CHUNK_SHIFT) - 1];
+  } 
+  
+  if (size <= LUAIO_PMEMORY_MAX_LARGE_CHUNK_SIZE) {
+    aligned_size = luaio_align(size, LUAIO_PMEMORY_LARGE_CHUNK_ALIGNMENT);
+    return indexes_large[(aligned_size >> LUAIO_PMEMORY_LARGE_CHUNK_SHIFT) - 1];
+  }
+
+  return -1;
+}
+
+int luaio_pmemory_get_stats(size_t index, luaio_pmemory_stats_t *stats) {
+  if (index >= LUAIO_PMEMORY_MAX_SLOT) return -1;
+
+  luaio_pmemory_pool_t *pool = &luaio_pmemory_pool[index];
+  stats->hits = pool->hits;
+  stats->misses = pool->misses;
+  stats->releases = pool->releases;
+  stats->capacity = pool->capacity;
+  stats->max_free_chunks = pool->max_free_chunks;
+  stats->free_chunks = pool->free_chunks;
+  stats->used_chunks = pool->used_chunks;
+  stats->slabs = pool->nslabs;
+  return 0;
+}
+
+void luaio_pmemory_get_huge_stats(luaio_pmemory_huge_stats_t *stats) {
+  *stats = luaio_pmemory_huge;
+}
+
+static void luaio_pmemory_slab_destroy(luaio_pmemory_slab_t *slab) {
+  luaio_pmemory_pool_t *pool = slab->pool;
+  luaio_list_remove(&slab->list);
+  pool->nslabs--;
+  pool->empty_slabs--;
+  pool->free_chunks -= pool->slab_chunks;
+  pool->releases += pool->slab_chunks;
+
+#ifdef LUAIO_POSIX
+  munmap(slab, LUAIO_PMEMORY_SLAB_SIZE);
+#else
+  luaio_free(slab);
+#endif
+}
+
+/*give back empty slabs until the free chunks fit in max_free_chunks*/
+static void luaio_pmemory_slab_trim(luaio_pmemory_pool_t *pool) {
+  luaio_list_t *head = &pool->slabs;
+  luaio_list_t *list = head->next;
+
+  while (list != head && pool->free_chunks > pool->max_free_chunks) {
+    luaio_pmemory_slab_t *slab = luaio_list_entry(list, luaio_pmemory_slab_t, list);
+    list = list->next;
+    if (slab->used == 0) luaio_pmemory_slab_destroy(slab);
+  }
+}
+
+static void luaio_pmemory_pool_trim(size_t index, uint32_t max_free_chunks) {
+  luaio_pmemory_pool_t *pool = &luaio_pmemory_pool[index];
+  luaio_list_t *free_list = &pool->free_list;
+  pool->max_free_chunks = max_free_chunks;
+
+  if (index < LUAIO_PMEMORY_SLAB_SLOTS) {
+    luaio_pmemory_slab_trim(pool);
+    return;
+  }
+
+  while (pool->free_chunks > max_free_chunks) {
+    luaio_list_t *list = free_list->next;
+    luaio_list_remove(list);
+    luaio_free(luaio_list_entry(list, luaio_pmemory_chunk_t, list));
+    pool->free_chunks--;
+    pool->releases++;
+  }
+}
+
+/* @overview: retune the free list cap of the size class which serves size,
+ *            cached chunks beyond the new cap are given back to the system.
+ * @return: capacity of the size class, 0 if size is not served by the pools
+ */
+size_t luaio_pmemory_set_max_free_chunks(size_t size, uint32_t max_free_chunks) {
+  int index = luaio_pmemory_get_index(size);
+  if (index < 0) return 0;
+
+  luaio_pmemory_pool_trim(index, max_free_chunks);
+  return luaio_pmemory_pool[index].capacity;
+}
+
+/*give back all cached chunks and empty slabs of the current thread*/
+void luaio_pmemory_destroy() {
+  for (size_t i = 0; i < LUAIO_PMEMORY_MAX_SLOT; i++) {
+    luaio_pmemory_pool_trim(i, 0);
   }
 }
 
 #ifdef LUAIO_USE_PMEMORY
 
+static inline uint32_t luaio_pmemory_ctz(uint64_t word) {
+#if LUAIO_HAS_BUILTIN_CTZ
+  return __builtin_ctzll(word);
+#else
+  uint32_t n = 0;
+  while (!(word & 1)) {
+    word >>= 1;
+    n++;
+  }
+  return n;
+#endif
+}
+
+static luaio_pmemory_slab_t *luaio_pmemory_slab_create(luaio_pmemory_pool_t *pool) {
+  luaio_pmemory_slab_t *slab;
+
+#ifdef LUAIO_POSIX
+  /*map twice the size and trim to get a size aligned slab*/
+  size_t size = LUAIO_PMEMORY_SLAB_SIZE * 2;
+  char *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (p == MAP_FAILED) return NULL;
+
+  char *aligned = (char*)(((uintptr_t)p + LUAIO_PMEMORY_SLAB_MASK) & ~LUAIO_PMEMORY_SLAB_MASK);
+  size_t head = aligned - p;
+  size_t tail = size - head - LUAIO_PMEMORY_SLAB_SIZE;
+  if (head) munmap(p, head);
+  if (tail) munmap(aligned + LUAIO_PMEMORY_SLAB_SIZE, tail);
+  slab = (luaio_pmemory_slab_t*)aligned;
+#else
+  slab = luaio_memalign(LUAIO_PMEMORY_SLAB_SIZE, LUAIO_PMEMORY_SLAB_SIZE);
+  if (slab == NULL) return NULL;
+#endif
+
+  uint32_t nchunks = pool->slab_chunks;
+  slab->pool = pool;
+  slab->base = (char*)slab + LUAIO_PMEMORY_SLAB_HEADER_SIZE;
+  slab->used = 0;
+  slab->hint = 0;
+
+  luaio_memzero(slab->map, sizeof(slab->map));
+  for (uint32_t i = 0; i < nchunks; i++) {
+    slab->map[i >> 6] |= (uint64_t)1 << (i & 63);
+  }
+
+  luaio_list_insert_head(&slab->list, &pool->slabs);
+  pool->nslabs++;
+  pool->empty_slabs++;
+  pool->free_chunks += nchunks;
+  return slab;
+}
+
+static void *luaio_pmemory_slab_alloc(luaio_pmemory_pool_t *pool) {
+  luaio_list_t *slabs = &pool->slabs;
+  luaio_pmemory_slab_t *slab;
+
+  if (!luaio_list_is_empty(slabs)) {
+    slab = luaio_list_entry(slabs->next, luaio_pmemory_slab_t, list);
+    pool->hits++;
+  } else {
+    slab = luaio_pmemory_slab_create(pool);
+    if (slab == NULL) return NULL;
+    pool->misses++;
+  }
+
+  /*the hint word is the lowest word which may have free chunks*/
+  uint32_t word = slab->hint;
+  while (slab->map[word] == 0) word++;
+  uint32_t bit = luaio_pmemory_ctz(slab->map[word]);
+  slab->map[word] &= ~((uint64_t)1 << bit);
+  slab->hint = word;
+
+  if (slab->used++ == 0) pool->empty_slabs--;
+  if (slab->used == pool->slab_chunks) luaio_list_remove(&slab->list);
+
+  pool->free_chunks--;
+  pool->used_chunks++;
+
+  luaio_pmemory_chunk_t *chunk = (luaio_pmemory_chunk_t*)(slab->base + (size_t)((word << 6) + bit) * pool->stride);
+  chunk->cookie.capacity = pool->capacity;
+  chunk->cookie.size = 0;
+  return (void*)((char*)chunk + sizeof(luaio_pmemory_chunk_t));
+}
+
+static void luaio_pmemory_slab_free(luaio_pmemory_chunk_t *chunk) {
+  luaio_pmemory_slab_t *slab = (luaio_pmemory_slab_t*)((uintptr_t)chunk & ~LUAIO_PMEMORY_SLAB_MASK);
+  luaio_pmemory_pool_t *pool = slab->pool;
+
+  uint32_t index = ((char*)chunk - slab->base) / pool->stride;
+  uint32_t word = index >> 6;
+  slab->map[word] |= (uint64_t)1 << (index & 63);
+  if (word < slab->hint) slab->hint = word;
+
+  /*full slab gets free chunks again*/
+  if (slab->used-- == pool->slab_chunks) {
+    luaio_list_insert_head(&slab->list, &pool->slabs);
+  }
+
+  pool->free_chunks++;
+  pool->used_chunks--;
+
+  if (slab->used == 0) {
+    pool->empty_slabs++;
+    if (pool->empty_slabs > LUAIO_PMEMORY_SLAB_MAX_EMPTY 
+        || pool->free_chunks > pool->max_free_chunks) {
+      luaio_pmemory_slab_destroy(slab);
+    }
+  }
+}
+
 static void *luaio_pmemory_alloc(luaio_pmemory_pool_t *pool) {
   luaio_list_t *free_list = &pool->free_list;
   size_t capacity = pool->capacity;
@@ -108,11 +377,15 @@ static void *luaio_pmemory_alloc(luaio_pmemory_pool_t *pool) {
     chunk = luaio_list_entry(list, luaio_pmemory_chunk_t, list);
     luaio_list_remove(list);
     pool->free_chunks--;  
+    pool->hits++;
   } else {
     chunk = luaio_memalign(LUAIO_PMEMORY_ALIGNMENT, capacity + sizeof(luaio_pmemory_chunk_t));
     if (chunk == NULL) return NULL;
+    pool->misses++;
   }
 
+  pool->used_chunks++;
+
   chunk->cookie.capacity = capacity;
   chunk->cookie.size = 0;
   return (void*)((char*)chunk + sizeof(luaio_pmemory_chunk_t));
@@ -124,7 +397,7 @@ void *luaio_palloc(size_t size) {
   if (size <= LUAIO_PMEMORY_MAX_SMALL_CHUNK_SIZE) {
     aligned_size = luaio_align(size, LUAIO_PMEMORY_SMALL_CHUNK_ALIGNMENT);
     index = indexes_small[(aligned_size >> LUAIO_PMEMORY_SMALL_CHUNK_SHIFT) - 1];
-    return luaio_pmemory_alloc(&luaio_pmemory_pool[index]);
+    return luaio_pmemory_slab_alloc(&luaio_pmemory_pool[index]);
   } else if (size <= LUAIO_PMEMORY_MAX_LARGE_CHUNK_SIZE) {
     aligned_size = luaio_align(size, LUAIO_PMEMORY_LARGE_CHUNK_ALIGNMENT);
     index = indexes_large[(aligned_size >> LUAIO_PMEMORY_LARGE_CHUNK_SHIFT) - 1];
@@ -132,6 +405,8 @@ void *luaio_palloc(size_t size) {
   } else {
     luaio_pmemory_chunk_t *chunk = luaio_memalign(LUAIO_PMEMORY_ALIGNMENT, size + sizeof(luaio_pmemory_chunk_t));
     if (chunk == NULL) return NULL;
+    luaio_pmemory_huge.allocs++;
+    luaio_pmemory_huge.used_bytes += size;
     chunk->cookie.capacity = size;
     chunk->cookie.size = 0;
     return (void*)((char*)chunk + sizeof(luaio_pmemory_chunk_t));
@@ -148,23 +423,22 @@ void luaio_pfree(void *p) {
     size_t capacity = chunk->cookie.capacity;
 
     if (capacity <= LUAIO_PMEMORY_MAX_SMALL_CHUNK_SIZE) {
-      /*aligned_size = luaio_align(size, LUAIO_PMEMORY_SMALL_CHUNK_ALIGNMENT);*/
-      index = indexes_small[(capacity >> LUAIO_PMEMORY_SMALL_CHUNK_SHIFT) - 1];
-      pool = &luaio_pmemory_pool[index];
-      if (pool->free_chunks < pool->max_free_chunks) {
-        luaio_list_insert_head(&chunk->list, &pool->free_list);
-        pool->free_chunks++;
-        return;
-      }
+      luaio_pmemory_slab_free(chunk);
+      return;
     } else if (capacity <= LUAIO_PMEMORY_MAX_LARGE_CHUNK_SIZE) {
       /*aligned_size = luaio_align(size, LUAIO_PMEMORY_LARGE_CHUNK_ALIGNMENT);*/
       index = indexes_large[(capacity >> LUAIO_PMEMORY_LARGE_CHUNK_SHIFT) - 1];
       pool = &luaio_pmemory_pool[index];
+      pool->used_chunks--;
       if (pool->free_chunks < pool->max_free_chunks) {
         luaio_list_insert_head(&chunk->list, &pool->free_list);
         pool->free_chunks++;
         return;
       }
+      pool->releases++;
+    } else {
+      luaio_pmemory_huge.frees++;
+      luaio_pmemory_huge.used_bytes -= capacity;
     }
 
     luaio_free(chunk);
@@ -190,8 +464,12 @@ void luaio_pfree(void *p) {
 
 #endif
 
-void *luaio_prealloc(void *p, size_t size) {
-  if (size == 0 && p != NULL) {
+/* @overview: resize p to size, only the first used bytes are preserved.
+ *            shrinking stays in place unless more than half of the chunk
+ *            would be wasted, then the data moves to a fitting size class.
+ */
+void *luaio_prealloc_used(void *p, size_t used, size_t size) {
+  if (size == 0) {
     luaio_pfree(p);
     return NULL;
   }
@@ -202,13 +480,45 @@ void *luaio_prealloc(void *p, size_t size) {
   size_t old_capacity = old_chunk->cookie.capacity;
 
   if (size <= old_capacity) {
-    return p;
+    if (size > (old_capacity >> 1)) return p;
+
+#ifdef LUAIO_USE_PMEMORY
+    /*already the smallest size class which fits*/
+    int index = luaio_pmemory_get_index(size);
+    if (index >= 0 && capacity_table[index] == old_capacity) return p;
+#endif
   }
 
+#ifdef LUAIO_USE_PMEMORY
+  /*huge chunks are plain malloc blocks, let realloc grow or shrink them in place*/
+  if (old_capacity > LUAIO_PMEMORY_MAX_LARGE_CHUNK_SIZE 
+      && size > LUAIO_PMEMORY_MAX_LARGE_CHUNK_SIZE) {
+    luaio_pmemory_chunk_t *chunk = luaio_realloc(old_chunk, size + sizeof(luaio_pmemory_chunk_t));
+    if (chunk == NULL) {
+      return size <= old_capacity ? p : NULL;
+    }
+
+    luaio_pmemory_huge.used_bytes += size;
+    luaio_pmemory_huge.used_bytes -= old_capacity;
+    chunk->cookie.capacity = size;
+    return (void*)((char*)chunk + sizeof(luaio_pmemory_chunk_t));
+  }
+#endif
+
   void *new_p = luaio_palloc(size);
-  if (new_p == NULL) return NULL;
-  luaio_memcpy(new_p, p, old_capacity);
+  if (new_p == NULL) {
+    return size <= old_capacity ? p : NULL;
+  }
+
+  if (used > old_capacity) used = old_capacity;
+  if (used > size) used = size;
+  luaio_memcpy(new_p, p, used);
   luaio_pfree(p);
 
   return new_p;
 }
+
+void *luaio_prealloc(void *p, size_t size) {
+  if (p == NULL) return luaio_palloc(size);
+  return luaio_prealloc_used(p, luaio_pmemory_get_capacity(p), size);
+}
@@ -22,11 +22,37 @@ typedef union {
   luaio_pmemory_cookie_t    cookie;
 } luaio_pmemory_chunk_t;
 
+typedef struct {
+  uint64_t  hits;           /* allocations served by a cached chunk: a partial slab, or the free list of a large class */
+  uint64_t  misses;         /* allocations which first mapped a new slab, or went to malloc for a large class */
+  uint64_t  releases;       /* chunks given back to the system: those of an unmapped empty slab, or large chunks freed past max_free_chunks */
+  uint32_t  capacity;
+  uint32_t  max_free_chunks;
+  uint32_t  free_chunks;
+  uint32_t  used_chunks;
+  uint32_t  slabs;          /* slabs backing the class, small classes only */
+} luaio_pmemory_stats_t;
+
+/*chunks bigger than LUAIO_PMEMORY_MAX_LARGE_CHUNK_SIZE always go to malloc*/
+typedef struct {
+  uint64_t  allocs;
+  uint64_t  frees;
+  uint64_t  used_bytes;
+} luaio_pmemory_huge_stats_t;
+
+#define LUAIO_PMEMORY_MAX_SLOT  64
+
 void luaio_pmemory_init();
+void luaio_pmemory_destroy();
+
+int luaio_pmemory_get_stats(size_t index, luaio_pmemory_stats_t *stats);
+void luaio_pmemory_get_huge_stats(luaio_pmemory_huge_stats_t *stats);
+size_t luaio_pmemory_set_max_free_chunks(size_t size, uint32_t max_free_chunks);
 
 void *luaio_palloc(size_t size);
 void luaio_pfree(void *p);
 void *luaio_prealloc(void *p, size_t size);
+void *luaio_prealloc_used(void *p, size_t used, size_t size);
 
 static inline size_t luaio_pmemory_get_capacity(void* p) {
   luaio_pmemory_chunk_t *chunk = (luaio_pmemory_chunk_t*)((char*)p - sizeof(luaio_pmemory_chunk_t));
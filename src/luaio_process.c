@@ -13,14 +13,14 @@ typedef struct {
   int           onexit_ref;
 } luaio_process_t;
 
-static uv_stdio_container_t luaio_process_stdio[3];
+static LUAIO_THREAD_LOCAL uv_stdio_container_t luaio_process_stdio[3];
 
 /* @brief: return number of seconds the process has been running
  * @example: local uptime = process_native.uptime()
  * @return: uptime {integer}
  */
 static int luaio_process_uptime(lua_State *L) {
-  uv_loop_t *loop = uv_default_loop();
+  uv_loop_t *loop = luaio_get_loop();
   uv_update_time(loop);
   uint64_t uptime = uv_now(loop) - luaio_get_start_time();
 
@@ -196,7 +196,7 @@ static int luaio_process_spawn(lua_State *L) {
   process->onexit_ref = onexit_ref;
 
   uv_process_t *handle = &process->handle;
-  int ret = uv_spawn(uv_default_loop(), handle, &options);
+  int ret = uv_spawn(luaio_get_loop(), handle, &options);
   luaio_free(args);
 
   if (ret < 0) {
@@ -0,0 +1,277 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: url decode, url encode and query string parsing in one pass,
+ *            a key or a value becomes one lua string, the escaped ones are
+ *            decoded into a stack buffer first.
+ */
+
+#include "luaio.h"
+#include "luaio_init.h"
+#include "luaio_stack_buffer.h"
+#include "luaio_querystring.h"
+
+static int luaio_querystring_unhex(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'A' && c <= 'F') return 10 + (c - 'A');
+  if (c >= 'a' && c <= 'f') return 10 + (c - 'a');
+  return -1;
+}
+
+size_t luaio_urldecode(char *dst, const char *src, size_t len) {
+  size_t k = 0;
+  for (size_t i = 0; i < len; i++) {
+    char c = src[i];
+    if (c == '+') {
+      c = ' ';
+    } else if (c == '%' && i + 2 < len) {
+      int hi = luaio_querystring_unhex(src[i + 1]);
+      int lo = luaio_querystring_unhex(src[i + 2]);
+      if (hi >= 0 && lo >= 0) {
+        c = (char)((hi << 4) | lo);
+        i += 2;
+      }
+    }
+
+    if (c == '\n' && k > 0 && dst[k - 1] == '\r') {
+      dst[k - 1] = '\n';
+      continue;
+    }
+
+    dst[k++] = c;
+  }
+
+  return k;
+}
+
+/*RFC 3986 unreserved characters are not escaped*/
+static int luaio_querystring_unreserved(unsigned char c) {
+  return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9')
+    || c == '-' || c == '_' || c == '.' || c == '~';
+}
+
+/*the bytes of a string or a slice, NULL otherwise*/
+static const char *luaio_querystring_check_data(lua_State *L, int index, size_t *len) {
+  int type = lua_type(L, index);
+  if (type == LUA_TSTRING || type == LUA_TNUMBER) {
+    return lua_tolstring(L, index, len);
+  }
+
+  if (type == LUA_TUSERDATA) {
+    luaio_buffer_slice_t *slice = lua_touserdata(L, index);
+    if (slice->type == LUAIO_TYPE_BUFFER_SLICE && !luaio_buffer_slice_is_stale(slice)) {
+      *len = slice->len;
+      return slice->base;
+    }
+  }
+
+  return NULL;
+}
+
+/*push s decoded, buf has room for n bytes*/
+static void luaio_querystring_push_token(lua_State *L, const char *s, size_t n, char *buf) {
+  for (size_t i = 0; i < n; i++) {
+    char c = s[i];
+    if (c == '%' || c == '+' || c == '\r') {
+      luaio_memcpy(buf, s, i);
+      size_t len = i + luaio_urldecode(buf + i, s + i, n - i);
+      lua_pushlstring(L, buf, len);
+      return;
+    }
+  }
+
+  lua_pushlstring(L, s, n);
+}
+
+/*the key and the value are on the top of the stack, the table is below them*/
+static void luaio_querystring_set(lua_State *L) {
+  lua_pushvalue(L, -2);
+  lua_rawget(L, -4);
+
+  int type = lua_type(L, -1);
+  if (type == LUA_TNIL) {
+    lua_pop(L, 1);
+    lua_rawset(L, -3);
+  } else if (type == LUA_TTABLE) {
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, lua_objlen(L, -2) + 1);
+    lua_pop(L, 2);
+  } else {
+    lua_createtable(L, 2, 0);
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, 1);
+    lua_insert(L, -2);
+    lua_rawseti(L, -2, 2);
+    lua_rawset(L, -3);
+  }
+}
+
+int luaio_querystring_push_args(lua_State *L, const char *query, size_t len, char sep, char eq, size_t max) {
+  lua_createtable(L, 0, 4);
+  if (len == 0) return 0;
+
+  luaio_stack_buffer_t stack_buf;
+  char *buf = luaio_stack_buffer_init(&stack_buf, len);
+  if (buf == NULL) return UV_ENOMEM;
+
+  const char *p = query;
+  const char *last = query + len;
+  size_t n = 0;
+  while (p < last) {
+    const char *end = memchr(p, sep, last - p);
+    if (end == NULL) end = last;
+
+    if (end != p) {
+      if (max > 0 && n == max) break;
+      n++;
+
+      const char *value = memchr(p, eq, end - p);
+      const char *key_end = value == NULL ? end : value++;
+      luaio_querystring_push_token(L, p, key_end - p, buf);
+      if (value == NULL) {
+        lua_pushliteral(L, "");
+      } else {
+        luaio_querystring_push_token(L, value, end - value, buf);
+      }
+
+      luaio_querystring_set(L);
+    }
+
+    p = end + 1;
+  }
+
+  luaio_stack_buffer_free(&stack_buf);
+  return 0;
+}
+
+/* @example: local str = querystring_native.urldecode(str)
+ * @param: str {string|slice}
+ * @return: str {string} '+' is space, invalid %XX is kept, CRLF becomes LF
+ */
+static int luaio_querystring_urldecode(lua_State *L) {
+  size_t len;
+  const char *src = luaio_querystring_check_data(L, 1, &len);
+  if (src == NULL) {
+    return luaL_argerror(L, 1, "querystring.urldecode(str) error: str must be [string|slice]\n");
+  }
+
+  luaio_stack_buffer_t stack_buf;
+  char *buf = luaio_stack_buffer_init(&stack_buf, len);
+  if (buf == NULL) {
+    return luaL_error(L, "querystring.urldecode(str) error: no memory\n");
+  }
+
+  luaio_querystring_push_token(L, src, len, buf);
+  luaio_stack_buffer_free(&stack_buf);
+  return 1;
+}
+
+/* @example: local str = querystring_native.urlencode(str)
+ * @param: str {string}
+ * @return: str {string} all but RFC 3986 unreserved bytes are %XX, LF is sent as CRLF
+ */
+static int luaio_querystring_urlencode(lua_State *L) {
+  size_t len;
+  const char *src = luaL_checklstring(L, 1, &len);
+
+  size_t size = len;
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = src[i];
+    if (!luaio_querystring_unreserved(c)) size += c == '\n' ? 5 : 2;
+  }
+
+  if (size == len) {
+    lua_pushvalue(L, 1);
+    return 1;
+  }
+
+  luaio_stack_buffer_t stack_buf;
+  char *dst = luaio_stack_buffer_init(&stack_buf, size);
+  if (dst == NULL) {
+    return luaL_error(L, "querystring.urlencode(str) error: no memory\n");
+  }
+
+  static const char hex[] = "0123456789ABCDEF";
+  size_t k = 0;
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = src[i];
+    if (luaio_querystring_unreserved(c)) {
+      dst[k++] = c;
+      continue;
+    }
+
+    if (c == '\n') {
+      dst[k++] = '%';
+      dst[k++] = '0';
+      dst[k++] = 'D';
+    }
+
+    dst[k++] = '%';
+    dst[k++] = hex[c >> 4];
+    dst[k++] = hex[c & 15];
+  }
+
+  lua_pushlstring(L, dst, k);
+  luaio_stack_buffer_free(&stack_buf);
+  return 1;
+}
+
+static char luaio_querystring_check_char(lua_State *L, int index, char def, const char *msg) {
+  size_t len;
+  const char *s = luaL_optlstring(L, index, NULL, &len);
+  if (s == NULL) return def;
+  if (len != 1) luaL_argerror(L, index, msg);
+  return s[0];
+}
+
+/* @example: local args = querystring_native.parse(query[, sep, eq, max])
+ * @param: query {nil|string|slice}
+ * @param: sep {string|default: '&'} one character
+ * @param: eq {string|default: '='} one character
+ * @param: max {integer|default: 0} pairs read at most, 0 means all
+ * @return: args {table} key => value, a repeated key has the array of its values
+ */
+static int luaio_querystring_parse(lua_State *L) {
+  size_t len = 0;
+  const char *query = NULL;
+  if (!lua_isnoneornil(L, 1)) {
+    query = luaio_querystring_check_data(L, 1, &len);
+    if (query == NULL) {
+      return luaL_argerror(L, 1, "querystring.parse(query, sep, eq, max) error: query must be [nil|string|slice]\n");
+    }
+  }
+
+  char sep = luaio_querystring_check_char(L, 2, '&', "querystring.parse(query, sep, eq, max) error: sep must be one character\n");
+  char eq = luaio_querystring_check_char(L, 3, '=', "querystring.parse(query, sep, eq, max) error: eq must be one character\n");
+  lua_Integer max = luaL_optinteger(L, 4, 0);
+  if (max < 0) max = 0;
+
+  if (luaio_querystring_push_args(L, query, len, sep, eq, (size_t)max) < 0) {
+    return luaL_error(L, "querystring.parse(query, sep, eq, max) error: no memory\n");
+  }
+
+  return 1;
+}
+
+int luaopen_querystring(lua_State *L) {
+  luaL_Reg lib[] = {
+    { "urldecode", luaio_querystring_urldecode },
+    { "urlencode", luaio_querystring_urlencode },
+    { "parse", luaio_querystring_parse },
+    { "__newindex", luaio_cannot_change },
+    { NULL, NULL }
+  };
+
+  lua_createtable(L, 0, 0);
+
+  luaL_newlib(L, lib);
+
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushliteral(L, "metatable is protected.");
+  lua_setfield(L, -2, "__metatable");
+
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
@@ -0,0 +1,26 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: url decode, url encode and query string parsing in one pass
+ */
+
+#ifndef LUAIO_QUERYSTRING_H
+#define LUAIO_QUERYSTRING_H
+
+#include "luaio.h"
+
+/*pairs read by request:query_args() unless told otherwise*/
+#define LUAIO_QUERYSTRING_MAX_ARGS  100
+
+/* decode src into dst(at least len bytes), '+' is space, invalid %XX is kept,
+ * CRLF becomes LF. dst may be src.
+ */
+size_t luaio_urldecode(char *dst, const char *src, size_t len);
+
+/* push the table of the pairs of query, a repeated key has the array of
+ * its values, a key without eq has ''. at most max pairs are read, 0 means all.
+ * @return: 0 or UV_ENOMEM, the table is pushed anyway
+ */
+int luaio_querystring_push_args(lua_State *L, const char *query, size_t len, char sep, char eq, size_t max);
+
+#endif /* LUAIO_QUERYSTRING_H */
@@ -15,6 +15,17 @@ static char luaio_read_buffer_metatable_key;
     return luaL_argerror(L, 1, "buffer:"#name" error: buffer must be [userdata](read_buffer)\n"); \
   }
 
+/*the memory of an adaptive buffer is released while empty, reading it is reading an empty buffer*/
+#define luaio_read_buffer_check_memory(L, name) \
+  if (buffer->capacity == 0) { \
+    if (buffer->max_size == 0) { \
+      return luaL_error(L, "buffer:"#name" error: no memory available\n"); \
+    } \
+    lua_pushnil(L); \
+    lua_pushinteger(L, LUAIO_EAGAIN); \
+    return 2; \
+  }
+
 #define luaio_buffer_check_rest_size(n) \
   if (n == rest_size) { \
     start = buffer->start; \
@@ -25,12 +36,20 @@ static char luaio_read_buffer_metatable_key;
   }
 
 /* local read_buffer = require('read_buffer')
- * local buffer = read_buffer.new(size)
+ * local buffer = read_buffer.new(size[, max_size])
+ * with max_size the buffer is adaptive, it starts with size bytes, grows up to
+ * max_size when a read(n), readline() or request head needs more, and gives
+ * its memory back to pmemory when it is empty before the socket reads again.
  */
 static int luaio_read_buffer_new(lua_State *L) {
   lua_Integer size = luaL_checkinteger(L, 1);
   if (size <= 0) {
-    return luaL_argerror(L, 1, "read_buffer.new(size) error: size must be > 0\n"); 
+    return luaL_argerror(L, 1, "read_buffer.new(size[, max_size]) error: size must be > 0\n"); 
+  }
+
+  lua_Integer max_size = luaL_optinteger(L, 2, 0);
+  if (max_size != 0 && max_size < size) {
+    return luaL_argerror(L, 2, "read_buffer.new(size[, max_size]) error: max_size must be >= size\n"); 
   }
 
   luaio_buffer_t *buffer = lua_newuserdata(L, sizeof(luaio_buffer_t));
@@ -42,6 +61,8 @@ static int luaio_read_buffer_new(lua_State *L) {
   buffer->type = LUAIO_TYPE_READ_BUFFER;
   buffer->size = size;
   buffer->capacity = 0;
+  buffer->max_size = max_size;
+  buffer->generation = 0;
   buffer->start = NULL;
   buffer->read_pos = NULL;
   buffer->write_pos = NULL;
@@ -54,12 +75,17 @@ static int luaio_read_buffer_new(lua_State *L) {
   return 1;
 }
 
-/* local data, err = buffer:read(n)  read n bytes data
- * local rest, err = buffer:read()   read rest data
- */
-static int luaio_buffer_read(lua_State *L) {
+/*string, or zero-copy slice of the buffer at index 1*/
+#define luaio_buffer_push_data(L, slice, data, n) \
+  if (slice) { \
+    luaio_buffer_slice_new(L, 1, data, n); \
+  } else { \
+    lua_pushlstring(L, data, n); \
+  }
+
+static int luaio_buffer__read(lua_State *L, int slice) {
   luaio_buffer_check_read_buffer(L, read([n]));
-  luaio_buffer_check_memory(L, read([n]));
+  luaio_read_buffer_check_memory(L, read([n]));
 
   lua_Integer n = luaL_checkinteger(L, 2);
 
@@ -73,7 +99,7 @@ static int luaio_buffer_read(lua_State *L) {
     assert(rest_size >= 0);
 
     if (rest_size > 0) {
-      lua_pushlstring(L, read_pos, rest_size);
+      luaio_buffer_push_data(L, slice, read_pos, rest_size);
       lua_pushinteger(L, rest_size);
 
       start = buffer->start;
@@ -88,12 +114,12 @@ static int luaio_buffer_read(lua_State *L) {
   }
 
   if (n == 0) {
-    lua_pushliteral(L, "");
+    luaio_buffer_push_data(L, slice, buffer->read_pos, 0);
     lua_pushinteger(L, 0);
     return 2;
   }
 
-  if (n > (lua_Integer)buffer->capacity) {
+  if (n > (lua_Integer)buffer->capacity && n > (lua_Integer)buffer->max_size) {
     return luaL_error(L, "buffer:read([n]) error: out of buffer capacity[%d]\n", buffer->capacity); 
   }
 
@@ -105,7 +131,7 @@ static int luaio_buffer_read(lua_State *L) {
    * -----------+++++++++++++++------------
    */
   if (n <= rest_size) {
-    lua_pushlstring(L, read_pos, n);
+    luaio_buffer_push_data(L, slice, read_pos, n);
     lua_pushinteger(L, n);
     
     luaio_buffer_check_rest_size(n);
@@ -117,10 +143,17 @@ static int luaio_buffer_read(lua_State *L) {
    * -----------++++++++++++---------------
    */
   if ((read_pos + n) > buffer->end) {
-    start = buffer->start;
-    luaio_memmove(start, read_pos, rest_size);
-    buffer->read_pos = start;
-    buffer->write_pos = start + rest_size;
+    if (n > (lua_Integer)buffer->capacity) {
+      if (luaio_buffer_grow(buffer, n) < 0) {
+        return luaL_error(L, "buffer:read([n]) error: no memory\n");
+      }
+    } else {
+      start = buffer->start;
+      luaio_memmove(start, read_pos, rest_size);
+      buffer->generation++;
+      buffer->read_pos = start;
+      buffer->write_pos = start + rest_size;
+    }
   }
 
   lua_pushnil(L);
@@ -128,10 +161,23 @@ static int luaio_buffer_read(lua_State *L) {
   return 2;
 }
 
-/* local data, err = buf:readline() */
-static int luaio_buffer_readline(lua_State *L) {
+/* local data, err = buffer:read(n)  read n bytes data
+ * local rest, err = buffer:read()   read rest data
+ */
+static int luaio_buffer_read(lua_State *L) {
+  return luaio_buffer__read(L, 0);
+}
+
+/* local slice, err = buffer:read_slice(n)  slice of n bytes data
+ * local slice, err = buffer:read_slice()   slice of rest data
+ */
+static int luaio_buffer_read_slice(lua_State *L) {
+  return luaio_buffer__read(L, 1);
+}
+
+static int luaio_buffer__readline(lua_State *L, int slice) {
   luaio_buffer_check_read_buffer(L, readline());
-  luaio_buffer_check_memory(L, readline());
+  luaio_read_buffer_check_memory(L, readline());
 
   char *start;
   char *read_pos = buffer->read_pos;
@@ -159,7 +205,7 @@ static int luaio_buffer_readline(lua_State *L) {
       --size;
     }
 
-    lua_pushlstring(L, read_pos, size);
+    luaio_buffer_push_data(L, slice, read_pos, size);
     lua_pushinteger(L, size);
 
     luaio_buffer_check_rest_size(n);
@@ -174,8 +220,9 @@ static int luaio_buffer_readline(lua_State *L) {
      * +++++++++++++++++++++++++++++
      */
     if (read_pos == start) {
+      int err = luaio_buffer_grow(buffer, buffer->capacity + 1);
       lua_pushnil(L);
-      lua_pushinteger(L, LUAIO_EXCEED_BUFFER_CAPACITY);
+      lua_pushinteger(L, err < 0 ? err : LUAIO_EAGAIN);
       return 2;
     }
 
@@ -184,6 +231,7 @@ static int luaio_buffer_readline(lua_State *L) {
      * ---------+++++++++++++++++++++
      */
     luaio_memmove(start, read_pos, rest_size);
+    buffer->generation++;
     buffer->read_pos = start;
     buffer->write_pos = start + rest_size;
   }
@@ -193,9 +241,19 @@ static int luaio_buffer_readline(lua_State *L) {
   return 2;
 }
 
+/* local data, err = buf:readline() */
+static int luaio_buffer_readline(lua_State *L) {
+  return luaio_buffer__readline(L, 0);
+}
+
+/* local slice, err = buf:readline_slice() */
+static int luaio_buffer_readline_slice(lua_State *L) {
+  return luaio_buffer__readline(L, 1);
+}
+
 #define luaio_buffer_read8(type, bytes) do{ \
   luaio_buffer_check_read_buffer(L, read_##type()); \
-  luaio_buffer_check_memory(L, read_##type()); \
+  luaio_read_buffer_check_memory(L, read_##type()); \
   \
   char *start; \
   char *read_pos = buffer->read_pos; \
@@ -228,7 +286,7 @@ static int luaio_buffer_read_int8(lua_State *L) {
 
 #define luaio_buffer_read_uint(name, type, bytes, endian) do { \
   luaio_buffer_check_read_buffer(L, read_##name()); \
-  luaio_buffer_check_memory(L, read_##name()); \
+  luaio_read_buffer_check_memory(L, read_##name()); \
   \
   char *start; \
   char *read_pos = buffer->read_pos; \
@@ -248,6 +306,7 @@ static int luaio_buffer_read_int8(lua_State *L) {
   if ((read_pos + bytes) > buffer->end) { \
     start = buffer->start; \
     luaio_memmove(start, read_pos, rest_size); \
+    buffer->generation++; \
     buffer->read_pos = start; \
     buffer->write_pos = start + rest_size; \
   } \
@@ -283,7 +342,7 @@ static int luaio_buffer_read_uint64_be(lua_State *L) {
 
 #define luaio_buffer_read_int(name, type, bytes, endian) do { \
   luaio_buffer_check_read_buffer(L, read_##name()); \
-  luaio_buffer_check_memory(L, read_##name()); \
+  luaio_read_buffer_check_memory(L, read_##name()); \
   \
   char *start; \
   char *read_pos = buffer->read_pos; \
@@ -304,6 +363,7 @@ static int luaio_buffer_read_uint64_be(lua_State *L) {
   if ((read_pos + bytes) > buffer->end) { \
     start = buffer->start; \
     luaio_memmove(start, read_pos, rest_size); \
+    buffer->generation++; \
     buffer->read_pos = start; \
     buffer->write_pos = start + rest_size; \
   } \
@@ -339,7 +399,7 @@ static int luaio_buffer_read_int64_be(lua_State *L) {
 
 #define luaio_buffer_read_float(name, type, bytes, endian, temp_type) do { \
   luaio_buffer_check_read_buffer(L, read_##name()); \
-  luaio_buffer_check_memory(L, read_##name()); \
+  luaio_read_buffer_check_memory(L, read_##name()); \
   \
   char *start; \
   char *read_pos = buffer->read_pos; \
@@ -360,6 +420,7 @@ static int luaio_buffer_read_int64_be(lua_State *L) {
   if ((read_pos + bytes) > buffer->end) { \
     start = buffer->start; \
     luaio_memmove(start, read_pos, rest_size); \
+    buffer->generation++; \
     buffer->read_pos = start; \
     buffer->write_pos = start + rest_size; \
   } \
@@ -390,8 +451,11 @@ int luaopen_read_buffer(lua_State *L) {
   luaL_Reg read_buffer_mtlib[] = {
     { "capacity", luaio_buffer_capacity },
     { "discard", luaio_buffer_discard },
+    { "tostring", luaio_buffer_tostring },
     { "read", luaio_buffer_read },
     { "readline", luaio_buffer_readline },
+    { "read_slice", luaio_buffer_read_slice },
+    { "readline_slice", luaio_buffer_readline_slice },
     { "read_uint8", luaio_buffer_read_uint8 },
     { "read_int8", luaio_buffer_read_int8 },
     { "read_uint16_le", luaio_buffer_read_uint16_le },
@@ -420,6 +484,8 @@ int luaopen_read_buffer(lua_State *L) {
   lua_setfield(L, -2, "__index");
   lua_rawset(L, LUA_REGISTRYINDEX);
 
+  luaio_buffer_slice_init(L);
+
   luaL_Reg lib[] = {
     { "new", luaio_read_buffer_new },
     { "__newindex", luaio_cannot_change },
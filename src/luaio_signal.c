@@ -45,7 +45,7 @@ static int luaio_signal_new(lua_State *L) {
 
   *signal_ptr = signal;
 
-  uv_loop_t *loop = uv_default_loop();
+  uv_loop_t *loop = luaio_get_loop();
   uv_signal_t *handle = &signal->handle;
   uv_signal_init(loop, handle);
   uv_unref((uv_handle_t*)handle);
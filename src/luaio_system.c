@@ -6,6 +6,7 @@
 
 #include "luaio.h"
 #include "luaio_init.h"
+#include "luaio_coroutine.h"
 
 static int luaio_system_cpuinfo(lua_State *L) {
   uv_cpu_info_t *cpu_infos;
@@ -99,6 +100,121 @@ static int luaio_system_uptime(lua_State *L) {
   return 1;
 }
 
+/* @example: local stats = system.pmemory_stats()
+ * @return: stats {table[array(object)]} one entry per size class
+ *    stats[i] = {
+ *      capacity = {integer} chunk size of the class
+ *      max_free_chunks = {integer}
+ *      free_chunks = {integer} chunks cached in the free list
+ *      used_chunks = {integer} chunks handed out and not freed yet
+ *      cached_bytes = {integer}
+ *      hits = {integer} allocations served from the free list
+ *      misses = {integer} allocations fell through to malloc
+ *      releases = {integer} chunks given back to the system
+ *      slabs = {integer} 64KB slabs backing the class(<= 4KB classes)
+ *    }
+ *    stats.huge = {
+ *      allocs = {integer}
+ *      frees = {integer}
+ *      used_bytes = {integer}
+ *    }
+ */
+static int luaio_system_pmemory_stats(lua_State *L) {
+  luaio_pmemory_stats_t stats;
+  luaio_pmemory_huge_stats_t huge;
+
+  lua_createtable(L, LUAIO_PMEMORY_MAX_SLOT, 1);
+  for (size_t i = 0; i < LUAIO_PMEMORY_MAX_SLOT; i++) {
+    luaio_pmemory_get_stats(i, &stats);
+
+    lua_createtable(L, 0, 9);
+    luaio_setinteger("capacity", stats.capacity)
+    luaio_setinteger("max_free_chunks", stats.max_free_chunks)
+    luaio_setinteger("free_chunks", stats.free_chunks)
+    luaio_setinteger("used_chunks", stats.used_chunks)
+    luaio_setinteger("cached_bytes", (uint64_t)stats.free_chunks * stats.capacity)
+    luaio_setinteger("hits", stats.hits)
+    luaio_setinteger("misses", stats.misses)
+    luaio_setinteger("releases", stats.releases)
+    luaio_setinteger("slabs", stats.slabs)
+    lua_rawseti(L, -2, i + 1);
+  }
+
+  luaio_pmemory_get_huge_stats(&huge);
+  lua_createtable(L, 0, 3);
+  luaio_setinteger("allocs", huge.allocs)
+  luaio_setinteger("frees", huge.frees)
+  luaio_setinteger("used_bytes", huge.used_bytes)
+  lua_setfield(L, -2, "huge");
+
+  return 1;
+}
+
+/* @example: local capacity, err = system.pmemory_set_max_free_chunks(size, n)
+ * @param: size {integer} any size served by the size class to retune
+ * @param: n {integer} new free list cap, extra cached chunks are released
+ * @return: capacity {integer} chunk size of the retuned class
+ * @return: err {integer}
+ */
+static int luaio_system_pmemory_set_max_free_chunks(lua_State *L) {
+  lua_Integer size = luaL_checkinteger(L, 1);
+  lua_Integer n = luaL_checkinteger(L, 2);
+  if (n < 0 || n > UINT32_MAX) {
+    return luaL_argerror(L, 2, "system.pmemory_set_max_free_chunks(size, n) error: n must be [0, 4294967295]\n");
+  }
+
+  size_t capacity = 0;
+  if (size > 0) {
+    capacity = luaio_pmemory_set_max_free_chunks(size, n);
+  }
+
+  if (capacity == 0) {
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, UV_EINVAL);
+    return 2;
+  }
+
+  lua_pushinteger(L, capacity);
+  lua_pushinteger(L, 0);
+  return 2;
+}
+
+/* @example: local stats = system.coroutine_stats()
+ * @return: stats {table}
+ *    stats = {
+ *      max_free_coroutines = {integer}
+ *      free_coroutines = {integer} finished coroutines cached for new connections
+ *      hits = {integer} connections served by a cached coroutine
+ *      misses = {integer} connections which created a new coroutine
+ *      releases = {integer} coroutines left to the GC
+ *    }
+ */
+static int luaio_system_coroutine_stats(lua_State *L) {
+  const luaio_coroutine_pool_t *pool = luaio_coroutine_get_pool();
+
+  lua_createtable(L, 0, 5);
+  luaio_setinteger("max_free_coroutines", pool->max_free_coroutines)
+  luaio_setinteger("free_coroutines", pool->free_coroutines)
+  luaio_setinteger("hits", pool->hits)
+  luaio_setinteger("misses", pool->misses)
+  luaio_setinteger("releases", pool->releases)
+  return 1;
+}
+
+/* @example: local err = system.set_max_free_coroutines(n)
+ * @param: n {integer} new pool size, extra cached coroutines are released
+ * @return: err {integer}
+ */
+static int luaio_system_set_max_free_coroutines(lua_State *L) {
+  lua_Integer n = luaL_checkinteger(L, 1);
+  if (n < 0) {
+    return luaL_argerror(L, 1, "system.set_max_free_coroutines(n) error: n must be >= 0\n");
+  }
+
+  lua_pushinteger(L, luaio_coroutine_set_max_free_coroutines(n));
+  return 1;
+}
+
 int luaopen_system(lua_State *L) {
   const char *type;
   const char *release;
@@ -148,6 +264,10 @@ int luaopen_system(lua_State *L) {
     { "loadavg", luaio_system_loadavg },
     { "hrtime", luaio_system_hrtime },
     { "uptime", luaio_system_uptime },
+    { "pmemory_stats", luaio_system_pmemory_stats },
+    { "pmemory_set_max_free_chunks", luaio_system_pmemory_set_max_free_chunks },
+    { "coroutine_stats", luaio_system_coroutine_stats },
+    { "set_max_free_coroutines", luaio_system_set_max_free_coroutines },
     { "__newindex", luaio_cannot_change },
     { NULL, NULL }
   };
@@ -165,6 +285,8 @@ int luaopen_system(lua_State *L) {
   lua_setfield(L, -2, "release");
   lua_pushlstring(L, endian, 2);
   lua_setfield(L, -2, "endian");
+  lua_pushstring(L, luaio_get_lua_allocator());
+  lua_setfield(L, -2, "allocator");
 
   lua_setmetatable(L, -2);
 
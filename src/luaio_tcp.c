@@ -7,38 +7,161 @@
 #include "luaio.h"
 #include "luaio_init.h"
 #include "luaio_timer.h"
+#include "luaio_coroutine.h"
 #include "luaio_check_data.h"
 
+typedef struct luaio_tcp_pipe_s luaio_tcp_pipe_t;
+typedef struct luaio_tcp_sendfile_s luaio_tcp_sendfile_t;
+
+/* accept state of a listening socket, connections are accepted in batches of
+ * accept_batch per loop iteration, accepting pauses at max_connections.
+ */
+typedef struct {
+  luaio_list_t        sockets;  /*accepted sockets which are not closed*/
+  uv_idle_t           idle;     /*resumes accepting after a full batch*/
+  size_t              max_connections;
+  size_t              connections;
+  size_t              accept_batch;
+  size_t              batch;
+  uint64_t            batch_time;
+  int                 paused;
+  int                 deferred;
+  uint64_t            accepted;
+  uint64_t            errors;
+  uint64_t            pauses;
+  uint64_t            deferrals;
+  uint64_t            rate;
+  uint64_t            rate_start;
+  uint64_t            rate_accepted;
+} luaio_tcp_server_t;
+
+/* corked writes of a socket, socket:write_async(data) appends pieces to the
+ * queue and the sockets with queued bytes are flushed with one writev each
+ * when the loop iteration ends(uv_check). small pieces are copied into chunk,
+ * one after another they make one piece, large strings are referenced.
+ */
+typedef struct {
+  char                *base;    /*NULL if the piece is in chunk*/
+  size_t              offset;
+  size_t              len;
+} luaio_tcp_cork_piece_t;
+
+typedef struct {
+  luaio_list_t            dirty;      /*in the dirty list while bytes are queued*/
+  luaio_tcp_cork_piece_t  *pieces;
+  size_t                  npiece;
+  size_t                  piece_capacity;
+  char                    *chunk;
+  size_t                  chunk_len;
+  size_t                  chunk_capacity;
+  size_t                  bytes;
+  size_t                  nref;
+  int                     refs_ref;   /*table of the large strings in pieces*/
+  int                     socket_ref; /*keeps a dirty socket alive until it is flushed*/
+  int                     enabled;
+  int                     status;     /*error of the last flush, returned by the next write*/
+  uint64_t                flushes;
+} luaio_tcp_cork_t;
+
 typedef struct {
-  size_t          type;
-  uint64_t        timeout;
-  uv_timer_t      *timer;
-  lua_State       *thread;
-  lua_State       *current_thread;
-  luaio_buffer_t  *read_buffer;
-  uv_tcp_t        handle;
-  int             thread_ref;
-  int             onconnect_ref;
+  size_t              type;
+  uint64_t            timeout;
+  int                 timer_precise;
+  luaio_timer_event_t timer;
+  lua_State           *thread;
+  lua_State           *current_thread;
+  luaio_buffer_t      *read_buffer;
+  luaio_buffer_chain_t *read_chain;  /*socket:read(chain) appends to it instead of read_buffer*/
+  luaio_tcp_pipe_t    *pipe;
+  luaio_tcp_pipe_t    *pipe_into;  /*the pipe writing to this socket*/
+  luaio_tcp_sendfile_t *sendfile;  /*socket:sendfile() waiting for writable*/
+  luaio_tcp_server_t  *listener;  /*listening socket*/
+  luaio_tcp_server_t  *server;    /*accepted socket*/
+  luaio_list_t        server_list;
+  uv_tcp_t            handle;
+  int                 thread_ref;
+  int                 coroutine_ref;  /*pooled coroutine of an accepted socket*/
+  int                 onconnect_ref;
+  luaio_timer_event_t park_timer;
+  int                 parked;     /*1 while parked, the error that closed it, 0 if not parked*/
+  int                 park_ref;   /*keeps a parked socket alive until its close callback*/
+  luaio_tcp_cork_t    cork;
+  /*write_async yields above write_high queued bytes until the queue drains to
+   *write_low, or returns UV_EAGAIN without queuing if write_nowait
+   */
+  size_t              write_high;   /*0 means no limit*/
+  size_t              write_low;
+  int                 write_nowait;
+  int                 write_full;     /*write_nowait: above write_high, not yet drained to write_low*/
+  luaio_list_t        write_waiting;  /*FIFO of the stalled write_async(luaio_tcp_stall_t)*/
+  uint64_t            stall_time;
+  uint64_t            stalls;
+  uint64_t            eagains;
+  size_t              queued_peak;
 } luaio_tcp_socket_t;
 
 typedef struct {
-  lua_State       *current_thread;
-  uv_timer_t      *timer;
-  uv_connect_t    req;
-  int             timed_out;
+  lua_State           *current_thread;
+  luaio_timer_event_t timer;
+  uv_connect_t        req;
+  int                 timed_out;
 } luaio_tcp_connect_req_t;
 
 typedef struct {
-  lua_State       *current_thread;
-  uv_timer_t      *timer;
-  size_t          bytes;
-  int             write_data_ref;
-  int             timed_out;
-  uv_write_t      req;
+  lua_State           *current_thread;
+  luaio_tcp_socket_t  *socket;
+  luaio_timer_event_t timer;
+  size_t              bytes;
+  int                 write_data_ref;
+  int                 timed_out;
+  uv_write_t          req;
 } luaio_tcp_write_req_t;
 
+/*a write_async stalled above the high watermark*/
+typedef struct {
+  luaio_list_t        list;
+  luaio_tcp_socket_t  *socket;
+  lua_State           *current_thread;
+  size_t              bytes;  /*returned when it goes on*/
+  uint64_t            start;
+  luaio_timer_event_t timer;
+} luaio_tcp_stall_t;
+
 static char luaio_tcp_socket_metatable_key;
 
+static void luaio_tcp_socket_init_watermarks(luaio_tcp_socket_t *socket) {
+  socket->write_high = 0;
+  socket->write_low = 0;
+  socket->write_nowait = 0;
+  socket->write_full = 0;
+  luaio_list_init(&socket->write_waiting);
+  socket->stall_time = 0;
+  socket->stalls = 0;
+  socket->eagains = 0;
+  socket->queued_peak = 0;
+}
+
+static void luaio_tcp_cork_init(luaio_tcp_cork_t *cork) {
+  luaio_list_init(&cork->dirty);
+  cork->pieces = NULL;
+  cork->npiece = 0;
+  cork->piece_capacity = 0;
+  cork->chunk = NULL;
+  cork->chunk_len = 0;
+  cork->chunk_capacity = 0;
+  cork->bytes = 0;
+  cork->nref = 0;
+  cork->refs_ref = LUA_NOREF;
+  cork->socket_ref = LUA_NOREF;
+  cork->enabled = 0;
+  cork->status = 0;
+  cork->flushes = 0;
+}
+
+static void luaio_tcp_socket_read_timeout(luaio_timer_event_t *event);
+static void luaio_tcp_socket_park_timeout(luaio_timer_event_t *event);
+static void luaio_tcp_socket_release(luaio_tcp_socket_t *socket);
+
 #define luaio_tcp_check_socket(L, name) \
   luaio_tcp_socket_t *socket = lua_touserdata(L, 1); \
   if (socket == NULL || socket->type != LUAIO_TYPE_SOCKET) { \
@@ -55,15 +178,23 @@ static int luaio_tcp_socket_new(lua_State *L) {
     return 1;
   }
 
-  uv_loop_t *loop = uv_default_loop();
+  uv_loop_t *loop = luaio_get_loop();
   uv_tcp_init(loop, &socket->handle);
 
   socket->type = LUAIO_TYPE_SOCKET;
   socket->thread = L;
   socket->current_thread = L;
   socket->read_buffer = NULL;
-  socket->timer = NULL;
+  socket->read_chain = NULL;
+  socket->pipe = NULL;
+  socket->pipe_into = NULL;
+  socket->sendfile = NULL;
+  socket->listener = NULL;
+  socket->server = NULL;
   socket->timeout = 0;
+  socket->timer_precise = 0;
+  luaio_timer_event_init(&socket->timer, luaio_tcp_socket_read_timeout, socket);
+  luaio_timer_event_init(&socket->park_timer, luaio_tcp_socket_park_timeout, socket);
 
   if (ref_thread) {
     lua_pushthread(L);
@@ -72,7 +203,12 @@ static int luaio_tcp_socket_new(lua_State *L) {
     socket->thread_ref = LUA_NOREF;
   }
 
+  socket->coroutine_ref = LUA_NOREF;
   socket->onconnect_ref = LUA_NOREF;
+  socket->parked = 0;
+  socket->park_ref = LUA_NOREF;
+  luaio_tcp_cork_init(&socket->cork);
+  luaio_tcp_socket_init_watermarks(socket);
 
   lua_pushlightuserdata(L, &luaio_tcp_socket_metatable_key);
   lua_rawget(L, LUA_REGISTRYINDEX);
@@ -112,46 +248,122 @@ static int luaio_tcp_socket_bind(lua_State *L) {
   return 1;
 }
 
+static void luaio_tcp_server_onconnect(uv_stream_t *handle, int status);
+
+static void luaio_tcp_server_onidle(uv_idle_t *idle) {
+  luaio_tcp_server_t *server = container_of(idle, luaio_tcp_server_t, idle);
+  uv_idle_stop(idle);
+  server->deferred = 0;
+  server->batch = 0;
+
+  /*the connection left in the server by the full batch*/
+  luaio_tcp_socket_t *socket = idle->data;
+  luaio_tcp_server_onconnect((uv_stream_t*)&socket->handle, 0);
+}
+
+static void luaio_tcp_server_onaccept_error(uv_handle_t *handle) {
+  luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
+  luaio_coroutine_free(socket->thread, socket->coroutine_ref, 1);
+}
+
+/* libuv drains the backlog and calls here once per connection, a connection
+ * which is not accepted is kept by libuv and the listening socket is not
+ * polled until it is accepted, so a full batch or max_connections pauses
+ * the accept loop without dropping the connection.
+ */
 static void luaio_tcp_server_onconnect(uv_stream_t *handle, int status) {
+  luaio_tcp_socket_t* listener = container_of(handle, luaio_tcp_socket_t, handle);
+  luaio_tcp_server_t *server = listener->listener;
+
   if (status ) {
+    server->errors++;
     fprintf(stderr, "server onconnect error: %s\n", uv_strerror(status));
     return;
   }
 
-  luaio_tcp_socket_t* server = container_of(handle, luaio_tcp_socket_t, handle);
-  lua_State *L = server->thread;
-  lua_State *co = lua_newthread(L);
-  int thread_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  if (server->connections >= server->max_connections) {
+    if (!server->paused) {
+      server->paused = 1;
+      server->pauses++;
+    }
+    return;
+  }
+
+  uv_loop_t *loop = luaio_get_loop();
+  uint64_t now = uv_now(loop);
+  if (server->batch_time != now) {
+    server->batch_time = now;
+    server->batch = 0;
+  }
+
+  if (server->batch >= server->accept_batch) {
+    if (!server->deferred) {
+      server->deferred = 1;
+      server->deferrals++;
+      uv_idle_start(&server->idle, luaio_tcp_server_onidle);
+    }
+    return;
+  }
+
+  int coroutine_ref;
+  lua_State *co = luaio_coroutine_alloc(&coroutine_ref);
 
   /*onconnect*/
-  lua_rawgeti(co, LUA_REGISTRYINDEX, server->onconnect_ref);
+  lua_rawgeti(co, LUA_REGISTRYINDEX, listener->onconnect_ref);
 
   luaio_tcp_socket_t *socket = lua_newuserdata(co, sizeof(luaio_tcp_socket_t));
   if (socket == NULL) {
-    luaL_unref(L, LUA_REGISTRYINDEX, thread_ref);
+    luaio_coroutine_free(co, coroutine_ref, 1);
+    server->errors++;
     fprintf(stderr, "server onconnect error: no memory for new connection\n");
     return;
   }
 
-  uv_loop_t *loop = uv_default_loop();
   uv_tcp_t *client_handle = &socket->handle;
   uv_tcp_init(loop, client_handle);
   int err = uv_accept(handle, (uv_stream_t*)client_handle);
   if (err) {
-    luaL_unref(L, LUA_REGISTRYINDEX, thread_ref);
-    uv_close((uv_handle_t*)(client_handle), NULL);
+    /*the socket lives on the stack of co until the handle is closed*/
+    socket->thread = co;
+    socket->coroutine_ref = coroutine_ref;
+    uv_close((uv_handle_t*)(client_handle), luaio_tcp_server_onaccept_error);
+    server->errors++;
     fprintf(stderr, "server onconnect error: %s\n", uv_strerror(err));
     return;
   }
 
+  server->batch++;
+  server->connections++;
+  server->accepted++;
+  if (now - server->rate_start >= 1000) {
+    server->rate = server->rate_accepted * 1000 / (now - server->rate_start);
+    server->rate_start = now;
+    server->rate_accepted = 0;
+  }
+  server->rate_accepted++;
+
   socket->type = LUAIO_TYPE_SOCKET;
   socket->thread = co;
   socket->current_thread = co;
   socket->read_buffer = NULL;
-  socket->timer = NULL;
-  socket->timeout = server->timeout;
+  socket->read_chain = NULL;
+  socket->pipe = NULL;
+  socket->pipe_into = NULL;
+  socket->sendfile = NULL;
+  socket->listener = NULL;
+  socket->server = server;
+  luaio_list_insert_tail(&socket->server_list, &server->sockets);
+  socket->timeout = listener->timeout;
+  socket->timer_precise = listener->timer_precise;
+  luaio_timer_event_init(&socket->timer, luaio_tcp_socket_read_timeout, socket);
+  luaio_timer_event_init(&socket->park_timer, luaio_tcp_socket_park_timeout, socket);
   socket->onconnect_ref = LUA_NOREF;
   socket->thread_ref = LUA_NOREF;
+  socket->coroutine_ref = coroutine_ref;
+  socket->parked = 0;
+  socket->park_ref = LUA_NOREF;
+  luaio_tcp_cork_init(&socket->cork);
+  luaio_tcp_socket_init_watermarks(socket);
 
   lua_pushlightuserdata(co, &luaio_tcp_socket_metatable_key);
   lua_rawget(co, LUA_REGISTRYINDEX);
@@ -160,30 +372,143 @@ static void luaio_tcp_server_onconnect(uv_stream_t *handle, int status) {
   luaio_resume(co, 1);
 }
 
-/*local err = socket:listen(onconnect, tcp_backlog)*/
+/*an accepted socket is closed, accept the connection kept by libuv if paused*/
+static void luaio_tcp_server_release(luaio_tcp_socket_t *socket) {
+  luaio_tcp_server_t *server = socket->server;
+  socket->server = NULL;
+  luaio_list_remove(&socket->server_list);
+  server->connections--;
+
+  if (server->paused && server->connections < server->max_connections) {
+    server->paused = 0;
+    luaio_tcp_socket_t *listener = server->idle.data;
+    luaio_tcp_server_onconnect((uv_stream_t*)&listener->handle, 0);
+  }
+}
+
+static void luaio_tcp_server_onclose(uv_handle_t *handle) {
+  luaio_tcp_server_t *server = container_of(handle, luaio_tcp_server_t, idle);
+  luaio_pfree(server);
+}
+
+/*the listening socket is closed, the accepted sockets live on without it*/
+static void luaio_tcp_server_destroy(luaio_tcp_socket_t *socket) {
+  luaio_tcp_server_t *server = socket->listener;
+  socket->listener = NULL;
+
+  luaio_list_t *head = &server->sockets;
+  while (!luaio_list_is_empty(head)) {
+    luaio_list_t *list = head->next;
+    luaio_tcp_socket_t *client = luaio_list_entry(list, luaio_tcp_socket_t, server_list);
+    luaio_list_remove(list);
+    client->server = NULL;
+  }
+
+  uv_close((uv_handle_t*)&server->idle, luaio_tcp_server_onclose);
+}
+
+/*local err = socket:listen(onconnect, tcp_backlog[, max_connections, accept_batch])*/
 static int luaio_tcp_socket_listen(lua_State *L) {
-  luaio_tcp_check_socket(L, listen(onconnect, tcp_backlog));
+  luaio_tcp_check_socket(L, listen(onconnect, tcp_backlog[, max_connections, accept_batch]));
 
   /*onconnect*/
   if (lua_type(L, 2) != LUA_TFUNCTION) {
     return luaL_argerror(L, 2, "socket:listen(onconnect, tcp_backlog) error: onconnect must be [function]\n"); 
   }
-  lua_pushvalue(L, 2);
-  socket->onconnect_ref = luaL_ref(L, LUA_REGISTRYINDEX);
 
   int tcp_backlog = luaL_checkinteger(L, 3);
+
+  lua_Integer max_connections = luaL_optinteger(L, 4, LUAIO_TCP_MAX_CONNECTIONS);
+  if (max_connections <= 0) {
+    return luaL_argerror(L, 4, "socket:listen(onconnect, tcp_backlog, max_connections) error: max_connections must be > 0\n"); 
+  }
+
+  lua_Integer accept_batch = luaL_optinteger(L, 5, LUAIO_TCP_ACCEPT_BATCH);
+  if (accept_batch <= 0) {
+    return luaL_argerror(L, 5, "socket:listen(onconnect, tcp_backlog, max_connections, accept_batch) error: accept_batch must be > 0\n"); 
+  }
+
+  if (socket->listener) {
+    lua_pushinteger(L, UV_EINVAL);
+    return 1;
+  }
+
+  luaio_tcp_server_t *server = luaio_palloc(sizeof(luaio_tcp_server_t));
+  if (server == NULL) {
+    lua_pushinteger(L, UV_ENOMEM);
+    return 1;
+  }
+
+  luaio_memzero(server, sizeof(luaio_tcp_server_t));
+  luaio_list_init(&server->sockets);
+  server->max_connections = max_connections;
+  server->accept_batch = accept_batch;
+  server->rate_start = uv_now(luaio_get_loop());
+  uv_idle_init(luaio_get_loop(), &server->idle);
+  server->idle.data = socket;
+  socket->listener = server;
+
   int err = uv_listen((uv_stream_t*)(&socket->handle), tcp_backlog, luaio_tcp_server_onconnect);
+  if (err) {
+    socket->listener = NULL;
+    uv_close((uv_handle_t*)&server->idle, luaio_tcp_server_onclose);
+    lua_pushinteger(L, err);
+    return 1;
+  }
+
+  lua_pushvalue(L, 2);
+  socket->onconnect_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+  lua_pushinteger(L, 0);
+  return 1;
+}
+
+/*local stats = socket:accept_stats()*/
+static int luaio_tcp_socket_accept_stats(lua_State *L) {
+  luaio_tcp_check_socket(L, accept_stats());
+
+  luaio_tcp_server_t *server = socket->listener;
+  if (server == NULL) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  lua_createtable(L, 0, 9);
+
+  lua_pushinteger(L, server->accepted);
+  lua_setfield(L, -2, "accepted");
+
+  lua_pushinteger(L, server->errors);
+  lua_setfield(L, -2, "errors");
+
+  lua_pushinteger(L, server->pauses);
+  lua_setfield(L, -2, "pauses");
+
+  lua_pushinteger(L, server->deferrals);
+  lua_setfield(L, -2, "deferrals");
+
+  lua_pushinteger(L, server->rate);
+  lua_setfield(L, -2, "rate");
+
+  lua_pushinteger(L, server->connections);
+  lua_setfield(L, -2, "connections");
+
+  lua_pushinteger(L, server->max_connections);
+  lua_setfield(L, -2, "max_connections");
+
+  lua_pushinteger(L, server->accept_batch);
+  lua_setfield(L, -2, "accept_batch");
+
+  lua_pushboolean(L, server->paused);
+  lua_setfield(L, -2, "paused");
 
-  lua_pushinteger(L, err);
   return 1;
 }
 
-static void luaio_tcp_socket_connect_timeout(uv_timer_t *handle) {
-  luaio_tcp_connect_req_t *luaio_req = handle->data;
+static void luaio_tcp_socket_connect_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_connect_req_t *luaio_req = event->data;
   lua_State *L = luaio_req->current_thread;
 
-  luaio_timer_free(handle);
-  luaio_req->timer = NULL;
   luaio_req->timed_out = 1;
 
   lua_pushinteger(L, UV_ETIMEDOUT);
@@ -194,11 +519,7 @@ static void luaio_tcp_socket_onconnect(uv_connect_t *req, int status) {
   luaio_tcp_connect_req_t *luaio_req = container_of(req, luaio_tcp_connect_req_t, req);
   lua_State *L = luaio_req->current_thread;
 
-  uv_timer_t *timer = luaio_req->timer;
-  if (timer != NULL) {
-    uv_timer_stop(timer);
-    luaio_timer_free(timer);
-  }
+  luaio_timer_event_stop(&luaio_req->timer);
 
   int timed_out = luaio_req->timed_out;
   luaio_pfree(luaio_req);
@@ -213,54 +534,36 @@ static int luaio_tcp_socket_connect(lua_State *L) {
   luaio_tcp_check_socket(L, connect(port, host));
   luaio_tcp_check_port_and_host(L, connect(port, host));
 
-  uint64_t timeout = socket->timeout;
-  uv_timer_t *timer = NULL;
-  if (timeout != 0) {
-    timer = luaio_timer_alloc();
-    if (timer == NULL) {
-      lua_pushinteger(L, UV_ENOMEM);
-      return 1;
-    }
-
-    uv_timer_start(timer, 
-                   luaio_tcp_socket_connect_timeout, 
-                   timeout, 
-                   0);
-  }
-
-
   luaio_tcp_connect_req_t *luaio_req = luaio_palloc(sizeof(luaio_tcp_connect_req_t));
   if (luaio_req == NULL) {
-    if (timer != NULL) {
-      uv_timer_stop(timer);
-      luaio_timer_free(timer);
-    }
-    
     lua_pushinteger(L, UV_ENOMEM);
     return 1;
   }
 
+  luaio_timer_event_init(&luaio_req->timer, luaio_tcp_socket_connect_timeout, luaio_req);
+
+  uint64_t timeout = socket->timeout;
+  if (timeout != 0) {
+    int err = luaio_timer_event_start(&luaio_req->timer, timeout, socket->timer_precise);
+    if (err) {
+      luaio_pfree(luaio_req);
+      lua_pushinteger(L, err);
+      return 1;
+    }
+  }
+
   int err = uv_tcp_connect(&luaio_req->req, 
                            &socket->handle,
                            addr,
                            luaio_tcp_socket_onconnect);
   if (err) {
-    if (timer != NULL) {
-      uv_timer_stop(timer);
-      luaio_timer_free(timer);
-    }
-   
+    luaio_timer_event_stop(&luaio_req->timer);
     luaio_pfree(luaio_req);
     lua_pushinteger(L, err);
     return 1;
   }
 
-  if (timer != NULL) {
-    timer->data = luaio_req;
-  }
-
   luaio_req->current_thread = L;
-  luaio_req->timer = timer;
   luaio_req->timed_out = 0;
 
   return lua_yield(L, 0);
@@ -288,12 +591,12 @@ static int luaio_tcp_socket_set_read_buffer(lua_State *L) {
   return 0;
 }
 
-static void luaio_tcp_socket_read_timeout(uv_timer_t *handle) {
-  luaio_tcp_socket_t *socket = handle->data;
+static void luaio_tcp_socket_read_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_socket_t *socket = event->data;
   lua_State *L = socket->current_thread;
 
   uv_read_stop((uv_stream_t*)(&socket->handle));
-  luaio_timer_free(handle);
+  socket->read_chain = NULL;
 
   lua_pushinteger(L, UV_ETIMEDOUT);
   luaio_resume(L, 1);
@@ -303,23 +606,23 @@ static void luaio_tcp_socket_onalloc(uv_handle_t *handle,
                                      size_t suggested_size, 
                                      uv_buf_t *buf) {
   luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
-  lua_State* L = socket->current_thread;
+
+  /*no memory: an empty buf makes libuv call onread with UV_ENOBUFS*/
+  luaio_buffer_chain_t *chain = socket->read_chain;
+  if (chain != NULL) {
+    size_t len = 0;
+    buf->base = luaio_buffer_chain_reserve(chain, &len);
+    buf->len = len;
+    return;
+  }
 
   luaio_buffer_t *buffer = socket->read_buffer;
   if (buffer->capacity == 0) {
     size_t buffer_size = buffer->size;
     char *start = luaio_palloc(buffer_size);
     if (start == NULL) {
-      uv_read_stop((uv_stream_t*)(&socket->handle));
-
-      uv_timer_t *timer = socket->timer;
-      if (timer != NULL) {
-        uv_timer_stop(timer);
-        luaio_timer_free(timer);
-      }
-
-      lua_pushinteger(L, UV_ENOMEM);
-      luaio_resume(L, 1);
+      buf->base = NULL;
+      buf->len = 0;
       return;
     }
 
@@ -332,6 +635,7 @@ static void luaio_tcp_socket_onalloc(uv_handle_t *handle,
     buffer->end = start + capacity;
   }
 
+  luaio_buffer_before_fill(buffer);
   char *write_pos = buffer->write_pos;
   buf->base = write_pos;
   buf->len = buffer->end - write_pos;
@@ -346,65 +650,194 @@ static void luaio_tcp_socket_onread(uv_stream_t *handle,
   lua_State* L = socket->current_thread;
 
   uv_read_stop((uv_stream_t*)(&socket->handle));
+  luaio_timer_event_stop(&socket->timer);
 
-  uv_timer_t *timer = socket->timer;
-  if (timer != NULL) {
-    uv_timer_stop(timer);
-    luaio_timer_free(timer);
-  }
-
+  luaio_buffer_chain_t *chain = socket->read_chain;
+  socket->read_chain = NULL;
   if (nread > 0) {
-    socket->read_buffer->write_pos += nread;
+    if (chain != NULL) {
+      luaio_buffer_chain_commit(chain, nread);
+    } else {
+      socket->read_buffer->write_pos += nread;
+    }
   }
 
   lua_pushinteger(L, nread);
   luaio_resume(L, 1);
 }
 
-/*local ret = socket:read()*/
+/* local ret = socket:read([chain])
+ * @param: chain {buffer_chain} the data is appended to chain instead of the read buffer
+ */
 static int luaio_tcp_socket_read(lua_State *L) {
-  luaio_tcp_check_socket(L, read(buffer));
+  luaio_tcp_check_socket(L, read([chain]));
+
+  luaio_buffer_chain_t *chain = lua_touserdata(L, 2);
+  if (chain != NULL && chain->type != LUAIO_TYPE_BUFFER_CHAIN) {
+    return luaL_argerror(L, 2, "socket:read([chain]) error: chain must be [userdata](buffer_chain)\n");
+  }
+
+  if (chain == NULL) {
+    if (socket->read_buffer == NULL) {
+      return luaL_error(L, "socket:read() error: no read buffer, please set a read buffer.\n");
+    }
 
-  if (socket->read_buffer == NULL) {
-    return luaL_error(L, "socket:read() error: no read buffer, please set a read buffer.\n");
+    /*an idle connection holds no memory, onalloc takes it back when data arrives*/
+    luaio_buffer_release(socket->read_buffer);
   }
 
   uint64_t timeout = socket->timeout;
-  uv_timer_t *timer = NULL;
   if (timeout != 0) {
-    timer = luaio_timer_alloc();
-    if (timer == NULL) {
-      lua_pushinteger(L, UV_ENOMEM);
+    int err = luaio_timer_event_start(&socket->timer, timeout, socket->timer_precise);
+    if (err) {
+      lua_pushinteger(L, err);
       return 1;
     }
-
-    uv_timer_start(timer, 
-                   luaio_tcp_socket_read_timeout, 
-                   timeout, 
-                   0);
   }
 
+  socket->read_chain = chain;
   int err = uv_read_start((uv_stream_t*)(&socket->handle), 
                           luaio_tcp_socket_onalloc, 
                           luaio_tcp_socket_onread);
   if (err) {
-    if (timer != NULL) {
-      uv_timer_stop(timer);
-      luaio_timer_free(timer);
-    }
-    
+    socket->read_chain = NULL;
+    luaio_timer_event_stop(&socket->timer);
     lua_pushinteger(L, err);
     return 1;
   }
 
-  socket->timer = timer;
   socket->current_thread = L;
 
-  if (timer != NULL) {
-    timer->data = socket;
+  return lua_yield(L, 0);
+}
+
+/* an idle connection parked in a pool is watched by the loop, EOF, bytes the
+ * peer should not send on an idle connection and the idle timeout close it
+ * in C, the pool learns why from socket:unpark() when it takes it out.
+ */
+static LUAIO_THREAD_LOCAL char luaio_tcp_park_scratch[64];
+
+static void luaio_tcp_socket_unref_park(luaio_tcp_socket_t *socket) {
+  int park_ref = socket->park_ref;
+  if (park_ref != LUA_NOREF) {
+    socket->park_ref = LUA_NOREF;
+    luaL_unref(luaio_get_main_thread(), LUA_REGISTRYINDEX, park_ref);
   }
+}
 
-  return lua_yield(L, 0);
+/*the same cleanup as socket:close(), socket:close() of the owner only returns*/
+static void luaio_tcp_socket_park_onclose(uv_handle_t *handle) {
+  luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
+  luaio_tcp_socket_release(socket);
+  luaio_tcp_socket_unref_park(socket);
+}
+
+static void luaio_tcp_socket_park_close(luaio_tcp_socket_t *socket, int status) {
+  uv_read_stop((uv_stream_t*)(&socket->handle));
+  luaio_timer_event_stop(&socket->park_timer);
+  socket->parked = status;
+  uv_close((uv_handle_t*)(&socket->handle), luaio_tcp_socket_park_onclose);
+}
+
+static void luaio_tcp_socket_park_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_socket_park_close(event->data, UV_ETIMEDOUT);
+}
+
+static void luaio_tcp_socket_park_onalloc(uv_handle_t *handle, 
+                                          size_t suggested_size, 
+                                          uv_buf_t *buf) {
+  buf->base = luaio_tcp_park_scratch;
+  buf->len = sizeof(luaio_tcp_park_scratch);
+}
+
+static void luaio_tcp_socket_park_onread(uv_stream_t *handle, 
+                                         ssize_t nread, 
+                                         const uv_buf_t* buf) {
+  if (nread == 0) return;
+
+  luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
+  luaio_tcp_socket_park_close(socket, nread > 0 ? UV_EPROTO : nread);
+}
+
+/* @example: local err = socket:park(idle_timeout)
+ * @param: idle_timeout {integer} milliseconds, 0 means no idle timeout
+ * @return: err {integer}
+ */
+static int luaio_tcp_socket_park(lua_State *L) {
+  luaio_tcp_check_socket(L, park(idle_timeout));
+
+  lua_Integer idle_timeout = luaL_checkinteger(L, 2);
+  if (idle_timeout < 0) {
+    return luaL_argerror(L, 2, "socket:park(idle_timeout) error: idle_timeout must be >= 0\n");
+  }
+
+  if (socket->parked != 0 || uv_is_closing((uv_handle_t*)(&socket->handle))) {
+    lua_pushinteger(L, UV_EINVAL);
+    return 1;
+  }
+
+  int err = uv_read_start((uv_stream_t*)(&socket->handle),
+                          luaio_tcp_socket_park_onalloc,
+                          luaio_tcp_socket_park_onread);
+  if (err) {
+    lua_pushinteger(L, err);
+    return 1;
+  }
+
+  if (idle_timeout > 0) {
+    err = luaio_timer_event_start(&socket->park_timer, idle_timeout, 0);
+    if (err) {
+      uv_read_stop((uv_stream_t*)(&socket->handle));
+      lua_pushinteger(L, err);
+      return 1;
+    }
+  }
+
+  lua_pushvalue(L, 1);
+  socket->park_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  socket->parked = 1;
+
+  lua_pushinteger(L, 0);
+  return 1;
+}
+
+/* @example: local err = socket:unpark()
+ * @return: err {integer} 0 if the connection can be reused, otherwise why it
+ *    has been closed: UV_EOF, UV_ETIMEDOUT, UV_EPROTO(unexpected data) ...
+ */
+static int luaio_tcp_socket_unpark(lua_State *L) {
+  luaio_tcp_check_socket(L, unpark());
+
+  int parked = socket->parked;
+  if (parked <= 0) {
+    lua_pushinteger(L, parked);
+    return 1;
+  }
+
+  uv_read_stop((uv_stream_t*)(&socket->handle));
+  luaio_timer_event_stop(&socket->park_timer);
+  socket->parked = 0;
+
+  /*the peer may have closed since the loop polled last*/
+  char ch;
+  int status = 0;
+  ssize_t n = recv(uv__stream_fd(&socket->handle), &ch, 1, MSG_PEEK | MSG_DONTWAIT);
+  if (n == 0) {
+    status = UV_EOF;
+  } else if (n > 0) {
+    status = UV_EPROTO;
+  } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+    status = -errno;
+  }
+
+  if (status) {
+    luaio_tcp_socket_park_close(socket, status);
+  } else {
+    luaio_tcp_socket_unref_park(socket);
+  }
+
+  lua_pushinteger(L, status);
+  return 1;
 }
 
 static int luaio_tcp_socket_try_write(uv_stream_t *handle, 
@@ -442,306 +875,1466 @@ static int luaio_tcp_socket_try_write(uv_stream_t *handle,
   return 0;
 }
 
-static void luaio_tcp_socket_write_timeout(uv_timer_t *handle) {
-  luaio_tcp_write_req_t *luaio_req = handle->data;
-  lua_State *L = luaio_req->current_thread;
- 
-  int write_data_ref = luaio_req->write_data_ref;
-  if (write_data_ref != LUA_NOREF) {
-    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
-  }
+/*bytes written by write_async and not yet taken by the kernel*/
+#define luaio_tcp_socket_queued(socket) \
+  ((socket)->handle.write_queue_size + (socket)->cork.bytes)
 
-  luaio_timer_free(handle);
-  luaio_req->timer = NULL;
-  luaio_req->timed_out = 1;
+/*resume the thread stalled in write_async with status*/
+static void luaio_tcp_socket_unstall(luaio_tcp_stall_t *stall, int status) {
+  luaio_tcp_socket_t *socket = stall->socket;
+  lua_State *L = stall->current_thread;
+  size_t bytes = stall->bytes;
 
-  lua_pushinteger(L, 0);
-  lua_pushinteger(L, UV_ETIMEDOUT);
+  luaio_list_remove(&stall->list);
+  luaio_timer_event_stop(&stall->timer);
+  socket->stall_time += uv_now(luaio_get_loop()) - stall->start;
+  luaio_pfree(stall);
+
+  lua_pushinteger(L, bytes);
+  lua_pushinteger(L, status);
   luaio_resume(L, 2);
 }
 
-static void luaio_tcp_socket_after_write(uv_write_t *req, int status) {
-  luaio_tcp_write_req_t *luaio_req = container_of(req, luaio_tcp_write_req_t, req);
-  lua_State* L = luaio_req->current_thread;
- 
-  uv_timer_t *timer = luaio_req->timer;
-  if (timer != NULL) {
-    uv_timer_stop(timer);
-    luaio_timer_free(timer);
+static void luaio_tcp_socket_stall_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_socket_unstall(event->data, UV_ETIMEDOUT);
+}
+
+/*resume the stalled threads in order with status*/
+static void luaio_tcp_socket_unstall_all(luaio_tcp_socket_t *socket, int status) {
+  luaio_list_t *waiting = &socket->write_waiting;
+  while (!luaio_list_is_empty(waiting)) {
+    luaio_tcp_socket_unstall(luaio_list_first_entry(waiting, luaio_tcp_stall_t, list), status);
   }
+}
 
-  int write_data_ref = luaio_req->write_data_ref;
-  if (write_data_ref != LUA_NOREF) {
-    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
+/* a write of socket has finished, at the low watermark the stalled writers go
+ * on in the order they stalled, until one of them fills the queue again.
+ */
+static void luaio_tcp_socket_after_drain(luaio_tcp_socket_t *socket, int status) {
+  if (status < 0) {
+    luaio_tcp_socket_unstall_all(socket, status);
+    return;
   }
 
-  size_t bytes = luaio_req->bytes;
-  int timed_out = luaio_req->timed_out;
-  luaio_pfree(luaio_req);
-  if (timed_out) return;
+  luaio_list_t *waiting = &socket->write_waiting;
+  while (luaio_tcp_socket_queued(socket) <= socket->write_low) {
+    socket->write_full = 0;
+    if (luaio_list_is_empty(waiting)) break;
+    luaio_tcp_socket_unstall(luaio_list_first_entry(waiting, luaio_tcp_stall_t, list), 0);
+  }
+}
 
-  if (status != 0) {
-    lua_pushinteger(L, 0);
-  } else {
-    lua_pushinteger(L, bytes);
+/* sockets of this loop with corked bytes, flushed by luaio_tcp_cork_check
+ * after the poll phase and by luaio_tcp_cork_prepare before it: an active
+ * uv_check does not keep poll from blocking, the bytes corked by a coroutine
+ * which a timer resumed must go out before the loop waits for I/O.
+ */
+static LUAIO_THREAD_LOCAL luaio_list_t luaio_tcp_cork_dirty;
+static LUAIO_THREAD_LOCAL uv_check_t luaio_tcp_cork_check;
+static LUAIO_THREAD_LOCAL uv_prepare_t luaio_tcp_cork_prepare;
+static LUAIO_THREAD_LOCAL int luaio_tcp_cork_check_inited = 0;
+
+typedef struct {
+  luaio_tcp_socket_t  *socket;
+  char                *chunk;
+  int                 refs_ref;
+  uv_write_t          req;
+} luaio_tcp_cork_write_t;
+
+static void luaio_tcp_cork_after_write(uv_write_t *req, int status) {
+  luaio_tcp_cork_write_t *cork_req = container_of(req, luaio_tcp_cork_write_t, req);
+  luaio_tcp_socket_t *socket = cork_req->socket;
+
+  if (cork_req->refs_ref != LUA_NOREF) {
+    luaL_unref(luaio_get_main_thread(), LUA_REGISTRYINDEX, cork_req->refs_ref);
   }
 
-  lua_pushinteger(L, status);
-  luaio_resume(L, 2);
+  if (cork_req->chunk != NULL) {
+    luaio_pfree(cork_req->chunk);
+  }
+
+  luaio_pfree(cork_req);
+  luaio_tcp_socket_after_drain(socket, status);
 }
 
-/*local bytes, err = socket:write(data)*/
-static int luaio_tcp_socket_write(lua_State *L) {
-  luaio_tcp_check_socket(L, write(data));
-  /*common.h*/
-  luaio_check_data(L, 2, socket:write(data));
+/*the queue is empty, the socket leaves the dirty list*/
+static void luaio_tcp_cork_clean(luaio_tcp_cork_t *cork) {
+  lua_State *L = luaio_get_main_thread();
 
-  size_t written = 0;
-  size_t vcount = count;
-  uv_stream_t *stream_handle = (uv_stream_t*)(&socket->handle);
-  int err = luaio_tcp_socket_try_write(stream_handle, 
-                                       &bufs, 
-                                       &vcount, 
-                                       &written);
-  if (err) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
-    }
+  cork->npiece = 0;
+  cork->chunk_len = 0;
+  cork->bytes = 0;
 
-    lua_pushinteger(L, 0);
-    lua_pushinteger(L, err);
-    return 2;
+  if (cork->refs_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, cork->refs_ref);
+    cork->refs_ref = LUA_NOREF;
+    cork->nref = 0;
   }
 
-  /*uv_try_write send all data*/
-  if (vcount == 0) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
-    }
+  if (!luaio_list_is_empty(&cork->dirty)) {
+    luaio_list_remove_init(&cork->dirty);
+  }
 
+  if (cork->socket_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, cork->socket_ref);
+    cork->socket_ref = LUA_NOREF;
+  }
+}
+
+/* write the queued pieces with one writev, what the kernel does not take at
+ * once is handed to uv_write together with the chunk and the referenced strings.
+ */
+static int luaio_tcp_cork_flush(luaio_tcp_socket_t *socket) {
+  luaio_tcp_cork_t *cork = &socket->cork;
+  size_t npiece = cork->npiece;
+  if (npiece == 0) return 0;
+
+  uv_stream_t *stream_handle = (uv_stream_t*)(&socket->handle);
+  int err = 0;
+  if (uv_is_closing((uv_handle_t*)stream_handle)) {
+    err = UV_ECANCELED;
+  } else {
+    luaio_stack_buffer_t stack_buf;
+    uv_buf_t *bufs = luaio_stack_buffer_init(&stack_buf, sizeof(uv_buf_t) * npiece);
+    if (bufs == NULL) {
+      err = UV_ENOMEM;
+    } else {
+      luaio_tcp_cork_piece_t *pieces = cork->pieces;
+      for (size_t i = 0; i < npiece; i++) {
+        bufs[i].base = pieces[i].base != NULL ? pieces[i].base : cork->chunk + pieces[i].offset;
+        bufs[i].len = pieces[i].len;
+      }
+
+      uv_buf_t *vbufs = bufs;
+      size_t vcount = npiece;
+      size_t written = 0;
+      err = luaio_tcp_socket_try_write(stream_handle, &vbufs, &vcount, &written);
+      if (err == 0 && vcount > 0) {
+        luaio_tcp_cork_write_t *cork_req = luaio_palloc(sizeof(luaio_tcp_cork_write_t));
+        if (cork_req == NULL) {
+          err = UV_ENOMEM;
+        } else {
+          err = uv_write(&cork_req->req, stream_handle, vbufs, vcount, luaio_tcp_cork_after_write);
+          if (err) {
+            luaio_pfree(cork_req);
+          } else {
+            /*the write owns the memory under the pieces now*/
+            cork_req->socket = socket;
+            cork_req->chunk = cork->chunk;
+            cork_req->refs_ref = cork->refs_ref;
+            cork->chunk = NULL;
+            cork->chunk_capacity = 0;
+            cork->refs_ref = LUA_NOREF;
+            cork->nref = 0;
+          }
+        }
+      }
+
+      luaio_stack_buffer_free(&stack_buf);
+    }
+  }
+
+  cork->flushes++;
+  if (err) cork->status = err;
+  luaio_tcp_cork_clean(cork);
+  return err;
+}
+
+static void luaio_tcp_cork_flush_dirty() {
+  luaio_list_t *dirty = &luaio_tcp_cork_dirty;
+  while (!luaio_list_is_empty(dirty)) {
+    luaio_tcp_cork_t *cork = luaio_list_first_entry(dirty, luaio_tcp_cork_t, dirty);
+    luaio_tcp_cork_flush(container_of(cork, luaio_tcp_socket_t, cork));
+  }
+
+  uv_check_stop(&luaio_tcp_cork_check);
+  uv_prepare_stop(&luaio_tcp_cork_prepare);
+}
+
+static void luaio_tcp_cork_oncheck(uv_check_t *check) {
+  luaio_tcp_cork_flush_dirty();
+}
+
+static void luaio_tcp_cork_onprepare(uv_prepare_t *prepare) {
+  luaio_tcp_cork_flush_dirty();
+}
+
+/*free the queue without writing it*/
+static void luaio_tcp_cork_release(luaio_tcp_cork_t *cork) {
+  luaio_tcp_cork_clean(cork);
+
+  if (cork->chunk != NULL) {
+    luaio_pfree(cork->chunk);
+    cork->chunk = NULL;
+    cork->chunk_capacity = 0;
+  }
+
+  if (cork->pieces != NULL) {
+    luaio_pfree(cork->pieces);
+    cork->pieces = NULL;
+    cork->piece_capacity = 0;
+  }
+
+  cork->enabled = 0;
+}
+
+static luaio_tcp_cork_piece_t *luaio_tcp_cork_new_piece(luaio_tcp_cork_t *cork) {
+  if (cork->npiece == cork->piece_capacity) {
+    size_t capacity = cork->piece_capacity ? cork->piece_capacity << 1 : LUAIO_TCP_CORK_PIECES;
+    luaio_tcp_cork_piece_t *pieces = luaio_prealloc_used(cork->pieces,
+                                                         sizeof(luaio_tcp_cork_piece_t) * cork->npiece,
+                                                         sizeof(luaio_tcp_cork_piece_t) * capacity);
+    if (pieces == NULL) return NULL;
+
+    cork->pieces = pieces;
+    cork->piece_capacity = capacity;
+  }
+
+  return &cork->pieces[cork->npiece++];
+}
+
+/*copy a small piece into chunk, it is merged into the last piece if that one ends the chunk*/
+static int luaio_tcp_cork_copy(luaio_tcp_cork_t *cork, const char *base, size_t len) {
+  size_t chunk_len = cork->chunk_len;
+  if (chunk_len + len > cork->chunk_capacity) {
+    size_t capacity = cork->chunk_capacity ? cork->chunk_capacity : LUAIO_TCP_CORK_CHUNK_SIZE;
+    while (capacity < chunk_len + len) capacity <<= 1;
+
+    char *chunk = luaio_prealloc_used(cork->chunk, chunk_len, capacity);
+    if (chunk == NULL) return UV_ENOMEM;
+
+    cork->chunk = chunk;
+    cork->chunk_capacity = luaio_pmemory_get_capacity(chunk);
+  }
+
+  luaio_memcpy(cork->chunk + chunk_len, base, len);
+  cork->chunk_len = chunk_len + len;
+
+  if (cork->npiece > 0) {
+    luaio_tcp_cork_piece_t *last = &cork->pieces[cork->npiece - 1];
+    if (last->base == NULL && last->offset + last->len == chunk_len) {
+      last->len += len;
+      return 0;
+    }
+  }
+
+  luaio_tcp_cork_piece_t *piece = luaio_tcp_cork_new_piece(cork);
+  if (piece == NULL) return UV_ENOMEM;
+
+  piece->base = NULL;
+  piece->offset = chunk_len;
+  piece->len = len;
+  return 0;
+}
+
+/*the reason luaio_tcp_cork_push() refuses the data at index, NULL if it takes it*/
+static const char *luaio_tcp_cork_check_piece(lua_State *L, int index) {
+  int type = lua_type(L, index);
+  if (type == LUA_TSTRING) return NULL;
+  if (type != LUA_TUSERDATA) {
+    return "socket:write_async(data) error: data must be [string|buffer|slice|chain|table(string|buffer|slice)]\n";
+  }
+
+  luaio_buffer_t *buffer = lua_touserdata(L, index);
+  if (buffer->type == LUAIO_TYPE_BUFFER_CHAIN) return NULL;
+
+  if (buffer->type == LUAIO_TYPE_BUFFER_SLICE) {
+    if (luaio_buffer_slice_is_stale((luaio_buffer_slice_t*)buffer)) {
+      return "socket:write_async(data) error: data is slice, but the buffer has been refilled\n";
+    }
+
+    return NULL;
+  }
+
+  if (!luaio_is_buffer(buffer->type)) {
+    return "socket:write_async(data) error: data is userdata, but not buffer\n";
+  }
+
+  if (buffer->capacity == 0) {
+    return "socket:write_async(data) error: data is buffer, but no memory available\n";
+  }
+
+  return NULL;
+}
+
+/*queue the string, buffer, slice or chain at index, buffers, slices and chains are copied since they are reused*/
+static int luaio_tcp_cork_push(lua_State *L, luaio_tcp_cork_t *cork, int index, size_t *bytes) {
+  const char *msg = luaio_tcp_cork_check_piece(L, index);
+  if (msg != NULL) {
+    return luaL_error(L, "%s", msg);
+  }
+
+  size_t len;
+  const char *base;
+  int type = lua_type(L, index);
+  if (type == LUA_TUSERDATA && ((luaio_buffer_t*)lua_touserdata(L, index))->type == LUAIO_TYPE_BUFFER_CHAIN) {
+    luaio_buffer_chain_t *chain = lua_touserdata(L, index);
+    luaio_buffer_chain_foreach(chain, segment) {
+      len = segment->write_pos - segment->read_pos;
+      if (len == 0) continue;
+
+      int err = luaio_tcp_cork_copy(cork, segment->read_pos, len);
+      if (err) return err;
+
+      *bytes += len;
+    }
+
+    return 0;
+  }
+
+  if (type == LUA_TSTRING) {
+    base = lua_tolstring(L, index, &len);
+    if (len > LUAIO_TCP_CORK_COPY_SIZE) {
+      luaio_tcp_cork_piece_t *piece = luaio_tcp_cork_new_piece(cork);
+      if (piece == NULL) return UV_ENOMEM;
+
+      piece->base = (char*)base;
+      piece->offset = 0;
+      piece->len = len;
+
+      if (cork->refs_ref == LUA_NOREF) {
+        lua_createtable(L, 4, 0);
+        cork->refs_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+      }
+
+      lua_rawgeti(L, LUA_REGISTRYINDEX, cork->refs_ref);
+      lua_pushvalue(L, index);
+      lua_rawseti(L, -2, ++cork->nref);
+      lua_pop(L, 1);
+      *bytes += len;
+      return 0;
+    }
+  } else {
+    luaio_buffer_t *buffer = lua_touserdata(L, index);
+    if (buffer->type == LUAIO_TYPE_BUFFER_SLICE) {
+      luaio_buffer_slice_t *slice = (luaio_buffer_slice_t*)buffer;
+      base = slice->base;
+      len = slice->len;
+    } else {
+      base = buffer->read_pos;
+      len = buffer->write_pos - base;
+    }
+  }
+
+  if (len == 0) return 0;
+
+  int err = luaio_tcp_cork_copy(cork, base, len);
+  if (err) return err;
+
+  *bytes += len;
+  return 0;
+}
+
+/* return bytes, 0 from write_async, or stall the thread while more than
+ * write_high bytes are queued until the queue drains to write_low. a writer
+ * also stalls above write_low while others are stalled, they go on in order.
+ */
+static int luaio_tcp_socket_write_return(lua_State *L, luaio_tcp_socket_t *socket, size_t bytes) {
+  size_t queued = luaio_tcp_socket_queued(socket);
+  if (queued > socket->queued_peak) socket->queued_peak = queued;
+
+  size_t limit = luaio_list_is_empty(&socket->write_waiting) ? socket->write_high : socket->write_low;
+  if (socket->write_high == 0 || socket->write_nowait || queued <= limit) {
+    lua_pushinteger(L, bytes);
+    lua_pushinteger(L, 0);
+    return 2;
+  }
+
+  /*corked bytes only drain once they are written*/
+  int err = luaio_tcp_cork_flush(socket);
+  if (err || luaio_tcp_socket_queued(socket) <= socket->write_low) {
+    socket->cork.status = 0;
+    lua_pushinteger(L, bytes);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  luaio_tcp_stall_t *stall = luaio_palloc(sizeof(luaio_tcp_stall_t));
+  if (stall == NULL) {
+    lua_pushinteger(L, bytes);
+    lua_pushinteger(L, UV_ENOMEM);
+    return 2;
+  }
+
+  luaio_timer_event_init(&stall->timer, luaio_tcp_socket_stall_timeout, stall);
+  if (socket->timeout) {
+    err = luaio_timer_event_start(&stall->timer, socket->timeout, socket->timer_precise);
+    if (err) {
+      luaio_pfree(stall);
+      lua_pushinteger(L, bytes);
+      lua_pushinteger(L, err);
+      return 2;
+    }
+  }
+
+  stall->socket = socket;
+  stall->current_thread = L;
+  stall->bytes = bytes;
+  stall->start = uv_now(luaio_get_loop());
+  luaio_list_insert_tail(&stall->list, &socket->write_waiting);
+  socket->stalls++;
+  return lua_yield(L, 0);
+}
+
+/* queue data of socket:write_async(data) while corked, the socket is at index 1
+ * @return: bytes {integer} bytes queued
+ * @return: err {integer} the error of the last flush if any
+ */
+static int luaio_tcp_cork_write(lua_State *L, luaio_tcp_socket_t *socket, int index) {
+  luaio_tcp_cork_t *cork = &socket->cork;
+  size_t bytes = 0;
+  int err = cork->status;
+  if (err) {
+    cork->status = 0;
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  if (lua_type(L, index) == LUA_TTABLE) {
+    /*refuse a bad piece before any piece is queued*/
+    size_t count = lua_rawlen(L, index);
+    for (size_t i = 1; i <= count; i++) {
+      lua_rawgeti(L, index, i);
+      const char *msg = luaio_tcp_cork_check_piece(L, -1);
+      if (msg != NULL) {
+        return luaL_error(L, "%s", msg);
+      }
+      lua_pop(L, 1);
+    }
+
+    for (size_t i = 1; i <= count && err == 0; i++) {
+      lua_rawgeti(L, index, i);
+      err = luaio_tcp_cork_push(L, cork, lua_gettop(L), &bytes);
+      lua_pop(L, 1);
+    }
+  } else {
+    err = luaio_tcp_cork_push(L, cork, index, &bytes);
+  }
+
+  cork->bytes += bytes;
+  if (cork->npiece > 0 && luaio_list_is_empty(&cork->dirty)) {
+    if (luaio_list_is_empty(&luaio_tcp_cork_dirty)) {
+      uv_check_start(&luaio_tcp_cork_check, luaio_tcp_cork_oncheck);
+      uv_prepare_start(&luaio_tcp_cork_prepare, luaio_tcp_cork_onprepare);
+    }
+
+    luaio_list_insert_tail(&cork->dirty, &luaio_tcp_cork_dirty);
+    lua_pushvalue(L, 1);
+    cork->socket_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  if (err) {
+    lua_pushinteger(L, bytes);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  return luaio_tcp_socket_write_return(L, socket, bytes);
+}
+
+/* @example: local err = socket:cork([enable])
+ * @param: enable {boolean|default: true}
+ * @return: err {integer} the error of flushing the queue when cork is turned off
+ *
+ * corked socket:write_async(data) only queues data, the queue of every socket
+ * is written with one writev when the loop iteration ends. socket:write(data),
+ * socket:sendfile(), socket:shutdown() and socket:close() flush it first.
+ */
+static int luaio_tcp_socket_cork(lua_State *L) {
+  luaio_tcp_check_socket(L, cork(enable));
+  int enable = lua_isnoneornil(L, 2) ? 1 : lua_toboolean(L, 2);
+
+  luaio_tcp_cork_t *cork = &socket->cork;
+  if (enable) {
+    if (!luaio_tcp_cork_check_inited) {
+      luaio_list_init(&luaio_tcp_cork_dirty);
+      uv_check_init(luaio_get_loop(), &luaio_tcp_cork_check);
+      uv_prepare_init(luaio_get_loop(), &luaio_tcp_cork_prepare);
+      luaio_tcp_cork_check_inited = 1;
+    }
+
+    cork->enabled = 1;
+    lua_pushinteger(L, 0);
+    return 1;
+  }
+
+  int err = luaio_tcp_cork_flush(socket);
+  cork->enabled = 0;
+  lua_pushinteger(L, err);
+  return 1;
+}
+
+/* @example: local err = socket:flush() write the corked queue now */
+static int luaio_tcp_socket_flush(lua_State *L) {
+  luaio_tcp_check_socket(L, flush());
+
+  int err = luaio_tcp_cork_flush(socket);
+  if (err == 0) {
+    err = socket->cork.status;
+  }
+
+  socket->cork.status = 0;
+  lua_pushinteger(L, err);
+  return 1;
+}
+
+/* @example: local bytes, pieces, flushes = socket:cork_stats()
+ * @return: bytes {integer} corked bytes
+ * @return: pieces {integer} iovec entries of the next writev
+ * @return: flushes {integer}
+ */
+static int luaio_tcp_socket_cork_stats(lua_State *L) {
+  luaio_tcp_check_socket(L, cork_stats());
+
+  luaio_tcp_cork_t *cork = &socket->cork;
+  lua_pushinteger(L, cork->bytes);
+  lua_pushinteger(L, cork->npiece);
+  lua_pushinteger(L, cork->flushes);
+  return 3;
+}
+
+/* @example: local err = socket:set_write_watermarks(high[, low, nowait])
+ * @param: high {integer} queued bytes above which write_async stalls, 0 means no limit
+ * @param: low {integer|default: high / 2} queued bytes at which the stalled write_async returns
+ * @param: nowait {boolean|default: false} write_async returns UV_EAGAIN without
+ *    queuing the data once more than high bytes are queued, until the queue
+ *    drains to low, it never yields
+ * @return: err {integer}
+ */
+static int luaio_tcp_socket_set_write_watermarks(lua_State *L) {
+  luaio_tcp_check_socket(L, set_write_watermarks(high, low, nowait));
+
+  lua_Integer high = luaL_checkinteger(L, 2);
+  lua_Integer low = luaL_optinteger(L, 3, high / 2);
+  if (high < 0 || low < 0 || low > high) {
+    return luaL_argerror(L, 2, "socket:set_write_watermarks(high, low, nowait) error: must be 0 <= low <= high\n");
+  }
+
+  socket->write_high = high;
+  socket->write_low = low;
+  socket->write_nowait = lua_toboolean(L, 4);
+
+  lua_pushinteger(L, 0);
+  return 1;
+}
+
+/* @example: local stats = socket:write_stats()
+ * @return: stats {table}
+ *    local stats = {
+ *      queued = {integer} bytes queued by write_async and not taken by the kernel
+ *      queued_peak = {integer}
+ *      stalls = {integer} times write_async stalled above the high watermark
+ *      stall_time = {integer} milliseconds write_async has been stalled
+ *      eagains = {integer} UV_EAGAIN returned in nowait mode
+ *      high = {integer}
+ *      low = {integer}
+ *    }
+ */
+static int luaio_tcp_socket_write_stats(lua_State *L) {
+  luaio_tcp_check_socket(L, write_stats());
+
+  uint64_t stall_time = socket->stall_time;
+  uint64_t now = uv_now(luaio_get_loop());
+  luaio_list_t *waiting = &socket->write_waiting;
+  for (luaio_list_t *node = waiting->next; node != waiting; node = node->next) {
+    stall_time += now - container_of(node, luaio_tcp_stall_t, list)->start;
+  }
+
+  lua_createtable(L, 0, 7);
+  luaio_setinteger("queued", luaio_tcp_socket_queued(socket));
+  luaio_setinteger("queued_peak", socket->queued_peak);
+  luaio_setinteger("stalls", socket->stalls);
+  luaio_setinteger("stall_time", stall_time);
+  luaio_setinteger("eagains", socket->eagains);
+  luaio_setinteger("high", socket->write_high);
+  luaio_setinteger("low", socket->write_low);
+  return 1;
+}
+
+static void luaio_tcp_socket_write_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_write_req_t *luaio_req = event->data;
+  lua_State *L = luaio_req->current_thread;
+ 
+  int write_data_ref = luaio_req->write_data_ref;
+  if (write_data_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
+    luaio_req->write_data_ref = LUA_NOREF;
+  }
+
+  luaio_req->timed_out = 1;
+
+  lua_pushinteger(L, 0);
+  lua_pushinteger(L, UV_ETIMEDOUT);
+  luaio_resume(L, 2);
+}
+
+static void luaio_tcp_socket_after_write(uv_write_t *req, int status) {
+  luaio_tcp_write_req_t *luaio_req = container_of(req, luaio_tcp_write_req_t, req);
+  lua_State* L = luaio_req->current_thread;
+ 
+  luaio_timer_event_stop(&luaio_req->timer);
+
+  int write_data_ref = luaio_req->write_data_ref;
+  if (write_data_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
+  }
+
+  size_t bytes = luaio_req->bytes;
+  int timed_out = luaio_req->timed_out;
+  luaio_tcp_socket_t *socket = luaio_req->socket;
+  luaio_pfree(luaio_req);
+  luaio_tcp_socket_after_drain(socket, status);
+  if (timed_out) return;
+
+  if (status != 0) {
+    lua_pushinteger(L, 0);
+  } else {
+    lua_pushinteger(L, bytes);
+  }
+
+  lua_pushinteger(L, status);
+  luaio_resume(L, 2);
+}
+
+/*local bytes, err = socket:write(data)*/
+static int luaio_tcp_socket_write(lua_State *L) {
+  luaio_tcp_check_socket(L, write(data));
+
+  /*corked bytes go out first, uv_write keeps the order*/
+  if (socket->cork.npiece > 0) {
+    luaio_tcp_cork_flush(socket);
+  }
+
+  /*common.h*/
+  luaio_check_data(L, 2, socket:write(data));
+
+  size_t written = 0;
+  size_t vcount = count;
+  uv_stream_t *stream_handle = (uv_stream_t*)(&socket->handle);
+  int err = luaio_tcp_socket_try_write(stream_handle, 
+                                       &bufs, 
+                                       &vcount, 
+                                       &written);
+  if (err) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  /*uv_try_write send all data*/
+  if (vcount == 0) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    lua_pushinteger(L, written);
+    lua_pushinteger(L, 0);
+    return 2;
+  }
+
+  luaio_tcp_write_req_t *luaio_req = luaio_palloc(sizeof(luaio_tcp_write_req_t));
+  if (luaio_req == NULL) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    lua_pushinteger(L, written);
+    lua_pushinteger(L, UV_ENOMEM);
+    return 2;
+  }
+
+  luaio_timer_event_init(&luaio_req->timer, luaio_tcp_socket_write_timeout, luaio_req);
+
+  uint64_t timeout = socket->timeout;
+  if (timeout != 0) {
+    err = luaio_timer_event_start(&luaio_req->timer, timeout, socket->timer_precise);
+    if (err) {
+      if (tmp != NULL) {
+        luaio_stack_buffer_free(&stack_buf);
+      }
+
+      luaio_pfree(luaio_req);
+      lua_pushinteger(L, written);
+      lua_pushinteger(L, err);
+      return 2;
+    }
+  }
+
+  err = uv_write2(&luaio_req->req, 
+                  stream_handle, 
+                  bufs, 
+                  vcount, 
+                  NULL, 
+                  luaio_tcp_socket_after_write);
+  if (err) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    luaio_timer_event_stop(&luaio_req->timer);
+    luaio_pfree(luaio_req);
     lua_pushinteger(L, written);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  lua_pushvalue(L, 2);
+  luaio_req->write_data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  luaio_req->current_thread = L;
+  luaio_req->socket = socket;
+  luaio_req->timed_out = 0;
+  luaio_req->bytes = bytes;
+
+  if (tmp != NULL) {
+    luaio_stack_buffer_free(&stack_buf);
+  }
+
+  return lua_yield(L, 0);
+}
+
+static void luaio_tcp_socket_write_async_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_write_req_t *luaio_req = event->data;
+  lua_State *L = luaio_get_main_thread();
+ 
+  int write_data_ref = luaio_req->write_data_ref;
+  if (write_data_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
+    luaio_req->write_data_ref = LUA_NOREF;
+  }
+}
+
+static void luaio_tcp_socket_after_write_async(uv_write_t *req, int status) {
+  luaio_tcp_write_req_t *luaio_req = container_of(req, luaio_tcp_write_req_t, req);
+  lua_State* L = luaio_get_main_thread();
+ 
+  luaio_timer_event_stop(&luaio_req->timer);
+
+  int write_data_ref = luaio_req->write_data_ref;
+  if (write_data_ref != LUA_NOREF) {
+    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
+  }
+
+  luaio_tcp_socket_t *socket = luaio_req->socket;
+  luaio_pfree(luaio_req);
+  luaio_tcp_socket_after_drain(socket, status);
+}
+
+/*local bytes, err = socket:write_async(data)*/
+static int luaio_tcp_socket_write_async(lua_State *L) {
+  luaio_tcp_check_socket(L, write(data));
+
+  /*the same bound as a stall, and no more data until the queue drains to write_low*/
+  if (socket->write_nowait && socket->write_high
+      && (socket->write_full || luaio_tcp_socket_queued(socket) > socket->write_high)) {
+    socket->write_full = 1;
+    socket->eagains++;
     lua_pushinteger(L, 0);
+    lua_pushinteger(L, UV_EAGAIN);
     return 2;
   }
 
-  uint64_t timeout = socket->timeout;
-  uv_timer_t *timer = NULL;
-  if (timeout != 0) {
-    timer = luaio_timer_alloc();
-    if (timer == NULL) {
-      if (tmp != NULL) {
-        luaio_stack_buffer_free(&stack_buf);
-      }
+  if (socket->cork.enabled) {
+    return luaio_tcp_cork_write(L, socket, 2);
+  }
+
+  /*common.h*/
+  luaio_check_data(L, 2, socket:write(data));
+
+  size_t written = 0;
+  size_t vcount = count;
+  uv_stream_t *stream_handle = (uv_stream_t*)(&socket->handle);
+  int err = luaio_tcp_socket_try_write(stream_handle, 
+                                       &bufs, 
+                                       &vcount, 
+                                       &written);
+  if (err) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  /*uv_try_write send all data*/
+  if (vcount == 0) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    lua_pushinteger(L, written);
+    lua_pushinteger(L, 0);
+    return 2;
+  }
+
+  luaio_tcp_write_req_t *luaio_req = luaio_palloc(sizeof(luaio_tcp_write_req_t));
+  if (luaio_req == NULL) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    lua_pushinteger(L, written);
+    lua_pushinteger(L, UV_ENOMEM);
+    return 2;
+  }
+
+  luaio_timer_event_init(&luaio_req->timer, luaio_tcp_socket_write_async_timeout, luaio_req);
+
+  uint64_t timeout = socket->timeout;
+  if (timeout != 0) {
+    err = luaio_timer_event_start(&luaio_req->timer, timeout, socket->timer_precise);
+    if (err) {
+      if (tmp != NULL) {
+        luaio_stack_buffer_free(&stack_buf);
+      }
+
+      luaio_pfree(luaio_req);
+      lua_pushinteger(L, written);
+      lua_pushinteger(L, err);
+      return 2;
+    }
+  }
+
+  err = uv_write2(&luaio_req->req, 
+                  stream_handle, 
+                  bufs, 
+                  vcount, 
+                  NULL, 
+                  luaio_tcp_socket_after_write_async);
+  if (err) {
+    if (tmp != NULL) {
+      luaio_stack_buffer_free(&stack_buf);
+    }
+
+    luaio_timer_event_stop(&luaio_req->timer);
+    luaio_pfree(luaio_req);
+    lua_pushinteger(L, written);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  lua_pushvalue(L, 2);
+  luaio_req->write_data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  luaio_req->current_thread = NULL;
+  luaio_req->socket = socket;
+
+  if (tmp != NULL) {
+    luaio_stack_buffer_free(&stack_buf);
+  }
+
+  return luaio_tcp_socket_write_return(L, socket, bytes);
+}
+
+
+/* socket:pipe(other) moves bytes from socket to other inside C, the lua
+ * thread is resumed only on EOF, error, limit or idle timeout.
+ * reading is paused while other has queued writes(backpressure).
+ */
+struct luaio_tcp_pipe_s {
+  luaio_tcp_socket_t  *src;
+  luaio_tcp_socket_t  *dst;
+  lua_State           *current_thread;
+  luaio_timer_event_t timer;
+  uint64_t            timeout;
+  uint64_t            limit;  /*0 means no limit*/
+  uint64_t            bytes;
+  char                *buf;
+  size_t              capacity;
+  int                 writing;
+  int                 draining;  /*ended, wait for the pending bytes*/
+  int                 finished;
+  int                 status;
+  uv_write_t          req;
+#if LUAIO_HAVE_SPLICE
+  int                 splice;
+  int                 src_fd;  /*dup of the sockets, polled beside the uv_tcp_t*/
+  int                 dst_fd;
+  int                 fds[2];
+  size_t              piped;  /*bytes in the kernel pipe*/
+  int                 closing;
+  uv_poll_t           src_poll;
+  uv_poll_t           dst_poll;
+#endif
+};
+
+#define luaio_tcp_pipe_rest(pipe) \
+  ((pipe)->limit ? (pipe)->limit - (pipe)->bytes : (uint64_t)-1)
+
+#if LUAIO_HAVE_SPLICE
+
+static void luaio_tcp_pipe_splice_onclose(uv_handle_t *handle) {
+  luaio_tcp_pipe_t *pipe = handle->data;
+  if (--pipe->closing > 0) return;
+
+  close(pipe->src_fd);
+  close(pipe->dst_fd);
+  close(pipe->fds[0]);
+  close(pipe->fds[1]);
+  luaio_pfree(pipe);
+}
+
+#endif
+
+/*resume the lua thread with bytes, status, the pipe is freed when no write is pending*/
+static void luaio_tcp_pipe_done(luaio_tcp_pipe_t *pipe, int status) {
+  if (pipe->finished) return;
+  pipe->finished = 1;
+
+  lua_State *L = pipe->current_thread;
+  uint64_t bytes = pipe->bytes;
+
+  luaio_timer_event_stop(&pipe->timer);
+  pipe->src->pipe = NULL;
+  pipe->dst->pipe_into = NULL;
+
+#if LUAIO_HAVE_SPLICE
+  if (pipe->splice) {
+    pipe->closing = 2;
+    uv_close((uv_handle_t*)&pipe->src_poll, luaio_tcp_pipe_splice_onclose);
+    uv_close((uv_handle_t*)&pipe->dst_poll, luaio_tcp_pipe_splice_onclose);
+  } else
+#endif
+  {
+    uv_read_stop((uv_stream_t*)&pipe->src->handle);
+    if (!pipe->writing) {
+      luaio_pfree(pipe->buf);
+      luaio_pfree(pipe);
+    }
+  }
+
+  lua_pushinteger(L, bytes);
+  lua_pushinteger(L, status);
+  luaio_resume(L, 2);
+}
+
+/*stop reading, finish after the pending bytes are written*/
+static void luaio_tcp_pipe_end(luaio_tcp_pipe_t *pipe, int status) {
+  int pending = pipe->writing;
+#if LUAIO_HAVE_SPLICE
+  if (pipe->splice) {
+    pending = pipe->piped > 0;
+    uv_poll_stop(&pipe->src_poll);
+  } else
+#endif
+  {
+    uv_read_stop((uv_stream_t*)&pipe->src->handle);
+  }
+
+  if (!pending) {
+    luaio_tcp_pipe_done(pipe, status);
+    return;
+  }
+
+  pipe->draining = 1;
+  pipe->status = status;
+}
+
+static void luaio_tcp_pipe_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_pipe_t *pipe = event->data;
+  luaio_tcp_pipe_done(pipe, UV_ETIMEDOUT);
+}
+
+static void luaio_tcp_pipe_touch(luaio_tcp_pipe_t *pipe) {
+  if (pipe->timeout != 0) {
+    luaio_timer_event_start(&pipe->timer, pipe->timeout, pipe->src->timer_precise);
+  }
+}
+
+static void luaio_tcp_pipe_onalloc(uv_handle_t *handle, 
+                                   size_t suggested_size, 
+                                   uv_buf_t *buf) {
+  luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
+  luaio_tcp_pipe_t *pipe = socket->pipe;
+
+  uint64_t rest = luaio_tcp_pipe_rest(pipe);
+  buf->base = pipe->buf;
+  buf->len = rest < pipe->capacity ? rest : pipe->capacity;
+}
+
+static void luaio_tcp_pipe_onread(uv_stream_t *handle, 
+                                  ssize_t nread, 
+                                  const uv_buf_t *buf);
+
+static void luaio_tcp_pipe_after_write(uv_write_t *req, int status) {
+  luaio_tcp_pipe_t *pipe = container_of(req, luaio_tcp_pipe_t, req);
+  pipe->writing = 0;
+
+  if (pipe->finished) {
+    luaio_pfree(pipe->buf);
+    luaio_pfree(pipe);
+    return;
+  }
+
+  if (status < 0) {
+    luaio_tcp_pipe_done(pipe, status);
+    return;
+  }
+
+  if (pipe->draining) {
+    luaio_tcp_pipe_done(pipe, pipe->status);
+    return;
+  }
 
-      lua_pushinteger(L, written);
-      lua_pushinteger(L, UV_ENOMEM);
-      return 2;
-    }
+  if (luaio_tcp_pipe_rest(pipe) == 0) {
+    luaio_tcp_pipe_done(pipe, 0);
+    return;
+  }
+
+  luaio_tcp_pipe_touch(pipe);
+  int err = uv_read_start((uv_stream_t*)&pipe->src->handle, 
+                          luaio_tcp_pipe_onalloc, 
+                          luaio_tcp_pipe_onread);
+  if (err) {
+    luaio_tcp_pipe_done(pipe, err);
+  }
+}
+
+static void luaio_tcp_pipe_onread(uv_stream_t *handle, 
+                                  ssize_t nread, 
+                                  const uv_buf_t *buf) {
+  if (nread == 0) return;
 
-    uv_timer_start(timer, 
-                   luaio_tcp_socket_write_timeout, 
-                   timeout, 
-                   0);
+  luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
+  luaio_tcp_pipe_t *pipe = socket->pipe;
+
+  if (nread < 0) {
+    luaio_tcp_pipe_end(pipe, nread);
+    return;
   }
 
-  luaio_tcp_write_req_t *luaio_req = luaio_palloc(sizeof(luaio_tcp_write_req_t));
-  if (luaio_req == NULL) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
+  luaio_tcp_pipe_touch(pipe);
+  pipe->bytes += nread;
+
+  uv_buf_t wbuf = uv_buf_init(buf->base, nread);
+  uv_stream_t *dst_handle = (uv_stream_t*)&pipe->dst->handle;
+  if (dst_handle->write_queue_size == 0) {
+    int written = uv_try_write(dst_handle, &wbuf, 1);
+    if (written == nread) {
+      if (luaio_tcp_pipe_rest(pipe) == 0) {
+        luaio_tcp_pipe_done(pipe, 0);
+      }
+      return;
     }
 
-    if (timer != NULL) {
-      uv_timer_stop(timer);
-      luaio_timer_free(timer);
+    if (written < 0 && written != UV_EAGAIN && written != UV_ENOSYS) {
+      luaio_tcp_pipe_done(pipe, written);
+      return;
     }
 
-    lua_pushinteger(L, written);
-    lua_pushinteger(L, UV_ENOMEM);
-    return 2;
+    if (written > 0) {
+      wbuf.base += written;
+      wbuf.len -= written;
+    }
   }
 
-  err = uv_write2(&luaio_req->req, 
-                  stream_handle, 
-                  bufs, 
-                  vcount, 
-                  NULL, 
-                  luaio_tcp_socket_after_write);
+  /*other is full, pause reading until the buffer is written*/
+  uv_read_stop(handle);
+  int err = uv_write(&pipe->req, dst_handle, &wbuf, 1, luaio_tcp_pipe_after_write);
   if (err) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
-    }
+    luaio_tcp_pipe_done(pipe, err);
+    return;
+  }
+
+  pipe->writing = 1;
+}
 
-    if (timer != NULL) {
-      uv_timer_stop(timer);
-      luaio_timer_free(timer);
+#if LUAIO_HAVE_SPLICE
+
+/*kernel pipe -> other, returns 0 or error, pipe->piped is the rest*/
+static int luaio_tcp_pipe_splice_out(luaio_tcp_pipe_t *pipe) {
+  while (pipe->piped > 0) {
+    ssize_t n = splice(pipe->fds[0], NULL, pipe->dst_fd, NULL, pipe->piped, 
+                       SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) return 0;
+      return -errno;
     }
 
-    luaio_pfree(luaio_req);
-    lua_pushinteger(L, written);
-    lua_pushinteger(L, err);
-    return 2;
+    pipe->piped -= n;
   }
 
-  lua_pushvalue(L, 2);
-  luaio_req->write_data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
-  luaio_req->current_thread = L;
-  luaio_req->timer = timer;
-  luaio_req->timed_out = 0;
-  luaio_req->bytes = bytes;
+  return 0;
+}
+
+static void luaio_tcp_pipe_splice_ondst(uv_poll_t *handle, int status, int events);
 
-  if (timer != NULL) {
-    timer->data = luaio_req;
+static void luaio_tcp_pipe_splice_onsrc(uv_poll_t *handle, int status, int events) {
+  luaio_tcp_pipe_t *pipe = handle->data;
+  if (status < 0) {
+    luaio_tcp_pipe_done(pipe, status);
+    return;
   }
 
-  if (tmp != NULL) {
-    luaio_stack_buffer_free(&stack_buf);
+  uint64_t rest = luaio_tcp_pipe_rest(pipe);
+  size_t size = rest < pipe->capacity ? rest : pipe->capacity;
+  ssize_t n = splice(pipe->src_fd, NULL, pipe->fds[1], NULL, size, 
+                     SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+  if (n == 0) {
+    luaio_tcp_pipe_end(pipe, UV_EOF);
+    return;
   }
 
-  return lua_yield(L, 0);
-}
+  if (n < 0) {
+    if (errno == EAGAIN || errno == EINTR) return;
+    luaio_tcp_pipe_done(pipe, -errno);
+    return;
+  }
 
-static void luaio_tcp_socket_write_async_timeout(uv_timer_t *handle) {
-  luaio_tcp_write_req_t *luaio_req = handle->data;
-  lua_State *L = luaio_get_main_thread();
- 
-  int write_data_ref = luaio_req->write_data_ref;
-  if (write_data_ref != LUA_NOREF) {
-    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
+  luaio_tcp_pipe_touch(pipe);
+  pipe->bytes += n;
+  pipe->piped += n;
+
+  int err = luaio_tcp_pipe_splice_out(pipe);
+  if (err) {
+    luaio_tcp_pipe_done(pipe, err);
+    return;
   }
 
-  luaio_timer_free(handle);
-  luaio_req->timer = NULL;
+  if (pipe->piped > 0) {
+    /*other is full, pause reading until the kernel pipe is drained*/
+    uv_poll_stop(&pipe->src_poll);
+    uv_poll_start(&pipe->dst_poll, UV_WRITABLE, luaio_tcp_pipe_splice_ondst);
+    return;
+  }
+
+  if (luaio_tcp_pipe_rest(pipe) == 0) {
+    luaio_tcp_pipe_done(pipe, 0);
+  }
 }
 
-static void luaio_tcp_socket_after_write_async(uv_write_t *req, int status) {
-  luaio_tcp_write_req_t *luaio_req = container_of(req, luaio_tcp_write_req_t, req);
-  lua_State* L = luaio_get_main_thread();
- 
-  uv_timer_t *timer = luaio_req->timer;
-  if (timer != NULL) {
-    uv_timer_stop(timer);
-    luaio_timer_free(timer);
+static void luaio_tcp_pipe_splice_ondst(uv_poll_t *handle, int status, int events) {
+  luaio_tcp_pipe_t *pipe = handle->data;
+  if (status < 0) {
+    luaio_tcp_pipe_done(pipe, status);
+    return;
   }
 
-  int write_data_ref = luaio_req->write_data_ref;
-  if (write_data_ref != LUA_NOREF) {
-    luaL_unref(L, LUA_REGISTRYINDEX, write_data_ref);
+  int err = luaio_tcp_pipe_splice_out(pipe);
+  if (err) {
+    luaio_tcp_pipe_done(pipe, err);
+    return;
   }
 
-  luaio_pfree(luaio_req);
+  if (pipe->piped > 0) return;
+
+  uv_poll_stop(&pipe->dst_poll);
+  if (pipe->draining) {
+    luaio_tcp_pipe_done(pipe, pipe->status);
+    return;
+  }
+
+  if (luaio_tcp_pipe_rest(pipe) == 0) {
+    luaio_tcp_pipe_done(pipe, 0);
+    return;
+  }
+
+  luaio_tcp_pipe_touch(pipe);
+  uv_poll_start(&pipe->src_poll, UV_READABLE, luaio_tcp_pipe_splice_onsrc);
 }
 
-/*local bytes, err = socket:write_async(data)*/
-static int luaio_tcp_socket_write_async(lua_State *L) {
-  luaio_tcp_check_socket(L, write(data));
-  /*common.h*/
-  luaio_check_data(L, 2, socket:write(data));
+/*returns 0 when splice is set up, otherwise the uv_tcp_t path is used*/
+static int luaio_tcp_pipe_splice_start(luaio_tcp_pipe_t *pipe) {
+  uv_loop_t *loop = luaio_get_loop();
+
+  /*bytes queued by uv_write must go out before the spliced ones*/
+  if (pipe->dst->handle.write_queue_size != 0) return -1;
+  if (pipe2(pipe->fds, O_NONBLOCK | O_CLOEXEC) < 0) return -1;
+
+  pipe->src_fd = dup(uv__stream_fd(&pipe->src->handle));
+  pipe->dst_fd = dup(uv__stream_fd(&pipe->dst->handle));
+  if (pipe->src_fd < 0 || pipe->dst_fd < 0
+      || uv_poll_init(loop, &pipe->src_poll, pipe->src_fd) 
+      || uv_poll_init(loop, &pipe->dst_poll, pipe->dst_fd)) {
+    if (pipe->src_fd >= 0) close(pipe->src_fd);
+    if (pipe->dst_fd >= 0) close(pipe->dst_fd);
+    close(pipe->fds[0]);
+    close(pipe->fds[1]);
+    return -1;
+  }
 
-  size_t written = 0;
-  size_t vcount = count;
-  uv_stream_t *stream_handle = (uv_stream_t*)(&socket->handle);
-  int err = luaio_tcp_socket_try_write(stream_handle, 
-                                       &bufs, 
-                                       &vcount, 
-                                       &written);
-  if (err) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
-    }
+  pipe->splice = 1;
+  pipe->piped = 0;
+  pipe->src_poll.data = pipe;
+  pipe->dst_poll.data = pipe;
+  uv_poll_start(&pipe->src_poll, UV_READABLE, luaio_tcp_pipe_splice_onsrc);
+  return 0;
+}
 
-    lua_pushinteger(L, 0);
-    lua_pushinteger(L, err);
-    return 2;
+#endif
+
+/*local bytes, err = socket:pipe(other, limit, timeout)*/
+static int luaio_tcp_socket_pipe(lua_State *L) {
+  luaio_tcp_check_socket(L, pipe(other, limit, timeout));
+
+  luaio_tcp_socket_t *other = lua_touserdata(L, 2);
+  if (other == NULL || other->type != LUAIO_TYPE_SOCKET || other == socket) {
+    return luaL_argerror(L, 2, "socket:pipe(other, limit, timeout) error: other must be another [userdata](socket)\n");
   }
 
-  /*uv_try_write send all data*/
-  if (vcount == 0) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
-    }
+  lua_Integer limit = luaL_optinteger(L, 3, 0);
+  lua_Integer timeout = luaL_optinteger(L, 4, 0);
+  if (limit < 0 || timeout < 0) {
+    return luaL_argerror(L, 3, "socket:pipe(other, limit, timeout) error: limit and timeout must be >= 0\n");
+  }
 
-    lua_pushinteger(L, written);
+  if (socket->pipe != NULL) {
+    return luaL_error(L, "socket:pipe(other, limit, timeout) error: socket is already piped\n");
+  }
+
+  if (other->pipe_into != NULL) {
+    return luaL_error(L, "socket:pipe(other, limit, timeout) error: other is already piped into\n");
+  }
+
+  if (other->cork.npiece > 0) {
+    luaio_tcp_cork_flush(other);
+  }
+
+  luaio_tcp_pipe_t *pipe = luaio_palloc(sizeof(luaio_tcp_pipe_t));
+  if (pipe == NULL) {
     lua_pushinteger(L, 0);
+    lua_pushinteger(L, UV_ENOMEM);
     return 2;
   }
 
-  uint64_t timeout = socket->timeout;
-  uv_timer_t *timer = NULL;
-  if (timeout != 0) {
-    timer = luaio_timer_alloc();
-    if (timer == NULL) {
-      if (tmp != NULL) {
-        luaio_stack_buffer_free(&stack_buf);
-      }
-
-      lua_pushinteger(L, written);
+  pipe->src = socket;
+  pipe->dst = other;
+  pipe->current_thread = L;
+  pipe->timeout = timeout;
+  pipe->limit = limit;
+  pipe->bytes = 0;
+  pipe->buf = NULL;
+  pipe->capacity = LUAIO_TCP_PIPE_SIZE;
+  pipe->writing = 0;
+  pipe->draining = 0;
+  pipe->finished = 0;
+  pipe->status = 0;
+  luaio_timer_event_init(&pipe->timer, luaio_tcp_pipe_timeout, pipe);
+
+  int err = 0;
+#if LUAIO_HAVE_SPLICE
+  pipe->splice = 0;
+  if (luaio_tcp_pipe_splice_start(pipe) != 0)
+#endif
+  {
+    pipe->buf = luaio_palloc(LUAIO_TCP_PIPE_SIZE);
+    if (pipe->buf == NULL) {
+      luaio_pfree(pipe);
+      lua_pushinteger(L, 0);
       lua_pushinteger(L, UV_ENOMEM);
       return 2;
     }
 
-    uv_timer_start(timer, 
-                   luaio_tcp_socket_write_async_timeout, 
-                   timeout, 
-                   0);
+    socket->pipe = pipe;
+    err = uv_read_start((uv_stream_t*)&socket->handle, 
+                        luaio_tcp_pipe_onalloc, 
+                        luaio_tcp_pipe_onread);
+    if (err) {
+      socket->pipe = NULL;
+      luaio_pfree(pipe->buf);
+      luaio_pfree(pipe);
+      lua_pushinteger(L, 0);
+      lua_pushinteger(L, err);
+      return 2;
+    }
   }
 
-  luaio_tcp_write_req_t *luaio_req = luaio_palloc(sizeof(luaio_tcp_write_req_t));
-  if (luaio_req == NULL) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
-    }
+  socket->pipe = pipe;
+  other->pipe_into = pipe;
+  socket->current_thread = L;
+  luaio_tcp_pipe_touch(pipe);
+
+  return lua_yield(L, 0);
+}
 
-    if (timer != NULL) {
-      uv_timer_stop(timer);
-      luaio_timer_free(timer);
+#if LUAIO_HAVE_SENDFILE
+
+/* socket:sendfile() copies the file to the socket in the kernel on the loop
+ * thread, at most LUAIO_TCP_SENDFILE_CHUNK bytes per loop iteration. when the
+ * socket buffer is full a dup of the socket is polled for writable, a slow
+ * client holds neither memory nor a thread of the pool.
+ * the price is that pages which are not cached are read from the disk on the
+ * loop thread, it is meant for hot files(the static cache), fs.sendfile runs
+ * in the thread pool for cold ones.
+ */
+struct luaio_tcp_sendfile_s {
+  luaio_tcp_socket_t  *socket;
+  lua_State           *current_thread;
+  luaio_timer_event_t timer;
+  uint64_t            timeout;
+  int                 in_fd;
+  int                 out_fd;  /*dup of the socket, polled beside the uv_tcp_t*/
+  int64_t             offset;
+  uint64_t            rest;
+  uint64_t            bytes;
+  uv_poll_t           poll;
+};
+
+/*returns 1 when all is sent or the file ended, 0 when the socket is full, or an error*/
+static int luaio_tcp_sendfile_send(luaio_tcp_sendfile_t *sf, int out_fd) {
+  size_t budget = LUAIO_TCP_SENDFILE_CHUNK;
+
+  while (sf->rest > 0 && budget > 0) {
+    size_t size = sf->rest < budget ? sf->rest : budget;
+    off_t offset = sf->offset;
+    ssize_t n = sendfile(out_fd, sf->in_fd, &offset, size);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EAGAIN) return 0;
+      return -errno;
     }
 
-    lua_pushinteger(L, written);
-    lua_pushinteger(L, UV_ENOMEM);
-    return 2;
+    /*the file is shorter than offset + length*/
+    if (n == 0) return 1;
+
+    sf->offset += n;
+    sf->rest -= n;
+    sf->bytes += n;
+    budget -= n;
   }
 
-  err = uv_write2(&luaio_req->req, 
-                  stream_handle, 
-                  bufs, 
-                  vcount, 
-                  NULL, 
-                  luaio_tcp_socket_after_write_async);
-  if (err) {
-    if (tmp != NULL) {
-      luaio_stack_buffer_free(&stack_buf);
-    }
+  return sf->rest == 0;
+}
 
-    if (timer != NULL) {
-      uv_timer_stop(timer);
-      luaio_timer_free(timer);
-    }
+static void luaio_tcp_sendfile_onclose(uv_handle_t *handle) {
+  luaio_tcp_sendfile_t *sf = handle->data;
+  close(sf->out_fd);
+  luaio_pfree(sf);
+}
 
-    luaio_pfree(luaio_req);
-    lua_pushinteger(L, written);
-    lua_pushinteger(L, err);
+static void luaio_tcp_sendfile_done(luaio_tcp_sendfile_t *sf, int status) {
+  lua_State *L = sf->current_thread;
+  uint64_t bytes = sf->bytes;
+
+  luaio_timer_event_stop(&sf->timer);
+  sf->socket->sendfile = NULL;
+  uv_poll_stop(&sf->poll);
+  uv_close((uv_handle_t*)&sf->poll, luaio_tcp_sendfile_onclose);
+
+  lua_pushinteger(L, bytes);
+  lua_pushinteger(L, status);
+  luaio_resume(L, 2);
+}
+
+static void luaio_tcp_sendfile_timeout(luaio_timer_event_t *event) {
+  luaio_tcp_sendfile_done(event->data, UV_ETIMEDOUT);
+}
+
+static void luaio_tcp_sendfile_onwritable(uv_poll_t *handle, int status, int events) {
+  luaio_tcp_sendfile_t *sf = handle->data;
+  if (status < 0) {
+    luaio_tcp_sendfile_done(sf, status);
+    return;
+  }
+
+  uint64_t bytes = sf->bytes;
+  int ret = luaio_tcp_sendfile_send(sf, sf->out_fd);
+  if (ret != 0) {
+    luaio_tcp_sendfile_done(sf, ret < 0 ? ret : 0);
+    return;
+  }
+
+  if (sf->timeout && sf->bytes != bytes) {
+    luaio_timer_event_start(&sf->timer, sf->timeout, 0);
+  }
+}
+
+#endif
+
+/* @example: local bytes, err = socket:sendfile(fd, offset, length[, timeout])
+ * @param: fd {integer} file opened for reading
+ * @param: offset {integer}
+ * @param: length {integer}
+ * @param: timeout {integer|default: socket timeout} milliseconds without progress, 0 means none
+ * @return: bytes {integer} bytes sent, less than length if the file is shorter
+ * @return: err {integer}
+ *
+ * it returns without yielding when the socket takes the whole range at once.
+ */
+static int luaio_tcp_socket_sendfile(lua_State *L) {
+  luaio_tcp_check_socket(L, sendfile(fd, offset, length, timeout));
+
+  lua_Integer fd = luaL_checkinteger(L, 2);
+  lua_Integer offset = luaL_checkinteger(L, 3);
+  lua_Integer length = luaL_checkinteger(L, 4);
+  lua_Integer timeout = luaL_optinteger(L, 5, socket->timeout);
+  if (fd < 0 || offset < 0 || length < 0 || timeout < 0) {
+    return luaL_argerror(L, 2, "socket:sendfile(fd, offset, length, timeout) error: fd, offset, length and timeout must be >= 0\n");
+  }
+
+#if LUAIO_HAVE_SENDFILE
+  if (socket->cork.npiece > 0) {
+    luaio_tcp_cork_flush(socket);
+  }
+
+  /*bytes queued by uv_write must go out first*/
+  if (socket->handle.write_queue_size != 0) {
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, UV_EBUSY);
     return 2;
   }
 
-  lua_pushvalue(L, 2);
-  luaio_req->write_data_ref = luaL_ref(L, LUA_REGISTRYINDEX);
-  luaio_req->current_thread = NULL;
-  luaio_req->timer = timer;
+  luaio_tcp_sendfile_t *sf = luaio_palloc(sizeof(luaio_tcp_sendfile_t));
+  if (sf == NULL) {
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, UV_ENOMEM);
+    return 2;
+  }
+
+  sf->in_fd = fd;
+  sf->offset = offset;
+  sf->rest = length;
+  sf->bytes = 0;
+  sf->timeout = timeout;
+
+  int ret = luaio_tcp_sendfile_send(sf, uv__stream_fd(&socket->handle));
+  if (ret != 0) {
+    lua_pushinteger(L, sf->bytes);
+    lua_pushinteger(L, ret < 0 ? ret : 0);
+    luaio_pfree(sf);
+    return 2;
+  }
 
-  if (timer != NULL) {
-    timer->data = luaio_req;
+  int err = 0;
+  sf->out_fd = dup(uv__stream_fd(&socket->handle));
+  if (sf->out_fd < 0) {
+    err = -errno;
+  } else {
+    err = uv_poll_init(luaio_get_loop(), &sf->poll, sf->out_fd);
+    if (err) close(sf->out_fd);
   }
 
-  if (tmp != NULL) {
-    luaio_stack_buffer_free(&stack_buf);
+  if (err) {
+    lua_pushinteger(L, sf->bytes);
+    lua_pushinteger(L, err);
+    luaio_pfree(sf);
+    return 2;
   }
 
-  lua_pushinteger(L, bytes);
+  sf->socket = socket;
+  sf->current_thread = L;
+  sf->poll.data = sf;
+  socket->sendfile = sf;
+  luaio_timer_event_init(&sf->timer, luaio_tcp_sendfile_timeout, sf);
+  if (timeout) {
+    luaio_timer_event_start(&sf->timer, timeout, 0);
+  }
+  uv_poll_start(&sf->poll, UV_WRITABLE, luaio_tcp_sendfile_onwritable);
+
+  return lua_yield(L, 0);
+#else
   lua_pushinteger(L, 0);
+  lua_pushinteger(L, UV_ENOSYS);
   return 2;
+#endif
 }
 
-
 /*local addr, err = socket:local_address()*/
 static int luaio_tcp_socket_local_address(lua_State *L) {
   luaio_tcp_check_socket(L, localAddress());
@@ -778,15 +2371,19 @@ static int luaio_tcp_socket_remote_address(lua_State *L) {
   return 2;
 }
 
-/*socket:set_timeout(timeout)*/
+/* socket:set_timeout(timeout, precise)
+ * timeouts run on the timer wheel(rounded up to LUAIO_TIMER_WHEEL_TICK) by default,
+ * precise timeouts use a uv_timer_t per operation.
+ */
 static int luaio_tcp_socket_set_timeout(lua_State *L) {
-  luaio_tcp_check_socket(L, setTimeout(timeout));
+  luaio_tcp_check_socket(L, setTimeout(timeout, precise));
 
   lua_Integer timeout = luaL_checkinteger(L, 2);
   if (timeout < 0) {
-    return luaL_argerror(L, 1, "socket:setTimeout(timeout) error: timeout must be >= 0\n");
+    return luaL_argerror(L, 1, "socket:setTimeout(timeout, precise) error: timeout must be >= 0\n");
   }
   socket->timeout = timeout;
+  socket->timer_precise = lua_toboolean(L, 3);
 
   return 0;
 }
@@ -828,6 +2425,10 @@ static void luaio_tcp_socket_after_shutdown(uv_shutdown_t *req, int status) {
 static int luaio_tcp_socket_shutdown(lua_State *L) {
   luaio_tcp_check_socket(L, shutdown());
 
+  if (socket->cork.npiece > 0) {
+    luaio_tcp_cork_flush(socket);
+  }
+
   uv_shutdown_t *req = luaio_palloc(sizeof(uv_shutdown_t));
   if (req == NULL) {
     lua_pushinteger(L, UV_ENOMEM);
@@ -847,15 +2448,41 @@ static int luaio_tcp_socket_shutdown(lua_State *L) {
   return lua_yield(L, 0);
 }
 
-static void luaio_tcp_socket_onclose(uv_handle_t *handle) {
-  luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
-  lua_State *L = socket->current_thread;
+/* cancel what is pending on a closed socket and drop its refs. the coroutines
+ * waiting on a pipe from or into it, on its sendfile and on its stalled writes
+ * are resumed with UV_ECANCELED from here, the coroutine which called close()
+ * is resumed by luaio_tcp_socket_onclose() afterwards.
+ */
+static void luaio_tcp_socket_release(luaio_tcp_socket_t *socket) {
+  lua_State *L = luaio_get_main_thread();
+
+  /*stop read timer*/
+  luaio_timer_event_stop(&socket->timer);
+  luaio_tcp_cork_release(&socket->cork);
+
+  /*a pipe from or into the socket ends, its polls and dup fds are closed*/
+  if (socket->pipe != NULL) {
+    luaio_tcp_pipe_done(socket->pipe, UV_ECANCELED);
+  }
 
-  /*free read timer*/
-  uv_timer_t *timer = socket->timer;
-  if (timer != NULL) {
-    uv_timer_stop(timer);
-    luaio_timer_free(timer);
+  if (socket->pipe_into != NULL) {
+    luaio_tcp_pipe_done(socket->pipe_into, UV_ECANCELED);
+  }
+
+#if LUAIO_HAVE_SENDFILE
+  if (socket->sendfile != NULL) {
+    luaio_tcp_sendfile_done(socket->sendfile, UV_ECANCELED);
+  }
+#endif
+
+  luaio_tcp_socket_unstall_all(socket, UV_ECANCELED);
+
+  if (socket->server) {
+    luaio_tcp_server_release(socket);
+  }
+
+  if (socket->listener) {
+    luaio_tcp_server_destroy(socket);
   }
 
   int onconnect_ref = socket->onconnect_ref;
@@ -870,19 +2497,58 @@ static void luaio_tcp_socket_onclose(uv_handle_t *handle) {
     socket->thread = NULL;
     socket->thread_ref = LUA_NOREF;
   }
+}
 
-  luaio_resume(L, 0);
+static void luaio_tcp_socket_onclose(uv_handle_t *handle) {
+  luaio_tcp_socket_t *socket = container_of(handle, luaio_tcp_socket_t, handle);
+  lua_State *L = socket->current_thread;
+
+  luaio_tcp_socket_release(socket);
+
+  /*the socket lives on the stack of its coroutine, keep what is needed*/
+  lua_State *co = socket->thread;
+  int coroutine_ref = socket->coroutine_ref;
+  socket->coroutine_ref = LUA_NOREF;
+
+  int ret = luaio_resume(L, 0);
+
+  /*the connection coroutine has returned, reuse it for a new connection*/
+  if (coroutine_ref != LUA_NOREF) {
+    luaio_coroutine_free(co, coroutine_ref, co == L && ret == LUA_OK);
+  }
 }
 
 /*socket:close()*/
 static int luaio_tcp_socket_close(lua_State *L) {
   luaio_tcp_check_socket(L, close());
 
+  /*closed while parked, released by its close callback but the pooled coroutine*/
+  if (socket->parked < 0) {
+    int coroutine_ref = socket->coroutine_ref;
+    if (coroutine_ref != LUA_NOREF) {
+      socket->coroutine_ref = LUA_NOREF;
+      luaio_coroutine_free(socket->thread, coroutine_ref, 0);
+    }
+
+    return 0;
+  }
+
+  if (socket->parked == 1) {
+    uv_read_stop((uv_stream_t*)(&socket->handle));
+    luaio_timer_event_stop(&socket->park_timer);
+    socket->parked = 0;
+    luaio_tcp_socket_unref_park(socket);
+  }
+
   uv_handle_t *handle = (uv_handle_t*)(&socket->handle);
   if (uv_is_closing(handle)) {
     luaL_error(L, "socket:close() error: socket is already closing");
   }
 
+  /*what the kernel takes at once is sent, the rest is cancelled by uv_close*/
+  luaio_tcp_cork_flush(socket);
+  luaio_tcp_cork_release(&socket->cork);
+
   uv_close(handle, luaio_tcp_socket_onclose);
 
   socket->current_thread = L;
@@ -910,6 +2576,7 @@ int luaopen_tcp(lua_State *L) {
   luaL_Reg tcp_socket_mtlib[] = {
     { "bind", luaio_tcp_socket_bind },
     { "listen", luaio_tcp_socket_listen },
+    { "accept_stats", luaio_tcp_socket_accept_stats },
     { "connect", luaio_tcp_socket_connect },
     { "fd", luaio_tcp_socket_fd },
     { "set_read_buffer", luaio_tcp_socket_set_read_buffer },
@@ -918,6 +2585,18 @@ int luaopen_tcp(lua_State *L) {
     { "write", luaio_tcp_socket_write },
     /*not yeild from current thread, ignore success, error, timeout message*/
     { "write_async", luaio_tcp_socket_write_async },
+    { "cork", luaio_tcp_socket_cork },
+    { "flush", luaio_tcp_socket_flush },
+    { "cork_stats", luaio_tcp_socket_cork_stats },
+    { "set_write_watermarks", luaio_tcp_socket_set_write_watermarks },
+    { "write_stats", luaio_tcp_socket_write_stats },
+    /*yield until EOF, error, limit or timeout, no lua in the data path*/
+    { "pipe", luaio_tcp_socket_pipe },
+    /*file to socket in the kernel, yield only while the socket is full*/
+    { "sendfile", luaio_tcp_socket_sendfile },
+    /*idle in a connection pool, EOF, stray data and the idle timeout close it in C*/
+    { "park", luaio_tcp_socket_park },
+    { "unpark", luaio_tcp_socket_unpark },
     { "local_address", luaio_tcp_socket_local_address },
     { "remote_address", luaio_tcp_socket_remote_address },
     { "set_timeout", luaio_tcp_socket_set_timeout },
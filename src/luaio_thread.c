@@ -0,0 +1,164 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: loop threads, every thread runs its own lua state on its own
+ *            loop, nothing is shared between them but the process.
+ */
+
+#include "luaio.h"
+#include "luaio_init.h"
+
+typedef struct {
+  luaio_list_t  list;
+  uv_thread_t   tid;
+  int           id;
+  uv_loop_t     loop;
+  int           argc;
+  char          *argv[3];
+} luaio_thread_t;
+
+static uv_once_t luaio_thread_once = UV_ONCE_INIT;
+static uv_mutex_t luaio_thread_mutex;
+static luaio_list_t luaio_thread_list;
+static int luaio_thread_ids;
+
+static void luaio_thread_once_init() {
+  int ret = uv_mutex_init(&luaio_thread_mutex);
+  assert(ret == 0);
+  luaio_list_init(&luaio_thread_list);
+}
+
+static char *luaio_thread_strdup(const char *str) {
+  size_t n = strlen(str) + 1;
+  char *dup = luaio_malloc(n);
+  if (dup) luaio_memcpy(dup, str, n);
+  return dup;
+}
+
+static void luaio_thread_free(luaio_thread_t *thread) {
+  for (int i = 0; i < thread->argc; i++) {
+    luaio_free(thread->argv[i]);
+  }
+
+  luaio_free(thread);
+}
+
+static void luaio_thread_entry(void *arg) {
+  luaio_thread_t *thread = arg;
+  uv_loop_t *loop = &thread->loop;
+
+  if (uv_loop_init(loop)) {
+    fprintf(stderr,
+            LUAIO_COLOR_ERROR
+            "thread[%d] uv_loop_init() failed\n"
+            LUAIO_COLOR_RESET,
+            thread->id);
+    return;
+  }
+
+  luaio_run(loop, thread->id, thread->argc, thread->argv);
+  uv_loop_close(loop);
+}
+
+/* @brief: start a new loop thread which runs file
+ * @example: local id = thread_native.spawn(execpath, file[, package])
+ * @param: execpath {string} the lib directory is found by it
+ * @param: file {string}
+ * @param: package {string}
+ * @return: id {integer} if id < 0 => error
+ */
+static int luaio_thread_spawn(lua_State *L) {
+  const char *execpath = luaL_checkstring(L, 1);
+  const char *file = luaL_checkstring(L, 2);
+  const char *package = luaL_optstring(L, 3, NULL);
+
+  uv_once(&luaio_thread_once, luaio_thread_once_init);
+
+  luaio_thread_t *thread = luaio_malloc(sizeof(luaio_thread_t));
+  if (thread == NULL) {
+    lua_pushinteger(L, UV_ENOMEM);
+    return 1;
+  }
+
+  thread->argc = 0;
+  thread->argv[thread->argc++] = luaio_thread_strdup(execpath);
+  thread->argv[thread->argc++] = luaio_thread_strdup(file);
+  if (package) {
+    thread->argv[thread->argc++] = luaio_thread_strdup(package);
+  }
+
+  for (int i = 0; i < thread->argc; i++) {
+    if (thread->argv[i] == NULL) {
+      luaio_thread_free(thread);
+      lua_pushinteger(L, UV_ENOMEM);
+      return 1;
+    }
+  }
+
+  uv_mutex_lock(&luaio_thread_mutex);
+
+  thread->id = ++luaio_thread_ids;
+  int ret = uv_thread_create(&thread->tid, luaio_thread_entry, thread);
+  if (ret < 0) {
+    uv_mutex_unlock(&luaio_thread_mutex);
+    luaio_thread_free(thread);
+    lua_pushinteger(L, ret);
+    return 1;
+  }
+
+  luaio_list_insert_tail(&thread->list, &luaio_thread_list);
+  uv_mutex_unlock(&luaio_thread_mutex);
+
+  lua_pushinteger(L, thread->id);
+  return 1;
+}
+
+/* @brief: return the id of the current loop thread, 0 for the main thread
+ * @example: local id = thread_native.id()
+ * @return: id {integer}
+ */
+static int luaio_thread_id(lua_State *L) {
+  lua_pushinteger(L, luaio_get_thread_id());
+  return 1;
+}
+
+/*the main loop has ended, wait for the loop threads(and the threads spawned by them)*/
+void luaio_thread_join_all() {
+  uv_once(&luaio_thread_once, luaio_thread_once_init);
+
+  for (;;) {
+    uv_mutex_lock(&luaio_thread_mutex);
+    if (luaio_list_is_empty(&luaio_thread_list)) {
+      uv_mutex_unlock(&luaio_thread_mutex);
+      return;
+    }
+
+    luaio_list_t *list = luaio_thread_list.next;
+    luaio_list_remove(list);
+    uv_mutex_unlock(&luaio_thread_mutex);
+
+    luaio_thread_t *thread = luaio_list_entry(list, luaio_thread_t, list);
+    uv_thread_join(&thread->tid);
+    luaio_thread_free(thread);
+  }
+}
+
+int luaopen_thread(lua_State *L) {
+  luaL_Reg lib[] = {
+    { "spawn", luaio_thread_spawn },
+    { "id", luaio_thread_id },
+    { "__newindex", luaio_cannot_change },
+    { NULL, NULL }
+  };
+
+  lua_createtable(L, 0, 0);
+
+  luaL_newlib(L, lib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushliteral(L, "metatable is protected");
+  lua_setfield(L, -2, "__metatable");
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
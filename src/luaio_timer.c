@@ -5,13 +5,44 @@
  */
 
 #include "luaio_timer.h"
+#include "luaio_init.h"
 
-static luaio_timer_pool_t luaio_timer_pool;
+static LUAIO_THREAD_LOCAL luaio_timer_pool_t luaio_timer_pool;
+static LUAIO_THREAD_LOCAL luaio_timer_wheel_t luaio_timer_wheel;
 
 void luaio_timer_init(size_t max_free_timers) {
   luaio_list_init(&(luaio_timer_pool.free_list));
   luaio_timer_pool.max_free_timers = max_free_timers;
   luaio_timer_pool.free_timers = 0;
+
+  luaio_timer_wheel_t *wheel = &luaio_timer_wheel;
+  for (int i = 0; i < LUAIO_TIMER_WHEEL_LEVELS; i++) {
+    for (int j = 0; j < LUAIO_TIMER_WHEEL_SLOTS; j++) {
+      luaio_list_init(&wheel->slots[i][j]);
+    }
+  }
+
+  wheel->current = 0;
+  wheel->events = 0;
+  uv_timer_init(luaio_get_loop(), &wheel->timer);
+}
+
+static void luaio_timer_onclose(uv_handle_t *handle);
+
+/*the loop has stopped, close the cached timers and the wheel*/
+void luaio_timer_destroy() {
+  luaio_list_t *free_list = &(luaio_timer_pool.free_list);
+
+  while (!luaio_list_is_empty(free_list)) {
+    luaio_list_t *list = free_list->next;
+    luaio_timer_t *luaio_timer = luaio_list_entry(list, luaio_timer_t, list);
+    luaio_list_remove(list);
+    uv_close((uv_handle_t*)&luaio_timer->timer, luaio_timer_onclose);
+  }
+
+  luaio_timer_pool.free_timers = 0;
+  luaio_timer_pool.max_free_timers = 0;
+  uv_close((uv_handle_t*)&luaio_timer_wheel.timer, NULL);
 }
 
 void luaio_timer_set_max_free_timers(size_t max_free_timers) {
@@ -34,7 +65,7 @@ uv_timer_t *luaio_timer_alloc() {
     if (luaio_timer == NULL) return NULL;
 
     timer = &luaio_timer->timer;
-    uv_timer_init(uv_default_loop(), timer);
+    uv_timer_init(luaio_get_loop(), timer);
   }
 
   return timer;
@@ -57,3 +88,150 @@ void luaio_timer_free(uv_timer_t *timer) {
     }
   }
 }
+
+static void luaio_timer_wheel_add(luaio_timer_wheel_t *wheel, luaio_timer_event_t *event) {
+  uint64_t expire = event->expire;
+  uint64_t current = wheel->current;
+  luaio_list_t *slot;
+
+  if (expire <= current) {
+    slot = &wheel->slots[0][current & LUAIO_TIMER_WHEEL_MASK];
+  } else {
+    uint64_t delta = expire - current;
+    int level = 0;
+    while (level < LUAIO_TIMER_WHEEL_LEVELS - 1 
+           && delta >= ((uint64_t)1 << (LUAIO_TIMER_WHEEL_BITS * (level + 1)))) {
+      level++;
+    }
+
+    /*beyond the last level, it is cascaded early and added again*/
+    size_t index = (expire >> (LUAIO_TIMER_WHEEL_BITS * level)) & LUAIO_TIMER_WHEEL_MASK;
+    slot = &wheel->slots[level][index];
+  }
+
+  luaio_list_insert_tail(&event->list, slot);
+}
+
+/*move all events of the slot to the events list*/
+static void luaio_timer_wheel_take(luaio_list_t *events, luaio_list_t *slot) {
+  luaio_list_insert_tail(events, slot);
+  luaio_list_remove_init(slot);
+}
+
+static void luaio_timer_wheel_cascade(luaio_timer_wheel_t *wheel, int level, size_t index) {
+  luaio_list_t events;
+  luaio_timer_wheel_take(&events, &wheel->slots[level][index]);
+
+  while (!luaio_list_is_empty(&events)) {
+    luaio_list_t *list = events.next;
+    luaio_list_remove(list);
+    luaio_timer_wheel_add(wheel, luaio_list_entry(list, luaio_timer_event_t, list));
+  }
+}
+
+static void luaio_timer_wheel_ontick(uv_timer_t *handle) {
+  luaio_timer_wheel_t *wheel = container_of(handle, luaio_timer_wheel_t, timer);
+  uint64_t now = uv_now(handle->loop) / LUAIO_TIMER_WHEEL_TICK;
+
+  while (wheel->events > 0 && wheel->current <= now) {
+    uint64_t current = wheel->current;
+    size_t index = current & LUAIO_TIMER_WHEEL_MASK;
+
+    if (index == 0) {
+      for (int level = 1; level < LUAIO_TIMER_WHEEL_LEVELS; level++) {
+        size_t level_index = (current >> (LUAIO_TIMER_WHEEL_BITS * level)) & LUAIO_TIMER_WHEEL_MASK;
+        luaio_timer_wheel_cascade(wheel, level, level_index);
+        if (level_index != 0) break;
+      }
+    }
+
+    /*callbacks may start and stop other events, so take the whole slot first*/
+    luaio_list_t expired;
+    luaio_timer_wheel_take(&expired, &wheel->slots[0][index]);
+    wheel->current++;
+
+    while (!luaio_list_is_empty(&expired)) {
+      luaio_list_t *list = expired.next;
+      luaio_timer_event_t *event = luaio_list_entry(list, luaio_timer_event_t, list);
+      luaio_list_remove(list);
+      event->active = 0;
+      wheel->events--;
+      event->cb(event);
+    }
+  }
+
+  if (wheel->events == 0) {
+    uv_timer_stop(handle);
+  }
+}
+
+void luaio_timer_event_init(luaio_timer_event_t *event, luaio_timer_event_cb cb, void *data) {
+  event->timer = NULL;
+  event->cb = cb;
+  event->data = data;
+  event->active = 0;
+}
+
+static void luaio_timer_event_ontimeout(uv_timer_t *handle) {
+  luaio_timer_event_t *event = handle->data;
+
+  luaio_timer_free(handle);
+  event->timer = NULL;
+  event->active = 0;
+  event->cb(event);
+}
+
+/* @overview: arm the event, timeout in milliseconds, a started event is
+ *            re-armed. wheel events are O(1) and rounded up to
+ *            LUAIO_TIMER_WHEEL_TICK, precise events use a pooled uv_timer_t.
+ * @return: 0 or UV_ENOMEM
+ */
+int luaio_timer_event_start(luaio_timer_event_t *event, uint64_t timeout, int precise) {
+  luaio_timer_event_stop(event);
+
+  if (precise) {
+    uv_timer_t *timer = luaio_timer_alloc();
+    if (timer == NULL) return UV_ENOMEM;
+
+    timer->data = event;
+    uv_timer_start(timer, luaio_timer_event_ontimeout, timeout, 0);
+    event->timer = timer;
+    event->active = 1;
+    return 0;
+  }
+
+  luaio_timer_wheel_t *wheel = &luaio_timer_wheel;
+  uint64_t now = uv_now(luaio_get_loop());
+
+  if (wheel->events == 0) {
+    wheel->current = now / LUAIO_TIMER_WHEEL_TICK;
+    uv_timer_start(&wheel->timer, 
+                   luaio_timer_wheel_ontick, 
+                   LUAIO_TIMER_WHEEL_TICK, 
+                   LUAIO_TIMER_WHEEL_TICK);
+  }
+
+  event->expire = (now + timeout + LUAIO_TIMER_WHEEL_TICK - 1) / LUAIO_TIMER_WHEEL_TICK;
+  luaio_timer_wheel_add(wheel, event);
+  wheel->events++;
+  event->active = 1;
+  return 0;
+}
+
+void luaio_timer_event_stop(luaio_timer_event_t *event) {
+  if (!event->active) return;
+  event->active = 0;
+
+  uv_timer_t *timer = event->timer;
+  if (timer != NULL) {
+    uv_timer_stop(timer);
+    luaio_timer_free(timer);
+    event->timer = NULL;
+    return;
+  }
+
+  luaio_list_remove(&event->list);
+  if (--luaio_timer_wheel.events == 0) {
+    uv_timer_stop(&luaio_timer_wheel.timer);
+  }
+}
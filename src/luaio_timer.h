@@ -24,9 +24,43 @@ typedef struct {
   uv_timer_t    timer;
 } luaio_timer_t;
 
+/* hierarchical timer wheel, 4 levels of 64 slots, driven by one uv_timer_t.
+ * level 0 holds the events expiring in the next 64 ticks, level n holds
+ * the events expiring in the next 64^(n+1) ticks, they are cascaded down
+ * when the lower level wraps.
+ */
+#define LUAIO_TIMER_WHEEL_BITS    6
+#define LUAIO_TIMER_WHEEL_SLOTS   (1 << LUAIO_TIMER_WHEEL_BITS)
+#define LUAIO_TIMER_WHEEL_MASK    (LUAIO_TIMER_WHEEL_SLOTS - 1)
+#define LUAIO_TIMER_WHEEL_LEVELS  4
+
+typedef struct {
+  uv_timer_t    timer;
+  uint64_t      current;  /*next tick to run*/
+  size_t        events;
+  luaio_list_t  slots[LUAIO_TIMER_WHEEL_LEVELS][LUAIO_TIMER_WHEEL_SLOTS];
+} luaio_timer_wheel_t;
+
+typedef struct luaio_timer_event_s luaio_timer_event_t;
+typedef void (*luaio_timer_event_cb)(luaio_timer_event_t *event);
+
+struct luaio_timer_event_s {
+  luaio_list_t          list;
+  uint64_t              expire;  /*tick*/
+  uv_timer_t            *timer;  /*precise event*/
+  luaio_timer_event_cb  cb;
+  void                  *data;
+  int                   active;
+};
+
 void luaio_timer_init(size_t max_free_timers);
+void luaio_timer_destroy();
 void luaio_timer_set_max_free_timers(size_t max_free_timers);
 uv_timer_t *luaio_timer_alloc();
 void luaio_timer_free(uv_timer_t *timer);
 
+void luaio_timer_event_init(luaio_timer_event_t *event, luaio_timer_event_cb cb, void *data);
+int luaio_timer_event_start(luaio_timer_event_t *event, uint64_t timeout, int precise);
+void luaio_timer_event_stop(luaio_timer_event_t *event);
+
 #endif /* LUAIO_TIMER_H */
@@ -0,0 +1,862 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: udp sockets on uv_udp_t. received datagrams go into a ring of
+ *            batch slots, a batched socket drains the rest of a wakeup with
+ *            one recvmmsg(2) after the datagram libuv has read, and its sends
+ *            are queued and written with sendmmsg(2) when the loop iteration
+ *            ends(uv_check).
+ */
+
+#include "luaio.h"
+#include "luaio_init.h"
+#include "luaio_timer.h"
+#include "luaio_check_data.h"
+
+#if LUAIO_HAVE_MMSG
+#include <sys/socket.h>
+#endif
+
+/*a received datagram, its bytes are at ring + index * datagram_size*/
+typedef struct {
+  size_t                  len;
+  int                     flags;      /*UV_UDP_PARTIAL if it was truncated*/
+  struct sockaddr_storage addr;       /*AF_UNSPEC if the sender is unknown*/
+} luaio_udp_slot_t;
+
+/*a queued datagram, its bytes are at chunk + offset*/
+typedef struct {
+  size_t                  offset;
+  size_t                  len;
+  struct sockaddr_storage addr;
+} luaio_udp_datagram_t;
+
+typedef struct {
+  size_t                  type;
+  uint64_t                timeout;
+  int                     timer_precise;
+  luaio_timer_event_t     timer;
+  lua_State               *current_thread;  /*the thread closing the socket*/
+  lua_State               *recv_waiting;
+  int                     receiving;
+  int                     recv_status;  /*returned once the ring is empty*/
+  int                     send_status;  /*error of the last flush, returned by the next send*/
+  size_t                  batch;
+  size_t                  datagram_size;
+  char                    *ring;
+  luaio_udp_slot_t        *slots;
+  size_t                  head;
+  size_t                  count;
+  luaio_list_t            dirty;        /*in the dirty list while datagrams are queued*/
+  int                     socket_ref;   /*keeps a dirty socket alive until it is flushed*/
+  luaio_udp_datagram_t    *queue;
+  size_t                  nqueue;
+  size_t                  queue_capacity;
+  char                    *chunk;
+  size_t                  chunk_len;
+  size_t                  chunk_capacity;
+  uint64_t                received;
+  uint64_t                recv_calls;
+  uint64_t                truncated;
+  uint64_t                sent;
+  uint64_t                send_calls;
+  uint64_t                send_errors;
+  uv_udp_t                handle;
+} luaio_udp_socket_t;
+
+/*a datagram the kernel did not take at once, the bytes follow the request*/
+typedef struct {
+  luaio_udp_socket_t      *socket;
+  uv_buf_t                buf;
+  uv_udp_send_t           req;
+} luaio_udp_send_req_t;
+
+static char luaio_udp_socket_metatable_key;
+
+/* sockets of this loop with queued datagrams, flushed by luaio_udp_check after
+ * the poll phase and by luaio_udp_prepare before it, so datagrams queued by a
+ * coroutine which a timer resumed go out before the loop waits for I/O
+ */
+static LUAIO_THREAD_LOCAL luaio_list_t luaio_udp_dirty;
+static LUAIO_THREAD_LOCAL uv_check_t luaio_udp_check;
+static LUAIO_THREAD_LOCAL uv_prepare_t luaio_udp_prepare;
+static LUAIO_THREAD_LOCAL int luaio_udp_check_inited = 0;
+
+#define luaio_udp_check_socket(L, name) \
+  luaio_udp_socket_t *socket = lua_touserdata(L, 1); \
+  if (socket == NULL || socket->type != LUAIO_TYPE_UDP_SOCKET) { \
+    return luaL_argerror(L, 1, "socket:"#name" error: socket must be [userdata](udp_socket)\n"); \
+  }
+
+#define luaio_udp_check_port_and_host(L, index, name) \
+  int port = luaL_checkinteger(L, index); \
+  if (port < 0 || port > 65535) { \
+    return luaL_argerror(L, index, "socket:"#name" error: port must be [0, 65535]\n"); \
+  } \
+  \
+  struct sockaddr *addr; \
+  struct sockaddr_in addr4; \
+  struct sockaddr_in6 addr6; \
+  const char *host = luaL_checkstring(L, index + 1); \
+  if (uv_ip4_addr(host, port, &addr4) == 0) { \
+    addr = (struct sockaddr*)(&addr4); \
+  } else if (uv_ip6_addr(host, port, &addr6) == 0) { \
+    addr = (struct sockaddr*)(&addr6); \
+  } else { \
+    return luaL_argerror(L, index + 1, "socket:"#name" error: host is not a IP address\n"); \
+  }
+
+#define luaio_udp_slot_data(socket, index) ((socket)->ring + (index) * (socket)->datagram_size)
+
+static size_t luaio_udp_addr_len(const struct sockaddr *addr) {
+  return addr->sa_family == AF_INET6 ? sizeof(struct sockaddr_in6) : sizeof(struct sockaddr_in);
+}
+
+static void luaio_udp_socket_recv_timeout(luaio_timer_event_t *event);
+
+/* @example: local socket = udp_native.new([batch, datagram_size])
+ * @param: batch {integer|default: 1} datagrams received per wakeup and kept
+ *         unread at most, sends of a socket with batch > 1 are queued until
+ *         the loop iteration ends, [1, LUAIO_UDP_MAX_BATCH]
+ * @param: datagram_size {integer|default: LUAIO_UDP_DATAGRAM_SIZE} longer
+ *         datagrams are truncated, [1, 65536]
+ */
+static int luaio_udp_socket_new(lua_State *L) {
+  lua_Integer batch = luaL_optinteger(L, 1, 1);
+  if (batch < 1 || batch > LUAIO_UDP_MAX_BATCH) {
+    return luaL_argerror(L, 1, "udp.new([batch, datagram_size]) error: batch must be [1, 64]\n");
+  }
+
+  lua_Integer datagram_size = luaL_optinteger(L, 2, LUAIO_UDP_DATAGRAM_SIZE);
+  if (datagram_size < 1 || datagram_size > 65536) {
+    return luaL_argerror(L, 2, "udp.new([batch, datagram_size]) error: datagram_size must be [1, 65536]\n");
+  }
+
+  luaio_udp_socket_t *socket = lua_newuserdata(L, sizeof(luaio_udp_socket_t));
+  if (socket == NULL) {
+    lua_pushnil(L);
+    return 1;
+  }
+
+  uv_udp_init(luaio_get_loop(), &socket->handle);
+
+  socket->type = LUAIO_TYPE_UDP_SOCKET;
+  socket->timeout = 0;
+  socket->timer_precise = 0;
+  luaio_timer_event_init(&socket->timer, luaio_udp_socket_recv_timeout, socket);
+  socket->current_thread = L;
+  socket->recv_waiting = NULL;
+  socket->receiving = 0;
+  socket->recv_status = 0;
+  socket->send_status = 0;
+  socket->batch = batch;
+  socket->datagram_size = datagram_size;
+  socket->ring = NULL;
+  socket->slots = NULL;
+  socket->head = 0;
+  socket->count = 0;
+  luaio_list_init(&socket->dirty);
+  socket->socket_ref = LUA_NOREF;
+  socket->queue = NULL;
+  socket->nqueue = 0;
+  socket->queue_capacity = 0;
+  socket->chunk = NULL;
+  socket->chunk_len = 0;
+  socket->chunk_capacity = 0;
+  socket->received = 0;
+  socket->recv_calls = 0;
+  socket->truncated = 0;
+  socket->sent = 0;
+  socket->send_calls = 0;
+  socket->send_errors = 0;
+
+  lua_pushlightuserdata(L, &luaio_udp_socket_metatable_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+  return 1;
+}
+
+/*local err = socket:bind(port, host[, reuseaddr])*/
+static int luaio_udp_socket_bind(lua_State *L) {
+  luaio_udp_check_socket(L, bind(port, host, reuseaddr));
+  luaio_udp_check_port_and_host(L, 2, bind(port, host, reuseaddr));
+
+  unsigned int flags = lua_toboolean(L, 4) ? UV_UDP_REUSEADDR : 0;
+  int err = uv_udp_bind(&socket->handle, addr, flags);
+
+  lua_pushinteger(L, err);
+  return 1;
+}
+
+static void luaio_udp_socket_commit(luaio_udp_socket_t *socket,
+                                    size_t len,
+                                    const struct sockaddr *addr,
+                                    int flags) {
+  luaio_udp_slot_t *slot = &socket->slots[(socket->head + socket->count) % socket->batch];
+  slot->len = len;
+  slot->flags = flags;
+  if (addr != NULL) {
+    luaio_memcpy(&slot->addr, addr, luaio_udp_addr_len(addr));
+  } else {
+    slot->addr.ss_family = AF_UNSPEC;
+  }
+
+  socket->count++;
+  socket->received++;
+  if (flags & UV_UDP_PARTIAL) socket->truncated++;
+}
+
+#if LUAIO_HAVE_MMSG
+/*read what is left of this wakeup into the free slots with one recvmmsg*/
+static void luaio_udp_socket_drain(luaio_udp_socket_t *socket) {
+  size_t room = socket->batch - socket->count;
+  if (room == 0) return;
+
+  struct mmsghdr msgs[LUAIO_UDP_MAX_BATCH];
+  struct iovec iovs[LUAIO_UDP_MAX_BATCH];
+  size_t first = socket->head + socket->count;
+  for (size_t i = 0; i < room; i++) {
+    size_t index = (first + i) % socket->batch;
+    iovs[i].iov_base = luaio_udp_slot_data(socket, index);
+    iovs[i].iov_len = socket->datagram_size;
+    memset(&msgs[i].msg_hdr, 0, sizeof(struct msghdr));
+    msgs[i].msg_hdr.msg_name = &socket->slots[index].addr;
+    msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_storage);
+    msgs[i].msg_hdr.msg_iov = &iovs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+
+  int n;
+  do {
+    n = recvmmsg(socket->handle.io_watcher.fd, msgs, room, MSG_DONTWAIT, NULL);
+  } while (n == -1 && errno == EINTR);
+  socket->recv_calls++;
+
+  /*errors are left to the next recvmsg of libuv*/
+  for (int i = 0; i < n; i++) {
+    luaio_udp_slot_t *slot = &socket->slots[(first + i) % socket->batch];
+    slot->len = msgs[i].msg_len;
+    slot->flags = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) ? UV_UDP_PARTIAL : 0;
+    if (msgs[i].msg_hdr.msg_namelen == 0) slot->addr.ss_family = AF_UNSPEC;
+
+    socket->count++;
+    socket->received++;
+    if (slot->flags) socket->truncated++;
+  }
+}
+#endif
+
+/*push data, bytes, host, port of the oldest datagram, or nil, err once the ring is empty*/
+static int luaio_udp_socket_push_datagram(lua_State *L, luaio_udp_socket_t *socket) {
+  if (socket->count == 0) {
+    lua_pushnil(L);
+    lua_pushinteger(L, socket->recv_status);
+    socket->recv_status = 0;
+    return 2;
+  }
+
+  size_t head = socket->head;
+  luaio_udp_slot_t *slot = &socket->slots[head];
+  lua_pushlstring(L, luaio_udp_slot_data(socket, head), slot->len);
+  lua_pushinteger(L, slot->len);
+
+  char ip[INET6_ADDRSTRLEN];
+  int family = slot->addr.ss_family;
+  if (family == AF_INET) {
+    struct sockaddr_in *addr_in = (struct sockaddr_in*)&slot->addr;
+    uv_inet_ntop(AF_INET, &addr_in->sin_addr, ip, sizeof(ip));
+    lua_pushstring(L, ip);
+    lua_pushinteger(L, ntohs(addr_in->sin_port));
+  } else if (family == AF_INET6) {
+    struct sockaddr_in6 *addr_in6 = (struct sockaddr_in6*)&slot->addr;
+    uv_inet_ntop(AF_INET6, &addr_in6->sin6_addr, ip, sizeof(ip));
+    lua_pushstring(L, ip);
+    lua_pushinteger(L, ntohs(addr_in6->sin6_port));
+  } else {
+    lua_pushnil(L);
+    lua_pushnil(L);
+  }
+
+  socket->head = (head + 1) % socket->batch;
+  socket->count--;
+  return 4;
+}
+
+static void luaio_udp_socket_onalloc(uv_handle_t *handle,
+                                     size_t suggested_size,
+                                     uv_buf_t *buf) {
+  luaio_udp_socket_t *socket = container_of(handle, luaio_udp_socket_t, handle);
+  if (socket->count == socket->batch) {
+    buf->base = NULL;
+    buf->len = 0;
+    return;
+  }
+
+  buf->base = luaio_udp_slot_data(socket, (socket->head + socket->count) % socket->batch);
+  buf->len = socket->datagram_size;
+}
+
+static void luaio_udp_socket_stop(luaio_udp_socket_t *socket) {
+  uv_udp_recv_stop(&socket->handle);
+  socket->receiving = 0;
+}
+
+static void luaio_udp_socket_onrecv(uv_udp_t *handle,
+                                    ssize_t nread,
+                                    const uv_buf_t *buf,
+                                    const struct sockaddr *addr,
+                                    unsigned flags) {
+  luaio_udp_socket_t *socket = container_of(handle, luaio_udp_socket_t, handle);
+  /*the ring is full, onalloc gave no memory*/
+  if (nread == UV_ENOBUFS) {
+    luaio_udp_socket_stop(socket);
+    return;
+  }
+
+  socket->recv_calls++;
+
+  /*nothing more to read in this wakeup*/
+  if (nread == 0 && addr == NULL) return;
+
+  if (nread < 0) {
+    luaio_udp_socket_stop(socket);
+    socket->recv_status = nread;
+  } else {
+    luaio_udp_socket_commit(socket, nread, addr, flags);
+#if LUAIO_HAVE_MMSG
+    if (socket->batch > 1) luaio_udp_socket_drain(socket);
+#endif
+  }
+
+  lua_State *L = socket->recv_waiting;
+  if (L != NULL) {
+    socket->recv_waiting = NULL;
+    luaio_timer_event_stop(&socket->timer);
+    luaio_resume(L, luaio_udp_socket_push_datagram(L, socket));
+  }
+
+  /*the ring is full, the kernel keeps what comes next until socket:recv()*/
+  if (socket->receiving && socket->count == socket->batch
+      && !uv_is_closing((uv_handle_t*)handle)) {
+    luaio_udp_socket_stop(socket);
+  }
+}
+
+static void luaio_udp_socket_recv_timeout(luaio_timer_event_t *event) {
+  luaio_udp_socket_t *socket = event->data;
+  lua_State *L = socket->recv_waiting;
+  socket->recv_waiting = NULL;
+
+  lua_pushnil(L);
+  lua_pushinteger(L, UV_ETIMEDOUT);
+  luaio_resume(L, 2);
+}
+
+/* @example: local data, bytes, host, port = socket:recv()
+ * @return: data {string|nil}
+ * @return: bytes {integer} bytes of data, or the error when data is nil
+ * @return: host {string|nil} nil if the sender is unknown
+ * @return: port {integer|nil}
+ *
+ * the datagrams received while nobody waits stay in the ring, socket:recv()
+ * returns the oldest one without yielding.
+ */
+static int luaio_udp_socket_recv(lua_State *L) {
+  luaio_udp_check_socket(L, recv());
+
+  if (uv_is_closing((uv_handle_t*)&socket->handle)) {
+    lua_pushnil(L);
+    lua_pushinteger(L, UV_ECANCELED);
+    return 2;
+  }
+
+  if (socket->recv_waiting != NULL) {
+    return luaL_error(L, "socket:recv() error: another coroutine is receiving\n");
+  }
+
+  if (socket->ring == NULL) {
+    socket->ring = luaio_palloc(socket->batch * socket->datagram_size);
+    socket->slots = luaio_palloc(socket->batch * sizeof(luaio_udp_slot_t));
+    if (socket->ring == NULL || socket->slots == NULL) {
+      if (socket->ring != NULL) luaio_pfree(socket->ring);
+      if (socket->slots != NULL) luaio_pfree(socket->slots);
+      socket->ring = NULL;
+      socket->slots = NULL;
+      lua_pushnil(L);
+      lua_pushinteger(L, UV_ENOMEM);
+      return 2;
+    }
+  }
+
+  if (socket->count > 0 || socket->recv_status < 0) {
+    int n = luaio_udp_socket_push_datagram(L, socket);
+    if (!socket->receiving && socket->count < socket->batch && socket->recv_status == 0) {
+      uv_udp_recv_start(&socket->handle, luaio_udp_socket_onalloc, luaio_udp_socket_onrecv);
+      socket->receiving = 1;
+    }
+
+    return n;
+  }
+
+  if (!socket->receiving) {
+    int err = uv_udp_recv_start(&socket->handle, luaio_udp_socket_onalloc, luaio_udp_socket_onrecv);
+    if (err) {
+      lua_pushnil(L);
+      lua_pushinteger(L, err);
+      return 2;
+    }
+
+    socket->receiving = 1;
+  }
+
+  uint64_t timeout = socket->timeout;
+  if (timeout != 0) {
+    int err = luaio_timer_event_start(&socket->timer, timeout, socket->timer_precise);
+    if (err) {
+      lua_pushnil(L);
+      lua_pushinteger(L, err);
+      return 2;
+    }
+  }
+
+  socket->recv_waiting = L;
+  return lua_yield(L, 0);
+}
+
+static void luaio_udp_socket_after_send(uv_udp_send_t *req, int status) {
+  luaio_udp_send_req_t *send_req = container_of(req, luaio_udp_send_req_t, req);
+  luaio_udp_socket_t *socket = send_req->socket;
+  luaio_pfree(send_req);
+
+  socket->send_calls++;
+  if (status == 0) {
+    socket->sent++;
+  } else if (status != UV_ECANCELED) {
+    socket->send_errors++;
+    socket->send_status = status;
+  }
+}
+
+/*send one datagram now, it is copied and left to libuv if the kernel does not take it*/
+static int luaio_udp_socket_send_now(luaio_udp_socket_t *socket,
+                                     uv_buf_t *bufs,
+                                     size_t count,
+                                     size_t bytes,
+                                     const struct sockaddr *addr) {
+  uv_udp_t *handle = &socket->handle;
+  if (handle->send_queue_count == 0) {
+    int ret = uv_udp_try_send(handle, bufs, count, addr);
+    socket->send_calls++;
+    if (ret >= 0) {
+      socket->sent++;
+      return 0;
+    }
+
+    if (ret != UV_EAGAIN) {
+      socket->send_errors++;
+      return ret;
+    }
+  }
+
+  luaio_udp_send_req_t *send_req = luaio_palloc(sizeof(luaio_udp_send_req_t) + bytes);
+  if (send_req == NULL) return UV_ENOMEM;
+
+  char *base = (char*)(send_req + 1);
+  size_t offset = 0;
+  for (size_t i = 0; i < count; i++) {
+    luaio_memcpy(base + offset, bufs[i].base, bufs[i].len);
+    offset += bufs[i].len;
+  }
+
+  send_req->socket = socket;
+  send_req->buf.base = base;
+  send_req->buf.len = bytes;
+  int err = uv_udp_send(&send_req->req, handle, &send_req->buf, 1, addr, luaio_udp_socket_after_send);
+  if (err) luaio_pfree(send_req);
+  return err;
+}
+
+/*the queue is empty, the socket leaves the dirty list*/
+static void luaio_udp_socket_clean(luaio_udp_socket_t *socket) {
+  socket->nqueue = 0;
+  socket->chunk_len = 0;
+
+  if (!luaio_list_is_empty(&socket->dirty)) {
+    luaio_list_remove_init(&socket->dirty);
+  }
+
+  if (socket->socket_ref != LUA_NOREF) {
+    luaL_unref(luaio_get_main_thread(), LUA_REGISTRYINDEX, socket->socket_ref);
+    socket->socket_ref = LUA_NOREF;
+  }
+}
+
+/* send the queued datagrams with sendmmsg, LUAIO_UDP_MAX_BATCH per call. a
+ * datagram refused by the kernel is counted and skipped, what does not fit
+ * in the socket buffer is left to libuv.
+ */
+static int luaio_udp_socket_flush(luaio_udp_socket_t *socket) {
+  size_t nqueue = socket->nqueue;
+  if (nqueue == 0) return 0;
+
+  int err = 0;
+  size_t i = 0;
+  if (uv_is_closing((uv_handle_t*)&socket->handle)) {
+    err = UV_ECANCELED;
+    i = nqueue;
+  }
+
+#if LUAIO_HAVE_MMSG
+  struct mmsghdr msgs[LUAIO_UDP_MAX_BATCH];
+  struct iovec iovs[LUAIO_UDP_MAX_BATCH];
+  while (i < nqueue && socket->handle.send_queue_count == 0) {
+    size_t n = nqueue - i;
+    if (n > LUAIO_UDP_MAX_BATCH) n = LUAIO_UDP_MAX_BATCH;
+
+    for (size_t k = 0; k < n; k++) {
+      luaio_udp_datagram_t *datagram = &socket->queue[i + k];
+      iovs[k].iov_base = socket->chunk + datagram->offset;
+      iovs[k].iov_len = datagram->len;
+      memset(&msgs[k].msg_hdr, 0, sizeof(struct msghdr));
+      msgs[k].msg_hdr.msg_name = &datagram->addr;
+      msgs[k].msg_hdr.msg_namelen = luaio_udp_addr_len((struct sockaddr*)&datagram->addr);
+      msgs[k].msg_hdr.msg_iov = &iovs[k];
+      msgs[k].msg_hdr.msg_iovlen = 1;
+    }
+
+    int ret;
+    do {
+      ret = sendmmsg(socket->handle.io_watcher.fd, msgs, n, 0);
+    } while (ret == -1 && errno == EINTR);
+    socket->send_calls++;
+
+    if (ret == -1) {
+      if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+
+      err = -errno;
+      socket->send_errors++;
+      i++;
+      continue;
+    }
+
+    socket->sent += ret;
+    i += ret;
+  }
+#endif
+
+  for (; i < nqueue; i++) {
+    luaio_udp_datagram_t *datagram = &socket->queue[i];
+    uv_buf_t buf = uv_buf_init(socket->chunk + datagram->offset, datagram->len);
+    int ret = luaio_udp_socket_send_now(socket, &buf, 1, datagram->len, (struct sockaddr*)&datagram->addr);
+    if (ret) err = ret;
+  }
+
+  if (err) socket->send_status = err;
+  luaio_udp_socket_clean(socket);
+  return err;
+}
+
+static void luaio_udp_flush_dirty() {
+  luaio_list_t *dirty = &luaio_udp_dirty;
+  while (!luaio_list_is_empty(dirty)) {
+    luaio_udp_socket_t *socket = luaio_list_first_entry(dirty, luaio_udp_socket_t, dirty);
+    luaio_udp_socket_flush(socket);
+  }
+
+  uv_check_stop(&luaio_udp_check);
+  uv_prepare_stop(&luaio_udp_prepare);
+}
+
+static void luaio_udp_oncheck(uv_check_t *check) {
+  luaio_udp_flush_dirty();
+}
+
+static void luaio_udp_onprepare(uv_prepare_t *prepare) {
+  luaio_udp_flush_dirty();
+}
+
+/*copy the datagram into chunk, the socket joins the dirty list with its first datagram*/
+static int luaio_udp_socket_queue(lua_State *L,
+                                  luaio_udp_socket_t *socket,
+                                  uv_buf_t *bufs,
+                                  size_t count,
+                                  size_t bytes,
+                                  const struct sockaddr *addr) {
+  /*sendmmsg needs the fd, a socket which is not bound yet is bound to any address*/
+  uv_os_fd_t fd;
+  if (uv_fileno((uv_handle_t*)&socket->handle, &fd) == UV_EBADF) {
+    struct sockaddr_storage any;
+    if (addr->sa_family == AF_INET6) {
+      uv_ip6_addr("::", 0, (struct sockaddr_in6*)&any);
+    } else {
+      uv_ip4_addr("0.0.0.0", 0, (struct sockaddr_in*)&any);
+    }
+
+    int err = uv_udp_bind(&socket->handle, (struct sockaddr*)&any, 0);
+    if (err) return err;
+  }
+
+  if (socket->nqueue == socket->queue_capacity) {
+    size_t capacity = socket->queue_capacity ? socket->queue_capacity << 1 : LUAIO_UDP_MAX_BATCH;
+    luaio_udp_datagram_t *queue = luaio_prealloc_used(socket->queue,
+                                                      sizeof(luaio_udp_datagram_t) * socket->nqueue,
+                                                      sizeof(luaio_udp_datagram_t) * capacity);
+    if (queue == NULL) return UV_ENOMEM;
+
+    socket->queue = queue;
+    socket->queue_capacity = capacity;
+  }
+
+  size_t chunk_len = socket->chunk_len;
+  if (chunk_len + bytes > socket->chunk_capacity) {
+    size_t capacity = socket->chunk_capacity ? socket->chunk_capacity : LUAIO_UDP_CHUNK_SIZE;
+    while (capacity < chunk_len + bytes) capacity <<= 1;
+
+    char *chunk = luaio_prealloc_used(socket->chunk, chunk_len, capacity);
+    if (chunk == NULL) return UV_ENOMEM;
+
+    socket->chunk = chunk;
+    socket->chunk_capacity = luaio_pmemory_get_capacity(chunk);
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    luaio_memcpy(socket->chunk + socket->chunk_len, bufs[i].base, bufs[i].len);
+    socket->chunk_len += bufs[i].len;
+  }
+
+  luaio_udp_datagram_t *datagram = &socket->queue[socket->nqueue++];
+  datagram->offset = chunk_len;
+  datagram->len = bytes;
+  luaio_memcpy(&datagram->addr, addr, luaio_udp_addr_len(addr));
+
+  if (luaio_list_is_empty(&socket->dirty)) {
+    if (!luaio_udp_check_inited) {
+      luaio_list_init(&luaio_udp_dirty);
+      uv_check_init(luaio_get_loop(), &luaio_udp_check);
+      uv_prepare_init(luaio_get_loop(), &luaio_udp_prepare);
+      luaio_udp_check_inited = 1;
+    }
+
+    if (luaio_list_is_empty(&luaio_udp_dirty)) {
+      uv_check_start(&luaio_udp_check, luaio_udp_oncheck);
+      uv_prepare_start(&luaio_udp_prepare, luaio_udp_onprepare);
+    }
+
+    luaio_list_insert_tail(&socket->dirty, &luaio_udp_dirty);
+    lua_pushvalue(L, 1);
+    socket->socket_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+  }
+
+  return 0;
+}
+
+/* @example: local bytes, err = socket:send(data, port, host)
+ * @param: data {string|buffer|slice|chain} one datagram
+ * @return: bytes {integer} 0 if err < 0
+ * @return: err {integer} an error of an earlier batch is returned first
+ *
+ * a socket with batch > 1 copies the datagram into its queue, the queue is
+ * sent with sendmmsg when the loop iteration ends or by socket:flush().
+ */
+static int luaio_udp_socket_send(lua_State *L) {
+  luaio_udp_check_socket(L, send(data, port, host));
+  luaio_udp_check_port_and_host(L, 3, send(data, port, host));
+
+  int err = socket->send_status;
+  if (err == 0 && uv_is_closing((uv_handle_t*)&socket->handle)) err = UV_ECANCELED;
+  if (err) {
+    socket->send_status = 0;
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, err);
+    return 2;
+  }
+
+  luaio_check_data(L, 2, socket:send(data, port, host));
+
+  /*an empty table is an empty datagram*/
+  if (count == 0) {
+    buf.base = NULL;
+    buf.len = 0;
+    count = 1;
+    bufs = &buf;
+  }
+
+  if (socket->batch > 1) {
+    err = luaio_udp_socket_queue(L, socket, bufs, count, bytes, addr);
+  } else {
+    err = luaio_udp_socket_send_now(socket, bufs, count, bytes, addr);
+  }
+
+  if (tmp != NULL) {
+    luaio_stack_buffer_free(&stack_buf);
+  }
+
+  lua_pushinteger(L, err ? 0 : bytes);
+  lua_pushinteger(L, err);
+  return 2;
+}
+
+/*local err = socket:flush() send the queued datagrams now*/
+static int luaio_udp_socket_flush_queue(lua_State *L) {
+  luaio_udp_check_socket(L, flush());
+
+  int err = luaio_udp_socket_flush(socket);
+  if (err == 0) err = socket->send_status;
+
+  socket->send_status = 0;
+  lua_pushinteger(L, err);
+  return 1;
+}
+
+/* socket:set_timeout(timeout, precise) the timeout of socket:recv()
+ * timeouts run on the timer wheel(rounded up to LUAIO_TIMER_WHEEL_TICK) by default,
+ * precise timeouts use a uv_timer_t.
+ */
+static int luaio_udp_socket_set_timeout(lua_State *L) {
+  luaio_udp_check_socket(L, setTimeout(timeout, precise));
+
+  lua_Integer timeout = luaL_checkinteger(L, 2);
+  if (timeout < 0) {
+    return luaL_argerror(L, 2, "socket:setTimeout(timeout, precise) error: timeout must be >= 0\n");
+  }
+
+  socket->timeout = timeout;
+  socket->timer_precise = lua_toboolean(L, 3);
+  return 0;
+}
+
+/*local addr, err = socket:local_address()*/
+static int luaio_udp_socket_local_address(lua_State *L) {
+  luaio_udp_check_socket(L, localAddress());
+
+  struct sockaddr_storage address;
+  int len = sizeof(address);
+  int ret = uv_udp_getsockname(&socket->handle, (struct sockaddr*)&address, &len);
+  if (ret == 0) {
+    ret = luaio_parse_socket_address(L, &address);
+  } else {
+    lua_pushnil(L);
+  }
+
+  lua_pushinteger(L, ret);
+  return 2;
+}
+
+/* @example: local stats = socket:stats()
+ * @return: stats {table} received, recv_calls(syscalls), truncated, unread,
+ *          sent, send_calls(syscalls), send_errors, queued, batch
+ */
+static int luaio_udp_socket_stats(lua_State *L) {
+  luaio_udp_check_socket(L, stats());
+
+  lua_createtable(L, 0, 9);
+  lua_pushinteger(L, socket->received);
+  lua_setfield(L, -2, "received");
+  lua_pushinteger(L, socket->recv_calls);
+  lua_setfield(L, -2, "recv_calls");
+  lua_pushinteger(L, socket->truncated);
+  lua_setfield(L, -2, "truncated");
+  lua_pushinteger(L, socket->count);
+  lua_setfield(L, -2, "unread");
+  lua_pushinteger(L, socket->sent);
+  lua_setfield(L, -2, "sent");
+  lua_pushinteger(L, socket->send_calls);
+  lua_setfield(L, -2, "send_calls");
+  lua_pushinteger(L, socket->send_errors);
+  lua_setfield(L, -2, "send_errors");
+  lua_pushinteger(L, socket->nqueue);
+  lua_setfield(L, -2, "queued");
+  lua_pushinteger(L, socket->batch);
+  lua_setfield(L, -2, "batch");
+  return 1;
+}
+
+static void luaio_udp_socket_onclose(uv_handle_t *handle) {
+  luaio_udp_socket_t *socket = container_of(handle, luaio_udp_socket_t, handle);
+  luaio_timer_event_stop(&socket->timer);
+  luaio_udp_socket_clean(socket);
+
+  if (socket->ring != NULL) {
+    luaio_pfree(socket->ring);
+    luaio_pfree(socket->slots);
+    socket->ring = NULL;
+    socket->slots = NULL;
+    socket->count = 0;
+  }
+
+  if (socket->queue != NULL) {
+    luaio_pfree(socket->queue);
+    socket->queue = NULL;
+    socket->queue_capacity = 0;
+  }
+
+  if (socket->chunk != NULL) {
+    luaio_pfree(socket->chunk);
+    socket->chunk = NULL;
+    socket->chunk_capacity = 0;
+  }
+
+  lua_State *waiting = socket->recv_waiting;
+  if (waiting != NULL) {
+    socket->recv_waiting = NULL;
+    lua_pushnil(waiting);
+    lua_pushinteger(waiting, UV_ECANCELED);
+    luaio_resume(waiting, 2);
+  }
+
+  luaio_resume(socket->current_thread, 0);
+}
+
+/*socket:close() the queued datagrams are sent first*/
+static int luaio_udp_socket_close(lua_State *L) {
+  luaio_udp_check_socket(L, close());
+
+  uv_handle_t *handle = (uv_handle_t*)(&socket->handle);
+  if (uv_is_closing(handle)) {
+    return luaL_error(L, "socket:close() error: socket is already closing\n");
+  }
+
+  luaio_udp_socket_flush(socket);
+  uv_close(handle, luaio_udp_socket_onclose);
+
+  socket->current_thread = L;
+  return lua_yield(L, 0);
+}
+
+int luaopen_udp(lua_State *L) {
+  luaL_Reg udp_socket_mtlib[] = {
+    { "bind", luaio_udp_socket_bind },
+    { "recv", luaio_udp_socket_recv },
+    { "send", luaio_udp_socket_send },
+    { "flush", luaio_udp_socket_flush_queue },
+    { "set_timeout", luaio_udp_socket_set_timeout },
+    { "local_address", luaio_udp_socket_local_address },
+    { "stats", luaio_udp_socket_stats },
+    { "close", luaio_udp_socket_close },
+    { NULL, NULL }
+  };
+
+  lua_pushlightuserdata(L, &luaio_udp_socket_metatable_key);
+  luaL_newlib(L, udp_socket_mtlib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_rawset(L, LUA_REGISTRYINDEX);
+
+  luaL_Reg lib[] = {
+    { "new", luaio_udp_socket_new },
+    { "__newindex", luaio_cannot_change },
+    { NULL, NULL }
+  };
+
+  lua_createtable(L, 0, 0);
+
+  luaL_newlib(L, lib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushliteral(L, "metatable is protected.");
+  lua_setfield(L, -2, "__metatable");
+
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
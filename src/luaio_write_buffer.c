@@ -41,6 +41,8 @@ static int luaio_write_buffer_new(lua_State *L) {
   buffer->type = LUAIO_TYPE_WRITE_BUFFER;
   buffer->size = size;
   buffer->capacity = capacity;
+  buffer->max_size = 0;
+  buffer->generation = 0;
   buffer->start = start;
   buffer->read_pos = start;
   buffer->write_pos = start;
@@ -315,6 +317,7 @@ int luaopen_write_buffer(lua_State *L) {
   luaL_Reg write_buffer_mtlib[] = {
     { "capacity", luaio_buffer_capacity },
     { "discard", luaio_buffer_discard },
+    { "tostring", luaio_buffer_tostring },
     { "write", luaio_buffer_write },
     { "write_uint8", luaio_buffer_write_uint8 },
     { "write_int8", luaio_buffer_write_int8 },
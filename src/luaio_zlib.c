@@ -0,0 +1,630 @@
+/* Copyright © 2015 coord.cn. All rights reserved.
+ * @author: QianYe(coordcn@163.com)
+ * @license: MIT license
+ * @overview: streaming deflate and inflate on the bundled zlib. a stream reads
+ *            the bytes between read_pos and write_pos of a buffer and appends its
+ *            output to a WriteBuffer, no lua string is made on the way. inputs
+ *            larger than the async threshold are compressed on the uv thread pool,
+ *            which works on copies: a buffer or slice input is copied and the
+ *            output goes to private memory appended to the WriteBuffer after the
+ *            work, the buffers may be used by other coroutines meanwhile. the
+ *            bytes of a buffer input are taken out of it before the call yields,
+ *            what zlib has not used of them is kept by the stream.
+ */
+
+#include "luaio.h"
+#include "luaio_init.h"
+#include "zlib.h"
+
+#define LUAIO_ZLIB_STREAM_END     1
+
+typedef struct {
+  size_t    type;
+  z_stream  strm;
+  int       deflate;
+  int       ended;            /*Z_STREAM_END has been returned*/
+  int       busy;             /*running on the thread pool*/
+  size_t    async_threshold;  /*0 means never*/
+  char      *pending;         /*output of the thread pool which did not fit, given out first*/
+  char      *pending_pos;
+  size_t    pending_len;
+  char      *input;           /*input taken by the thread pool which zlib has not used, used first*/
+  char      *input_pos;
+  size_t    input_len;
+} luaio_zlib_stream_t;
+
+typedef struct {
+  uv_work_t           req;
+  lua_State           *current_thread;
+  luaio_zlib_stream_t *stream;
+  luaio_buffer_t      *output;
+  char                *in_copy; /*NULL if the input is a string*/
+  char                *out_copy;
+  size_t              in_len;
+  size_t              out_len;
+  size_t              drained;  /*pending bytes given out before the work*/
+  int                 taken;    /*the input was taken out of a buffer or the stream*/
+  size_t              consumed; /*bytes of the caller's input taken, if taken*/
+  int                 waiting;  /*the caller's input waits for the next call*/
+  int                 flush;
+  int                 ret;
+  int                 stream_ref;
+  int                 input_ref;
+  int                 output_ref;
+} luaio_zlib_work_t;
+
+static char luaio_zlib_stream_metatable_key;
+
+#define luaio_zlib_check_stream(L, name) \
+  luaio_zlib_stream_t *stream = lua_touserdata(L, 1); \
+  if (stream == NULL || stream->type != LUAIO_TYPE_ZLIB_STREAM) { \
+    return luaL_argerror(L, 1, "zlib_stream:"#name" error: stream must be [userdata](zlib_stream)\n"); \
+  } \
+  if (stream->busy) { \
+    return luaL_error(L, "zlib_stream:"#name" error: stream is running on the thread pool\n"); \
+  }
+
+static int luaio_zlib_errno(int ret) {
+  switch (ret) {
+    case Z_OK:
+    case Z_BUF_ERROR:
+      return 0;
+
+    case Z_STREAM_END:
+      return LUAIO_ZLIB_STREAM_END;
+
+    case Z_MEM_ERROR:
+      return UV_ENOMEM;
+
+    case Z_DATA_ERROR:
+    case Z_NEED_DICT:
+      return LUAIO_EZLIB_DATA;
+
+    default:
+      return LUAIO_EZLIB_STREAM;
+  }
+}
+
+/*inflate() or deflate() once, it stops when the input is used up or the output is full*/
+static int luaio_zlib_process(luaio_zlib_stream_t *stream, int flush) {
+  z_stream *strm = &stream->strm;
+  int ret = stream->deflate ? deflate(strm, flush) : inflate(strm, flush);
+
+  int err = luaio_zlib_errno(ret);
+  if (err < 0) return err;
+
+  if (err == LUAIO_ZLIB_STREAM_END) {
+    stream->ended = 1;
+    return err;
+  }
+
+  /*output is full, the rest comes with the next call*/
+  if (strm->avail_out == 0) return LUAIO_EXCEED_BUFFER_CAPACITY;
+
+  return 0;
+}
+
+/*make room at the tail of the output buffer*/
+static void luaio_zlib_prepare_output(luaio_buffer_t *output) {
+  char *start = output->start;
+  char *read_pos = output->read_pos;
+  char *write_pos = output->write_pos;
+
+  if (read_pos == write_pos) {
+    output->read_pos = start;
+    output->write_pos = start;
+  } else if (write_pos == output->end && read_pos != start) {
+    size_t rest_size = write_pos - read_pos;
+    luaio_memmove(start, read_pos, rest_size);
+    output->generation++;
+    output->read_pos = start;
+    output->write_pos = start + rest_size;
+  }
+}
+
+/*move the buffer positions over the bytes the stream has used and produced*/
+static void luaio_zlib_commit(luaio_zlib_stream_t *stream,
+                              luaio_buffer_t *input,
+                              luaio_buffer_t *output,
+                              size_t *consumed,
+                              size_t *produced) {
+  z_stream *strm = &stream->strm;
+  *consumed -= strm->avail_in;
+  *produced -= strm->avail_out;
+
+  if (input != NULL) {
+    input->read_pos += *consumed;
+    if (input->read_pos == input->write_pos) {
+      input->read_pos = input->start;
+      input->write_pos = input->start;
+    }
+  }
+
+  output->write_pos += *produced;
+}
+
+/*give out the pending bytes as far as output has room, returns the bytes given*/
+static size_t luaio_zlib_drain_pending(luaio_zlib_stream_t *stream, luaio_buffer_t *output) {
+  size_t room = output->end - output->write_pos;
+  size_t n = stream->pending_len < room ? stream->pending_len : room;
+
+  luaio_memcpy(output->write_pos, stream->pending_pos, n);
+  output->write_pos += n;
+  stream->pending_pos += n;
+  stream->pending_len -= n;
+
+  if (stream->pending_len == 0) {
+    luaio_pfree(stream->pending);
+    stream->pending = NULL;
+    stream->pending_pos = NULL;
+  }
+
+  return n;
+}
+
+static void luaio_zlib_free_input(luaio_zlib_stream_t *stream) {
+  luaio_pfree(stream->input);
+  stream->input = NULL;
+  stream->input_pos = NULL;
+  stream->input_len = 0;
+}
+
+static void luaio_zlib_work(uv_work_t *req) {
+  luaio_zlib_work_t *work = container_of(req, luaio_zlib_work_t, req);
+  work->ret = luaio_zlib_process(work->stream, work->flush);
+}
+
+static void luaio_zlib_after_work(uv_work_t *req, int status) {
+  luaio_zlib_work_t *work = container_of(req, luaio_zlib_work_t, req);
+  lua_State *L = work->current_thread;
+  luaio_zlib_stream_t *stream = work->stream;
+  z_stream *strm = &stream->strm;
+  luaio_buffer_t *output = work->output;
+
+  stream->busy = 0;
+  size_t consumed = work->taken ? work->consumed : work->in_len - strm->avail_in;
+  size_t produced = work->out_len - strm->avail_out;
+  int ret = status < 0 ? status : work->ret;
+  if (ret == 0 && work->waiting) ret = LUAIO_EXCEED_BUFFER_CAPACITY;
+
+  /*the taken bytes zlib has not used go first next time, after the end they are dropped*/
+  if (work->taken && strm->avail_in > 0 && !stream->ended) {
+    stream->input = work->in_copy;
+    stream->input_pos = (char*)strm->next_in;
+    stream->input_len = strm->avail_in;
+  } else if (work->in_copy != NULL) {
+    luaio_pfree(work->in_copy);
+  }
+
+  /*another coroutine may have filled the output meanwhile, what does not fit is given out by the next write*/
+  luaio_zlib_prepare_output(output);
+  size_t room = output->end - output->write_pos;
+  size_t n = produced < room ? produced : room;
+  luaio_memcpy(output->write_pos, work->out_copy, n);
+  output->write_pos += n;
+
+  if (n < produced) {
+    stream->pending = work->out_copy;
+    stream->pending_pos = work->out_copy + n;
+    stream->pending_len = produced - n;
+    if (ret >= 0) ret = LUAIO_EXCEED_BUFFER_CAPACITY;
+  } else {
+    luaio_pfree(work->out_copy);
+  }
+
+  luaL_unref(L, LUA_REGISTRYINDEX, work->stream_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, work->input_ref);
+  luaL_unref(L, LUA_REGISTRYINDEX, work->output_ref);
+
+  lua_pushinteger(L, work->drained + n);
+  lua_pushinteger(L, consumed);
+  lua_pushinteger(L, ret);
+  luaio_pfree(work);
+
+  luaio_resume(L, 3);
+}
+
+/* @example: local produced, consumed, err = zlib_stream:write(input, output[, flush])
+ * @param: input {nil|string|buffer|slice} the bytes of a buffer are consumed from it, on the
+ *    thread pool all of them are taken and the bytes zlib has not used are kept by the stream,
+ *    they are used before the next input, which is then left alone
+ * @param: output {userdata(WriteBuffer)}
+ * @param: flush {integer} zlib.NO_FLUSH(default), zlib.SYNC_FLUSH, zlib.FULL_FLUSH or zlib.FINISH
+ * @return: produced {integer} bytes appended to output
+ * @return: consumed {integer} bytes used from input
+ * @return: err {integer} 0, zlib.STREAM_END, LUAIO_EXCEED_BUFFER_CAPACITY(output is full,
+ *    drain it and call again with the rest of the input and the same flush) or an error
+ */
+static int luaio_zlib_stream_write(lua_State *L) {
+  luaio_zlib_check_stream(L, write(input, output, flush));
+
+  char *in_base = NULL;
+  size_t in_len = 0;
+  luaio_buffer_t *input = NULL;
+  luaio_buffer_slice_t *slice = NULL;
+  int type = lua_type(L, 2);
+  if (type == LUA_TSTRING) {
+    in_base = (char*)lua_tolstring(L, 2, &in_len);
+  } else if (type == LUA_TUSERDATA) {
+    luaio_buffer_t *buffer = lua_touserdata(L, 2);
+    if (buffer->type == LUAIO_TYPE_BUFFER_SLICE) {
+      slice = (luaio_buffer_slice_t*)buffer;
+      in_base = slice->base;
+      in_len = slice->len;
+    } else if (luaio_is_buffer(buffer->type)) {
+      /*a buffer without memory has nothing to read*/
+      if (buffer->capacity > 0) {
+        input = buffer;
+        in_base = buffer->read_pos;
+        in_len = buffer->write_pos - in_base;
+      }
+    } else {
+      return luaL_argerror(L, 2, "zlib_stream:write(input, output, flush) error: input is userdata, but not buffer\n");
+    }
+  } else if (type != LUA_TNIL && type != LUA_TNONE) {
+    return luaL_argerror(L, 2, "zlib_stream:write(input, output, flush) error: input must be [nil|string|buffer|slice]\n");
+  }
+
+  luaio_buffer_t *output = lua_touserdata(L, 3);
+  if (output == NULL || output->type != LUAIO_TYPE_WRITE_BUFFER) {
+    return luaL_argerror(L, 3, "zlib_stream:write(input, output, flush) error: output must be [userdata](WriteBuffer)\n");
+  }
+
+  int flush = luaL_optinteger(L, 4, Z_NO_FLUSH);
+  if (flush != Z_NO_FLUSH && flush != Z_SYNC_FLUSH && flush != Z_FULL_FLUSH && flush != Z_FINISH) {
+    return luaL_argerror(L, 4, "zlib_stream:write(input, output, flush) error: flush must be zlib.NO_FLUSH, zlib.SYNC_FLUSH, zlib.FULL_FLUSH or zlib.FINISH\n");
+  }
+
+  /*compacting output makes its slices stale, the input may be one of them*/
+  luaio_zlib_prepare_output(output);
+  if (slice != NULL && luaio_buffer_slice_is_stale(slice)) {
+    return luaL_argerror(L, 2, "zlib_stream:write(input, output, flush) error: input is slice, but the buffer has been refilled\n");
+  }
+
+  /*the output of the thread pool which did not fit last time goes first*/
+  size_t drained = 0;
+  if (stream->pending != NULL) {
+    drained = luaio_zlib_drain_pending(stream, output);
+    if (stream->pending != NULL) {
+      lua_pushinteger(L, drained);
+      lua_pushinteger(L, 0);
+      lua_pushinteger(L, LUAIO_EXCEED_BUFFER_CAPACITY);
+      return 3;
+    }
+  }
+
+  if (stream->ended) {
+    lua_pushinteger(L, drained);
+    lua_pushinteger(L, 0);
+    lua_pushinteger(L, LUAIO_ZLIB_STREAM_END);
+    return 3;
+  }
+
+  /*the input kept from the thread pool goes before this one, which waits for the next call*/
+  int kept = stream->input != NULL;
+  size_t waiting = in_len;
+  if (kept) {
+    input = NULL;
+    in_base = stream->input_pos;
+    in_len = stream->input_len;
+  }
+
+  size_t out_len = output->end - output->write_pos;
+
+  z_stream *strm = &stream->strm;
+  strm->next_in = (Bytef*)in_base;
+  strm->avail_in = in_len;
+  strm->next_out = (Bytef*)output->write_pos;
+  strm->avail_out = out_len;
+
+  size_t threshold = stream->async_threshold;
+  if (threshold > 0 && in_len >= threshold && out_len > 0) {
+    luaio_zlib_work_t *work = luaio_palloc(sizeof(luaio_zlib_work_t));
+    char *in_copy = NULL;
+    char *out_copy = luaio_palloc(out_len);
+    if (type != LUA_TSTRING && !kept) {
+      in_copy = luaio_palloc(in_len);
+    }
+
+    if (work == NULL || out_copy == NULL || (type != LUA_TSTRING && !kept && in_copy == NULL)) {
+      if (work != NULL) luaio_pfree(work);
+      if (out_copy != NULL) luaio_pfree(out_copy);
+      if (in_copy != NULL) luaio_pfree(in_copy);
+      lua_pushinteger(L, drained);
+      lua_pushinteger(L, 0);
+      lua_pushinteger(L, UV_ENOMEM);
+      return 3;
+    }
+
+    /*strings do not move, buffers and slices may be refilled while the work runs*/
+    if (in_copy != NULL) {
+      luaio_memcpy(in_copy, in_base, in_len);
+      strm->next_in = (Bytef*)in_copy;
+    }
+    strm->next_out = (Bytef*)out_copy;
+
+    work->current_thread = L;
+    work->stream = stream;
+    work->output = output;
+    work->in_copy = in_copy;
+    work->out_copy = out_copy;
+    work->in_len = in_len;
+    work->out_len = out_len;
+    work->drained = drained;
+    work->taken = kept || input != NULL;
+    work->consumed = kept ? 0 : in_len;
+    work->waiting = kept && waiting > 0;
+    work->flush = flush;
+    work->ret = 0;
+
+    int err = uv_queue_work(luaio_get_loop(), &work->req, luaio_zlib_work, luaio_zlib_after_work);
+    if (err) {
+      if (in_copy != NULL) luaio_pfree(in_copy);
+      luaio_pfree(out_copy);
+      luaio_pfree(work);
+      lua_pushinteger(L, drained);
+      lua_pushinteger(L, 0);
+      lua_pushinteger(L, err);
+      return 3;
+    }
+
+    /*the work owns the kept input, the bytes of a buffer are taken before the call yields*/
+    if (kept) {
+      work->in_copy = stream->input;
+      stream->input = NULL;
+      stream->input_pos = NULL;
+      stream->input_len = 0;
+    } else if (input != NULL) {
+      input->read_pos = input->start;
+      input->write_pos = input->start;
+    }
+
+    /*the stream, a string input and the output buffer stay alive until the work is done*/
+    lua_pushvalue(L, 1);
+    work->stream_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pushvalue(L, 2);
+    work->input_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pushvalue(L, 3);
+    work->output_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+
+    stream->busy = 1;
+    return lua_yield(L, 0);
+  }
+
+  int ret = luaio_zlib_process(stream, flush);
+  luaio_zlib_commit(stream, input, output, &in_len, &out_len);
+
+  if (kept) {
+    stream->input_pos += in_len;
+    stream->input_len -= in_len;
+    if (stream->input_len == 0 || stream->ended) {
+      luaio_zlib_free_input(stream);
+    }
+
+    /*the input of this call has not been used, it is passed again*/
+    in_len = 0;
+    if (ret == 0 && waiting > 0) ret = LUAIO_EXCEED_BUFFER_CAPACITY;
+  }
+
+  lua_pushinteger(L, drained + out_len);
+  lua_pushinteger(L, in_len);
+  lua_pushinteger(L, ret);
+  return 3;
+}
+
+/* @example: local err = zlib_stream:reset()
+ * @overview: start a new stream with the same settings, no memory is allocated again
+ */
+static int luaio_zlib_stream_reset(lua_State *L) {
+  luaio_zlib_check_stream(L, reset());
+
+  z_stream *strm = &stream->strm;
+  int ret = stream->deflate ? deflateReset(strm) : inflateReset(strm);
+  stream->ended = 0;
+
+  if (stream->pending != NULL) {
+    luaio_pfree(stream->pending);
+    stream->pending = NULL;
+    stream->pending_pos = NULL;
+    stream->pending_len = 0;
+  }
+
+  if (stream->input != NULL) {
+    luaio_zlib_free_input(stream);
+  }
+
+  lua_pushinteger(L, luaio_zlib_errno(ret));
+  return 1;
+}
+
+/* @example: zlib_stream:set_async_threshold(bytes)
+ * @param: bytes {integer} inputs of at least bytes run on the thread pool, 0 means never
+ */
+static int luaio_zlib_stream_set_async_threshold(lua_State *L) {
+  luaio_zlib_check_stream(L, set_async_threshold(bytes));
+
+  lua_Integer bytes = luaL_checkinteger(L, 2);
+  if (bytes < 0) {
+    return luaL_argerror(L, 2, "zlib_stream:set_async_threshold(bytes) error: bytes must be >= 0\n");
+  }
+
+  stream->async_threshold = bytes;
+  return 0;
+}
+
+/* @example: local total_in, total_out = zlib_stream:totals()
+ * @return: total_in {integer} bytes used since the stream started
+ * @return: total_out {integer} bytes produced since the stream started
+ */
+static int luaio_zlib_stream_totals(lua_State *L) {
+  luaio_zlib_check_stream(L, totals());
+
+  lua_pushinteger(L, stream->strm.total_in);
+  lua_pushinteger(L, stream->strm.total_out);
+  return 2;
+}
+
+static int luaio_zlib_stream_gc(lua_State *L) {
+  luaio_zlib_stream_t *stream = lua_touserdata(L, 1);
+  if (stream->deflate) {
+    deflateEnd(&stream->strm);
+  } else {
+    inflateEnd(&stream->strm);
+  }
+
+  if (stream->pending != NULL) {
+    luaio_pfree(stream->pending);
+  }
+
+  if (stream->input != NULL) {
+    luaio_pfree(stream->input);
+  }
+
+  return 0;
+}
+
+static luaio_zlib_stream_t *luaio_zlib_stream_new(lua_State *L, int deflate) {
+  luaio_zlib_stream_t *stream = lua_newuserdata(L, sizeof(luaio_zlib_stream_t));
+  if (stream == NULL) return NULL;
+
+  /*zlib allocates with malloc, the thread pool must not touch the pool allocator*/
+  memset(&stream->strm, 0, sizeof(z_stream));
+  stream->type = 0;
+  stream->deflate = deflate;
+  stream->ended = 0;
+  stream->busy = 0;
+  stream->async_threshold = 0;
+  stream->pending = NULL;
+  stream->pending_pos = NULL;
+  stream->pending_len = 0;
+  stream->input = NULL;
+  stream->input_pos = NULL;
+  stream->input_len = 0;
+  return stream;
+}
+
+static void luaio_zlib_stream_setup(lua_State *L, luaio_zlib_stream_t *stream) {
+  stream->type = LUAIO_TYPE_ZLIB_STREAM;
+
+  lua_pushlightuserdata(L, &luaio_zlib_stream_metatable_key);
+  lua_rawget(L, LUA_REGISTRYINDEX);
+  lua_setmetatable(L, -2);
+}
+
+/* @example: local stream, err = zlib.new_deflate([level[, window_bits[, mem_level[, strategy]]]])
+ * @param: level {integer|default: zlib.DEFAULT_COMPRESSION} 0 - 9
+ * @param: window_bits {integer|default: 15} 9 - 15 zlib format, +16 gzip format, -15 - -9 raw deflate
+ * @param: mem_level {integer|default: 8} 1 - 9
+ * @param: strategy {integer|default: zlib.DEFAULT_STRATEGY}
+ * @return: stream {userdata|nil}
+ * @return: err {integer}
+ */
+static int luaio_zlib_new_deflate(lua_State *L) {
+  int level = luaL_optinteger(L, 1, Z_DEFAULT_COMPRESSION);
+  int window_bits = luaL_optinteger(L, 2, MAX_WBITS);
+  int mem_level = luaL_optinteger(L, 3, 8);
+  int strategy = luaL_optinteger(L, 4, Z_DEFAULT_STRATEGY);
+
+  luaio_zlib_stream_t *stream = luaio_zlib_stream_new(L, 1);
+  if (stream == NULL) {
+    lua_pushnil(L);
+    lua_pushinteger(L, UV_ENOMEM);
+    return 2;
+  }
+
+  int ret = deflateInit2(&stream->strm, level, Z_DEFLATED, window_bits, mem_level, strategy);
+  if (ret != Z_OK) {
+    lua_pushnil(L);
+    lua_pushinteger(L, luaio_zlib_errno(ret));
+    return 2;
+  }
+
+  luaio_zlib_stream_setup(L, stream);
+  lua_pushinteger(L, 0);
+  return 2;
+}
+
+/* @example: local stream, err = zlib.new_inflate([window_bits])
+ * @param: window_bits {integer|default: 15} 9 - 15 zlib format, +16 gzip format,
+ *    +32 zlib or gzip by the header, -15 - -9 raw deflate
+ * @return: stream {userdata|nil}
+ * @return: err {integer}
+ */
+static int luaio_zlib_new_inflate(lua_State *L) {
+  int window_bits = luaL_optinteger(L, 1, MAX_WBITS);
+
+  luaio_zlib_stream_t *stream = luaio_zlib_stream_new(L, 0);
+  if (stream == NULL) {
+    lua_pushnil(L);
+    lua_pushinteger(L, UV_ENOMEM);
+    return 2;
+  }
+
+  int ret = inflateInit2(&stream->strm, window_bits);
+  if (ret != Z_OK) {
+    lua_pushnil(L);
+    lua_pushinteger(L, luaio_zlib_errno(ret));
+    return 2;
+  }
+
+  luaio_zlib_stream_setup(L, stream);
+  lua_pushinteger(L, 0);
+  return 2;
+}
+
+int luaopen_zlib(lua_State *L) {
+  /*zlib stream metatable*/
+  luaL_Reg zlib_stream_mtlib[] = {
+    { "write", luaio_zlib_stream_write },
+    { "reset", luaio_zlib_stream_reset },
+    { "set_async_threshold", luaio_zlib_stream_set_async_threshold },
+    { "totals", luaio_zlib_stream_totals },
+    { "__gc", luaio_zlib_stream_gc },
+    { NULL, NULL }
+  };
+
+  lua_pushlightuserdata(L, &luaio_zlib_stream_metatable_key);
+  luaL_newlib(L, zlib_stream_mtlib);
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_rawset(L, LUA_REGISTRYINDEX);
+
+  luaL_Reg lib[] = {
+    { "new_deflate", luaio_zlib_new_deflate },
+    { "new_inflate", luaio_zlib_new_inflate },
+    { "__newindex", luaio_cannot_change },
+    { NULL, NULL }
+  };
+
+  lua_createtable(L, 0, 0);
+
+  luaL_newlib(L, lib);
+
+  luaio_setinteger("NO_FLUSH", Z_NO_FLUSH);
+  luaio_setinteger("SYNC_FLUSH", Z_SYNC_FLUSH);
+  luaio_setinteger("FULL_FLUSH", Z_FULL_FLUSH);
+  luaio_setinteger("FINISH", Z_FINISH);
+  luaio_setinteger("STREAM_END", LUAIO_ZLIB_STREAM_END);
+
+  luaio_setinteger("NO_COMPRESSION", Z_NO_COMPRESSION);
+  luaio_setinteger("BEST_SPEED", Z_BEST_SPEED);
+  luaio_setinteger("BEST_COMPRESSION", Z_BEST_COMPRESSION);
+  luaio_setinteger("DEFAULT_COMPRESSION", Z_DEFAULT_COMPRESSION);
+
+  luaio_setinteger("FILTERED", Z_FILTERED);
+  luaio_setinteger("HUFFMAN_ONLY", Z_HUFFMAN_ONLY);
+  luaio_setinteger("RLE", Z_RLE);
+  luaio_setinteger("FIXED", Z_FIXED);
+  luaio_setinteger("DEFAULT_STRATEGY", Z_DEFAULT_STRATEGY);
+
+  luaio_setstring("VERSION", ZLIB_VERSION);
+
+  lua_pushvalue(L, -1);
+  lua_setfield(L, -2, "__index");
+  lua_pushliteral(L, "metatable is protected.");
+  lua_setfield(L, -2, "__metatable");
+
+  lua_setmetatable(L, -2);
+
+  return 1;
+}
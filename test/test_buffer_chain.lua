@@ -0,0 +1,77 @@
+local color = require('color')
+local tcp = require('tcp')
+local tcp_native = require('tcp_native')
+local ERRNO = require('errno')
+local BufferChain = require('buffer_chain')
+
+local PORT = 18018
+local HOST = '127.0.0.1'
+
+-- small segments, every line below spans several of them
+local chain = BufferChain.new(256)
+local line = string.rep('abcdefgh', 100)
+local bytes, err = chain:append(line)
+assert(bytes == #line and err == 0, color.red('test_buffer_chain [chain:append(data)] error'))
+assert(chain:size() == #line and chain:segments() > 1, color.red('test_buffer_chain [chain:segments()] error'))
+
+-- no newline yet, the bytes searched are not searched again
+local data
+data, err = chain:readline()
+assert(data == nil and err == ERRNO.LUAIO_EAGAIN, color.red('test_buffer_chain [chain:readline()] EAGAIN error'))
+chain:append('\r\nsecond line\nthird')
+data, err = chain:readline()
+assert(data == line and err == #line, color.red('test_buffer_chain [chain:readline()] error'))
+data = chain:readline()
+assert(data == 'second line', color.red('test_buffer_chain [chain:readline()] error'))
+data, err = chain:readline()
+assert(data == nil and err == ERRNO.LUAIO_EAGAIN, color.red('test_buffer_chain [chain:readline()] EAGAIN error'))
+
+-- read(n) waits for n bytes, read() takes the rest
+chain:append(string.rep('x', 1000))
+data, err = chain:read(2000)
+assert(data == nil and err == ERRNO.LUAIO_EAGAIN, color.red('test_buffer_chain [chain:read(n)] EAGAIN error'))
+data = chain:read(5)
+assert(data == 'third', color.red('test_buffer_chain [chain:read(n)] error'))
+assert(chain:discard(10) == 10, color.red('test_buffer_chain [chain:discard(n)] error'))
+data, err = chain:read()
+assert(data == string.rep('x', 990) and err == 990, color.red('test_buffer_chain [chain:read()] error'))
+
+-- read segments go back to pmemory
+assert(chain:size() == 0 and chain:segments() == 0, color.red('test_buffer_chain [release] error'))
+data, err = chain:read()
+assert(data == nil and err == ERRNO.LUAIO_EAGAIN, color.red('test_buffer_chain [chain:read()] EAGAIN error'))
+
+-- a message is gathered in the chain without moving the received bytes,
+-- the chain goes back out as an iovec
+local message = string.rep('0123456789', 20000)
+local echoed
+local server = tcp.createServer(PORT, function(socket)
+  local received = BufferChain.new()
+  while received:size() < #message do
+    local n, err = socket:readChain(received)
+    if err < 0 then break end
+  end
+
+  echoed = received:segments()
+  socket:write(received)
+  socket:close()
+end, { host = HOST, bufferSize = 1024 })
+
+local client = tcp_native.new()
+assert(client:connect(PORT, HOST) == 0, color.red('test_buffer_chain [socket:connect(port, host)] error'))
+client:write(message)
+
+local reply = BufferChain.new()
+while true do
+  local n = client:read(reply)
+  if n < 0 then break end
+end
+
+assert(echoed > 1, color.red('test_buffer_chain [socket:readChain(chain)] error'))
+assert(reply:read() == message, color.red('test_buffer_chain [socket:read(chain), socket:write(chain)] error'))
+client:close()
+server:close()
+
+assert(not pcall(chain.append, chain, {}), color.red('test_buffer_chain [chain:append(data)] error'))
+assert(not pcall(BufferChain.new, 8), color.red('test_buffer_chain [buffer_chain.new(segment_size)] error'))
+print(color.green('test_buffer_chain ok'))
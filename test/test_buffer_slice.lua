@@ -0,0 +1,71 @@
+local color = require('color')
+local fs = require('fs')
+local ReadBuffer = require('read_buffer')
+
+local file = './test_buffer_slice.txt'
+local line = 'GET /index.html HTTP/1.1'
+local body = 'Host: coord.cn\r\nUser-Agent: luaio\r\n\r\n'
+local content = line .. '\r\n' .. body
+
+local function read_file(buffer)
+  local fd = fs.open(file, 'r')
+  assert(fd >= 0, color.red('test_buffer_slice [fs.open(path, flag)] error'))
+  local n = fs.read(fd, buffer)
+  fs.close(fd)
+  return n
+end
+
+assert(fs.writeFile(file, content) == #content, color.red('test_buffer_slice [fs.writeFile(path, data)] error'))
+
+local buffer = ReadBuffer.new(4096)
+assert(read_file(buffer) == #content, color.red('test_buffer_slice [fs.read(fd, buffer)] error'))
+
+local slice, size = buffer:readline_slice()
+assert(size == #line and slice:len() == #line and #slice == #line, color.red('test_buffer_slice [buffer:readline_slice()] error'))
+assert(slice:equals(line), color.red('test_buffer_slice [slice:equals(string)] error'))
+assert(not slice:equals(line .. ' '), color.red('test_buffer_slice [slice:equals(string)] error'))
+assert(tostring(slice) == line and slice:tostring() == line, color.red('test_buffer_slice [slice:tostring()] error'))
+assert(slice:byte(1) == line:byte(1) and slice:byte(-1) == line:byte(-1), color.red('test_buffer_slice [slice:byte(i)] error'))
+
+local rest = buffer:read_slice(-1)
+assert(rest:tostring() == body, color.red('test_buffer_slice [buffer:read_slice()] error'))
+
+local first, last = rest:find('User-Agent')
+assert(first == body:find('User-Agent', 1, true) and last == first + 9, color.red('test_buffer_slice [slice:find(string)] error'))
+assert(rest:find('\r\n', first) == body:find('\r\n', first, true), color.red('test_buffer_slice [slice:find(string, init)] error'))
+assert(rest:find('Cookie') == nil, color.red('test_buffer_slice [slice:find(string)] error'))
+
+local host = rest:sub(7, 14)
+assert(host:tostring() == 'coord.cn', color.red('test_buffer_slice [slice:sub(i, j)] error'))
+assert(host == rest:sub(7, 14), color.red('test_buffer_slice [slice == slice] error'))
+assert(host ~= rest:sub(7, 13), color.red('test_buffer_slice [slice ~= slice] error'))
+assert(host:hash() == rest:sub(7, 14):hash(), color.red('test_buffer_slice [slice:hash()] error'))
+assert(rest:sub(-4):tostring() == '\r\n\r\n', color.red('test_buffer_slice [slice:sub(-i)] error'))
+assert(rest:sub(3, 2):len() == 0, color.red('test_buffer_slice [slice:sub(i, j)] error'))
+
+-- slices are written as they are, no lua string is created
+local fd = fs.open(file, 'w')
+local n = fs.write(fd, { slice, '\n', host })
+fs.close(fd)
+assert(n == #line + 1 + 8, color.red('test_buffer_slice [fs.write(fd, {slice})] error'))
+assert(fs.readFile(file) == line .. '\ncoord.cn', color.red('test_buffer_slice [fs.write(fd, {slice})] error'))
+
+-- refilling the buffer from its start makes the old slices stale
+read_file(buffer)
+assert(not pcall(host.tostring, host), color.red('test_buffer_slice [stale slice] error'))
+assert(not pcall(fs.write, 1, host), color.red('test_buffer_slice [stale slice] error'))
+
+-- a numeric read which compacts the buffer makes the old slices stale too
+local small = ReadBuffer.new(64)
+assert(fs.writeFile(file, string.rep('n', 4096)) == 4096, color.red('test_buffer_slice [fs.writeFile(path, data)] error'))
+local size = read_file(small)
+assert(size == small:capacity(), color.red('test_buffer_slice [fs.read(fd, buffer)] error'))
+local head = small:read_slice(size - 2)
+assert(head:len() == size - 2, color.red('test_buffer_slice [buffer:read_slice(n)] error'))
+local num, err = small:read_uint32_le()
+assert(num == nil and err < 0, color.red('test_buffer_slice [buffer:read_uint32_le()] error'))
+assert(not pcall(head.tostring, head), color.red('test_buffer_slice [stale slice after read_uint] error'))
+
+fs.unlink(file)
+
+print(color.green('test_buffer_slice ok'))
@@ -0,0 +1,62 @@
+local color = require('color')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local coro = require('coro')
+
+local PORT = 18011
+local N = 16
+
+-- connection coroutines are reused once they return
+local served = 0
+local threads = {}
+local server = tcp_native.new(true)
+assert(server:bind(PORT, '127.0.0.1') == 0, color.red('test_coroutine_pool [server:bind(port, host)] error'))
+assert(server:listen(function(socket)
+  local buffer = ReadBuffer.new(1024)
+  socket:set_read_buffer(buffer)
+  socket:read()
+  assert(buffer:read(-1) == 'ping', color.red('test_coroutine_pool [read on reused coroutine] error'))
+  threads[coroutine.running()] = true
+  served = served + 1
+  socket:close()
+end, 511) == 0, color.red('test_coroutine_pool [server:listen(onconnect, backlog)] error'))
+
+local stats = system.coroutine_stats()
+local hits = stats.hits
+local misses = stats.misses
+assert(stats.max_free_coroutines > 0, color.red('test_coroutine_pool [stats.max_free_coroutines] error'))
+
+for i = 1, N do
+  local client = tcp_native.new()
+  assert(client:connect(PORT, '127.0.0.1') == 0, color.red('test_coroutine_pool [socket:connect(port, host)] error'))
+  client:write('ping')
+  while served < i do sleep(5) end
+  client:close()
+end
+
+local count = 0
+for _ in pairs(threads) do count = count + 1 end
+
+stats = system.coroutine_stats()
+assert(served == N, color.red('test_coroutine_pool [served] error'))
+assert(stats.hits - hits >= N - 1 and count < N, color.red('test_coroutine_pool [stats.hits] error'))
+assert(stats.misses - misses <= 1, color.red('test_coroutine_pool [stats.misses] error'))
+
+-- the pool can be shrunk and disabled
+local max = stats.max_free_coroutines
+assert(system.set_max_free_coroutines(0) == 0, color.red('test_coroutine_pool [system.set_max_free_coroutines(0)] error'))
+stats = system.coroutine_stats()
+assert(stats.free_coroutines == 0 and stats.max_free_coroutines == 0, color.red('test_coroutine_pool [shrink] error'))
+system.set_max_free_coroutines(max)
+server:close()
+
+-- lib/coro.lua recycles finished coroutines
+local results = {}
+local co1 = coro.create(function(a) results[#results + 1] = a end)
+coroutine.resume(co1, 1)
+local co2 = coro.create(function(a) results[#results + 1] = a * 2 end)
+coroutine.resume(co2, 2)
+assert(co1 == co2, color.red('test_coroutine_pool [coro.create(fn) reuse] error'))
+assert(results[1] == 1 and results[2] == 4, color.red('test_coroutine_pool [coro.create(fn) results] error'))
+
+print(color.green('test_coroutine_pool ok'))
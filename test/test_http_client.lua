@@ -0,0 +1,180 @@
+local color = require('color')
+local http = require('http')
+local ERRNO = require('errno')
+
+local PORT = 18012
+local HOST = '127.0.0.1'
+
+local big = string.rep('0123456789', 10000)
+local server = http.createServer(PORT, function(request, response)
+  local path = request:path()
+
+  if path == '/stream' then
+    response:writeHead(200, { ['Content-Type'] = 'text/plain' })
+    for i = 1, 5 do
+      response:write('part' .. i .. ';')
+    end
+    response:finish()
+  elseif path == '/big' then
+    response:send(200, nil, big)
+  elseif path == '/close' then
+    response:send(200, { Connection = 'close' }, 'bye')
+  elseif path == '/echo' then
+    local body = response:readBody()
+    response:send(200, { ['Set-Cookie'] = { 'a=1', 'b=2' } }, 'echo ' .. body)
+  else
+    response:send(200, nil, path)
+  end
+end, { host = HOST, timeout = 300 })
+
+local agent = http.Agent:new({ maxIdle = 2, idleTimeout = 1000, bufferSize = 16384 })
+
+local function get(path, method, body)
+  local response, err = http.request({
+    host = HOST,
+    port = PORT,
+    path = path,
+    method = method,
+    body = body,
+    agent = agent
+  })
+  assert(response and err == 0, color.red('test_http_client [http.request(' .. path .. ')] error'))
+  return response
+end
+
+-- the connection goes back to the pool after the body and is reused
+local response = get('/hello')
+assert(response.status == 200 and response.keep_alive, color.red('test_http_client [response head] error'))
+assert(response.headers['content-length'] == '6', color.red('test_http_client [response.headers] error'))
+assert(response:readBody() == '/hello', color.red('test_http_client [response:readBody()] error'))
+assert(agent:idleCount(HOST, PORT) == 1, color.red('test_http_client [agent:idleCount()] error'))
+
+response = get('/again')
+assert(response:readBody() == '/again', color.red('test_http_client [reuse] error'))
+assert(agent.created == 1 and agent.reused == 1, color.red('test_http_client [reuse] error'))
+
+-- bodies are streamed as they arrive
+response = get('/stream')
+local parts = {}
+while true do
+  local data, err = response:read()
+  assert(err == 0, color.red('test_http_client [response:read()] chunked error'))
+  if not data then break end
+  parts[#parts + 1] = data
+end
+assert(table.concat(parts) == 'part1;part2;part3;part4;part5;', color.red('test_http_client [response:read()] chunked error'))
+
+response = get('/big')
+parts = {}
+while true do
+  local data, err = response:read()
+  assert(err == 0, color.red('test_http_client [response:read()] content-length error'))
+  if not data then break end
+  assert(#data <= 16384, color.red('test_http_client [response:read()] streaming error'))
+  parts[#parts + 1] = data
+end
+assert(#parts > 1 and table.concat(parts) == big, color.red('test_http_client [response:read()] content-length error'))
+
+response = get('/echo', 'POST', 'hello')
+assert(response:readBody() == 'echo hello', color.red('test_http_client [request body] error'))
+assert(response.cookies[1] == 'a=1' and response.cookies[2] == 'b=2', color.red('test_http_client [response.cookies] error'))
+
+response = get('/head', 'HEAD')
+assert(response.headers['content-length'] == '5' and response:readBody() == '', color.red('test_http_client [HEAD] error'))
+assert(agent.created == 1, color.red('test_http_client [reuse] error'))
+
+-- Connection: close is not pooled
+response = get('/close')
+assert(not response.keep_alive and response:readBody() == 'bye', color.red('test_http_client [Connection: close] error'))
+assert(agent:idleCount(HOST, PORT) == 0, color.red('test_http_client [Connection: close] error'))
+
+-- the server closes the idle connection, the pool sees EOF in C and reconnects
+response = get('/a')
+response:readBody()
+assert(agent:idleCount(HOST, PORT) == 1, color.red('test_http_client [agent:idleCount()] error'))
+sleep(500)
+local created = agent.created
+response = get('/b')
+assert(response:readBody() == '/b', color.red('test_http_client [stale connection] error'))
+assert(agent.stale == 1 and agent.created == created + 1, color.red('test_http_client [stale connection] error'))
+
+-- idle timeout is enforced in C
+local socket = agent:_acquire(HOST, PORT)
+assert(socket:park(50) == 0, color.red('test_http_client [socket:park(idle_timeout)] error'))
+sleep(200)
+assert(socket:unpark() == ERRNO.UV_ETIMEDOUT, color.red('test_http_client [socket:unpark()] timeout error'))
+socket:close()
+
+socket = agent:_acquire(HOST, PORT)
+assert(socket:park(1000) == 0, color.red('test_http_client [socket:park(idle_timeout)] error'))
+assert(socket:unpark() == 0, color.red('test_http_client [socket:unpark()] error'))
+socket:close()
+
+-- at most maxIdle connections per host are kept
+local sockets = {}
+for i = 1, 3 do
+  sockets[i] = agent:_acquire(HOST, PORT)
+end
+for i = 1, 3 do
+  agent:_release(sockets[i], true)
+end
+assert(agent:idleCount(HOST, PORT) == 2, color.red('test_http_client [maxIdle] error'))
+agent:close()
+assert(agent:idleCount() == 0, color.red('test_http_client [agent:close()] error'))
+
+server:close()
+
+-- requests which would split the head are refused
+for _, options in ipairs({
+  { path = '/a\r\nX-Injected: 1' },
+  { path = '/a b' },
+  { method = 'GET /x' },
+  { headers = { ['X-A'] = 'a\r\nX-Injected: 1' } },
+  { headers = { ['X-A'] = { 'a', 'b\n' } } },
+  { headers = { ['X-A: b'] = 'c' } }
+}) do
+  options.host = HOST
+  options.port = PORT
+  assert(not pcall(http.request, options), color.red('test_http_client [CR LF] error'))
+end
+
+-- the server answers the first request of a connection and closes on the second,
+-- a GET is sent again on a new connection, a POST is not
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local once = tcp_native.new(true)
+assert(once:bind(PORT + 13, HOST) == 0, color.red('test_http_client [once:bind(port, host)] error'))
+once:listen(function(socket)
+  local buffer = ReadBuffer.new(4096)
+  socket:set_read_buffer(buffer)
+  local requests = 0
+  while socket:read() > 0 do
+    local data = buffer:read(-1)
+    if data:find('\r\n\r\n', 1, true) then
+      requests = requests + 1
+      if requests > 1 then break end
+      socket:write('HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\nok')
+    end
+  end
+  socket:close()
+end, 511)
+
+agent = http.Agent:new()
+local function once_request(method)
+  return http.request({ host = HOST, port = PORT + 13, method = method, body = method == 'POST' and 'x' or nil, agent = agent })
+end
+
+response = once_request('GET')
+assert(response and response:readBody() == 'ok', color.red('test_http_client [retry] error'))
+local err
+response, err = once_request('POST')
+assert(response == nil and err < 0 and agent.created == 1, color.red('test_http_client [no retry for POST] error'))
+
+response = once_request('GET')
+assert(response and response:readBody() == 'ok' and agent.created == 2, color.red('test_http_client [retry] error'))
+response = once_request('GET')
+assert(response and response:readBody() == 'ok' and agent.created == 3, color.red('test_http_client [retry GET] error'))
+agent:close()
+once:close()
+
+print(color.green('test_http_client ok'))
@@ -11,7 +11,7 @@ fs.mkdir(DIR)
 local PRINT_RESULT = true
 local BUFFER_SIZE = 512
 
-function TEST_REQ(name, show, data, buffer_size, request, vheaders, vcookies)
+function TEST_REQ(name, show, data, buffer_size, request, vheaders, vcookies, vbody)
   if show then
     print(color.blue('TESTING: ' .. name))
   end
@@ -94,6 +94,23 @@ function TEST_REQ(name, show, data, buffer_size, request, vheaders, vcookies)
     end
   end
 
+  if vbody then
+    local chunks = {}
+    local data, err
+    while true do
+      data, err = parser:parse_chunked(buffer)
+      chunks[#chunks + 1] = data
+      if err ~= http_native.AGAIN then break end
+      size = fs.read(fd, buffer)
+      assert(size > 0)
+    end
+
+    local body = table.concat(chunks)
+    if show then print('parse_chunked error: ' .. err .. ' body: ' .. body) end
+    assert(err == http_native.OK)
+    assert(body == vbody)
+  end
+
   fs.close(fd)
 end
 
@@ -405,10 +422,9 @@ function POST_CHUNKED_ALL_YOUR_BASE()
 
   local show = PRINT_RESULT
   local buffer_size = BUFFER_SIZE
-  TEST_REQ(name, show, data, buffer_size, request, headers)
+  TEST_REQ(name, show, data, buffer_size, request, headers, nil, "all your base are belong to us")
 end
 
--- TODO not support
 function TWO_CHUNKS_MULT_ZERO_END()
   local name = "TWO_CHUNKS_MULT_ZERO_END"
   local data = {
@@ -442,10 +458,9 @@ function TWO_CHUNKS_MULT_ZERO_END()
 
   local show = PRINT_RESULT
   local buffer_size = BUFFER_SIZE
-  TEST_REQ(name, show, data, buffer_size, request, headers)
+  TEST_REQ(name, show, data, buffer_size, request, headers, nil, "hello world")
 end
 
--- TODO not support 
 -- chunked with trailing headers. blech.
 function CHUNKED_W_TRAILING_HEADERS()
   local name = "CHUNKED_W_TRAILING_HEADERS"
@@ -482,10 +497,9 @@ function CHUNKED_W_TRAILING_HEADERS()
 
   local show = PRINT_RESULT
   local buffer_size = BUFFER_SIZE
-  TEST_REQ(name, show, data, buffer_size, request, headers)
+  TEST_REQ(name, show, data, buffer_size, request, headers, nil, "hello world")
 end
 
--- TODO not support
 -- with bullshit after the length
 function CHUNKED_W_BULLSHIT_AFTER_LENGTH()
   local name = "CHUNKED_W_BULLSHIT_AFTER_LENGTH"
@@ -520,7 +534,7 @@ function CHUNKED_W_BULLSHIT_AFTER_LENGTH()
 
   local show = PRINT_RESULT
   local buffer_size = BUFFER_SIZE
-  TEST_REQ(name, show, data, buffer_size, request, headers)
+  TEST_REQ(name, show, data, buffer_size, request, headers, nil, "hello world")
 end
 
 function WITH_QUOTES()
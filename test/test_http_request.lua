@@ -0,0 +1,196 @@
+local color = require('color')
+local fs = require('fs')
+local http_native = require('http_native')
+local ReadBuffer = require('read_buffer')
+
+local file = './test_http_request.txt'
+
+local function read_file(buffer, content)
+  assert(fs.writeFile(file, content) == #content, color.red('test_http_request [fs.writeFile(path, data)] error'))
+  local fd = fs.open(file, 'r')
+  assert(fd >= 0, color.red('test_http_request [fs.open(path, flag)] error'))
+  local n = fs.read(fd, buffer)
+  fs.close(fd)
+  return n
+end
+
+local head = 'GET /index.html?a=1&b=2 HTTP/1.1\r\n'
+  .. 'Host: coord.cn\r\n'
+  .. 'User-Agent: luaio\r\n'
+  .. 'Cookie: a=1\r\n'
+  .. 'Cookie: b=2\r\n'
+  .. 'X-Empty:\r\n'
+  .. '\r\n'
+local body = 'hello'
+
+-- the whole request arrives in one read
+local parser = http_native.new_parser()
+local buffer = ReadBuffer.new(4096)
+read_file(buffer, head .. body)
+
+local request, err = parser:parse_request(buffer)
+assert(err == http_native.OK and request, color.red('test_http_request [parser:parse_request(buffer)] error'))
+assert(request:method() == http_native.GET, color.red('test_http_request [request:method()] error'))
+local major, minor = request:version()
+assert(major == 1 and minor == 1, color.red('test_http_request [request:version()] error'))
+assert(request:path() == '/index.html', color.red('test_http_request [request:path()] error'))
+assert(request:query() == 'a=1&b=2', color.red('test_http_request [request:query()] error'))
+local args = request:query_args()
+assert(args.a == '1' and args.b == '2', color.red('test_http_request [request:query_args()] error'))
+assert(request:query_args(1).b == nil, color.red('test_http_request [request:query_args(max)] error'))
+assert(request:url().path == '/index.html', color.red('test_http_request [request:url()] error'))
+assert(request:head():lower() == head:lower(), color.red('test_http_request [request:head()] error'))
+assert(request:nheader() == 5, color.red('test_http_request [request:nheader()] error'))
+assert(request:header('Host') == 'coord.cn', color.red('test_http_request [request:header(name)] error'))
+assert(request:header('user-agent') == 'luaio', color.red('test_http_request [request:header(name)] error'))
+assert(request:header('x-empty') == '', color.red('test_http_request [request:header(name)] error'))
+assert(request:header('accept') == nil, color.red('test_http_request [request:header(name)] error'))
+assert(request:keep_alive() == true, color.red('test_http_request [request:keep_alive()] error'))
+
+local headers = request:headers()
+assert(headers['host'] == 'coord.cn' and headers['cookie'] == nil, color.red('test_http_request [request:headers()] error'))
+assert(request:headers() == headers, color.red('test_http_request [request:headers()] error'))
+local cookies = request:cookies()
+assert(#cookies == 2 and cookies[1] == 'a=1' and cookies[2] == 'b=2', color.red('test_http_request [request:cookies()] error'))
+
+-- the head is consumed, the body is left in the buffer
+assert(buffer:read(-1) == body, color.red('test_http_request [parser:parse_request(buffer)] error'))
+
+-- the head arrives in two reads
+local split = 40
+local partial = head:sub(1, split)
+buffer = ReadBuffer.new(4096)
+read_file(buffer, partial)
+request, err = parser:parse_request(buffer)
+assert(request == nil and err == http_native.AGAIN, color.red('test_http_request [parser:parse_request(buffer)] AGAIN error'))
+
+read_file(buffer, head:sub(split + 1))
+request, err = parser:parse_request(buffer)
+assert(err == http_native.OK and request:header('cookie') == 'a=1', color.red('test_http_request [parser:parse_request(buffer)] error'))
+assert(request:head():lower() == head:lower(), color.red('test_http_request [request:head()] error'))
+
+-- requests outlive the buffer contents
+buffer = ReadBuffer.new(4096)
+read_file(buffer, 'POST /a HTTP/1.0\r\nConnection: keep-alive\r\n\r\nGET /b HTTP/1.0\r\n\r\n')
+local first = parser:parse_request(buffer)
+local second = parser:parse_request(buffer)
+assert(first:method() == http_native.POST and first:path() == '/a', color.red('test_http_request [parser:parse_request(buffer)] error'))
+assert(first:keep_alive() == true, color.red('test_http_request [request:keep_alive()] error'))
+assert(second:path() == '/b' and second:keep_alive() == false, color.red('test_http_request [request:keep_alive()] error'))
+
+-- errors
+buffer = ReadBuffer.new(4096)
+read_file(buffer, 'GET index.html HTTP/1.1\r\n\r\n')
+request, err = parser:parse_request(buffer)
+assert(request == nil and err == 400, color.red('test_http_request [parser:parse_request(buffer)] error'))
+
+-- chunked body fed one byte at a time
+local chunked = 'POST /upload HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n'
+  .. '5;name=value\r\nhello\r\n'
+  .. '1A\r\n, all your base are belong\r\n'
+  .. '0\r\nVary: *\r\n\r\n'
+  .. 'GET /next HTTP/1.1\r\n\r\n'
+buffer = ReadBuffer.new(4096)
+read_file(buffer, chunked:sub(1, 54))
+request, err = parser:parse_request(buffer)
+assert(err == http_native.OK and request:header('transfer-encoding') == 'chunked', color.red('test_http_request [parser:parse_request(buffer)] error'))
+
+local chunks = {}
+local pos = 55
+while true do
+  local data
+  data, err = parser:parse_chunked(buffer)
+  chunks[#chunks + 1] = data
+  if err ~= http_native.AGAIN then break end
+  read_file(buffer, chunked:sub(pos, pos))
+  pos = pos + 1
+end
+assert(err == http_native.OK and table.concat(chunks) == 'hello, all your base are belong', color.red('test_http_request [parser:parse_chunked(buffer)] error'))
+
+read_file(buffer, chunked:sub(pos))
+request, err = parser:parse_request(buffer)
+assert(err == http_native.OK and request:path() == '/next', color.red('test_http_request [parser:parse_chunked(buffer)] error'))
+
+buffer = ReadBuffer.new(4096)
+read_file(buffer, '5\r\nhelloX\r\n')
+local data
+data, err = parser:parse_chunked(buffer)
+assert(data == 'hello' and err == 400, color.red('test_http_request [parser:parse_chunked(buffer)] error'))
+parser:reset()
+
+local known = {
+  'accept', 'accept-charset', 'accept-encoding', 'accept-language', 'accept-ranges',
+  'access-control-allow-credentials', 'access-control-allow-headers',
+  'access-control-allow-methods', 'access-control-allow-origin', 'access-control-expose-headers',
+  'access-control-max-age', 'access-control-request-headers', 'access-control-request-method',
+  'age', 'allow', 'authorization', 'cache-control', 'connection', 'content-disposition',
+  'content-encoding', 'content-language', 'content-length', 'content-location', 'content-range',
+  'content-type', 'cookie', 'date', 'dnt', 'etag', 'expect', 'expires', 'forwarded', 'from',
+  'host', 'if-match', 'if-modified-since', 'if-none-match', 'if-range', 'if-unmodified-since',
+  'keep-alive', 'last-modified', 'link', 'location', 'max-forwards', 'origin', 'pragma',
+  'proxy-authenticate', 'proxy-authorization', 'proxy-connection', 'range', 'referer',
+  'retry-after', 'sec-websocket-accept', 'sec-websocket-extensions', 'sec-websocket-key',
+  'sec-websocket-protocol', 'sec-websocket-version', 'server', 'set-cookie',
+  'strict-transport-security', 'te', 'trailer', 'transfer-encoding', 'upgrade',
+  'upgrade-insecure-requests', 'user-agent', 'vary', 'via', 'warning', 'www-authenticate',
+  'x-forwarded-for', 'x-forwarded-host', 'x-forwarded-proto', 'x-real-ip', 'x-requested-with'
+}
+
+-- every known header is found by its id
+local all = { 'GET / HTTP/1.1\r\n' }
+for i = 1, #known do
+  all[#all + 1] = known[i]:upper() .. ': ' .. i .. '\r\n'
+end
+all[#all + 1] = 'X-Custom: custom\r\n\r\n'
+buffer = ReadBuffer.new(8192)
+read_file(buffer, table.concat(all))
+request, err = parser:parse_request(buffer)
+assert(err == http_native.OK, color.red('test_http_request [parser:parse_request(buffer)] error'))
+for i = 1, #known do
+  local id = http_native['HEADER_' .. known[i]:upper():gsub('-', '_')]
+  assert(id == i, color.red('test_http_request [http_native.HEADER_*] error'))
+  assert(request:header(id) == tostring(i), color.red('test_http_request [request:header(id)] error'))
+  assert(request:header(known[i]) == tostring(i), color.red('test_http_request [request:header(name)] error'))
+end
+assert(request:header('x-custom') == 'custom' and request:header(0) == nil, color.red('test_http_request [request:header(name)] error'))
+headers = request:headers()
+assert(headers['user-agent'] == tostring(http_native.HEADER_USER_AGENT) and headers['x-custom'] == 'custom', color.red('test_http_request [request:headers()] error'))
+
+local parsed, parsed_cookies = {}, {}
+buffer = ReadBuffer.new(8192)
+read_file(buffer, table.concat(all, '', 2))
+parser = http_native.new_parser()
+repeat
+  err = parser:parse_headers(buffer, parsed, parsed_cookies)
+until err ~= http_native.DONE
+assert(err == http_native.OK and parsed['host'] == tostring(http_native.HEADER_HOST), color.red('test_http_request [parser:parse_headers(buffer)] error'))
+assert(parsed['cookie'] == nil and #parsed_cookies == 2, color.red('test_http_request [parser:parse_headers(buffer)] error'))
+
+-- long runs go through the SIMD scanners(http_native.simd), results must not change
+local long_path = '/' .. string.rep('abcdefghij/', 9) .. 'index.html'
+local long_query = string.rep('key=value&', 8) .. 'last=?'
+local long_field = 'X-Very-Long-Header-Name-Scanned-In-Blocks_' .. string.rep('AbC', 7)
+for i = 0, 40 do
+  local path = long_path:sub(1, #long_path - i)
+  buffer = ReadBuffer.new(4096)
+  read_file(buffer, 'GET ' .. path .. '?' .. long_query .. '#hash HTTP/1.1\r\n'
+            .. long_field:sub(1, #long_field - i) .. ': value\r\n\r\n')
+  request, err = parser:parse_request(buffer)
+  assert(err == http_native.OK, color.red('test_http_request [parser:parse_request(buffer)] simd error'))
+  assert(request:path() == path and request:query() == long_query, color.red('test_http_request [request:path()] simd error'))
+  assert(request:header(long_field:sub(1, #long_field - i)) == 'value', color.red('test_http_request [request:header(name)] simd error'))
+  assert(next(request:headers()) == long_field:sub(1, #long_field - i):lower(), color.red('test_http_request [request:headers()] simd error'))
+end
+
+buffer = ReadBuffer.new(4096)
+read_file(buffer, 'GET ' .. long_path .. '\127 HTTP/1.1\r\n\r\n')
+request, err = parser:parse_request(buffer)
+assert(request == nil and err == 400, color.red('test_http_request [parser:parse_request(buffer)] simd error'))
+
+buffer = ReadBuffer.new(4096)
+read_file(buffer, 'GET / HTTP/1.1\r\n' .. long_field .. '(: value\r\n\r\n')
+request, err = parser:parse_request(buffer)
+assert(request == nil and err == 400, color.red('test_http_request [parser:parse_request(buffer)] simd error'))
+
+fs.unlink(file)
+print(color.green('test_http_request ok'))
@@ -0,0 +1,80 @@
+local color = require('color')
+local date = require('date')
+local errno = require('errno')
+local fs = require('fs')
+local http_native = require('http_native')
+local WriteBuffer = require('write_buffer')
+
+local file = './test_http_response.txt'
+
+local function buffer_string(buffer)
+  assert(fs.writeFile(file, buffer) >= 0, color.red('test_http_response [fs.writeFile(path, buffer)] error'))
+  local data = fs.readFile(file)
+  fs.unlink(file)
+  return data
+end
+
+local function check_date(head)
+  local value = head:match('\r\nDate: ([^\r]+)\r\n')
+  local t = date.parseUTCString(value)
+  assert(t and math.abs(t - date.now()) <= 1, color.red('test_http_response [http_native.write_head()] Date error'))
+  return value
+end
+
+-- the head is returned as a string without a buffer
+local head = http_native.write_head(nil, 200, { ['Content-Type'] = 'text/plain' }, 'hello')
+local value = check_date(head)
+assert(head == 'HTTP/1.1 200 OK\r\nContent-Type: text/plain\r\nDate: ' .. value .. '\r\nContent-Length: 5\r\n\r\n',
+       color.red('test_http_response [http_native.write_head(nil, status, headers, body)] error'))
+
+-- the date is cached for the second
+assert(check_date(http_native.write_head(nil, 204)) == value or date.now() ~= date.parseUTCString(value),
+       color.red('test_http_response [http_native.write_head()] Date error'))
+
+-- Content-Length of every body type
+assert(http_native.write_head(nil, 200, nil, 42):find('\r\nContent-Length: 42\r\n', 1, true), color.red('test_http_response [http_native.write_head(nil, status, nil, length)] error'))
+assert(http_native.write_head(nil, 200, nil, { 'ab', 'cde', '' }):find('\r\nContent-Length: 5\r\n', 1, true), color.red('test_http_response [http_native.write_head(nil, status, nil, table)] error'))
+local body_buffer = WriteBuffer.new(64)
+body_buffer:write('0123456789')
+assert(http_native.write_head(nil, 200, nil, body_buffer):find('\r\nContent-Length: 10\r\n', 1, true), color.red('test_http_response [http_native.write_head(nil, status, nil, buffer)] error'))
+assert(not http_native.write_head(nil, 304):find('Content-Length', 1, true), color.red('test_http_response [http_native.write_head(nil, status)] error'))
+
+-- headers given by the caller win, arrays are repeated
+head = http_native.write_head(nil, 404, {
+  date = 'Tue, 10 Nov 2002 23:50:13 GMT',
+  ['Transfer-Encoding'] = 'chunked',
+  ['Set-Cookie'] = { 'a=1', 'b=2' },
+  ['X-Number'] = 7
+}, 'ignored')
+assert(head:sub(1, 24) == 'HTTP/1.1 404 Not Found\r\n', color.red('test_http_response [http_native.write_head()] status line error'))
+assert(head:find('\r\ndate: Tue, 10 Nov 2002 23:50:13 GMT\r\n', 1, true) and not head:find('\r\nDate:', 1, true), color.red('test_http_response [http_native.write_head()] Date error'))
+assert(not head:find('Content-Length', 1, true), color.red('test_http_response [http_native.write_head()] Content-Length error'))
+assert(head:find('\r\nSet-Cookie: a=1\r\nSet-Cookie: b=2\r\n', 1, true) and head:find('\r\nX-Number: 7\r\n', 1, true), color.red('test_http_response [http_native.write_head()] headers error'))
+assert(head:sub(-4) == '\r\n\r\n', color.red('test_http_response [http_native.write_head()] error'))
+
+-- unlisted status codes have an empty reason phrase
+assert(http_native.write_head(nil, 299):sub(1, 15) == 'HTTP/1.1 299 \r\n', color.red('test_http_response [http_native.write_head(nil, 299)] error'))
+assert(not pcall(http_native.write_head, nil, 99), color.red('test_http_response [http_native.write_head(nil, 99)] error'))
+assert(not pcall(http_native.write_head, nil, 200, { ['X-Bad'] = 'a\r\nb' }), color.red('test_http_response [http_native.write_head()] CRLF error'))
+for _, name in ipairs({ 'X-Bad\r\nSet-Cookie', 'X-Bad: a', 'X Bad', 'X-Bad\t', '' }) do
+  assert(not pcall(http_native.write_head, nil, 200, { [name] = 'a' }), color.red('test_http_response [http_native.write_head()] header name error'))
+end
+
+-- the head and the chunks go into a WriteBuffer
+local buffer = WriteBuffer.new(256)
+local bytes = http_native.write_head(buffer, 200, { ['Transfer-Encoding'] = 'chunked' })
+assert(bytes > 0, color.red('test_http_response [http_native.write_head(buffer, status, headers)] error'))
+assert(http_native.write_chunk(buffer, 'hello') == 10, color.red('test_http_response [http_native.write_chunk(buffer, data)] error'))
+assert(http_native.write_chunk(buffer, string.rep('x', 26)) == 32, color.red('test_http_response [http_native.write_chunk(buffer, data)] error'))
+assert(http_native.write_chunk(buffer) == 5, color.red('test_http_response [http_native.write_chunk(buffer)] error'))
+local data = buffer_string(buffer)
+assert(#data == bytes + 47, color.red('test_http_response [http_native.write_chunk(buffer, data)] error'))
+assert(data:sub(bytes + 1) == '5\r\nhello\r\n1a\r\n' .. string.rep('x', 26) .. '\r\n0\r\n\r\n', color.red('test_http_response [http_native.write_chunk(buffer, data)] error'))
+assert(http_native.write_chunk(nil, 'abc') == '3\r\nabc\r\n', color.red('test_http_response [http_native.write_chunk(nil, data)] error'))
+assert(http_native.write_chunk(nil, '') == '0\r\n\r\n', color.red('test_http_response [http_native.write_chunk(nil, data)] error'))
+
+-- the buffer is full
+buffer = WriteBuffer.new(32)
+assert(http_native.write_head(buffer, 200, nil, 0) == errno.LUAIO_EXCEED_BUFFER_CAPACITY, color.red('test_http_response [http_native.write_head(buffer, status)] error'))
+
+print(color.green('test_http_response ok'))
@@ -0,0 +1,143 @@
+local color = require('color')
+local fs = require('fs')
+local http_native = require('http_native')
+local ReadBuffer = require('read_buffer')
+local ERRNO = require('errno')
+
+local router = http_native.new_router()
+local GET, POST, HEAD, PUT = http_native.GET, http_native.POST, http_native.HEAD, http_native.PUT
+
+local routes = {
+  { GET, '/', 1 },
+  { GET, '/users', 2 },
+  { GET, '/users/new', 3 },
+  { GET, '/users/:id', 4 },
+  { GET, '/users/:id/posts/:post', 5 },
+  { GET, '/user', 6 },
+  { GET, '/static/*path', 7 },
+  { POST, '/users', 8 },
+  { GET, '/files/:name/raw', 9 },
+  { GET, '/files/*rest', 10 },
+  { http_native.UNKNOWN, '/any/:x', 11 },
+  { GET, '/a:b', 12 }
+}
+
+for i = 1, #routes do
+  local r = routes[i]
+  assert(router:add(r[1], r[2], r[3]) == 0, color.red('test_http_router [router:add(method, pattern, id)] error'))
+end
+
+local function check(method, path, id, params)
+  local got, got_params = router:match(method, path)
+  assert(got == id, color.red('test_http_router [router:match(' .. method .. ', ' .. path .. ')] error'))
+  if params == nil then
+    assert(got_params == nil, color.red('test_http_router [router:match(' .. path .. ')] params error'))
+    return
+  end
+
+  local n = 0
+  for k, v in pairs(got_params) do
+    n = n + 1
+    assert(params[k] == v, color.red('test_http_router [router:match(' .. path .. ')] params error'))
+  end
+  for _ in pairs(params) do n = n - 1 end
+  assert(n == 0, color.red('test_http_router [router:match(' .. path .. ')] params error'))
+end
+
+check(GET, '/', 1)
+check(GET, '/users', 2)
+check(GET, '/users/new', 3)
+check(GET, '/users/42', 4, { id = '42' })
+check(GET, '/users/newer', 4, { id = 'newer' })
+check(GET, '/users/42/posts/7', 5, { id = '42', post = '7' })
+check(GET, '/users/new/posts/7', 5, { id = 'new', post = '7' })
+check(GET, '/user', 6)
+check(GET, '/users/', nil)
+check(GET, '/users/42/', nil)
+check(GET, '/static/css/site.css', 7, { path = 'css/site.css' })
+check(GET, '/static/', 7, { path = '' })
+check(POST, '/users', 8)
+check(POST, '/users/42', nil)
+check(PUT, '/users', nil)
+check(HEAD, '/users/42', 4, { id = '42' })
+check(GET, '/files/a.txt/raw', 9, { name = 'a.txt' })
+check(GET, '/files/a.txt/other', 10, { rest = 'a.txt/other' })
+check(PUT, '/any/1', 11, { x = '1' })
+check(GET, '/a:b', 12)
+check(GET, '/ab', nil)
+check(GET, '', nil)
+check(GET, 'users', nil)
+
+-- conflicts and bad patterns
+assert(router:add(GET, '/users', 99) == ERRNO.UV_EEXIST, color.red('test_http_router [router:add()] EEXIST error'))
+assert(router:add(GET, '/users/:name', 99) == ERRNO.UV_EEXIST, color.red('test_http_router [router:add()] EEXIST error'))
+assert(router:add(GET, '/static/*other', 99) == ERRNO.UV_EEXIST, color.red('test_http_router [router:add()] EEXIST error'))
+assert(not pcall(router.add, router, GET, 'users', 99), color.red('test_http_router [router:add()] pattern error'))
+assert(not pcall(router.add, router, GET, '/users/:', 99), color.red('test_http_router [router:add()] pattern error'))
+assert(not pcall(router.add, router, GET, '/static/*path/x', 99), color.red('test_http_router [router:add()] pattern error'))
+assert(not pcall(router.add, router, GET, '/x', 0), color.red('test_http_router [router:add()] id error'))
+
+-- the path of a parsed request is matched in place
+local file = './test_http_router.txt'
+local content = 'GET /users/42/posts/7?x=1 HTTP/1.1\r\nHost: coord.cn\r\n\r\n'
+assert(fs.writeFile(file, content) == #content, color.red('test_http_router [fs.writeFile(path, data)] error'))
+local fd = fs.open(file, 'r')
+local buffer = ReadBuffer.new(4096)
+fs.read(fd, buffer)
+fs.close(fd)
+fs.unlink(file)
+local request = http_native.new_parser():parse_request(buffer)
+local id, params = router:match(request)
+assert(id == 5 and params.id == '42' and params.post == '7', color.red('test_http_router [router:match(request)] error'))
+
+-- thousands of routes
+local big = http_native.new_router()
+for i = 1, 5000 do
+  assert(big:add(GET, '/api/v' .. (i % 7) .. '/resource' .. i .. '/:id', i) == 0, color.red('test_http_router [router:add()] error'))
+  assert(big:add(POST, '/api/v' .. (i % 7) .. '/resource' .. i, i + 5000) == 0, color.red('test_http_router [router:add()] error'))
+end
+for i = 1, 5000, 37 do
+  id, params = big:match(GET, '/api/v' .. (i % 7) .. '/resource' .. i .. '/abc')
+  assert(id == i and params.id == 'abc', color.red('test_http_router [router:match()] many routes error'))
+  assert(big:match(POST, '/api/v' .. (i % 7) .. '/resource' .. i) == i + 5000, color.red('test_http_router [router:match()] many routes error'))
+end
+assert(big:match(GET, '/api/v1/resource1/') == nil, color.red('test_http_router [router:match()] many routes error'))
+
+-- a static and a :name sibling at every level, a failed branch is not walked
+-- again, so a path which fails at the end does not try every mix of them and
+-- a route found only after many failed branches is still found
+local deep = http_native.new_router()
+local DEPTH = 10
+local id = 0
+local function add_deep(prefix, level)
+  if level > DEPTH then
+    id = id + 1
+    assert(deep:add(GET, prefix .. '/x', id) == 0, color.red('test_http_router [router:add()] deep error'))
+    return
+  end
+  add_deep(prefix .. '/a', level + 1)
+  add_deep(prefix .. '/:p' .. level, level + 1)
+end
+add_deep('', 1)
+local params_y = ''
+for level = 1, DEPTH do
+  params_y = params_y .. '/:p' .. level
+end
+assert(deep:add(GET, params_y .. '/y', 10000) == 0, color.red('test_http_router [router:add()] deep error'))
+
+local start = system.hrtime()
+assert(deep:match(GET, string.rep('/a', DEPTH) .. '/z') == nil, color.red('test_http_router [router:match()] backtrack error'))
+assert((system.hrtime() - start) / 1000000 < 50, color.red('test_http_router [router:match()] backtrack bound error'))
+assert(deep:match(GET, string.rep('/a', DEPTH) .. '/x') == 1, color.red('test_http_router [router:match()] deep error'))
+local deep_id, deep_params = deep:match(GET, '/b' .. string.rep('/a', DEPTH - 1) .. '/x')
+assert(deep_id and deep_params.p1 == 'b', color.red('test_http_router [router:match()] deep :name error'))
+
+start = system.hrtime()
+deep_id, deep_params = deep:match(GET, string.rep('/a', DEPTH) .. '/y')
+assert(deep_id == 10000 and deep_params.p1 == 'a' and deep_params['p' .. DEPTH] == 'a', color.red('test_http_router [router:match()] deep backtrack error'))
+deep_id, deep_params = deep:match(GET, '/b' .. string.rep('/a', DEPTH - 1) .. '/y')
+assert(deep_id == 10000 and deep_params.p1 == 'b' and deep_params.p2 == 'a', color.red('test_http_router [router:match()] deep backtrack error'))
+assert(deep:match(HEAD, string.rep('/a', DEPTH) .. '/y') == 10000, color.red('test_http_router [router:match()] deep backtrack HEAD error'))
+assert((system.hrtime() - start) / 1000000 < 50, color.red('test_http_router [router:match()] backtrack bound error'))
+
+print(color.green('test_http_router ok'))
@@ -0,0 +1,136 @@
+local color = require('color')
+local http = require('http')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local WriteBuffer = require('write_buffer')
+
+local PORT = 18011
+
+local connection
+local bodies = {}
+-- one WriteBuffer reused by every /wb request
+local wb = WriteBuffer.new(1024)
+local server = http.createServer(PORT, function(request, response)
+  connection = response.connection
+  local path = request:path()
+
+  if path == '/echo' then
+    local body = response:readBody()
+    bodies[#bodies + 1] = body
+    response:send(200, { ['Content-Type'] = 'text/plain' }, body)
+  elseif path == '/stream' then
+    response:writeHead(200, { ['Content-Type'] = 'text/plain' })
+    response:write('hello ')
+    response:write(string.rep('x', 5000))
+    response:finish(' world')
+  elseif path:sub(1, 4) == '/wb/' then
+    wb:discard(-1)
+    wb:write(path:sub(5))
+    response:send(200, nil, wb)
+  elseif path == '/skip' then
+    -- the body is not read, the server drops it
+    response:send(204)
+  else
+    response:send(200, nil, path)
+  end
+end, { host = '127.0.0.1' })
+
+local function connect()
+  local socket = tcp_native.new()
+  assert(socket:connect(PORT, '127.0.0.1') == 0, color.red('test_http_server [socket:connect(port, host)] error'))
+  local buffer = ReadBuffer.new(65536)
+  socket:set_read_buffer(buffer)
+  return socket, buffer
+end
+
+-- read until the data ends with tail
+local function read_until(socket, buffer, tail)
+  local data = ''
+  while data:sub(-#tail) ~= tail do
+    assert(socket:read() > 0, color.red('test_http_server [socket:read()] error'))
+    data = data .. buffer:read(-1)
+  end
+  return data
+end
+
+-- pipelined requests in one write, the responses come back with one flush
+local socket, buffer = connect()
+local pipelined = {}
+for i = 1, 8 do
+  pipelined[i] = 'GET /r' .. i .. ' HTTP/1.1\r\nHost: coord.cn\r\n\r\n'
+end
+socket:write(table.concat(pipelined))
+local data = read_until(socket, buffer, '/r8')
+local i = 0
+for body in data:gmatch('Content%-Length: %d+\r\n\r\n(/r%d)') do
+  i = i + 1
+  assert(body == '/r' .. i, color.red('test_http_server [pipelined order] error'))
+end
+assert(i == 8, color.red('test_http_server [pipelined responses] error'))
+assert(connection.flushes == 1, color.red('test_http_server [batched flush] error'))
+
+-- a WriteBuffer body is queued as a copy, the next pipelined request reuses it
+pipelined = {}
+for i = 1, 4 do
+  pipelined[i] = 'GET /wb/' .. string.rep(tostring(i), i) .. ' HTTP/1.1\r\nHost: coord.cn\r\n\r\n'
+end
+socket:write(table.concat(pipelined))
+data = read_until(socket, buffer, '4444')
+i = 0
+for length, body in data:gmatch('Content%-Length: (%d+)\r\n\r\n(%d+)') do
+  i = i + 1
+  assert(tonumber(length) == i and body == string.rep(tostring(i), i), color.red('test_http_server [pipelined WriteBuffer] error'))
+end
+assert(i == 4, color.red('test_http_server [pipelined WriteBuffer] error'))
+
+-- bodies between pipelined requests
+socket:write('POST /echo HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello'
+             .. 'POST /skip HTTP/1.1\r\nContent-Length: 3\r\n\r\nabc'
+             .. 'POST /echo HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n3\r\nabc\r\n2\r\nde\r\n0\r\n\r\n'
+             .. 'GET /last HTTP/1.1\r\n\r\n')
+data = read_until(socket, buffer, '/last')
+assert(bodies[1] == 'hello' and bodies[2] == 'abcde', color.red('test_http_server [response:readBody()] error'))
+assert(data:find('HTTP/1.1 204 No Content\r\n', 1, true), color.red('test_http_server [skip body] error'))
+
+-- chunked response
+socket:write('GET /stream HTTP/1.1\r\n\r\n')
+data = read_until(socket, buffer, '0\r\n\r\n')
+local head, body = data:match('^(.-\r\n\r\n)(.*)$')
+assert(head:find('Transfer-Encoding: chunked\r\n', 1, true), color.red('test_http_server [response:write(data)] error'))
+local decoded = {}
+local pos = 1
+while true do
+  local size, start = body:match('^(%x+)\r\n()', pos)
+  size = tonumber(size, 16)
+  if size == 0 then break end
+  decoded[#decoded + 1] = body:sub(start, start + size - 1)
+  pos = start + size + 2
+end
+assert(table.concat(decoded) == 'hello ' .. string.rep('x', 5000) .. ' world', color.red('test_http_server [response:write(data)] error'))
+socket:close()
+
+-- HTTP/1.0 closes after the response, bad requests are rejected
+socket, buffer = connect()
+socket:write('GET /old HTTP/1.0\r\n\r\n')
+data = ''
+while true do
+  local ret = socket:read()
+  if ret < 0 then break end
+  data = data .. buffer:read(-1)
+end
+assert(data:find('Connection: close\r\n', 1, true) and data:sub(-4) == '/old', color.red('test_http_server [HTTP/1.0] error'))
+socket:close()
+
+socket, buffer = connect()
+socket:write('GET index.html HTTP/1.1\r\n\r\n')
+data = ''
+while true do
+  local ret = socket:read()
+  if ret < 0 then break end
+  data = data .. buffer:read(-1)
+end
+assert(data:sub(1, 24) == 'HTTP/1.1 400 Bad Request', color.red('test_http_server [bad request] error'))
+socket:close()
+
+server:close()
+print(color.green('test_http_server ok'))
@@ -0,0 +1,137 @@
+local color = require('color')
+local fs = require('fs')
+local http = require('http')
+local static = require('static')
+
+local PORT = 18013
+local HOST = '127.0.0.1'
+local ROOT = './test_http_static'
+
+fs.mkdir(ROOT, 493)
+fs.mkdir(ROOT .. '/docs', 493)
+
+local function write(name, data)
+  local fd = fs.open(ROOT .. name, 'w')
+  fs.write(fd, data)
+  fs.close(fd)
+end
+
+local hello = 'hello static world'
+local chunk = string.rep('0123456789abcdef', 4096)
+local big = string.rep(chunk, 64)
+write('/hello.txt', hello)
+write('/big.bin', big)
+write('/app.js', string.rep('console.log(1);', 100))
+write('/app.js.gz', 'GZIPPED')
+write('/docs/index.html', '<html></html>')
+for i = 1, 5 do
+  write('/f' .. i .. '.txt', 'file' .. i)
+end
+
+local files = static.new(ROOT, { maxFiles = 8, ttl = 100, maxAge = 60, gzip = true })
+local server = http.createServer(PORT, function(request, response)
+  files:serve(request, response)
+end, { host = HOST })
+
+local agent = http.Agent:new()
+
+local function get(path, headers, method)
+  local response, err = http.request({
+    host = HOST,
+    port = PORT,
+    path = path,
+    method = method,
+    headers = headers,
+    agent = agent
+  })
+  assert(response and err == 0, color.red('test_http_static [http.request(' .. path .. ')] error'))
+  local body = response:readBody()
+  return response, body
+end
+
+local response, body = get('/hello.txt')
+local headers = response.headers
+assert(response.status == 200 and body == hello, color.red('test_http_static [200] error'))
+assert(headers['content-type'] == 'text/plain; charset=utf-8', color.red('test_http_static [Content-Type] error'))
+assert(headers['accept-ranges'] == 'bytes' and headers['cache-control'] == 'public, max-age=60', color.red('test_http_static [headers] error'))
+local etag = headers['etag']
+local last_modified = headers['last-modified']
+assert(etag and last_modified, color.red('test_http_static [ETag, Last-Modified] error'))
+
+-- the open fd and the stat result are cached
+get('/hello.txt')
+local stats = files:stats()
+assert(stats.hits == 1 and stats.misses == 1, color.red('test_http_static [cache] error'))
+
+-- conditional requests
+response, body = get('/hello.txt', { ['If-None-Match'] = etag })
+assert(response.status == 304 and body == '' and response.headers['etag'] == etag, color.red('test_http_static [If-None-Match] error'))
+response = get('/hello.txt', { ['If-Modified-Since'] = last_modified })
+assert(response.status == 304, color.red('test_http_static [If-Modified-Since] error'))
+response = get('/hello.txt', { ['If-None-Match'] = '"other"' })
+assert(response.status == 200, color.red('test_http_static [If-None-Match] error'))
+
+-- ranges
+response, body = get('/hello.txt', { Range = 'bytes=6-11' })
+assert(response.status == 206 and body == 'static', color.red('test_http_static [Range] error'))
+assert(response.headers['content-range'] == 'bytes 6-11/' .. #hello, color.red('test_http_static [Content-Range] error'))
+response, body = get('/hello.txt', { Range = 'bytes=-5' })
+assert(response.status == 206 and body == 'world', color.red('test_http_static [suffix Range] error'))
+response, body = get('/hello.txt', { Range = 'bytes=100-' })
+assert(response.status == 416 and response.headers['content-range'] == 'bytes */' .. #hello, color.red('test_http_static [416] error'))
+response, body = get('/hello.txt', { Range = 'bytes=0-4', ['If-Range'] = '"stale"' })
+assert(response.status == 200 and body == hello, color.red('test_http_static [If-Range] error'))
+
+-- a large file goes out in chunks while the client reads slowly
+response, body = get('/big.bin')
+assert(response.status == 200 and body == big, color.red('test_http_static [sendfile] error'))
+response, body = get('/big.bin', { Range = 'bytes=1000000-1000015' })
+assert(body == big:sub(1000001, 1000016), color.red('test_http_static [sendfile range] error'))
+
+-- precompressed sibling
+response, body = get('/app.js', { ['Accept-Encoding'] = 'gzip, deflate' })
+assert(response.headers['content-encoding'] == 'gzip' and body == 'GZIPPED', color.red('test_http_static [gzip] error'))
+assert(response.headers['vary'] == 'Accept-Encoding', color.red('test_http_static [Vary] error'))
+response, body = get('/app.js')
+assert(response.headers['content-encoding'] == nil and #body == 1500, color.red('test_http_static [identity] error'))
+
+-- index, directories, errors
+response, body = get('/docs/')
+assert(response.status == 200 and body == '<html></html>', color.red('test_http_static [index] error'))
+response = get('/docs')
+assert(response.status == 301 and response.headers['location'] == '/docs/', color.red('test_http_static [301] error'))
+response = get('/missing.txt')
+assert(response.status == 404, color.red('test_http_static [404] error'))
+response = get('/../test_http_static.lua')
+assert(response.status == 403, color.red('test_http_static [403] error'))
+response = get('/%2e%2e/test_http_static.lua')
+assert(response.status == 403, color.red('test_http_static [403] error'))
+response, body = get('/hello.txt', nil, 'HEAD')
+assert(response.status == 200 and body == '' and response.headers['content-length'] == tostring(#hello), color.red('test_http_static [HEAD] error'))
+response = get('/hello.txt', nil, 'POST')
+assert(response.status == 405, color.red('test_http_static [405] error'))
+
+-- a changed file is seen after the ttl
+write('/hello.txt', 'changed')
+sleep(150)
+response, body = get('/hello.txt')
+assert(body == 'changed' and response.headers['etag'] ~= etag, color.red('test_http_static [ttl] error'))
+
+-- least recently used files are closed
+for i = 1, 5 do
+  get('/f' .. i .. '.txt')
+end
+stats = files:stats()
+assert(stats.files <= 8 and stats.evictions > 0, color.red('test_http_static [LRU] error'))
+
+agent:close()
+server:close()
+files:close()
+
+for _, name in ipairs({ 'hello.txt', 'big.bin', 'app.js', 'app.js.gz', 'docs/index.html',
+                        'f1.txt', 'f2.txt', 'f3.txt', 'f4.txt', 'f5.txt' }) do
+  fs.unlink(ROOT .. '/' .. name)
+end
+fs.rmdir(ROOT .. '/docs')
+fs.rmdir(ROOT)
+print(color.green('test_http_static ok'))
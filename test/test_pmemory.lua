@@ -0,0 +1,71 @@
+local color = require('color')
+local WriteBuffer = require('write_buffer')
+local ERRNO = require('errno')
+
+-- 100 bytes are served by the 128 bytes size class(slab)
+local SMALL_SLOT = 2
+-- 8000 bytes are served by the 8192 bytes size class(free list)
+local LARGE_SLOT = 40
+
+local stats = system.pmemory_stats()
+assert(#stats == 64, color.red('test_pmemory [system.pmemory_stats()] error'))
+assert(stats[SMALL_SLOT].capacity == 128, color.red('test_pmemory [stats.capacity] error'))
+assert(stats[LARGE_SLOT].capacity == 8192, color.red('test_pmemory [stats.capacity] error'))
+assert(stats.huge, color.red('test_pmemory [stats.huge] error'))
+
+-- small size class
+local used = stats[SMALL_SLOT].used_chunks
+local releases = stats[SMALL_SLOT].releases
+
+local buffers = {}
+for i = 1, 1024 do
+  buffers[i] = WriteBuffer.new(100)
+end
+
+stats = system.pmemory_stats()
+local slabs = stats[SMALL_SLOT].slabs
+assert(stats[SMALL_SLOT].used_chunks == used + 1024, color.red('test_pmemory [stats.used_chunks] error'))
+assert(slabs >= 2, color.red('test_pmemory [stats.slabs] error'))
+
+buffers = nil
+collectgarbage()
+
+stats = system.pmemory_stats()
+assert(stats[SMALL_SLOT].used_chunks == used, color.red('test_pmemory [stats.used_chunks after free] error'))
+assert(stats[SMALL_SLOT].slabs < slabs, color.red('test_pmemory [stats.slabs after free] error'))
+assert(stats[SMALL_SLOT].releases > releases, color.red('test_pmemory [stats.releases after free] error'))
+
+-- large size class
+used = stats[LARGE_SLOT].used_chunks
+
+buffers = {}
+for i = 1, 8 do
+  buffers[i] = WriteBuffer.new(8000)
+end
+
+stats = system.pmemory_stats()
+assert(stats[LARGE_SLOT].used_chunks == used + 8, color.red('test_pmemory [stats.used_chunks] error'))
+
+buffers = nil
+collectgarbage()
+
+stats = system.pmemory_stats()
+assert(stats[LARGE_SLOT].used_chunks == used, color.red('test_pmemory [stats.used_chunks after free] error'))
+assert(stats[LARGE_SLOT].free_chunks >= 8, color.red('test_pmemory [stats.free_chunks after free] error'))
+assert(stats[LARGE_SLOT].cached_bytes == stats[LARGE_SLOT].free_chunks * 8192,
+       color.red('test_pmemory [stats.cached_bytes] error'))
+
+local max_free_chunks = stats[LARGE_SLOT].max_free_chunks
+local capacity, err = system.pmemory_set_max_free_chunks(8000, 2)
+assert(err == 0 and capacity == 8192, color.red('test_pmemory [system.pmemory_set_max_free_chunks(size, n)] error'))
+
+stats = system.pmemory_stats()
+assert(stats[LARGE_SLOT].max_free_chunks == 2, color.red('test_pmemory [stats.max_free_chunks] error'))
+assert(stats[LARGE_SLOT].free_chunks == 2, color.red('test_pmemory [stats.free_chunks after trim] error'))
+
+capacity, err = system.pmemory_set_max_free_chunks(1024 * 1024, 2)
+assert(err == ERRNO.UV_EINVAL, color.red('test_pmemory [system.pmemory_set_max_free_chunks(huge, n)] error'))
+
+system.pmemory_set_max_free_chunks(8000, max_free_chunks)
+
+print(color.green('test_pmemory ok'))
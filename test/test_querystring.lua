@@ -0,0 +1,62 @@
+local color = require('color')
+local fs = require('fs')
+local querystring = require('querystring')
+local ReadBuffer = require('read_buffer')
+
+local urldecode = querystring.urldecode
+local urlencode = querystring.urlencode
+local parse = querystring.parse
+
+assert(urldecode('a+b%20c%2Fd') == 'a b c/d', color.red('test_querystring [urldecode] error'))
+assert(urldecode('plain') == 'plain', color.red('test_querystring [urldecode] error'))
+assert(urldecode('100%') == '100%' and urldecode('%zz%4') == '%zz%4', color.red('test_querystring [urldecode] invalid escape error'))
+assert(urldecode('a%0D%0Ab') == 'a\nb', color.red('test_querystring [urldecode] CRLF error'))
+assert(urldecode('%E4%BD%A0%e5%a5%bd') == '你好', color.red('test_querystring [urldecode] utf8 error'))
+
+assert(urlencode('abc-_.~123') == 'abc-_.~123', color.red('test_querystring [urlencode] error'))
+assert(urlencode('a b&c=/') == 'a%20b%26c%3D%2F', color.red('test_querystring [urlencode] error'))
+assert(urlencode('a\nb') == 'a%0D%0Ab', color.red('test_querystring [urlencode] LF error'))
+local bytes = {}
+for i = 0, 255 do
+  bytes[#bytes + 1] = string.char(i)
+end
+bytes = table.concat(bytes)
+assert(urldecode(urlencode(bytes)) == bytes:gsub('\r\n', '\n'), color.red('test_querystring [urlencode] roundtrip error'))
+
+local args = parse('a=1&b=x+y&c=%26%3D&&d&e=&a=2&a=3&f==g')
+assert(args.b == 'x y' and args.c == '&=' and args.d == '' and args.e == '' and args.f == '=g', color.red('test_querystring [parse] error'))
+assert(type(args.a) == 'table' and #args.a == 3 and args.a[1] == '1' and args.a[3] == '3', color.red('test_querystring [parse] repeated key error'))
+assert(args[''] == nil, color.red('test_querystring [parse] empty pair error'))
+
+args = parse('a=1&a=2')
+assert(args.a[1] == '1' and args.a[2] == '2', color.red('test_querystring [parse] repeated key error'))
+args = parse('%61=%31&a=2')
+assert(args.a[1] == '1' and args.a[2] == '2', color.red('test_querystring [parse] escaped key error'))
+
+args = parse('a:1;b:2', ';', ':')
+assert(args.a == '1' and args.b == '2', color.red('test_querystring [parse(sep, eq)] error'))
+args = parse('a=1&b=2&c=3', nil, nil, 2)
+assert(args.b == '2' and args.c == nil, color.red('test_querystring [parse(max)] error'))
+assert(next(parse(nil)) == nil and next(parse('')) == nil, color.red('test_querystring [parse(nil)] error'))
+
+local long = string.rep('%41', 5000)
+assert(parse('k=' .. long).k == string.rep('A', 5000), color.red('test_querystring [parse] long value error'))
+
+local query = querystring.stringify({ q = 'a b', t = { '1', '2' } })
+args = parse(query)
+assert(args.q == 'a b' and args.t[1] == '1' and args.t[2] == '2', color.red('test_querystring [stringify] error'))
+
+-- a slice of a read buffer is parsed in place
+local file = './test_querystring.txt'
+assert(fs.writeFile(file, 'x=1&y=%7E\n') == 10, color.red('test_querystring [fs.writeFile(path, data)] error'))
+local fd = fs.open(file, 'r')
+local buffer = ReadBuffer.new(64)
+fs.read(fd, buffer)
+fs.close(fd)
+fs.unlink(file)
+local slice = buffer:readline_slice()
+args = parse(slice)
+assert(args.x == '1' and args.y == '~', color.red('test_querystring [parse(slice)] error'))
+assert(urldecode(slice) == 'x=1&y=~', color.red('test_querystring [urldecode(slice)] error'))
+
+print(color.green('test_querystring ok'))
@@ -0,0 +1,78 @@
+local color = require('color')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+
+local MAX_PORT = 18009
+local BATCH_PORT = 18010
+
+local function listen(port, max_connections, accept_batch)
+  local server = tcp_native.new(true)
+  assert(server:bind(port, '127.0.0.1') == 0, color.red('test_tcp_accept [server:bind(port, host)] error'))
+  local err = server:listen(function(socket)
+    socket:set_read_buffer(ReadBuffer.new(1024))
+    socket:read()
+    socket:close()
+  end, 511, max_connections, accept_batch)
+  assert(err == 0, color.red('test_tcp_accept [server:listen(onconnect, backlog, max, batch)] error'))
+  return server
+end
+
+local function connect(port)
+  local socket = tcp_native.new()
+  assert(socket:connect(port, '127.0.0.1') == 0, color.red('test_tcp_accept [socket:connect(port, host)] error'))
+  return socket
+end
+
+-- max connections: accepting pauses, the backlog keeps the others
+local server = listen(MAX_PORT, 2, 64)
+local clients = {}
+for i = 1, 4 do
+  clients[i] = connect(MAX_PORT)
+end
+sleep(50)
+
+local stats = server:accept_stats()
+assert(stats.accepted == 2 and stats.connections == 2, color.red('test_tcp_accept [max_connections] error'))
+assert(stats.paused and stats.pauses >= 1, color.red('test_tcp_accept [stats.paused] error'))
+
+clients[1]:close()
+sleep(50)
+stats = server:accept_stats()
+assert(stats.accepted == 3 and stats.connections == 2, color.red('test_tcp_accept [resume after close] error'))
+
+for i = 2, 4 do
+  clients[i]:close()
+end
+sleep(50)
+stats = server:accept_stats()
+assert(stats.accepted == 4 and stats.connections == 0, color.red('test_tcp_accept [connections after close] error'))
+assert(not stats.paused and stats.errors == 0, color.red('test_tcp_accept [stats.errors] error'))
+server:close()
+
+-- batch: one connection per loop iteration, the rest is deferred
+server = listen(BATCH_PORT, 1024, 1)
+local connected = 0
+clients = {}
+-- the connecting coroutines must stay referenced while they yield
+local connectors = {}
+for i = 1, 8 do
+  connectors[i] = coroutine.create(function()
+    clients[i] = connect(BATCH_PORT)
+    connected = connected + 1
+  end)
+  coroutine.resume(connectors[i])
+end
+while connected < 8 do sleep(10) end
+sleep(50)
+
+stats = server:accept_stats()
+assert(stats.accepted == 8 and stats.connections == 8, color.red('test_tcp_accept [accept_batch] error'))
+assert(stats.deferrals >= 1, color.red('test_tcp_accept [stats.deferrals] error'))
+assert(stats.rate >= 0, color.red('test_tcp_accept [stats.rate] error'))
+
+for i = 1, 8 do
+  clients[i]:close()
+end
+server:close()
+
+print(color.green('test_tcp_accept ok'))
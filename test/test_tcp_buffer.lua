@@ -0,0 +1,100 @@
+local color = require('color')
+local tcp = require('tcp')
+local http = require('http')
+local ERRNO = require('errno')
+local ReadBuffer = require('read_buffer')
+
+local PORT = 18016
+local HOST = '127.0.0.1'
+
+local long_line = string.rep('x', 5000)
+local data = string.rep('0123456789', 600)
+local results = {}
+
+-- read buffers start with 1KB, grow up to 8KB and are released while the connection waits
+local server = tcp.createServer(PORT, function(socket)
+  local buffer = socket.read_buffer
+  results.buffer = buffer
+
+  results.hello = socket:readline()
+  results.small = buffer:capacity()
+
+  results.long_line = socket:readline()
+  results.line_capacity = buffer:capacity()
+
+  results.data = socket:read(#data)
+  results.read_capacity = buffer:capacity()
+
+  results.idle = true
+  results.after_idle = socket:readline()
+  results.after_idle_capacity = buffer:capacity()
+
+  local line, err = socket:readline()
+  results.exceed = err
+
+  socket:close()
+  results.done = true
+end, { host = HOST, bufferSize = 1024, maxBufferSize = 8192 })
+
+local function wait(name)
+  while not results[name] do
+    sleep(10)
+  end
+end
+
+local client = tcp.connect(PORT, HOST)
+assert(client, color.red('test_tcp_buffer [tcp.connect(port, host)] error'))
+
+client:write('hello\n')
+wait('small')
+assert(results.hello == 'hello' and results.small == 1024, color.red('test_tcp_buffer [initial size] error'))
+
+-- a line longer than the buffer grows it, the line is intact
+client:write(long_line .. '\n')
+wait('line_capacity')
+assert(results.long_line == long_line, color.red('test_tcp_buffer [readline()] error'))
+assert(results.line_capacity > 1024 and results.line_capacity <= 8192, color.red('test_tcp_buffer [readline() grow] error'))
+
+client:write(data)
+wait('read_capacity')
+assert(results.data == data and results.read_capacity >= #data, color.red('test_tcp_buffer [read(n) grow] error'))
+
+-- the empty buffer has gone back to pmemory while the server waits for more data
+wait('idle')
+sleep(20)
+assert(results.buffer:capacity() == 0, color.red('test_tcp_buffer [release] error'))
+
+-- the next fill starts small again
+client:write('after idle\n')
+wait('after_idle_capacity')
+assert(results.after_idle == 'after idle' and results.after_idle_capacity == 1024, color.red('test_tcp_buffer [refill] error'))
+
+-- a line longer than maxBufferSize is refused
+client:write(string.rep('y', 9000) .. '\n')
+wait('done')
+assert(results.exceed == ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY, color.red('test_tcp_buffer [maxBufferSize] error'))
+client:close()
+server:close()
+
+assert(not pcall(ReadBuffer.new, 1024, 512), color.red('test_tcp_buffer [ReadBuffer.new(size, max_size)] error'))
+local fixed = ReadBuffer.new(1024)
+assert(not pcall(fixed.read, fixed, 2000), color.red('test_tcp_buffer [fixed buffer] error'))
+
+-- a request head larger than the initial buffer is parsed after the buffer grows
+local big = string.rep('v', 4000)
+local http_server = http.createServer(PORT + 1, function(request, response)
+  response:send(200, nil, request:header('x-big') == big and 'big' or 'small')
+end, { host = HOST, bufferSize = 1024, maxBufferSize = 16384 })
+
+local response, err = http.request({
+  host = HOST,
+  port = PORT + 1,
+  path = '/',
+  headers = { ['X-Big'] = big }
+})
+assert(response and err == 0 and response.status == 200, color.red('test_tcp_buffer [http head] error'))
+assert(response:readBody() == 'big', color.red('test_tcp_buffer [http head] error'))
+
+http.globalAgent:close()
+http_server:close()
+print(color.green('test_tcp_buffer ok'))
@@ -0,0 +1,139 @@
+local color = require('color')
+local fs = require('fs')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+
+local PORT = 18014
+
+-- the server keeps everything it receives until EOF
+local received = {}
+local server = tcp_native.new(true)
+assert(server:bind(PORT, '127.0.0.1') == 0, color.red('test_tcp_cork [server:bind(port, host)] error'))
+assert(server:listen(function(socket)
+  local buffer = ReadBuffer.new(65536)
+  socket:set_read_buffer(buffer)
+  local parts = {}
+  while true do
+    local n = socket:read()
+    if n < 0 then break end
+    parts[#parts + 1] = buffer:read(-1)
+  end
+  received[#received + 1] = table.concat(parts)
+  socket:close()
+end, 511) == 0, color.red('test_tcp_cork [server:listen(onconnect, backlog)] error'))
+
+local function connect()
+  local socket = tcp_native.new()
+  assert(socket:connect(PORT, '127.0.0.1') == 0, color.red('test_tcp_cork [socket:connect(port, host)] error'))
+  return socket
+end
+
+local function wait(n)
+  while #received < n do
+    sleep(10)
+  end
+  return received[n]
+end
+
+-- small writes are copied one after another into one iovec entry
+local client = connect()
+assert(client:cork() == 0, color.red('test_tcp_cork [socket:cork()] error'))
+local expected = {}
+local function write(data)
+  local bytes, err = client:write_async(data)
+  assert(err == 0, color.red('test_tcp_cork [socket:write_async(data)] error'))
+  expected[#expected + 1] = type(data) == 'table' and table.concat(data) or data
+  return bytes
+end
+
+assert(write('HTTP/1.1 200 OK\r\n') == 17, color.red('test_tcp_cork [socket:write_async(data)] bytes error'))
+write('Content-Length: 5\r\n\r\n')
+write('hello')
+local bytes, pieces, flushes = client:cork_stats()
+assert(bytes == 43 and pieces == 1 and flushes == 0, color.red('test_tcp_cork [socket:cork_stats()] coalesce error'))
+
+-- the queue goes out when the loop iteration ends
+sleep(10)
+bytes, pieces, flushes = client:cork_stats()
+assert(bytes == 0 and pieces == 0 and flushes == 1, color.red('test_tcp_cork [uv_check flush] error'))
+
+-- large strings are referenced, buffers are copied at once since they are reused
+local large = string.rep('x', 100000)
+local buffer = ReadBuffer.new(64)
+assert(fs.writeFile('./test_tcp_cork.txt', 'from a buffer') == 13, color.red('test_tcp_cork [fs.writeFile(path, data)] error'))
+local fd = fs.open('./test_tcp_cork.txt', 'r')
+fs.read(fd, buffer)
+fs.close(fd)
+fs.unlink('./test_tcp_cork.txt')
+
+write('a')
+write(large)
+write({ 'b', 'c' })
+client:write_async(buffer)
+expected[#expected + 1] = 'from a buffer'
+buffer:discard(-1)
+bytes, pieces = client:cork_stats()
+assert(bytes == 100016 and pieces == 3, color.red('test_tcp_cork [socket:cork_stats()] reference error'))
+
+-- socket:write() keeps the order of the corked bytes
+client:write('|sync|')
+expected[#expected + 1] = '|sync|'
+bytes, pieces, flushes = client:cork_stats()
+assert(bytes == 0 and flushes == 2, color.red('test_tcp_cork [socket:write(data)] flush error'))
+
+-- more than the kernel takes at once, the rest is handed to uv_write
+for i = 1, 64 do
+  write(large)
+  write(tostring(i))
+end
+assert(client:flush() == 0, color.red('test_tcp_cork [socket:flush()] error'))
+
+-- turning cork off flushes
+write('last')
+assert(client:cork(false) == 0, color.red('test_tcp_cork [socket:cork(false)] error'))
+client:write_async('uncorked')
+expected[#expected + 1] = 'uncorked'
+client:shutdown()
+assert(wait(1) == table.concat(expected), color.red('test_tcp_cork [data] error'))
+client:close()
+
+-- close sends what the kernel takes at once
+client = connect()
+client:cork()
+client:write_async('bye')
+client:close()
+assert(wait(2) == 'bye', color.red('test_tcp_cork [socket:close()] error'))
+
+server:close()
+
+-- bytes corked by a coroutine a timer resumed go out before the loop waits for I/O
+local echo = tcp_native.new(true)
+assert(echo:bind(PORT + 7, '127.0.0.1') == 0, color.red('test_tcp_cork [echo:bind(port, host)] error'))
+echo:listen(function(socket)
+  local buffer = ReadBuffer.new(64)
+  socket:set_read_buffer(buffer)
+  while socket:read() > 0 do
+    socket:write(buffer:read(-1))
+  end
+  socket:close()
+end, 511)
+
+client = tcp_native.new()
+assert(client:connect(PORT + 7, '127.0.0.1') == 0, color.red('test_tcp_cork [socket:connect(port, host)] error'))
+client:cork()
+local reply = ReadBuffer.new(64)
+client:set_read_buffer(reply)
+sleep(20)
+client:write_async('ping')
+assert(client:read() == 4 and reply:read(-1) == 'ping', color.red('test_tcp_cork [timer resumed flush] error'))
+
+-- a bad piece of a table queues nothing
+client:write_async('a')
+assert(not pcall(client.write_async, client, { 'b', 'c', 1 }), color.red('test_tcp_cork [socket:write_async(table)] error'))
+bytes, pieces = client:cork_stats()
+assert(bytes == 1 and pieces == 1, color.red('test_tcp_cork [socket:write_async(table)] rollback error'))
+assert(client:read() == 1 and reply:read(-1) == 'a', color.red('test_tcp_cork [socket:write_async(table)] flush error'))
+
+client:close()
+echo:close()
+print(color.green('test_tcp_cork ok'))
@@ -0,0 +1,166 @@
+local color = require('color')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local ERRNO = require('errno')
+
+local SINK_PORT = 18006
+local RELAY_PORT = 18007
+local HOLD_PORT = 18022
+local ECHO_PORT = 18023
+local DUPLEX_PORT = 18024
+local SIZE = 1024 * 1024
+
+local chunk = string.rep('0123456789abcdef', 1024)
+local stream = string.rep(chunk, SIZE / #chunk)
+
+local function listen(port, onconnect)
+  local server = tcp_native.new(true)
+  assert(server:bind(port, '127.0.0.1') == 0, color.red('test_tcp_pipe [server:bind(port, host)] error'))
+  assert(server:listen(onconnect, 511) == 0, color.red('test_tcp_pipe [server:listen(onconnect, backlog)] error'))
+  return server
+end
+
+local function connect(port)
+  local socket = tcp_native.new()
+  assert(socket:connect(port, '127.0.0.1') == 0, color.red('test_tcp_pipe [socket:connect(port, host)] error'))
+  return socket
+end
+
+-- sink counts the bytes it receives until EOF
+local received = 0
+local sink_done = false
+local sink = listen(SINK_PORT, function(socket)
+  local buffer = ReadBuffer.new(65536)
+  socket:set_read_buffer(buffer)
+  while true do
+    local n = socket:read()
+    if n < 0 then break end
+    local data = buffer:read(-1)
+    assert(data == stream:sub(received + 1, received + #data), color.red('test_tcp_pipe [sink data] error'))
+    received = received + n
+  end
+  sink_done = true
+  socket:close()
+end)
+
+-- relay moves bytes from the client to the sink inside C
+local results = {}
+local relay = listen(RELAY_PORT, function(socket)
+  local upstream = connect(SINK_PORT)
+  local limit = #results == 0 and 0 or 1000
+  local timeout = #results == 2 and 50 or 0
+  local bytes, err = socket:pipe(upstream, limit, timeout)
+  results[#results + 1] = { bytes = bytes, err = err }
+  upstream:close()
+  socket:close()
+end)
+
+-- EOF
+local client = connect(RELAY_PORT)
+for i = 1, SIZE / #chunk do
+  client:write(chunk)
+end
+client:shutdown()
+while not sink_done do sleep(10) end
+client:close()
+
+assert(results[1].bytes == SIZE and results[1].err == ERRNO.UV_EOF, color.red('test_tcp_pipe [socket:pipe(other) EOF] error'))
+assert(received == SIZE, color.red('test_tcp_pipe [socket:pipe(other) data] error'))
+
+-- limit
+sink_done = false
+received = 0
+client = connect(RELAY_PORT)
+client:write(chunk)
+while not sink_done do sleep(10) end
+assert(results[2].bytes == 1000 and results[2].err == 0, color.red('test_tcp_pipe [socket:pipe(other, limit)] error'))
+assert(received == 1000, color.red('test_tcp_pipe [socket:pipe(other, limit) data] error'))
+client:close()
+
+-- idle timeout
+sink_done = false
+client = connect(RELAY_PORT)
+while not sink_done do sleep(10) end
+assert(results[3].bytes == 0 and results[3].err == ERRNO.UV_ETIMEDOUT, color.red('test_tcp_pipe [socket:pipe(other, limit, timeout)] error'))
+client:close()
+
+relay:close()
+sink:close()
+
+-- closing either side ends the pipe with UV_ECANCELED, the peer of the closed
+-- side sees EOF once the pipe has let go of the socket
+local eofs = 0
+local hold = listen(HOLD_PORT, function(socket)
+  socket:set_read_buffer(ReadBuffer.new(1024))
+  while socket:read() >= 0 do end
+  eofs = eofs + 1
+  socket:close()
+end)
+
+local function close_mid_pipe(close_src)
+  local src = connect(HOLD_PORT)
+  local dst = connect(HOLD_PORT)
+  local piped
+  coroutine.wrap(function()
+    local bytes, err = src:pipe(dst)
+    piped = err
+  end)()
+
+  eofs = 0
+  if close_src then src:close() else dst:close() end
+  assert(piped == ERRNO.UV_ECANCELED, color.red('test_tcp_pipe [socket:close() mid pipe] error'))
+  while eofs < 1 do sleep(10) end
+  if close_src then dst:close() else src:close() end
+  while eofs < 2 do sleep(10) end
+end
+
+close_mid_pipe(true)
+close_mid_pipe(false)
+hold:close()
+
+-- a relay pipes both ways between the client and an echo upstream
+local echo = listen(ECHO_PORT, function(socket)
+  local buffer = ReadBuffer.new(65536)
+  socket:set_read_buffer(buffer)
+  while socket:read() >= 0 do
+    socket:write(buffer:read(-1))
+  end
+  socket:close()
+end)
+
+local up, down
+local duplex = listen(DUPLEX_PORT, function(socket)
+  local upstream = connect(ECHO_PORT)
+  local up_done = false
+  coroutine.wrap(function()
+    up = { upstream:pipe(socket) }
+    up_done = true
+  end)()
+  down = { socket:pipe(upstream) }
+  upstream:shutdown()
+  while not up_done do sleep(10) end
+  upstream:close()
+  socket:close()
+end)
+
+client = connect(DUPLEX_PORT)
+local reply = ReadBuffer.new(65536)
+client:set_read_buffer(reply)
+local echoed = {}
+for i = 1, 16 do
+  client:write(chunk)
+end
+client:shutdown()
+while client:read() >= 0 do
+  echoed[#echoed + 1] = reply:read(-1)
+end
+client:close()
+
+local sent = string.rep(chunk, 16)
+assert(table.concat(echoed) == sent, color.red('test_tcp_pipe [duplex data] error'))
+assert(down[1] == #sent and down[2] == ERRNO.UV_EOF, color.red('test_tcp_pipe [duplex down] error'))
+assert(up[1] == #sent and up[2] == ERRNO.UV_EOF, color.red('test_tcp_pipe [duplex up] error'))
+duplex:close()
+echo:close()
+
+print(color.green('test_tcp_pipe ok'))
@@ -0,0 +1,134 @@
+local color = require('color')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local ERRNO = require('errno')
+
+local PORT = 18015
+local HIGH = 256 * 1024
+local LOW = 64 * 1024
+local chunk = string.rep('0123456789abcdef', 4096)
+local COUNT = 256
+
+-- the first and the third connections are read after a while, the others never
+local READ = { [1] = true, [3] = true }
+local connections = 0
+local received = 0
+local done = false
+local server = tcp_native.new(true)
+assert(server:bind(PORT, '127.0.0.1') == 0, color.red('test_tcp_watermark [server:bind(port, host)] error'))
+assert(server:listen(function(socket)
+  connections = connections + 1
+  if not READ[connections] then
+    while not done do
+      sleep(10)
+    end
+    socket:close()
+    return
+  end
+
+  sleep(200)
+  local buffer = ReadBuffer.new(65536)
+  socket:set_read_buffer(buffer)
+  while true do
+    local n = socket:read()
+    if n < 0 then break end
+    local data = buffer:read(-1)
+    local pos = received % #chunk
+    assert(data == string.rep(chunk, 2):sub(pos + 1, pos + #data), color.red('test_tcp_watermark [data] error'))
+    received = received + n
+  end
+  socket:close()
+end, 511) == 0, color.red('test_tcp_watermark [server:listen(onconnect, backlog)] error'))
+
+local function connect()
+  local socket = tcp_native.new()
+  assert(socket:connect(PORT, '127.0.0.1') == 0, color.red('test_tcp_watermark [socket:connect(port, host)] error'))
+  return socket
+end
+
+-- write_async stalls above the high watermark until the reader drains the queue to the low one
+local client = connect()
+assert(client:set_write_watermarks(HIGH, LOW) == 0, color.red('test_tcp_watermark [socket:set_write_watermarks(high, low)] error'))
+for i = 1, COUNT do
+  local bytes, err = client:write_async(chunk)
+  assert(bytes == #chunk and err == 0, color.red('test_tcp_watermark [socket:write_async(data)] error'))
+  assert(client:write_stats().queued <= HIGH + #chunk, color.red('test_tcp_watermark [high watermark] error'))
+end
+
+local stats = client:write_stats()
+assert(stats.stalls > 0 and stats.stall_time >= 100, color.red('test_tcp_watermark [socket:write_stats()] stall error'))
+assert(stats.queued_peak > HIGH and stats.queued_peak <= HIGH + #chunk, color.red('test_tcp_watermark [socket:write_stats()] peak error'))
+assert(stats.high == HIGH and stats.low == LOW, color.red('test_tcp_watermark [socket:write_stats()] error'))
+client:shutdown()
+client:close()
+while received < COUNT * #chunk do
+  sleep(10)
+end
+
+-- nowait: nothing is queued above the high watermark
+client = connect()
+client:set_write_watermarks(HIGH, LOW, true)
+local queued = 0
+local err
+for i = 1, COUNT do
+  local bytes
+  bytes, err = client:write_async(chunk)
+  if err == ERRNO.UV_EAGAIN then
+    assert(bytes == 0, color.red('test_tcp_watermark [nowait] error'))
+    break
+  end
+  queued = queued + bytes
+end
+stats = client:write_stats()
+assert(err == ERRNO.UV_EAGAIN and stats.eagains == 1 and stats.stalls == 0, color.red('test_tcp_watermark [nowait] error'))
+assert(stats.queued > HIGH and stats.queued <= HIGH + #chunk, color.red('test_tcp_watermark [nowait] queued error'))
+
+-- nowait refuses data until the queue drains to the low watermark, not just below high
+client:set_write_watermarks(stats.queued + 1, LOW, true)
+local bytes
+bytes, err = client:write_async('x')
+assert(bytes == 0 and err == ERRNO.UV_EAGAIN, color.red('test_tcp_watermark [nowait hysteresis] error'))
+client:close()
+
+-- concurrent writers: each of them stalls above the high watermark, they go on in
+-- order, each one queues at most one chunk before it stalls
+client = connect()
+client:set_write_watermarks(HIGH, LOW)
+local finished = 0
+for _ = 1, 2 do
+  coroutine.wrap(function()
+    for i = 1, COUNT / 2 do
+      local bytes, err = client:write_async(chunk)
+      assert(bytes == #chunk and err == 0, color.red('test_tcp_watermark [concurrent writers] error'))
+      assert(client:write_stats().queued <= HIGH + 2 * #chunk, color.red('test_tcp_watermark [concurrent high watermark] error'))
+    end
+    finished = finished + 1
+  end)()
+end
+while finished < 2 do
+  sleep(10)
+end
+stats = client:write_stats()
+assert(stats.queued_peak <= HIGH + 2 * #chunk and stats.stalls >= 2, color.red('test_tcp_watermark [concurrent writers] stall error'))
+client:shutdown()
+client:close()
+while received < 2 * COUNT * #chunk do
+  sleep(10)
+end
+
+-- the socket timeout ends a stall
+client = connect()
+client:set_timeout(50)
+client:set_write_watermarks(HIGH)
+for i = 1, COUNT do
+  local bytes
+  bytes, err = client:write_async(chunk)
+  if err ~= 0 then break end
+end
+assert(err == ERRNO.UV_ETIMEDOUT, color.red('test_tcp_watermark [stall timeout] error'))
+assert(client:write_stats().low == HIGH / 2, color.red('test_tcp_watermark [default low watermark] error'))
+client:close()
+
+done = true
+server:close()
+print(color.green('test_tcp_watermark ok'))
@@ -0,0 +1,30 @@
+local color = require('color')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local thread = require('thread')
+
+local PORT = 18008
+
+assert(thread.id == 0, color.red('test_thread [thread.id] error'))
+
+local id = thread.spawn('./thread_worker.lua')
+assert(id > 0, color.red('test_thread [thread.spawn(file)] error'))
+
+local socket
+for i = 1, 100 do
+  socket = tcp_native.new()
+  if socket:connect(PORT, '127.0.0.1') == 0 then break end
+  socket:close()
+  socket = nil
+  sleep(10)
+end
+assert(socket, color.red('test_thread [connect to thread] error'))
+
+local buffer = ReadBuffer.new(1024)
+socket:set_read_buffer(buffer)
+socket:write('hello')
+assert(socket:read() > 0, color.red('test_thread [read from thread] error'))
+assert(buffer:read(-1) == 'hello from thread ' .. id, color.red('test_thread [thread data] error'))
+socket:close()
+
+print(color.green('test_thread ok'))
@@ -0,0 +1,56 @@
+local color = require('color')
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local ERRNO = require('errno')
+
+local PORT = 18004
+
+local server = tcp_native.new(true)
+assert(server:bind(PORT, '127.0.0.1') == 0, color.red('test_timer [server:bind(port, host)] error'))
+
+local err = server:listen(function(client)
+  -- keep quiet to let the client time out, then answer once
+  sleep(1200)
+  client:write('pong')
+  sleep(100)
+  client:close()
+end, 511)
+assert(err == 0, color.red('test_timer [server:listen(onconnect, backlog)] error'))
+
+local socket = tcp_native.new()
+err = socket:connect(PORT, '127.0.0.1')
+assert(err == 0, color.red('test_timer [socket:connect(port, host)] error'))
+local read_buffer = ReadBuffer.new(1024)
+socket:set_read_buffer(read_buffer)
+
+local function read_timeout(timeout, precise)
+  socket:set_timeout(timeout, precise)
+  local start = system.hrtime()
+  local ret = socket:read()
+  local cost = (system.hrtime() - start) / 1000000
+  return ret, cost
+end
+
+-- timer wheel
+local ret, cost = read_timeout(50)
+assert(ret == ERRNO.UV_ETIMEDOUT, color.red('test_timer [wheel timeout] error'))
+assert(cost >= 49 and cost < 200, color.red('test_timer [wheel timeout precision] error'))
+
+-- per operation uv_timer_t
+ret, cost = read_timeout(50, true)
+assert(ret == ERRNO.UV_ETIMEDOUT, color.red('test_timer [precise timeout] error'))
+assert(cost >= 49 and cost < 200, color.red('test_timer [precise timeout precision] error'))
+
+-- beyond the first level of the wheel, cascaded before it expires
+ret, cost = read_timeout(700)
+assert(ret == ERRNO.UV_ETIMEDOUT, color.red('test_timer [wheel cascade timeout] error'))
+assert(cost >= 699 and cost < 900, color.red('test_timer [wheel cascade timeout precision] error'))
+
+-- data arrives before the deadline, the event is disarmed
+ret = read_timeout(5000)
+assert(ret == 4, color.red('test_timer [read before timeout] error'))
+
+socket:close()
+server:close()
+
+print(color.green('test_timer ok'))
@@ -0,0 +1,97 @@
+local color = require('color')
+local udp = require('udp')
+local ERRNO = require('errno')
+
+local PORT = 18019
+local HOST = '127.0.0.1'
+
+-- one datagram per recv, the sender is returned with it
+local server = udp.createSocket()
+assert(server:bind(PORT, HOST) == 0, color.red('test_udp [socket:bind(port, host)] error'))
+local client = udp.createSocket()
+
+local bytes, err = client:send('hello', PORT, HOST)
+assert(bytes == 5 and err == 0, color.red('test_udp [socket:send(data, port, host)] error'))
+local data, n, host, port = server:recv()
+assert(data == 'hello' and n == 5 and host == HOST, color.red('test_udp [socket:recv()] error'))
+assert(port == client:localAddress().port, color.red('test_udp [socket:recv()] sender error'))
+
+server:send({ 'wor', 'ld' }, port, host)
+data = client:recv()
+assert(data == 'world', color.red('test_udp [socket:send(table, port, host)] error'))
+
+-- recv times out, close cancels the recv of another coroutine
+server:setTimeout(20)
+data, err = server:recv()
+assert(data == nil and err == ERRNO.UV_ETIMEDOUT, color.red('test_udp [socket:setTimeout(ms)] error'))
+
+local cancelled
+coroutine.wrap(function()
+  local data, err = client:recv()
+  cancelled = err
+end)()
+client:close()
+assert(cancelled == ERRNO.UV_ECANCELED, color.red('test_udp [socket:close()] error'))
+server:close()
+
+-- batched sockets: the sends of one loop iteration go out with one sendmmsg,
+-- the receiver drains them with one recvmmsg
+local receiver = udp.createSocket({ batch = 16, datagramSize = 64 })
+assert(receiver:bind(PORT + 1, HOST) == 0, color.red('test_udp [batch bind] error'))
+local sender = udp.createSocket({ batch = 16 })
+
+local received = {}
+local done = false
+coroutine.wrap(function()
+  while #received < 11 do
+    local data = receiver:recv()
+    received[#received + 1] = data
+  end
+  done = true
+end)()
+
+for i = 1, 10 do
+  assert(sender:send('datagram ' .. i, PORT + 1, HOST) == #('datagram ' .. i), color.red('test_udp [batch send] error'))
+end
+assert(sender:stats().queued == 10, color.red('test_udp [batch queue] error'))
+
+-- truncated to datagramSize
+sender:send(string.rep('x', 100), PORT + 1, HOST)
+
+while not done do
+  sleep(10)
+end
+
+for i = 1, 10 do
+  assert(received[i] == 'datagram ' .. i, color.red('test_udp [batch recv] error'))
+end
+assert(received[11] == string.rep('x', 64), color.red('test_udp [datagramSize] error'))
+
+local send_stats = sender:stats()
+assert(send_stats.sent == 11 and send_stats.queued == 0, color.red('test_udp [batch stats] error'))
+assert(send_stats.send_calls < send_stats.sent, color.red('test_udp [sendmmsg] error'))
+local recv_stats = receiver:stats()
+assert(recv_stats.received == 11 and recv_stats.truncated == 1, color.red('test_udp [batch stats] error'))
+assert(recv_stats.recv_calls < recv_stats.received, color.red('test_udp [recvmmsg] error'))
+
+-- flush sends the queue before the loop iteration ends
+sender:send('flushed', PORT + 1, HOST)
+assert(sender:flush() == 0 and sender:stats().queued == 0, color.red('test_udp [socket:flush()] error'))
+data = receiver:recv()
+assert(data == 'flushed', color.red('test_udp [socket:flush()] error'))
+
+-- datagrams queued by a coroutine a timer resumed go out before the loop waits for I/O
+coroutine.wrap(function()
+  local data, n, host, port = receiver:recv()
+  receiver:send(data, port, host)
+end)()
+sleep(20)
+sender:send('ping', PORT + 1, HOST)
+data = sender:recv()
+assert(data == 'ping', color.red('test_udp [timer resumed flush] error'))
+
+sender:close()
+receiver:close()
+
+assert(not pcall(udp.createSocket, { batch = 100 }), color.red('test_udp [batch] error'))
+print(color.green('test_udp ok'))
@@ -0,0 +1,207 @@
+local color = require('color')
+local fs = require('fs')
+local zlib = require('zlib')
+local ReadBuffer = require('read_buffer')
+local WriteBuffer = require('write_buffer')
+local ERRNO = require('errno')
+
+local COMPRESSED = './test_zlib.gz'
+local PLAIN = './test_zlib.txt'
+
+local items = {}
+for i = 1, 2000 do
+  items[i] = '{"id":' .. i .. ',"name":"user' .. i .. '","active":' .. tostring(i % 3 == 0) .. '}'
+end
+local json = '[' .. table.concat(items, ',') .. ']'
+
+-- the output buffer is smaller than the data, it is drained whenever it is full
+local output = WriteBuffer.new(4096)
+
+local function drain(fd)
+  fs.write(fd, output)
+  output:discard(-1)
+end
+
+-- feed a string piece by piece, the rest of a piece is passed again when the output is full
+local function deflate_string(stream, data, piece, path)
+  local fd = fs.open(path, 'w')
+  local pos = 1
+  while true do
+    local rest = data:sub(pos, pos + piece - 1)
+    pos = pos + #rest
+    local flush = pos > #data and zlib.FINISH or zlib.NO_FLUSH
+
+    while true do
+      local produced, consumed, err = stream:write(rest, output, flush)
+      assert(err >= 0 or err == ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY, color.red('test_zlib [zlib_stream:write()] deflate error'))
+      drain(fd)
+      rest = rest:sub(consumed + 1)
+      if err == zlib.STREAM_END or (err == 0 and flush ~= zlib.FINISH) then break end
+    end
+
+    if flush == zlib.FINISH then break end
+  end
+  fs.close(fd)
+end
+
+-- the compressed file is read into a ReadBuffer, the stream consumes it in place
+local function inflate_file(stream, path, out_path)
+  local fd = fs.open(path, 'r')
+  local out = fs.open(out_path, 'w')
+  local buffer = ReadBuffer.new(1024)
+  local last = 0
+
+  while last ~= zlib.STREAM_END do
+    local n = fs.read(fd, buffer)
+    if n <= 0 then break end
+
+    while true do
+      local produced, consumed, err = stream:write(buffer, output)
+      last = err
+      if err < 0 and err ~= ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY then
+        fs.close(fd)
+        fs.close(out)
+        return err
+      end
+      drain(out)
+      if err ~= ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY then break end
+    end
+  end
+
+  fs.close(fd)
+  fs.close(out)
+  return last
+end
+
+local function roundtrip(deflate, inflate, name)
+  deflate_string(deflate, json, 10000, COMPRESSED)
+  local compressed = fs.readFile(COMPRESSED)
+  assert(#compressed > 0 and #compressed < #json / 5, color.red('test_zlib [' .. name .. '] ratio error'))
+
+  local err = inflate_file(inflate, COMPRESSED, PLAIN)
+  assert(err == zlib.STREAM_END, color.red('test_zlib [' .. name .. '] inflate error'))
+  assert(fs.readFile(PLAIN) == json, color.red('test_zlib [' .. name .. '] roundtrip error'))
+  return compressed
+end
+
+-- zlib format
+local deflate = zlib.new_deflate()
+local inflate = zlib.new_inflate()
+local compressed = roundtrip(deflate, inflate, 'zlib')
+local total_in, total_out = deflate:totals()
+assert(total_in == #json and total_out == #compressed, color.red('test_zlib [zlib_stream:totals()] error'))
+
+-- the stream ends once, reset starts a new one with the same settings
+local produced, consumed, err = deflate:write('more', output, zlib.FINISH)
+assert(err == zlib.STREAM_END and produced == 0 and consumed == 0, color.red('test_zlib [stream end] error'))
+assert(deflate:reset() == 0 and inflate:reset() == 0, color.red('test_zlib [zlib_stream:reset()] error'))
+assert(roundtrip(deflate, inflate, 'reset') == compressed, color.red('test_zlib [zlib_stream:reset()] error'))
+
+-- gzip format, level, window size and memLevel, inflate detects the format by its header
+local gzip = roundtrip(zlib.new_deflate(zlib.BEST_COMPRESSION, 31, 9), zlib.new_inflate(47), 'gzip')
+assert(gzip:byte(1) == 0x1f and gzip:byte(2) == 0x8b, color.red('test_zlib [gzip header] error'))
+
+-- raw deflate, small window
+roundtrip(zlib.new_deflate(zlib.BEST_SPEED, -9, 1), zlib.new_inflate(-9), 'raw')
+
+-- large inputs run on the thread pool
+deflate = zlib.new_deflate(6, 31)
+deflate:set_async_threshold(4096)
+roundtrip(deflate, zlib.new_inflate(31), 'async')
+
+-- the thread pool works on copies, the output is filled by another coroutine
+-- meanwhile, the bytes which do not fit are given out by the next write
+fs.writeFile(PLAIN, json)
+local fd = fs.open(PLAIN, 'r')
+local input = ReadBuffer.new(#json * 2)
+assert(fs.read(fd, input) == #json, color.red('test_zlib [async input] error'))
+fs.close(fd)
+
+deflate = zlib.new_deflate()
+deflate:set_async_threshold(4096)
+local small = WriteBuffer.new(4096)
+local filler = string.rep('x', 4080)
+local first, done
+local out = fs.open(COMPRESSED, 'w')
+coroutine.wrap(function()
+  while true do
+    local produced, consumed, err = deflate:write(input, small, zlib.FINISH)
+    if not first then
+      first = { produced = produced, consumed = consumed, err = err }
+      small:discard(#filler)
+    end
+    fs.write(out, small)
+    small:discard(-1)
+    if err ~= ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY then break end
+  end
+  done = true
+end)()
+assert(small:write(filler) == #filler, color.red('test_zlib [async output] error'))
+-- the bytes of the input buffer have been taken before the write yielded
+assert(input:tostring() == '', color.red('test_zlib [async input taken] error'))
+while not done do sleep(10) end
+fs.close(out)
+
+assert(first.produced <= small:capacity() - #filler and first.err == ERRNO.LUAIO_EXCEED_BUFFER_CAPACITY, color.red('test_zlib [async pending] error'))
+assert(first.consumed == #json, color.red('test_zlib [async consumed] error'))
+assert(inflate_file(zlib.new_inflate(), COMPRESSED, PLAIN) == zlib.STREAM_END, color.red('test_zlib [async copies] error'))
+assert(fs.readFile(PLAIN) == json, color.red('test_zlib [async copies] error'))
+
+-- the input buffer is refilled while the work runs, the bytes zlib has not used
+-- yet are kept by the stream and go before the new ones
+local half = math.floor(#compressed / 2)
+fs.writeFile(COMPRESSED, compressed:sub(1, half))
+fs.writeFile(PLAIN, compressed:sub(half + 1))
+input = ReadBuffer.new(#compressed)
+fd = fs.open(COMPRESSED, 'r')
+assert(fs.read(fd, input) == half, color.red('test_zlib [async refill] error'))
+fs.close(fd)
+
+inflate = zlib.new_inflate()
+inflate:set_async_threshold(1024)
+local tiny = WriteBuffer.new(256)
+local pieces = {}
+local refilled, waited = false, false
+done = false
+coroutine.wrap(function()
+  while true do
+    local rest = input:tostring()
+    local produced, consumed, err = inflate:write(input, tiny)
+    if consumed == 0 and #rest > 0 then waited = true end
+    pieces[#pieces + 1] = tiny:tostring()
+    tiny:discard(-1)
+    if err == zlib.STREAM_END then break end
+    if err == 0 and not refilled then sleep(1) end
+  end
+  done = true
+end)()
+fd = fs.open(PLAIN, 'r')
+assert(fs.read(fd, input) == #compressed - half, color.red('test_zlib [async refill] error'))
+fs.close(fd)
+refilled = true
+while not done do sleep(10) end
+
+assert(table.concat(pieces) == json, color.red('test_zlib [async refill] error'))
+assert(waited, color.red('test_zlib [async kept input] error'))
+
+-- a sync flush makes everything written so far decodable
+deflate = zlib.new_deflate()
+inflate = zlib.new_inflate()
+local middle = WriteBuffer.new(4096)
+produced, consumed, err = deflate:write('hello ', middle, zlib.SYNC_FLUSH)
+assert(err == 0 and consumed == 6 and produced > 0, color.red('test_zlib [SYNC_FLUSH] error'))
+produced, consumed, err = inflate:write(middle, output)
+assert(err == 0 and produced == 6, color.red('test_zlib [SYNC_FLUSH] error'))
+output:discard(-1)
+
+-- broken data
+inflate = zlib.new_inflate()
+produced, consumed, err = inflate:write('this is not deflate data', output)
+assert(err == ERRNO.LUAIO_EZLIB_DATA, color.red('test_zlib [LUAIO_EZLIB_DATA] error'))
+
+assert(not pcall(deflate.write, deflate, 'x', ReadBuffer.new(64)), color.red('test_zlib [output] error'))
+assert(zlib.new_deflate(6, 7) == nil, color.red('test_zlib [window_bits] error'))
+
+fs.unlink(COMPRESSED)
+fs.unlink(PLAIN)
+print(color.green('test_zlib ok'))
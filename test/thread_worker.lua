@@ -0,0 +1,20 @@
+-- run by test_thread.lua in a loop thread
+local tcp_native = require('tcp_native')
+local ReadBuffer = require('read_buffer')
+local thread = require('thread')
+
+local PORT = 18008
+
+local server = tcp_native.new(true)
+assert(server:bind(PORT, '127.0.0.1') == 0)
+assert(server:listen(function(socket)
+  local buffer = ReadBuffer.new(1024)
+  socket:set_read_buffer(buffer)
+  socket:read()
+  local data = buffer:read(-1)
+  -- timers belong to the loop of this thread
+  sleep(10)
+  socket:write(data .. ' from thread ' .. thread.id)
+  socket:close()
+  server:close()
+end, 511) == 0)